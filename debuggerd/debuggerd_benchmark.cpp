@@ -17,12 +17,14 @@
 #include <err.h>
 #include <errno.h>
 #include <sched.h>
+#include <signal.h>
 #include <string.h>
 #include <sys/wait.h>
 #include <unistd.h>
 
 #include <chrono>
 #include <thread>
+#include <vector>
 
 #include <benchmark/benchmark.h>
 #include <debuggerd/client.h>
@@ -125,4 +127,64 @@ static void BM_maximum_pause_debuggerd(benchmark::State& state) {
 BENCHMARK(BM_maximum_pause_noop)->Iterations(128)->UseManualTime();
 BENCHMARK(BM_maximum_pause_debuggerd)->Iterations(128)->UseManualTime();
 
+// Forks a process with |thread_count| idle threads and returns its pid once they are running.
+static pid_t SpawnManyThreadTarget(int thread_count) {
+  int pipefd[2];
+  if (pipe(pipefd) != 0) {
+    err(1, "pipe failed");
+  }
+
+  pid_t pid = fork();
+  if (pid == -1) {
+    err(1, "fork failed");
+  } else if (pid == 0) {
+    close(pipefd[0]);
+    std::vector<std::thread> threads;
+    for (int i = 0; i < thread_count; ++i) {
+      threads.emplace_back([]() {
+        while (true) {
+          pause();
+        }
+      });
+    }
+    if (write(pipefd[1], "\1", 1) != 1) {
+      _exit(1);
+    }
+    while (true) {
+      pause();
+    }
+  }
+
+  close(pipefd[1]);
+  char buf;
+  if (TEMP_FAILURE_RETRY(read(pipefd[0], &buf, 1)) != 1) {
+    errx(1, "many-thread target failed to start");
+  }
+  close(pipefd[0]);
+  return pid;
+}
+
+// Measures how long a full tombstone of a process with many threads takes. Set
+// debug.debuggerd.unwind_threads to compare sequential and parallel unwinding.
+static void BM_tombstone_many_threads(benchmark::State& state) {
+  pid_t target = SpawnManyThreadTarget(state.range(0));
+
+  for (auto _ : state) {
+    android::base::unique_fd output_fd(open("/dev/null", O_WRONLY | O_CLOEXEC));
+    if (output_fd == -1) {
+      err(1, "failed to open /dev/null");
+    }
+
+    if (!debuggerd_trigger_dump(target, kDebuggerdTombstone, 10000, std::move(output_fd))) {
+      state.SkipWithError("failed to trigger dump");
+      break;
+    }
+  }
+
+  kill(target, SIGKILL);
+  waitpid(target, nullptr, 0);
+}
+
+BENCHMARK(BM_tombstone_many_threads)->Arg(16)->Arg(128)->Arg(512)->UseRealTime();
+
 BENCHMARK_MAIN();
@@ -20,6 +20,7 @@
 #include <fcntl.h>
 #include <linux/prctl.h>
 #include <malloc.h>
+#include <poll.h>
 #include <pthread.h>
 #include <stdlib.h>
 #include <sys/capability.h>
@@ -32,6 +33,7 @@
 #include <unistd.h>
 
 #include <chrono>
+#include <deque>
 #include <regex>
 #include <set>
 #include <string>
@@ -2067,6 +2069,188 @@ TEST(tombstoned, stress) {
   }
 }
 
+TEST(tombstoned, concurrent_crashers) {
+  // Simulate a crash storm: many processes asking for a dump at once, each of which takes a
+  // while to write it. Every one of them must eventually be told to dump and have its output
+  // delivered, even though only a few run concurrently.
+  static constexpr int kCrasherCount = 24;
+
+  std::atomic<bool> start(false);
+  std::atomic<int> completed(0);
+  std::vector<std::thread> threads;
+  for (int i = 0; i < kCrasherCount; ++i) {
+    threads.emplace_back([&start, &completed, i]() {
+      // Use a way out of range pid, to avoid stomping on an actual process.
+      pid_t pid = 3'000'000 + i;
+
+      unique_fd intercept_fd, output_fd;
+      InterceptResponse response = {};
+      tombstoned_intercept(pid, &intercept_fd, &output_fd, &response, kDebuggerdTombstone);
+      ASSERT_EQ(InterceptStatus::kRegistered, response.status)
+          << "Error message: " << response.error_message;
+
+      while (!start) {
+        continue;
+      }
+
+      {
+        unique_fd tombstoned_socket, input_fd;
+        ASSERT_TRUE(tombstoned_connect(pid, &tombstoned_socket, &input_fd, kDebuggerdTombstone));
+        // Pretend that unwinding takes a while.
+        std::this_thread::sleep_for(100ms);
+        ASSERT_TRUE(android::base::WriteFully(input_fd.get(), &pid, sizeof(pid)));
+        tombstoned_notify_completion(tombstoned_socket.get());
+      }
+
+      pid_t read_pid;
+      ASSERT_TRUE(android::base::ReadFully(output_fd.get(), &read_pid, sizeof(read_pid)));
+      ASSERT_EQ(read_pid, pid);
+      ++completed;
+    });
+  }
+
+  auto start_time = std::chrono::steady_clock::now();
+  start = true;
+
+  for (std::thread& thread : threads) {
+    thread.join();
+  }
+
+  ASSERT_EQ(kCrasherCount, completed.load());
+  auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(
+      std::chrono::steady_clock::now() - start_time);
+  GTEST_LOG_(INFO) << kCrasherCount << " concurrent dumps took " << elapsed.count() << "ms";
+}
+
+// Sends a tombstone dump request for |pid|, without waiting for tombstoned to answer it.
+static unique_fd send_tombstone_request(pid_t pid) {
+  unique_fd sockfd(socket_local_client(kTombstonedCrashSocketName,
+                                       ANDROID_SOCKET_NAMESPACE_RESERVED, SOCK_SEQPACKET));
+  if (sockfd == -1) {
+    return {};
+  }
+  TombstonedCrashPacket packet = {};
+  packet.packet_type = CrashPacketType::kDumpRequest;
+  packet.packet.dump_request.pid = pid;
+  packet.packet.dump_request.dump_type = kDebuggerdTombstone;
+  if (TEMP_FAILURE_RETRY(write(sockfd, &packet, sizeof(packet))) != sizeof(packet)) {
+    return {};
+  }
+  return sockfd;
+}
+
+enum class DumpRequestState { kQueued, kStarted, kDropped };
+
+// Returns whether tombstoned has told the sender of a request to dump, has dropped the request by
+// closing its socket, or hasn't answered it yet.
+static DumpRequestState get_tombstone_request_state(int sockfd) {
+  pollfd pfd = {.fd = sockfd, .events = POLLIN};
+  if (TEMP_FAILURE_RETRY(poll(&pfd, 1, 0)) != 1) {
+    return DumpRequestState::kQueued;
+  }
+  TombstonedCrashPacket packet = {};
+  unique_fd output_fd;
+  if (android::base::ReceiveFileDescriptors(sockfd, &packet, sizeof(packet), &output_fd) !=
+          sizeof(packet) ||
+      packet.packet_type != CrashPacketType::kPerformDump) {
+    return DumpRequestState::kDropped;
+  }
+  return DumpRequestState::kStarted;
+}
+
+static size_t get_max_concurrent_tombstones() {
+  return std::max<size_t>(
+      android::base::GetUintProperty<size_t>("tombstoned.max_concurrent_tombstones", 2), 1);
+}
+
+TEST(tombstoned, tombstone_lane_concurrency) {
+  // Without an intercept, a tombstone request goes through the tombstone lane, which runs a
+  // bounded number of dumps at once and starts queued ones as running ones complete. This writes
+  // (empty) tombstones.
+  const size_t max_concurrent = get_max_concurrent_tombstones();
+  const size_t crasher_count = max_concurrent + 3;
+
+  std::vector<unique_fd> sockets;
+  for (size_t i = 0; i < crasher_count; ++i) {
+    // Use a way out of range pid, to avoid stomping on an actual process.
+    sockets.emplace_back(send_tombstone_request(4'000'000 + i));
+    ASSERT_NE(-1, sockets.back().get()) << "failed to send dump request: " << strerror(errno);
+  }
+
+  std::vector<bool> started(crasher_count);
+  std::deque<size_t> running;
+  for (size_t completed = 0; completed < crasher_count; ++completed) {
+    // Give tombstoned time to start every dump that it is going to start.
+    std::this_thread::sleep_for(200ms * android::base::HwTimeoutMultiplier());
+    for (size_t i = 0; i < crasher_count; ++i) {
+      if (started[i]) {
+        continue;
+      }
+      DumpRequestState state = get_tombstone_request_state(sockets[i].get());
+      ASSERT_NE(DumpRequestState::kDropped, state) << "request " << i << " was dropped";
+      if (state == DumpRequestState::kStarted) {
+        started[i] = true;
+        running.push_back(i);
+      }
+    }
+
+    // The lane is kept full for as long as there are queued requests.
+    ASSERT_EQ(std::min(max_concurrent, crasher_count - completed), running.size());
+
+    size_t i = running.front();
+    running.pop_front();
+    tombstoned_notify_completion(sockets[i].get());
+    sockets[i].reset();
+  }
+}
+
+TEST(tombstoned, tombstone_lane_drops_beyond_queue_depth) {
+  // Requests that find the tombstone lane and its queue full are dropped right away, rather than
+  // left to time out. This writes (empty) tombstones.
+  static constexpr size_t kExtraRequests = 3;
+  const size_t max_concurrent = get_max_concurrent_tombstones();
+  const size_t max_queued =
+      android::base::GetUintProperty<size_t>("tombstoned.max_queued_tombstones", 32);
+  const size_t request_count = max_concurrent + max_queued + kExtraRequests;
+
+  std::vector<unique_fd> sockets;
+  for (size_t i = 0; i < request_count; ++i) {
+    // Use a way out of range pid, to avoid stomping on an actual process.
+    sockets.emplace_back(send_tombstone_request(5'000'000 + i));
+    ASSERT_NE(-1, sockets.back().get()) << "failed to send dump request: " << strerror(errno);
+  }
+
+  // Give tombstoned time to handle every request.
+  std::this_thread::sleep_for(500ms * android::base::HwTimeoutMultiplier());
+
+  std::vector<unique_fd> started_sockets;
+  size_t queued = 0;
+  size_t dropped = 0;
+  for (unique_fd& sockfd : sockets) {
+    switch (get_tombstone_request_state(sockfd.get())) {
+      case DumpRequestState::kQueued:
+        ++queued;
+        break;
+      case DumpRequestState::kStarted:
+        started_sockets.emplace_back(std::move(sockfd));
+        break;
+      case DumpRequestState::kDropped:
+        ++dropped;
+        break;
+    }
+  }
+  EXPECT_EQ(max_concurrent, started_sockets.size());
+  EXPECT_EQ(max_queued, queued);
+  EXPECT_EQ(kExtraRequests, dropped);
+
+  // Close the queued requests first, so that tombstoned fails to start them once the running
+  // dumps complete, and the lane drains for the following tests.
+  sockets.clear();
+  for (unique_fd& sockfd : started_sockets) {
+    tombstoned_notify_completion(sockfd.get());
+  }
+}
+
 TEST(tombstoned, intercept_java_trace_smoke) {
   // Using a "real" PID is a little dangerous here - if the test fails
   // or crashes, we might end up getting a bogus / unreliable stack
@@ -49,19 +49,23 @@ constexpr size_t kMaxFrames = 256;
  */
 int open_tombstone(std::string* path);
 
-/* Creates a tombstone file and writes the crash dump to it. */
+/* Creates a tombstone file and writes the crash dump to it.
+ * Threads other than target_thread are unwound on up to unwind_threads threads; values
+ * greater than 1 require an unwinder whose process memory is safe to read concurrently.
+ */
 void engrave_tombstone(android::base::unique_fd output_fd, android::base::unique_fd proto_fd,
                        unwindstack::AndroidUnwinder* unwinder,
                        const std::map<pid_t, ThreadInfo>& thread_info, pid_t target_thread,
                        const ProcessInfo& process_info, OpenFilesList* open_files,
-                       std::string* amfd_data);
+                       std::string* amfd_data, size_t unwind_threads = 1);
 
 void engrave_tombstone_ucontext(int tombstone_fd, int proto_fd, uint64_t abort_msg_address,
                                 siginfo_t* siginfo, ucontext_t* ucontext);
 
 void engrave_tombstone_proto(Tombstone* tombstone, unwindstack::AndroidUnwinder* unwinder,
                              const std::map<pid_t, ThreadInfo>& threads, pid_t target_thread,
-                             const ProcessInfo& process_info, const OpenFilesList* open_files);
+                             const ProcessInfo& process_info, const OpenFilesList* open_files,
+                             size_t unwind_threads = 1);
 
 bool tombstone_proto_to_text(
     const Tombstone& tombstone,
@@ -33,10 +33,14 @@
 #include <sys/sysinfo.h>
 #include <time.h>
 
+#include <algorithm>
+#include <atomic>
 #include <memory>
 #include <optional>
 #include <set>
 #include <string>
+#include <thread>
+#include <vector>
 
 #include <async_safe/log.h>
 
@@ -481,8 +485,8 @@ static void dump_thread_backtrace(std::vector<unwindstack::FrameData>& frames, T
   }
 }
 
-static void dump_thread(Tombstone* tombstone, unwindstack::AndroidUnwinder* unwinder,
-                        const ThreadInfo& thread_info, bool memory_dump = false) {
+static Thread unwind_thread(unwindstack::AndroidUnwinder* unwinder, const ThreadInfo& thread_info,
+                            bool memory_dump) {
   Thread thread;
 
   thread.set_id(thread_info.tid);
@@ -506,9 +510,67 @@ static void dump_thread(Tombstone* tombstone, unwindstack::AndroidUnwinder* unwi
     dump_thread_backtrace(data.frames, thread);
   }
   dump_registers(unwinder, *data.saved_initial_regs, thread, memory_dump);
+  return thread;
+}
 
+static void dump_thread(Tombstone* tombstone, unwindstack::AndroidUnwinder* unwinder,
+                        const ThreadInfo& thread_info, bool memory_dump = false) {
   auto& threads = *tombstone->mutable_threads();
-  threads[thread_info.tid] = thread;
+  threads[thread_info.tid] = unwind_thread(unwinder, thread_info, memory_dump);
+}
+
+// Unwinds every thread except the target thread, using up to |unwind_threads| threads.
+// The results are added to the tombstone in tid order regardless of which worker
+// finished first, so the output is the same as for a sequential unwind.
+static void dump_other_threads(Tombstone* tombstone, unwindstack::AndroidUnwinder* unwinder,
+                               const std::map<pid_t, ThreadInfo>& threads, pid_t target_thread,
+                               size_t unwind_threads) {
+  std::vector<const ThreadInfo*> pending;
+  pending.reserve(threads.size());
+  for (const auto& [tid, thread_info] : threads) {
+    if (tid != target_thread) {
+      pending.push_back(&thread_info);
+    }
+  }
+
+  size_t workers = std::min(unwind_threads, pending.size());
+  if (workers <= 1) {
+    for (const ThreadInfo* thread_info : pending) {
+      dump_thread(tombstone, unwinder, *thread_info);
+    }
+    return;
+  }
+
+  std::vector<Thread> results(pending.size());
+  std::atomic<size_t> next_thread = 0;
+  auto unwind_pending = [&]() {
+    size_t i;
+    while ((i = next_thread.fetch_add(1, std::memory_order_relaxed)) < pending.size()) {
+      // Threads without registers are unwound through ptrace, which only works
+      // from the thread that attached to them, so leave them to the caller.
+      if (pending[i]->registers != nullptr) {
+        results[i] = unwind_thread(unwinder, *pending[i], false);
+      }
+    }
+  };
+
+  std::vector<std::thread> pool;
+  pool.reserve(workers - 1);
+  for (size_t i = 1; i < workers; ++i) {
+    pool.emplace_back(unwind_pending);
+  }
+  unwind_pending();
+  for (auto& worker : pool) {
+    worker.join();
+  }
+
+  auto& proto_threads = *tombstone->mutable_threads();
+  for (size_t i = 0; i < pending.size(); ++i) {
+    if (pending[i]->registers == nullptr) {
+      results[i] = unwind_thread(unwinder, *pending[i], false);
+    }
+    proto_threads[pending[i]->tid] = std::move(results[i]);
+  }
 }
 
 static void dump_mappings(Tombstone* tombstone, unwindstack::Maps* maps,
@@ -686,7 +748,8 @@ static void dump_tags_around_fault_addr(Signal* signal, const Tombstone& tombsto
 
 void engrave_tombstone_proto(Tombstone* tombstone, unwindstack::AndroidUnwinder* unwinder,
                              const std::map<pid_t, ThreadInfo>& threads, pid_t target_thread,
-                             const ProcessInfo& process_info, const OpenFilesList* open_files) {
+                             const ProcessInfo& process_info, const OpenFilesList* open_files,
+                             size_t unwind_threads) {
   Tombstone result;
 
   result.set_arch(get_arch());
@@ -749,11 +812,7 @@ void engrave_tombstone_proto(Tombstone* tombstone, unwindstack::AndroidUnwinder*
   // Dump the main thread, but save the memory around the registers.
   dump_thread(&result, unwinder, main_thread, /* memory_dump */ true);
 
-  for (const auto& [tid, thread_info] : threads) {
-    if (tid != target_thread) {
-      dump_thread(&result, unwinder, thread_info);
-    }
-  }
+  dump_other_threads(&result, unwinder, threads, target_thread, unwind_threads);
 
   dump_probable_cause(&result, unwinder, process_info, main_thread);
 
@@ -21,7 +21,9 @@
 #include <sys/types.h>
 #include <unistd.h>
 
+#include <algorithm>
 #include <array>
+#include <chrono>
 #include <deque>
 #include <string>
 #include <unordered_map>
@@ -46,6 +48,7 @@
 #include "intercept_manager.h"
 
 using android::base::GetIntProperty;
+using android::base::GetUintProperty;
 using android::base::SendFileDescriptors;
 using android::base::StringPrintf;
 
@@ -59,6 +62,12 @@ enum CrashStatus {
   kCrashStatusQueued,
 };
 
+enum EnqueueStatus {
+  kEnqueueStatusRunNow,
+  kEnqueueStatusQueued,
+  kEnqueueStatusDropped,
+};
+
 struct CrashArtifact {
   unique_fd fd;
 
@@ -79,9 +88,11 @@ struct CrashOutput {
   std::optional<CrashArtifact> proto;
 };
 
+class DumpLane;
+
 // Ownership of Crash is a bit messy.
 // It's either owned by an active event that must have a timeout, or owned by
-// queued_requests, in the case that multiple crashes come in at the same time.
+// its lane's queued_requests, in the case that multiple crashes come in at the same time.
 struct Crash {
   ~Crash() { event_free(crash_event); }
 
@@ -91,28 +102,128 @@ struct Crash {
   event* crash_event = nullptr;
 
   DebuggerdDumpType crash_type;
+
+  DumpLane* lane = nullptr;
+  std::chrono::steady_clock::time_point request_time;
+};
+
+// Schedules one class of dumps (tombstones, java traces or intercepted dumps).
+// Each lane runs up to max_concurrent_dumps at once and queues at most
+// max_queue_depth more, so a burst of one kind of dump can't starve the others.
+class DumpLane {
+ public:
+  DumpLane(const char* name, size_t max_concurrent_dumps, size_t max_queue_depth)
+      : name_(name),
+        max_concurrent_dumps_(std::max<size_t>(max_concurrent_dumps, 1)),
+        max_queue_depth_(max_queue_depth),
+        num_concurrent_dumps_(0) {}
+
+  static DumpLane* for_tombstones();
+  static DumpLane* for_java_traces();
+
+  static DumpLane* for_intercepts() {
+    static DumpLane lane("intercept",
+                         GetUintProperty<size_t>("tombstoned.max_concurrent_intercepts", 4),
+                         GetUintProperty<size_t>("tombstoned.max_queued_intercepts", 64));
+    return &lane;
+  }
+
+  // Consumes crash unless it returns kEnqueueStatusRunNow, in which case it is left untouched.
+  EnqueueStatus maybe_enqueue_crash(std::unique_ptr<Crash>&& crash) {
+    if (num_concurrent_dumps_ < max_concurrent_dumps_) {
+      return kEnqueueStatusRunNow;
+    }
+
+    if (queued_requests_.size() >= max_queue_depth_) {
+      ++num_dropped_dumps_;
+      LOG(ERROR) << name_ << " lane is full (" << queued_requests_.size()
+                 << " queued), dropping dump request for pid " << crash->crash_pid;
+      crash.reset();
+      return kEnqueueStatusDropped;
+    }
+
+    queued_requests_.emplace_back(std::move(crash));
+    queued_since_idle_ = true;
+    max_observed_queue_depth_ = std::max(max_observed_queue_depth_, queued_requests_.size());
+    return kEnqueueStatusQueued;
+  }
+
+  void maybe_dequeue_crashes(void (*handler)(std::unique_ptr<Crash> crash)) {
+    while (!queued_requests_.empty() && num_concurrent_dumps_ < max_concurrent_dumps_) {
+      std::unique_ptr<Crash> next_crash = std::move(queued_requests_.front());
+      queued_requests_.pop_front();
+      handler(std::move(next_crash));
+    }
+  }
+
+  void on_crash_started(const Crash* crash) {
+    ++num_concurrent_dumps_;
+    ++num_started_dumps_;
+
+    auto wait = std::chrono::steady_clock::now() - crash->request_time;
+    total_wait_time_ += wait;
+    max_wait_time_ = std::max(max_wait_time_, wait);
+    if (wait >= std::chrono::milliseconds(100)) {
+      LOG(INFO) << "starting " << name_ << " dump for pid " << crash->crash_pid << " after "
+                << std::chrono::duration_cast<std::chrono::milliseconds>(wait).count()
+                << "ms in queue";
+    }
+  }
+
+  void on_crash_completed() {
+    --num_concurrent_dumps_;
+    // Summarize each burst that had to queue once the lane drains.
+    if (num_concurrent_dumps_ == 0 && queued_requests_.empty() && queued_since_idle_) {
+      queued_since_idle_ = false;
+      log_stats();
+    }
+  }
+
+  void log_stats() const {
+    using std::chrono::duration_cast;
+    using std::chrono::milliseconds;
+
+    auto average_wait = num_started_dumps_ ? total_wait_time_ / num_started_dumps_
+                                           : std::chrono::steady_clock::duration::zero();
+    LOG(INFO) << name_ << " lane: " << num_started_dumps_ << " dumps started, "
+              << num_dropped_dumps_ << " dropped, max queue depth " << max_observed_queue_depth_
+              << ", wait avg " << duration_cast<milliseconds>(average_wait).count() << "ms max "
+              << duration_cast<milliseconds>(max_wait_time_).count() << "ms";
+  }
+
+ private:
+  const char* const name_;
+
+  const size_t max_concurrent_dumps_;
+  const size_t max_queue_depth_;
+  size_t num_concurrent_dumps_;
+
+  std::deque<std::unique_ptr<Crash>> queued_requests_;
+
+  size_t num_started_dumps_ = 0;
+  size_t num_dropped_dumps_ = 0;
+  size_t max_observed_queue_depth_ = 0;
+  bool queued_since_idle_ = false;
+  std::chrono::steady_clock::duration total_wait_time_ = {};
+  std::chrono::steady_clock::duration max_wait_time_ = {};
+
+  DISALLOW_COPY_AND_ASSIGN(DumpLane);
 };
 
 class CrashQueue {
  public:
   CrashQueue(const std::string& dir_path, const std::string& file_name_prefix, size_t max_artifacts,
-             size_t max_concurrent_dumps, bool supports_proto)
+             bool supports_proto)
       : file_name_prefix_(file_name_prefix),
         dir_path_(dir_path),
         dir_fd_(open(dir_path.c_str(), O_DIRECTORY | O_RDONLY | O_CLOEXEC)),
         max_artifacts_(max_artifacts),
         next_artifact_(0),
-        max_concurrent_dumps_(max_concurrent_dumps),
-        num_concurrent_dumps_(0),
         supports_proto_(supports_proto) {
     if (dir_fd_ == -1) {
       PLOG(FATAL) << "failed to open directory: " << dir_path;
     }
 
-    // NOTE: If max_artifacts_ <= max_concurrent_dumps_, then theoretically the
-    // same filename could be handed out to multiple processes.
-    CHECK(max_artifacts_ > max_concurrent_dumps_);
-
     find_oldest_artifact();
   }
 
@@ -127,14 +238,14 @@ class CrashQueue {
   static CrashQueue* for_tombstones() {
     static CrashQueue queue("/data/tombstones", "tombstone_" /* file_name_prefix */,
                             GetIntProperty("tombstoned.max_tombstone_count", 32),
-                            1 /* max_concurrent_dumps */, true /* supports_proto */);
+                            true /* supports_proto */);
     return &queue;
   }
 
   static CrashQueue* for_anrs() {
     static CrashQueue queue("/data/anr", "trace_" /* file_name_prefix */,
                             GetIntProperty("tombstoned.max_anr_count", 64),
-                            4 /* max_concurrent_dumps */, false /* supports_proto */);
+                            false /* supports_proto */);
     return &queue;
   }
 
@@ -200,27 +311,7 @@ class CrashQueue {
     return result;
   }
 
-  // Consumes crash if it returns true, otherwise leaves it untouched.
-  bool maybe_enqueue_crash(std::unique_ptr<Crash>&& crash) {
-    if (num_concurrent_dumps_ == max_concurrent_dumps_) {
-      queued_requests_.emplace_back(std::move(crash));
-      return true;
-    }
-
-    return false;
-  }
-
-  void maybe_dequeue_crashes(void (*handler)(std::unique_ptr<Crash> crash)) {
-    while (!queued_requests_.empty() && num_concurrent_dumps_ < max_concurrent_dumps_) {
-      std::unique_ptr<Crash> next_crash = std::move(queued_requests_.front());
-      queued_requests_.pop_front();
-      handler(std::move(next_crash));
-    }
-  }
-
-  void on_crash_started() { ++num_concurrent_dumps_; }
-
-  void on_crash_completed() { --num_concurrent_dumps_; }
+  size_t max_artifacts() const { return max_artifacts_; }
 
  private:
   void find_oldest_artifact() {
@@ -258,16 +349,42 @@ class CrashQueue {
   const size_t max_artifacts_;
   int next_artifact_;
 
-  const size_t max_concurrent_dumps_;
-  size_t num_concurrent_dumps_;
-
   bool supports_proto_;
 
-  std::deque<std::unique_ptr<Crash>> queued_requests_;
-
   DISALLOW_COPY_AND_ASSIGN(CrashQueue);
 };
 
+// Each running dump writes to its own artifact slot of the queue, so a lane must run fewer
+// dumps at once than its queue keeps artifacts, or they would overwrite each other.
+static size_t max_concurrent_dumps_for(const CrashQueue* queue, const char* property,
+                                       size_t default_value) {
+  size_t max_concurrent_dumps = GetUintProperty<size_t>(property, default_value);
+  size_t limit = std::max<size_t>(queue->max_artifacts(), 2) - 1;
+  if (max_concurrent_dumps > limit) {
+    LOG(WARNING) << property << " (" << max_concurrent_dumps << ") must be lower than the "
+                 << queue->max_artifacts() << " artifacts kept, using " << limit;
+    max_concurrent_dumps = limit;
+  }
+  CHECK(queue->max_artifacts() > max_concurrent_dumps);
+  return max_concurrent_dumps;
+}
+
+DumpLane* DumpLane::for_tombstones() {
+  static DumpLane lane("tombstone",
+                       max_concurrent_dumps_for(CrashQueue::for_tombstones(),
+                                                "tombstoned.max_concurrent_tombstones", 2),
+                       GetUintProperty<size_t>("tombstoned.max_queued_tombstones", 32));
+  return &lane;
+}
+
+DumpLane* DumpLane::for_java_traces() {
+  static DumpLane lane("java trace",
+                       max_concurrent_dumps_for(CrashQueue::for_anrs(),
+                                                "tombstoned.max_concurrent_anrs", 4),
+                       GetUintProperty<size_t>("tombstoned.max_queued_anrs", 64));
+  return &lane;
+}
+
 // Whether java trace dumps are produced via tombstoned.
 static constexpr bool kJavaTraceDumpsEnabled = true;
 
@@ -321,7 +438,7 @@ static void perform_request(std::unique_ptr<Crash> crash) {
   event_assign(crash->crash_event, base, crash->crash_socket_fd, EV_TIMEOUT | EV_READ,
                crash_completed_cb, crash.get());
   event_add(crash->crash_event, &timeout);
-  CrashQueue::for_crash(crash)->on_crash_started();
+  crash->lane->on_crash_started(crash.get());
 
   // The crash is now owned by the event loop.
   crash.release();
@@ -395,10 +512,24 @@ static void crash_request_cb(evutil_socket_t sockfd, short ev, void* arg) {
   pid_t crash_pid = crash->crash_pid;
   LOG(INFO) << "received crash request for pid " << crash_pid;
 
-  if (CrashQueue::for_crash(crash)->maybe_enqueue_crash(std::move(crash))) {
-    LOG(INFO) << "enqueueing crash request for pid " << crash_pid;
+  if (intercept_manager->Get(crash_pid, crash->crash_type) != nullptr) {
+    crash->lane = DumpLane::for_intercepts();
+  } else if (crash->crash_type == kDebuggerdJavaBacktrace) {
+    crash->lane = DumpLane::for_java_traces();
   } else {
-    perform_request(std::move(crash));
+    crash->lane = DumpLane::for_tombstones();
+  }
+  crash->request_time = std::chrono::steady_clock::now();
+
+  switch (crash->lane->maybe_enqueue_crash(std::move(crash))) {
+    case kEnqueueStatusRunNow:
+      perform_request(std::move(crash));
+      break;
+    case kEnqueueStatusQueued:
+      LOG(INFO) << "enqueueing crash request for pid " << crash_pid;
+      break;
+    case kEnqueueStatusDropped:
+      break;
   }
 }
 
@@ -472,16 +603,18 @@ static void crash_completed(borrowed_fd sockfd, std::unique_ptr<Crash> crash) {
 
 static void crash_completed_cb(evutil_socket_t sockfd, short ev, void* arg) {
   std::unique_ptr<Crash> crash(static_cast<Crash*>(arg));
-  CrashQueue* queue = CrashQueue::for_crash(crash);
+  DumpLane* lane = crash->lane;
 
-  queue->on_crash_completed();
+  lane->on_crash_completed();
 
   if ((ev & EV_READ) == EV_READ) {
     crash_completed(sockfd, std::move(crash));
+  } else {
+    LOG(WARNING) << "dump for pid " << crash->crash_pid << " timed out";
   }
 
   // If there's something queued up, let them proceed.
-  queue->maybe_dequeue_crashes(perform_request);
+  lane->maybe_dequeue_crashes(perform_request);
 }
 
 int main(int, char* []) {
@@ -36,6 +36,7 @@
 #define FB_CMD_GSI "gsi"
 #define FB_CMD_SNAPSHOT_UPDATE "snapshot-update"
 #define FB_CMD_FETCH "fetch"
+#define FB_CMD_STREAM_FLASH "stream-flash"
 
 #define RESPONSE_OKAY "OKAY"
 #define RESPONSE_FAIL "FAIL"
@@ -81,6 +82,7 @@
 #define FB_VAR_SECURITY_PATCH_LEVEL "security-patch-level"
 #define FB_VAR_TREBLE_ENABLED "treble-enabled"
 #define FB_VAR_MAX_FETCH_SIZE "max-fetch-size"
+#define FB_VAR_STREAM_FLASH "stream-flash"
 #define FB_VAR_DMESG "dmesg"
 #define FB_VAR_BATTERY_SERIAL_NUMBER "battery-serial-number"
 #define FB_VAR_BATTERY_PART_STATUS "battery-part-status"
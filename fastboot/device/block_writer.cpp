@@ -0,0 +1,476 @@
+/*
+ * Copyright (C) 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "block_writer.h"
+
+#include <fcntl.h>
+#include <linux/fs.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <unistd.h>
+
+#include <algorithm>
+
+#include <android-base/logging.h>
+#include <android-base/stringprintf.h>
+#include <libavb/libavb.h>
+#include <liburing.h>
+
+#include "sparse_format.h"
+
+namespace {
+
+constexpr uint64_t kDirectAlignment = 4096;
+
+bool IsDirectAligned(uint64_t value) {
+    return (value & (kDirectAlignment - 1)) == 0;
+}
+
+}  // namespace
+
+BlockWriter::BlockWriter(PartitionHandle* handle, const Options& options)
+    : handle_(handle), options_(options) {}
+
+BlockWriter::~BlockWriter() {
+    if (ring_) {
+        Drain();
+        io_uring_queue_exit(ring_.get());
+    }
+}
+
+bool BlockWriter::Init() {
+    buffers_.resize(std::max<size_t>(options_.queue_depth, 1));
+    for (auto& buffer : buffers_) {
+        void* data;
+        if (posix_memalign(&data, kDirectAlignment, options_.buffer_size)) {
+            PLOG(ERROR) << "Failed to allocate write buffer";
+            return false;
+        }
+        buffer.data.reset(data);
+        free_buffers_.emplace_back(&buffer);
+    }
+
+    if (options_.use_io_uring) {
+        ring_ = std::make_unique<io_uring>();
+        int ret = io_uring_queue_init(buffers_.size(), ring_.get(), 0);
+        if (ret < 0) {
+            // Not fatal, e.g. io_uring may be disabled in this kernel.
+            LOG(WARNING) << "io_uring_queue_init failed, writing synchronously: "
+                         << strerror(-ret);
+            ring_.reset();
+        }
+    }
+    return true;
+}
+
+int BlockWriter::GetBuffer() {
+    if (buffer_) {
+        return 0;
+    }
+    while (free_buffers_.empty()) {
+        if (int ret = Reap(); ret < 0) return ret;
+    }
+    buffer_ = free_buffers_.back();
+    free_buffers_.pop_back();
+    buffer_len_ = 0;
+    return 0;
+}
+
+int BlockWriter::Write(const void* data, size_t len) {
+    const char* src = reinterpret_cast<const char*>(data);
+    while (len > 0) {
+        if (int ret = GetBuffer(); ret < 0) return ret;
+        size_t n = std::min(len, options_.buffer_size - buffer_len_);
+        memcpy(reinterpret_cast<char*>(buffer_->data.get()) + buffer_len_, src, n);
+        buffer_len_ += n;
+        src += n;
+        len -= n;
+        if (buffer_len_ == options_.buffer_size) {
+            if (int ret = Submit(); ret < 0) return ret;
+        }
+    }
+    return 0;
+}
+
+int BlockWriter::Fill(uint32_t value, uint64_t len) {
+    if (value == 0 && options_.use_zeroout) {
+        return ZeroOut(len);
+    }
+    return FillBuffers(value, len);
+}
+
+int BlockWriter::FillBuffers(uint32_t value, uint64_t len) {
+    if (pattern_.empty() || pattern_value_ != value) {
+        pattern_.assign(options_.buffer_size / sizeof(value) + 1, value);
+        pattern_value_ = value;
+    }
+    const char* pattern = reinterpret_cast<const char*>(pattern_.data());
+    for (uint64_t done = 0; done < len;) {
+        if (int ret = GetBuffer(); ret < 0) return ret;
+        size_t n = std::min<uint64_t>(len - done, options_.buffer_size - buffer_len_);
+        memcpy(reinterpret_cast<char*>(buffer_->data.get()) + buffer_len_,
+               pattern + done % sizeof(value), n);
+        buffer_len_ += n;
+        done += n;
+        if (buffer_len_ == options_.buffer_size) {
+            if (int ret = Submit(); ret < 0) return ret;
+        }
+    }
+    return 0;
+}
+
+int BlockWriter::ZeroOut(uint64_t len) {
+    // Only the aligned middle of the range is zeroed by the block layer, so
+    // that the writes around it can keep using O_DIRECT. Short ranges are not
+    // worth an ioctl and a partial buffer.
+    uint64_t begin = offset();
+    uint64_t start = (begin + kDirectAlignment - 1) & ~(kDirectAlignment - 1);
+    uint64_t end = (begin + len) & ~(kDirectAlignment - 1);
+    if (end <= start || end - start < options_.buffer_size) {
+        return FillBuffers(0, len);
+    }
+
+    if (int ret = FillBuffers(0, start - begin); ret < 0) return ret;
+    if (int ret = Submit(); ret < 0) return ret;
+
+    uint64_t range[2] = {start, end - start};
+    if (ioctl(handle_->fd(), BLKZEROOUT, &range) < 0) {
+        if (errno != ENOTTY && errno != EOPNOTSUPP && errno != EINVAL) {
+            int ret = -errno;
+            PLOG(ERROR) << "BLKZEROOUT failed for " << range[1] << " bytes at " << range[0];
+            return ret;
+        }
+        // Not a block device, or the device cannot do it; write zeroes from now on.
+        PLOG(WARNING) << "BLKZEROOUT not supported, writing zeroes instead";
+        options_.use_zeroout = false;
+        return FillBuffers(0, begin + len - start);
+    }
+    buffer_offset_ = end;
+    return FillBuffers(0, begin + len - end);
+}
+
+int BlockWriter::Skip(uint64_t len) {
+    if (int ret = Submit(); ret < 0) return ret;
+    buffer_offset_ += len;
+    return 0;
+}
+
+int BlockWriter::Submit() {
+    if (!buffer_ || buffer_len_ == 0) {
+        return 0;
+    }
+    Buffer* buffer = buffer_;
+    buffer->offset = buffer_offset_;
+    buffer->len = buffer_len_;
+    buffer_ = nullptr;
+    buffer_offset_ += buffer_len_;
+    buffer_len_ = 0;
+
+    if (direct_ && (!IsDirectAligned(buffer->offset) || !IsDirectAligned(buffer->len))) {
+        // In case of non 4KB aligned writes, reopen without O_DIRECT flag
+        if (int ret = Drain(); ret < 0) {
+            free_buffers_.emplace_back(buffer);
+            return ret;
+        }
+        if (!handle_->Reset(O_WRONLY)) {
+            PLOG(ERROR) << "Failed to reset file descriptor";
+            free_buffers_.emplace_back(buffer);
+            return -EIO;
+        }
+        direct_ = false;
+    }
+
+    if (!ring_) {
+        int ret = WriteSync(buffer);
+        free_buffers_.emplace_back(buffer);
+        return ret;
+    }
+
+    // There are as many submission queue entries as buffers.
+    io_uring_sqe* sqe = io_uring_get_sqe(ring_.get());
+    io_uring_prep_write(sqe, handle_->fd(), buffer->data.get(), buffer->len, buffer->offset);
+    io_uring_sqe_set_data(sqe, buffer);
+    int ret = io_uring_submit(ring_.get());
+    if (ret < 0) {
+        LOG(ERROR) << "io_uring_submit failed: " << strerror(-ret);
+        free_buffers_.emplace_back(buffer);
+        return ret;
+    }
+    in_flight_++;
+    return 0;
+}
+
+int BlockWriter::WriteSync(Buffer* buffer) {
+    const char* data = reinterpret_cast<const char*>(buffer->data.get());
+    size_t written = 0;
+    while (written < buffer->len) {
+        ssize_t ret = TEMP_FAILURE_RETRY(pwrite64(handle_->fd(), data + written,
+                                                  buffer->len - written, buffer->offset + written));
+        if (ret < 0) {
+            int err = errno;
+            PLOG(ERROR) << "Failed to flash data of len " << buffer->len << " at offset "
+                        << buffer->offset;
+            return -err;
+        }
+        if (ret == 0) {
+            LOG(ERROR) << "Failed to flash data at offset " << buffer->offset + written
+                       << ": end of partition";
+            return -ENOSPC;
+        }
+        written += ret;
+    }
+    return 0;
+}
+
+int BlockWriter::Reap() {
+    io_uring_cqe* cqe;
+    int ret = io_uring_wait_cqe(ring_.get(), &cqe);
+    if (ret < 0) {
+        LOG(ERROR) << "io_uring_wait_cqe failed: " << strerror(-ret);
+        return ret;
+    }
+    Buffer* buffer = reinterpret_cast<Buffer*>(io_uring_cqe_get_data(cqe));
+    int res = cqe->res;
+    io_uring_cqe_seen(ring_.get(), cqe);
+    in_flight_--;
+    free_buffers_.emplace_back(buffer);
+
+    if (res < 0) {
+        LOG(ERROR) << "Failed to flash data of len " << buffer->len << " at offset "
+                   << buffer->offset << ": " << strerror(-res);
+        return res;
+    }
+    if (static_cast<size_t>(res) != buffer->len) {
+        LOG(ERROR) << "Short write of " << res << " bytes at offset " << buffer->offset
+                   << ", expected " << buffer->len;
+        return -ENOSPC;
+    }
+    return 0;
+}
+
+int BlockWriter::Drain() {
+    int result = 0;
+    while (in_flight_ > 0) {
+        int ret = Reap();
+        if (result == 0) result = ret;
+    }
+    return result;
+}
+
+int BlockWriter::Finish() {
+    int result = Submit();
+    int ret = ring_ ? Drain() : 0;
+    return result ? result : ret;
+}
+
+int ImageWriter::StartRawImage() {
+    if (image_size_ > device_size_) {
+        LOG(ERROR) << "Cannot flash " << image_size_ << " bytes to block device of size "
+                   << device_size_;
+        return -EOVERFLOW;
+    }
+    state_ = State::kRawImage;
+    return Output(header_.data(), header_.size());
+}
+
+int ImageWriter::Write(const char* data, size_t len) {
+    while (len > 0) {
+        size_t n = len;
+        int ret = 0;
+        switch (state_) {
+            case State::kMagic:
+            case State::kFileHeader:
+            case State::kChunkHeader:
+            case State::kFillValue:
+                n = std::min(len, header_size_ - header_.size());
+                header_.insert(header_.end(), data, data + n);
+                if (header_.size() < header_size_) {
+                    break;
+                }
+                if (state_ == State::kMagic) {
+                    uint32_t magic;
+                    memcpy(&magic, header_.data(), sizeof(magic));
+                    if (magic == SPARSE_HEADER_MAGIC) {
+                        state_ = State::kFileHeader;
+                        header_size_ = sizeof(sparse_header_t);
+                        break;
+                    }
+                    ret = StartRawImage();
+                } else if (state_ == State::kFileHeader) {
+                    ret = ParseFileHeader();
+                } else if (state_ == State::kChunkHeader) {
+                    ret = ParseChunkHeader();
+                } else {
+                    uint32_t value;
+                    memcpy(&value, header_.data(), sizeof(value));
+                    ret = writer_->Fill(value, chunk_blocks_ * block_size_);
+                    if (ret == 0) ret = EndChunk();
+                }
+                break;
+            case State::kRawData:
+            case State::kIgnore:
+                n = std::min<uint64_t>(len, remaining_);
+                if (state_ == State::kRawData) {
+                    ret = Output(data, n);
+                }
+                remaining_ -= n;
+                if (ret == 0 && remaining_ == 0) {
+                    ret = EndChunk();
+                }
+                break;
+            case State::kRawImage:
+                ret = Output(data, n);
+                break;
+            case State::kDone:
+                // Trailing data after the last chunk is ignored, as libsparse does.
+                return 0;
+        }
+        if (ret < 0) {
+            return ret;
+        }
+        data += n;
+        len -= n;
+    }
+    return 0;
+}
+
+int ImageWriter::ParseFileHeader() {
+    sparse_header_t header;
+    memcpy(&header, header_.data(), sizeof(header));
+    if (header_.size() < header.file_hdr_sz) {
+        // Skip over any extension of the file header.
+        header_size_ = header.file_hdr_sz;
+        return 0;
+    }
+    if (header.major_version != 1 || header.file_hdr_sz < sizeof(sparse_header_t) ||
+        header.chunk_hdr_sz < sizeof(chunk_header_t) || header.blk_sz == 0 ||
+        header.blk_sz % 4 != 0) {
+        LOG(ERROR) << "Invalid sparse image header";
+        return -EINVAL;
+    }
+    block_size_ = header.blk_sz;
+    total_blocks_ = header.total_blks;
+    total_chunks_ = header.total_chunks;
+    chunk_header_size_ = header.chunk_hdr_sz;
+
+    uint64_t out_size = static_cast<uint64_t>(total_blocks_) * block_size_;
+    if (out_size > device_size_) {
+        LOG(ERROR) << "Cannot flash " << out_size << " bytes to block device of size "
+                   << device_size_;
+        return -EOVERFLOW;
+    }
+    return EndChunk();
+}
+
+int ImageWriter::ParseChunkHeader() {
+    chunk_header_t chunk;
+    memcpy(&chunk, header_.data(), sizeof(chunk));
+    if (chunk.total_sz < chunk_header_size_) {
+        LOG(ERROR) << "Invalid sparse chunk size " << chunk.total_sz;
+        return -EINVAL;
+    }
+    uint64_t data_len = chunk.total_sz - chunk_header_size_;
+    uint64_t out_len = static_cast<uint64_t>(chunk.chunk_sz) * block_size_;
+    chunk_blocks_ = chunk.chunk_sz;
+
+    switch (chunk.chunk_type) {
+        case CHUNK_TYPE_RAW:
+            if (data_len != out_len) break;
+            state_ = State::kRawData;
+            remaining_ = data_len;
+            return data_len ? StartChunk(out_len) : EndChunk();
+        case CHUNK_TYPE_FILL:
+            if (data_len != sizeof(uint32_t)) break;
+            state_ = State::kFillValue;
+            header_.clear();
+            header_size_ = sizeof(uint32_t);
+            return StartChunk(out_len);
+        case CHUNK_TYPE_DONT_CARE:
+            if (data_len != 0) break;
+            if (int ret = StartChunk(out_len); ret < 0) return ret;
+            if (int ret = writer_->Skip(out_len); ret < 0) return ret;
+            return EndChunk();
+        case CHUNK_TYPE_CRC32:
+            if (data_len != sizeof(uint32_t)) break;
+            // Like sparse_file_import() without crc checking, the value is ignored.
+            chunk_blocks_ = 0;
+            state_ = State::kIgnore;
+            remaining_ = data_len;
+            return 0;
+        default:
+            break;
+    }
+    LOG(ERROR) << "Invalid sparse chunk of type "
+               << android::base::StringPrintf("0x%04x", chunk.chunk_type) << " and size "
+               << chunk.total_sz;
+    return -EINVAL;
+}
+
+// Checks that a chunk of |out_len| bytes still fits in the image.
+int ImageWriter::StartChunk(uint64_t out_len) {
+    if (blocks_done_ + chunk_blocks_ > total_blocks_) {
+        LOG(ERROR) << "Sparse chunk of " << out_len << " bytes is past the end of the image";
+        return -EINVAL;
+    }
+    return 0;
+}
+
+int ImageWriter::EndChunk() {
+    if (state_ != State::kFileHeader) {
+        blocks_done_ += chunk_blocks_;
+        chunks_done_++;
+    }
+    if (chunks_done_ == total_chunks_) {
+        state_ = State::kDone;
+        return 0;
+    }
+    state_ = State::kChunkHeader;
+    header_.clear();
+    header_size_ = chunk_header_size_;
+    return 0;
+}
+
+int ImageWriter::Output(const char* data, size_t len) {
+    if (state_ == State::kRawImage && copy_avb_footer_) {
+        size_t n = std::min<size_t>(len, AVB_FOOTER_SIZE);
+        tail_.append(data + len - n, n);
+        if (tail_.size() > AVB_FOOTER_SIZE) {
+            tail_.erase(0, tail_.size() - AVB_FOOTER_SIZE);
+        }
+    }
+    return writer_->Write(data, len);
+}
+
+int ImageWriter::Finish() {
+    if (state_ == State::kMagic) {
+        // Too short to be a sparse image.
+        if (int ret = StartRawImage(); ret < 0) return ret;
+    }
+    if (state_ == State::kRawImage && copy_avb_footer_ && image_size_ < device_size_ &&
+        tail_.size() == AVB_FOOTER_SIZE &&
+        tail_.compare(0, AVB_FOOTER_MAGIC_LEN, AVB_FOOTER_MAGIC) == 0) {
+        // Move the footer to the end of the partition, zeroing the space in
+        // between, so that libavb can find it.
+        int ret = writer_->Fill(0, device_size_ - AVB_FOOTER_SIZE - image_size_);
+        if (ret == 0) ret = writer_->Write(tail_.data(), tail_.size());
+        if (ret < 0) return ret;
+    } else if (state_ != State::kRawImage && state_ != State::kDone) {
+        LOG(ERROR) << "Sparse image ended after " << chunks_done_ << " of "
+                   << total_chunks_ << " chunks";
+        return -EINVAL;
+    }
+    return writer_->Finish();
+}
@@ -0,0 +1,159 @@
+/*
+ * Copyright (C) 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "utility.h"
+
+struct io_uring;
+
+// Sequential writer for a partition opened with O_DIRECT. Data is staged in a
+// fixed pool of aligned buffers, and full buffers are written asynchronously
+// with io_uring so that several writes are in flight while the next buffer is
+// filled. Zero fills are offloaded to the block layer with BLKZEROOUT.
+//
+// Unaligned writes cannot use O_DIRECT; the first one waits for all pending
+// writes and reopens the partition without it.
+class BlockWriter {
+  public:
+    static constexpr size_t kDefaultBufferSize = 1048576;
+    static constexpr size_t kDefaultQueueDepth = 4;
+
+    struct Options {
+        size_t buffer_size = kDefaultBufferSize;
+        // Number of buffers, and so the maximum number of writes in flight.
+        size_t queue_depth = kDefaultQueueDepth;
+        bool use_io_uring = true;
+        bool use_zeroout = true;
+    };
+
+    explicit BlockWriter(PartitionHandle* handle) : BlockWriter(handle, Options{}) {}
+    BlockWriter(PartitionHandle* handle, const Options& options);
+    ~BlockWriter();
+
+    bool Init();
+
+    // All of these return 0 on success or a negative errno value, and advance
+    // the current offset by |len|.
+    int Write(const void* data, size_t len);
+    int Fill(uint32_t value, uint64_t len);
+    int Skip(uint64_t len);
+    // Writes out any staged data and waits for every pending write.
+    int Finish();
+
+    uint64_t offset() const { return buffer_offset_ + buffer_len_; }
+
+  private:
+    struct Buffer {
+        std::unique_ptr<void, decltype(&free)> data{nullptr, free};
+        uint64_t offset = 0;
+        size_t len = 0;
+    };
+
+    int GetBuffer();
+    int Submit();
+    int WriteSync(Buffer* buffer);
+    int Reap();
+    int Drain();
+    int FillBuffers(uint32_t value, uint64_t len);
+    int ZeroOut(uint64_t len);
+
+    PartitionHandle* handle_;
+    Options options_;
+    std::vector<Buffer> buffers_;
+    std::vector<Buffer*> free_buffers_;
+    // Buffer being filled, and the partition offset and length of its data.
+    Buffer* buffer_ = nullptr;
+    uint64_t buffer_offset_ = 0;
+    size_t buffer_len_ = 0;
+
+    std::unique_ptr<io_uring> ring_;
+    size_t in_flight_ = 0;
+    bool direct_ = true;
+    // Fill pattern, one word longer than a buffer so that any phase can be copied.
+    std::vector<uint32_t> pattern_;
+    uint32_t pattern_value_ = 0;
+};
+
+// Writes a raw or sparse image to a BlockWriter. The image may be passed in
+// arbitrarily sized pieces, so it can be flashed while it is being received.
+// Sparse images are expanded as they are parsed; fill chunks go through
+// BlockWriter::Fill() so zero fills are never materialized.
+class ImageWriter {
+  public:
+    // |image_size| is the size of the whole image. If |copy_avb_footer| is set
+    // and a raw image ends with an AVB footer, the footer is also written to
+    // the end of the partition, as for boot images.
+    ImageWriter(BlockWriter* writer, uint64_t device_size, uint64_t image_size,
+                bool copy_avb_footer)
+        : writer_(writer),
+          device_size_(device_size),
+          image_size_(image_size),
+          copy_avb_footer_(copy_avb_footer) {}
+
+    int Write(const char* data, size_t len);
+    int Finish();
+
+  private:
+    enum class State {
+        kMagic,
+        kFileHeader,
+        kChunkHeader,
+        kRawData,
+        kFillValue,
+        kIgnore,
+        kRawImage,
+        kDone,
+    };
+
+    int StartRawImage();
+    int ParseFileHeader();
+    int ParseChunkHeader();
+    int StartChunk(uint64_t out_len);
+    int EndChunk();
+    int Output(const char* data, size_t len);
+
+    BlockWriter* writer_;
+    uint64_t device_size_;
+    uint64_t image_size_;
+    bool copy_avb_footer_;
+
+    State state_ = State::kMagic;
+    // Header being accumulated, and the number of bytes it needs.
+    std::vector<char> header_;
+    size_t header_size_ = sizeof(uint32_t);
+    // Bytes left in the current raw chunk or ignored chunk payload.
+    uint64_t remaining_ = 0;
+    // From the sparse file header.
+    uint32_t block_size_ = 0;
+    uint32_t total_blocks_ = 0;
+    uint32_t total_chunks_ = 0;
+    uint16_t chunk_header_size_ = 0;
+    uint32_t chunks_done_ = 0;
+    uint64_t blocks_done_ = 0;
+    uint64_t chunk_blocks_ = 0;
+
+    // Tail of a raw image, for the AVB footer.
+    std::string tail_;
+};
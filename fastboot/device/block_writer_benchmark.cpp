@@ -0,0 +1,153 @@
+/*
+ * Copyright (C) 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Measures flashing a sparse image through BlockWriter. By default the image
+// is written to a temporary file; to measure a real block device (and
+// BLKZEROOUT), point FASTBOOTD_BENCHMARK_DEVICE at one, e.g.:
+//
+//   truncate -s 512M /tmp/part.img
+//   FASTBOOTD_BENCHMARK_DEVICE=$(losetup -f --show /tmp/part.img) \
+//       fastbootd_block_writer_benchmark
+
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <android-base/file.h>
+#include <android-base/logging.h>
+#include <benchmark/benchmark.h>
+#include <sparse/sparse.h>
+
+#include "block_writer.h"
+
+namespace {
+
+constexpr unsigned int kBlockSize = 4096;
+constexpr uint64_t kImageSize = 256 * 1024 * 1024;
+
+// A system-like image: mostly data, with zero fills, pattern fills and holes.
+struct SparseImage {
+    std::vector<char> data;
+    std::vector<char> sparse;
+};
+
+const SparseImage& GetImage() {
+    static SparseImage* image = [] {
+        auto image = new SparseImage;
+        image->data.resize(kImageSize / 2);
+        uint32_t x = 1;
+        for (size_t i = 0; i < image->data.size(); i += sizeof(x)) {
+            x = x * 1103515245 + 12345;
+            memcpy(&image->data[i], &x, sizeof(x));
+        }
+
+        auto file = std::unique_ptr<sparse_file, decltype(&sparse_file_destroy)>(
+                sparse_file_new(kBlockSize, kImageSize), sparse_file_destroy);
+        constexpr uint64_t kExtent = 8 * 1024 * 1024;
+        unsigned int block = 0;
+        size_t data_offset = 0;
+        for (uint64_t offset = 0; offset < kImageSize; offset += kExtent) {
+            unsigned int blocks = kExtent / kBlockSize;
+            switch ((offset / kExtent) % 8) {
+                case 0:
+                case 1:
+                case 3:
+                case 5:
+                    sparse_file_add_data(file.get(), &image->data[data_offset], kExtent, block);
+                    data_offset += kExtent;
+                    break;
+                case 2:
+                case 6:
+                    sparse_file_add_fill(file.get(), 0, kExtent, block);
+                    break;
+                case 4:
+                    sparse_file_add_fill(file.get(), 0xdeadbeef, kExtent, block);
+                    break;
+                default:
+                    // Left as a hole (DONT_CARE).
+                    break;
+            }
+            block += blocks;
+        }
+
+        auto append = [](void* priv, const void* data, size_t len) -> int {
+            auto out = reinterpret_cast<std::vector<char>*>(priv);
+            const char* p = reinterpret_cast<const char*>(data);
+            out->insert(out->end(), p, p + len);
+            return 0;
+        };
+        CHECK_EQ(sparse_file_callback(file.get(), true, false, append, &image->sparse), 0);
+        return image;
+    }();
+    return *image;
+}
+
+std::string GetTarget(std::unique_ptr<TemporaryFile>* temp) {
+    if (const char* device = getenv("FASTBOOTD_BENCHMARK_DEVICE")) {
+        return device;
+    }
+    *temp = std::make_unique<TemporaryFile>();
+    CHECK_EQ(ftruncate((*temp)->fd, kImageSize), 0);
+    return (*temp)->path;
+}
+
+}  // namespace
+
+// Flashes the sparse image with |range(0)| buffers (writes in flight), with
+// or without io_uring (|range(1)|) and BLKZEROOUT (|range(2)|).
+static void BM_BlockWriter_flashSparse(benchmark::State& state) {
+    const SparseImage& image = GetImage();
+    std::unique_ptr<TemporaryFile> temp;
+    std::string target = GetTarget(&temp);
+
+    BlockWriter::Options options;
+    options.queue_depth = state.range(0);
+    options.use_io_uring = state.range(1);
+    options.use_zeroout = state.range(2);
+
+    for (auto _ : state) {
+        PartitionHandle handle(target);
+        if (!handle.Open(O_WRONLY | O_DIRECT)) {
+            state.SkipWithError("could not open target");
+            return;
+        }
+        BlockWriter writer(&handle, options);
+        if (!writer.Init()) {
+            state.SkipWithError("could not allocate buffers");
+            return;
+        }
+        ImageWriter image_writer(&writer, kImageSize, image.sparse.size(), false);
+        if (image_writer.Write(image.sparse.data(), image.sparse.size()) ||
+            image_writer.Finish()) {
+            state.SkipWithError("flash failed");
+            return;
+        }
+        fsync(handle.fd());
+    }
+    state.SetBytesProcessed(state.iterations() * kImageSize);
+}
+BENCHMARK(BM_BlockWriter_flashSparse)
+        ->ArgsProduct({{1, 4, 8}, {0, 1}, {0, 1}})
+        ->ArgNames({"depth", "uring", "zeroout"})
+        ->Unit(benchmark::kMillisecond)
+        ->UseRealTime();
+
+BENCHMARK_MAIN();
@@ -0,0 +1,313 @@
+/*
+ * Copyright (C) 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "block_writer.h"
+
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <memory>
+#include <string>
+#include <tuple>
+#include <vector>
+
+#include <android-base/file.h>
+#include <gtest/gtest.h>
+#include <libavb/libavb.h>
+#include <sparse/sparse.h>
+
+#include "sparse_format.h"
+
+namespace {
+
+constexpr unsigned int kBlockSize = 4096;
+constexpr uint64_t kDeviceSize = 4 * 1024 * 1024;
+// Bytes of a partition that a flash did not write.
+constexpr char kBackground = '\x5a';
+
+using SparsePtr = std::unique_ptr<sparse_file, decltype(&sparse_file_destroy)>;
+
+std::vector<char> RandomData(size_t len, uint32_t seed) {
+    std::vector<char> data(len);
+    for (auto& c : data) {
+        seed = seed * 1103515245 + 12345;
+        c = static_cast<char>(seed >> 16);
+    }
+    return data;
+}
+
+std::vector<char> ToSparseImage(sparse_file* file, bool crc) {
+    std::vector<char> image;
+    auto append = [](void* priv, const void* data, size_t len) -> int {
+        auto out = reinterpret_cast<std::vector<char>*>(priv);
+        const char* p = reinterpret_cast<const char*>(data);
+        out->insert(out->end(), p, p + len);
+        return 0;
+    };
+    EXPECT_EQ(sparse_file_callback(file, true, crc, append, &image), 0);
+    return image;
+}
+
+// A partition of |size| bytes that were not written yet.
+std::unique_ptr<TemporaryFile> CreatePartition(uint64_t size) {
+    auto file = std::make_unique<TemporaryFile>();
+    std::string background(size, kBackground);
+    EXPECT_TRUE(android::base::WriteFully(file->fd, background.data(), background.size()));
+    EXPECT_EQ(lseek(file->fd, 0, SEEK_SET), 0);
+    return file;
+}
+
+std::string ReadPartition(const TemporaryFile& file) {
+    std::string contents;
+    EXPECT_TRUE(android::base::ReadFileToString(file.path, &contents));
+    return contents;
+}
+
+// What libsparse writes for |image| to a partition of |size| bytes.
+std::string ExpandWithLibsparse(const std::vector<char>& image, uint64_t size) {
+    auto partition = CreatePartition(size);
+    std::vector<char> buf = image;
+    // Like ImageWriter, the value of a CRC32 chunk is not checked. libsparse
+    // only adds the first block of a fill chunk to the CRC it writes.
+    SparsePtr file(sparse_file_import_buf(buf.data(), buf.size(), false, false),
+                   sparse_file_destroy);
+    EXPECT_NE(file, nullptr);
+    if (!file) return {};
+    EXPECT_EQ(sparse_file_write(file.get(), partition->fd, false, false, false), 0);
+    return ReadPartition(*partition);
+}
+
+struct FlashResult {
+    int write = 0;
+    int finish = 0;
+    std::string contents;
+};
+
+// Flashes |image| to a partition of |device_size| bytes, passing it to
+// ImageWriter |piece| bytes at a time, or all at once if |piece| is 0.
+FlashResult Flash(const std::vector<char>& image, uint64_t device_size,
+                  const BlockWriter::Options& options, size_t piece = 0,
+                  bool copy_avb_footer = false) {
+    FlashResult result;
+    auto partition = CreatePartition(device_size);
+    PartitionHandle handle(partition->path);
+    EXPECT_TRUE(handle.Open(O_WRONLY));
+
+    BlockWriter writer(&handle, options);
+    EXPECT_TRUE(writer.Init());
+    ImageWriter image_writer(&writer, device_size, image.size(), copy_avb_footer);
+    if (piece == 0) piece = image.size();
+    for (size_t offset = 0; offset < image.size() && result.write == 0; offset += piece) {
+        result.write = image_writer.Write(image.data() + offset,
+                                          std::min(piece, image.size() - offset));
+    }
+    if (result.write == 0) {
+        result.finish = image_writer.Finish();
+    }
+    result.contents = ReadPartition(*partition);
+    return result;
+}
+
+BlockWriter::Options SmallBuffers(bool use_io_uring = true) {
+    BlockWriter::Options options;
+    options.buffer_size = 64 * 1024;
+    options.use_io_uring = use_io_uring;
+    return options;
+}
+
+// An image with every kind of chunk. The zero fill is longer than a buffer,
+// so that BlockWriter tries BLKZEROOUT, which regular files do not support.
+std::vector<char> CreateTestSparseImage(bool crc) {
+    SparsePtr file(sparse_file_new(kBlockSize, kDeviceSize), sparse_file_destroy);
+    std::vector<char> data = RandomData(3 * kBlockSize, 1);
+    std::vector<char> tail = RandomData(2 * kBlockSize, 2);
+    EXPECT_EQ(sparse_file_add_data(file.get(), data.data(), data.size(), 0), 0);
+    EXPECT_EQ(sparse_file_add_fill(file.get(), 0xdeadbeef, 2 * kBlockSize, 3), 0);
+    EXPECT_EQ(sparse_file_add_fill(file.get(), 0, 300 * kBlockSize, 5), 0);
+    // Blocks 305 to 899 are left as a hole (DONT_CARE).
+    EXPECT_EQ(sparse_file_add_data(file.get(), tail.data(), tail.size(), 900), 0);
+    // The rest of the image is a trailing hole.
+    return ToSparseImage(file.get(), crc);
+}
+
+}  // namespace
+
+// Parameterized on the size of the pieces the image is received in, and on
+// whether io_uring is used.
+class ImageWriterSparseTest : public ::testing::TestWithParam<std::tuple<size_t, bool>> {};
+
+TEST_P(ImageWriterSparseTest, MatchesLibsparse) {
+    const auto [piece, use_io_uring] = GetParam();
+    for (bool crc : {false, true}) {
+        std::vector<char> image = CreateTestSparseImage(crc);
+        std::string expected = ExpandWithLibsparse(image, kDeviceSize);
+        ASSERT_EQ(expected.size(), kDeviceSize);
+
+        FlashResult result = Flash(image, kDeviceSize, SmallBuffers(use_io_uring), piece);
+        ASSERT_EQ(result.write, 0);
+        ASSERT_EQ(result.finish, 0);
+        ASSERT_TRUE(result.contents == expected) << "crc: " << crc;
+    }
+}
+
+INSTANTIATE_TEST_SUITE_P(Pieces, ImageWriterSparseTest,
+                         ::testing::Combine(::testing::Values(0, 1, 7, 4096, 65536 + 3),
+                                            ::testing::Bool()));
+
+TEST(ImageWriterTest, RawImage) {
+    std::vector<char> image = RandomData(3 * kBlockSize + 100, 3);
+    FlashResult result = Flash(image, kDeviceSize, SmallBuffers(), 1000);
+    ASSERT_EQ(result.write, 0);
+    ASSERT_EQ(result.finish, 0);
+
+    std::string expected(image.begin(), image.end());
+    expected.resize(kDeviceSize, kBackground);
+    ASSERT_TRUE(result.contents == expected);
+}
+
+TEST(ImageWriterTest, RawImageShorterThanMagic) {
+    std::vector<char> image = {'a', 'b'};
+    FlashResult result = Flash(image, kDeviceSize, SmallBuffers());
+    ASSERT_EQ(result.finish, 0);
+    ASSERT_EQ(result.contents.substr(0, 3), std::string("ab") + kBackground);
+}
+
+TEST(ImageWriterTest, MovesAvbFooter) {
+    std::vector<char> image = RandomData(10 * kBlockSize, 4);
+    char* footer = &image[image.size() - AVB_FOOTER_SIZE];
+    memcpy(footer, AVB_FOOTER_MAGIC, AVB_FOOTER_MAGIC_LEN);
+
+    // Same as the image flashed by the download then flash path: the image,
+    // zeroes, and a copy of the footer at the end of the partition.
+    std::string expected(image.begin(), image.end());
+    expected.resize(kDeviceSize - AVB_FOOTER_SIZE, '\0');
+    expected.append(footer, AVB_FOOTER_SIZE);
+
+    FlashResult result = Flash(image, kDeviceSize, SmallBuffers(), 4096 + 5, true);
+    ASSERT_EQ(result.write, 0);
+    ASSERT_EQ(result.finish, 0);
+    ASSERT_TRUE(result.contents == expected);
+}
+
+TEST(ImageWriterTest, NoAvbFooter) {
+    std::vector<char> image = RandomData(10 * kBlockSize, 5);
+    FlashResult result = Flash(image, kDeviceSize, SmallBuffers(), 0, true);
+    ASSERT_EQ(result.finish, 0);
+
+    std::string expected(image.begin(), image.end());
+    expected.resize(kDeviceSize, kBackground);
+    ASSERT_TRUE(result.contents == expected);
+}
+
+TEST(ImageWriterTest, RejectsImageLargerThanDevice) {
+    std::vector<char> raw = RandomData(kDeviceSize + 1, 6);
+    EXPECT_EQ(Flash(raw, kDeviceSize, SmallBuffers()).write, -EOVERFLOW);
+
+    std::vector<char> sparse = CreateTestSparseImage(false);
+    EXPECT_EQ(Flash(sparse, kDeviceSize / 2, SmallBuffers()).write, -EOVERFLOW);
+}
+
+TEST(ImageWriterTest, RejectsBadSparseVersion) {
+    std::vector<char> image = CreateTestSparseImage(false);
+    auto header = reinterpret_cast<sparse_header_t*>(image.data());
+    header->major_version = 2;
+    EXPECT_EQ(Flash(image, kDeviceSize, SmallBuffers()).write, -EINVAL);
+}
+
+TEST(ImageWriterTest, RejectsBadChunkType) {
+    std::vector<char> image = CreateTestSparseImage(false);
+    auto chunk = reinterpret_cast<chunk_header_t*>(image.data() + sizeof(sparse_header_t));
+    chunk->chunk_type = 0xCAC5;
+    EXPECT_EQ(Flash(image, kDeviceSize, SmallBuffers()).write, -EINVAL);
+}
+
+TEST(ImageWriterTest, RejectsTruncatedSparseImage) {
+    std::vector<char> image = CreateTestSparseImage(false);
+    image.resize(image.size() - 1);
+    FlashResult result = Flash(image, kDeviceSize, SmallBuffers());
+    EXPECT_EQ(result.write, 0);
+    EXPECT_EQ(result.finish, -EINVAL);
+}
+
+TEST(ImageWriterTest, RejectsChunksPastEndOfImage) {
+    std::vector<char> image = CreateTestSparseImage(false);
+    auto header = reinterpret_cast<sparse_header_t*>(image.data());
+    header->total_blks = 100;
+    EXPECT_EQ(Flash(image, kDeviceSize, SmallBuffers()).write, -EINVAL);
+}
+
+TEST(BlockWriterTest, ZeroFillWithoutBlkZeroout) {
+    // A regular file does not support BLKZEROOUT, so the zeroes are written.
+    auto partition = CreatePartition(kDeviceSize);
+    PartitionHandle handle(partition->path);
+    ASSERT_TRUE(handle.Open(O_WRONLY));
+    BlockWriter writer(&handle, SmallBuffers());
+    ASSERT_TRUE(writer.Init());
+
+    // Unaligned on both ends, and a second fill after the fallback.
+    ASSERT_EQ(writer.Write("x", 1), 0);
+    ASSERT_EQ(writer.Fill(0, 1024 * 1024), 0);
+    ASSERT_EQ(writer.Fill(0, 1024 * 1024 + 10), 0);
+    ASSERT_EQ(writer.Write("y", 1), 0);
+    ASSERT_EQ(writer.Finish(), 0);
+    ASSERT_EQ(writer.offset(), 2 * 1024 * 1024 + 12u);
+
+    std::string expected = "x" + std::string(2 * 1024 * 1024 + 10, '\0') + "y";
+    expected.resize(kDeviceSize, kBackground);
+    ASSERT_TRUE(ReadPartition(*partition) == expected);
+}
+
+TEST(BlockWriterTest, FillAfterUnalignedWrite) {
+    auto partition = CreatePartition(kDeviceSize);
+    PartitionHandle handle(partition->path);
+    ASSERT_TRUE(handle.Open(O_WRONLY));
+    BlockWriter writer(&handle, SmallBuffers());
+    ASSERT_TRUE(writer.Init());
+
+    // The pattern crosses several buffers, each starting at a different byte of it.
+    const uint32_t value = 0xdeadbeef;
+    const size_t len = 3 * 64 * 1024 + 2;
+    ASSERT_EQ(writer.Write("x", 1), 0);
+    ASSERT_EQ(writer.Fill(value, len), 0);
+    ASSERT_EQ(writer.Finish(), 0);
+
+    std::string expected = "x";
+    for (size_t i = 0; i < len; i++) {
+        expected += reinterpret_cast<const char*>(&value)[i % sizeof(value)];
+    }
+    expected.resize(kDeviceSize, kBackground);
+    ASSERT_TRUE(ReadPartition(*partition) == expected);
+}
+
+TEST(BlockWriterTest, UnalignedWriteReopensWithoutDirectIo) {
+    auto partition = CreatePartition(kDeviceSize);
+    PartitionHandle handle(partition->path);
+    if (!handle.Open(O_WRONLY | O_DIRECT)) {
+        GTEST_SKIP() << "O_DIRECT is not supported for " << partition->path;
+    }
+    BlockWriter writer(&handle, SmallBuffers());
+    ASSERT_TRUE(writer.Init());
+
+    std::vector<char> data = RandomData(3 * 64 * 1024 + 100, 7);
+    ASSERT_EQ(writer.Write(data.data(), data.size()), 0);
+    ASSERT_EQ(writer.Finish(), 0);
+    EXPECT_EQ(fcntl(handle.fd(), F_GETFL) & O_DIRECT, 0);
+
+    std::string expected(data.begin(), data.end());
+    expected.resize(kDeviceSize, kBackground);
+    ASSERT_TRUE(ReadPartition(*partition) == expected);
+}
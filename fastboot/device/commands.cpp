@@ -147,6 +147,7 @@ const std::unordered_map<std::string, VariableHandlers> kVariableMap = {
         {FB_VAR_SECURITY_PATCH_LEVEL, {GetSecurityPatchLevel, nullptr}},
         {FB_VAR_TREBLE_ENABLED, {GetTrebleEnabled, nullptr}},
         {FB_VAR_MAX_FETCH_SIZE, {GetMaxFetchSize, nullptr}},
+        {FB_VAR_STREAM_FLASH, {GetStreamFlash, nullptr}},
         {FB_VAR_BATTERY_SERIAL_NUMBER, {GetBatterySerialNumber, nullptr}},
         {FB_VAR_BATTERY_PART_STATUS, {GetBatteryPartStatus, nullptr}},
 };
@@ -598,27 +599,72 @@ void CancelPartitionSnapshot(FastbootDevice* device, const std::string& partitio
     builder.Write();
 }
 
+// Checks that |partition_name| may be flashed, and cancels any snapshot of it.
+static bool PrepareFlash(FastbootDevice* device, const std::string& partition_name,
+                         std::string* message) {
+    if (GetDeviceLockStatus()) {
+        *message = "Flashing is not allowed on locked devices";
+        return false;
+    }
+
+    if (IsProtectedPartitionDuringMerge(device, partition_name)) {
+        *message = "Cannot flash " + partition_name + " while a snapshot update is in progress";
+        return false;
+    }
+
+    if (LogicalPartitionExists(device, partition_name)) {
+        CancelPartitionSnapshot(device, partition_name);
+    }
+    return true;
+}
+
 bool FlashHandler(FastbootDevice* device, const std::vector<std::string>& args) {
     if (args.size() < 2) {
         return device->WriteStatus(FastbootResult::FAIL, "Invalid arguments");
     }
 
-    if (GetDeviceLockStatus()) {
-        return device->WriteStatus(FastbootResult::FAIL,
-                                   "Flashing is not allowed on locked devices");
+    const auto& partition_name = args[1];
+    std::string message;
+    if (!PrepareFlash(device, partition_name, &message)) {
+        return device->WriteFail(message);
+    }
+
+    int ret = Flash(device, partition_name);
+    if (ret < 0) {
+        return device->WriteStatus(FastbootResult::FAIL, strerror(-ret));
+    }
+    if (partition_name == "userdata") {
+        PostWipeData();
+    }
+
+    return device->WriteStatus(FastbootResult::OKAY, "Flashing succeeded");
+}
+
+// stream-flash:<partition>:<size> receives the image like download, but
+// writes it to the partition as it arrives.
+bool StreamFlashHandler(FastbootDevice* device, const std::vector<std::string>& args) {
+    if (args.size() < 3) {
+        return device->WriteStatus(FastbootResult::FAIL, "Invalid arguments");
     }
 
     const auto& partition_name = args[1];
-    if (IsProtectedPartitionDuringMerge(device, partition_name)) {
-        auto message = "Cannot flash " + partition_name + " while a snapshot update is in progress";
+    std::string message;
+    if (!PrepareFlash(device, partition_name, &message)) {
         return device->WriteFail(message);
     }
 
-    if (LogicalPartitionExists(device, partition_name)) {
-        CancelPartitionSnapshot(device, partition_name);
+    if (args[2].length() != 8) {
+        return device->WriteStatus(FastbootResult::FAIL, "Invalid size (length of size != 8)");
+    }
+    unsigned int size;
+    if (!android::base::ParseUint("0x" + args[2], &size)) {
+        return device->WriteStatus(FastbootResult::FAIL, "Invalid size");
+    }
+    if (size == 0) {
+        return device->WriteStatus(FastbootResult::FAIL, "Invalid size (0)");
     }
 
-    int ret = Flash(device, partition_name);
+    int ret = FlashStream(device, partition_name, size);
     if (ret < 0) {
         return device->WriteStatus(FastbootResult::FAIL, strerror(-ret));
     }
@@ -21,24 +21,28 @@
 #include <unistd.h>
 
 #include <algorithm>
+#include <condition_variable>
+#include <deque>
 #include <memory>
+#include <mutex>
 #include <optional>
 #include <set>
 #include <string>
+#include <thread>
 
 #include <android-base/file.h>
 #include <android-base/logging.h>
 #include <android-base/properties.h>
+#include <android-base/stringprintf.h>
 #include <android-base/strings.h>
 #include <ext4_utils/ext4_utils.h>
 #include <fs_mgr_overlayfs.h>
 #include <fstab/fstab.h>
-#include <libavb/libavb.h>
 #include <liblp/builder.h>
 #include <liblp/liblp.h>
 #include <libsnapshot/snapshot.h>
-#include <sparse/sparse.h>
 
+#include "block_writer.h"
 #include "fastboot_device.h"
 #include "utility.h"
 
@@ -47,7 +51,9 @@ using namespace std::literals;
 
 namespace {
 
-constexpr uint32_t SPARSE_HEADER_MAGIC = 0xed26ff3a;
+// Receive buffers for stream-flash.
+constexpr size_t kStreamBufferSize = 1048576;
+constexpr size_t kStreamBufferCount = 4;
 
 void WipeOverlayfsForPartition(FastbootDevice* device, const std::string& partition_name) {
     // May be called, in the case of sparse data, multiple times so cache/skip.
@@ -76,101 +82,10 @@ void WipeOverlayfsForPartition(FastbootDevice* device, const std::string& partit
 
 }  // namespace
 
-int FlashRawDataChunk(PartitionHandle* handle, const char* data, size_t len) {
-    size_t ret = 0;
-    const size_t max_write_size = 1048576;
-    void* aligned_buffer;
-
-    if (posix_memalign(&aligned_buffer, 4096, max_write_size)) {
-        PLOG(ERROR) << "Failed to allocate write buffer";
-        return -ENOMEM;
-    }
-
-    auto aligned_buffer_unique_ptr = std::unique_ptr<void, decltype(&free)>{aligned_buffer, free};
-
-    while (ret < len) {
-        int this_len = std::min(max_write_size, len - ret);
-        memcpy(aligned_buffer_unique_ptr.get(), data, this_len);
-        // In case of non 4KB aligned writes, reopen without O_DIRECT flag
-        if (this_len & 0xFFF) {
-            if (handle->Reset(O_WRONLY) != true) {
-                PLOG(ERROR) << "Failed to reset file descriptor";
-                return -1;
-            }
-        }
-
-        int this_ret = write(handle->fd(), aligned_buffer_unique_ptr.get(), this_len);
-        if (this_ret < 0) {
-            PLOG(ERROR) << "Failed to flash data of len " << len;
-            return -1;
-        }
-        data += this_ret;
-        ret += this_ret;
-    }
-    return 0;
-}
-
-int FlashRawData(PartitionHandle* handle, const std::vector<char>& downloaded_data) {
-    int ret = FlashRawDataChunk(handle, downloaded_data.data(), downloaded_data.size());
-    if (ret < 0) {
-        return -errno;
-    }
-    return ret;
-}
-
-int WriteCallback(void* priv, const void* data, size_t len) {
-    PartitionHandle* handle = reinterpret_cast<PartitionHandle*>(priv);
-    if (!data) {
-        if (lseek64(handle->fd(), len, SEEK_CUR) < 0) {
-            int rv = -errno;
-            PLOG(ERROR) << "lseek failed";
-            return rv;
-        }
-        return 0;
-    }
-    return FlashRawDataChunk(handle, reinterpret_cast<const char*>(data), len);
-}
-
-int FlashSparseData(PartitionHandle* handle, std::vector<char>& downloaded_data) {
-    struct sparse_file* file = sparse_file_import_buf(downloaded_data.data(),
-                                                      downloaded_data.size(), true, false);
-    if (!file) {
-        // Invalid sparse format
-        LOG(ERROR) << "Unable to open sparse data for flashing";
-        return -EINVAL;
-    }
-    return sparse_file_callback(file, false, false, WriteCallback, reinterpret_cast<void*>(handle));
-}
-
-int FlashBlockDevice(PartitionHandle* handle, std::vector<char>& downloaded_data) {
-    lseek64(handle->fd(), 0, SEEK_SET);
-    if (downloaded_data.size() >= sizeof(SPARSE_HEADER_MAGIC) &&
-        *reinterpret_cast<uint32_t*>(downloaded_data.data()) == SPARSE_HEADER_MAGIC) {
-        return FlashSparseData(handle, downloaded_data);
-    } else {
-        return FlashRawData(handle, downloaded_data);
-    }
-}
-
-static void CopyAVBFooter(std::vector<char>* data, const uint64_t block_device_size) {
-    if (data->size() < AVB_FOOTER_SIZE) {
-        return;
-    }
-    std::string footer;
-    uint64_t footer_offset = data->size() - AVB_FOOTER_SIZE;
-    for (int idx = 0; idx < AVB_FOOTER_MAGIC_LEN; idx++) {
-        footer.push_back(data->at(footer_offset + idx));
-    }
-    if (0 != footer.compare(AVB_FOOTER_MAGIC)) {
-        return;
-    }
-
-    // copy AVB footer from end of data to end of block device
-    uint64_t original_data_size = data->size();
-    data->resize(block_device_size, 0);
-    for (int idx = 0; idx < AVB_FOOTER_SIZE; idx++) {
-        data->at(block_device_size - 1 - idx) = data->at(original_data_size - 1 - idx);
-    }
+static bool HasAVBFooterAtEnd(const std::string& partition_name) {
+    return partition_name == "boot" || partition_name == "boot_a" || partition_name == "boot_b" ||
+           partition_name == "init_boot" || partition_name == "init_boot_a" ||
+           partition_name == "init_boot_b";
 }
 
 int Flash(FastbootDevice* device, const std::string& partition_name) {
@@ -189,16 +104,128 @@ int Flash(FastbootDevice* device, const std::string& partition_name) {
         LOG(ERROR) << "Cannot flash " << data.size() << " bytes to block device of size "
                    << block_device_size;
         return -EOVERFLOW;
-    } else if (data.size() < block_device_size &&
-               (partition_name == "boot" || partition_name == "boot_a" ||
-                partition_name == "boot_b" || partition_name == "init_boot" ||
-                partition_name == "init_boot_a" || partition_name == "init_boot_b")) {
-        CopyAVBFooter(&data, block_device_size);
     }
     if (android::base::GetProperty("ro.system.build.type", "") != "user") {
         WipeOverlayfsForPartition(device, partition_name);
     }
-    int result = FlashBlockDevice(&handle, data);
+
+    BlockWriter writer(&handle);
+    if (!writer.Init()) {
+        return -ENOMEM;
+    }
+    ImageWriter image(&writer, block_device_size, data.size(),
+                      data.size() < block_device_size && HasAVBFooterAtEnd(partition_name));
+    int result = image.Write(data.data(), data.size());
+    if (result == 0) {
+        result = image.Finish();
+    }
+    sync();
+    return result;
+}
+
+int FlashStream(FastbootDevice* device, const std::string& partition_name, uint32_t size) {
+    PartitionHandle handle;
+    if (!OpenPartition(device, partition_name, &handle, O_WRONLY | O_DIRECT)) {
+        return -ENOENT;
+    }
+    uint64_t block_device_size = get_block_device_size(handle.fd());
+    if (android::base::GetProperty("ro.system.build.type", "") != "user") {
+        WipeOverlayfsForPartition(device, partition_name);
+    }
+
+    BlockWriter writer(&handle);
+    if (!writer.Init()) {
+        return -ENOMEM;
+    }
+    ImageWriter image(&writer, block_device_size, size,
+                      size < block_device_size && HasAVBFooterAtEnd(partition_name));
+    if (!device->WriteStatus(FastbootResult::DATA, android::base::StringPrintf("%08x", size))) {
+        return -EIO;
+    }
+
+    // Data is received into a small ring of buffers, so that the transfer of
+    // one buffer overlaps with the write of the previous one.
+    struct Buffer {
+        std::unique_ptr<char[]> data;
+        size_t len;
+    };
+    std::vector<Buffer> buffers(kStreamBufferCount);
+    std::deque<Buffer*> free_buffers;
+    std::deque<Buffer*> full_buffers;
+    for (auto& buffer : buffers) {
+        buffer.data = std::make_unique<char[]>(kStreamBufferSize);
+        free_buffers.emplace_back(&buffer);
+    }
+    std::mutex lock;
+    std::condition_variable cv;
+    bool received = false;
+
+    // Once a write fails, the rest of the data is still received (and
+    // dropped) so that the host sees the failure as the response.
+    int result = 0;
+    std::thread write_thread([&]() -> void {
+        for (;;) {
+            Buffer* buffer;
+            {
+                std::unique_lock<std::mutex> guard(lock);
+                cv.wait(guard, [&] { return !full_buffers.empty() || received; });
+                if (full_buffers.empty()) return;
+                buffer = full_buffers.front();
+                full_buffers.pop_front();
+            }
+            if (result == 0) {
+                result = image.Write(buffer->data.get(), buffer->len);
+            }
+            {
+                std::lock_guard<std::mutex> guard(lock);
+                free_buffers.emplace_back(buffer);
+            }
+            cv.notify_all();
+        }
+    });
+
+    bool transport_ok = true;
+    for (uint32_t remaining = size; remaining > 0 && transport_ok;) {
+        Buffer* buffer;
+        {
+            std::unique_lock<std::mutex> guard(lock);
+            cv.wait(guard, [&] { return !free_buffers.empty(); });
+            buffer = free_buffers.front();
+            free_buffers.pop_front();
+        }
+        buffer->len = 0;
+        size_t want = std::min<size_t>(remaining, kStreamBufferSize);
+        while (buffer->len < want) {
+            ssize_t ret = device->get_transport()->Read(buffer->data.get() + buffer->len,
+                                                        want - buffer->len);
+            if (ret <= 0) {
+                LOG(ERROR) << "read from transport failed after " << (size - remaining)
+                           << " bytes";
+                transport_ok = false;
+                break;
+            }
+            buffer->len += ret;
+            remaining -= ret;
+        }
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            full_buffers.emplace_back(buffer);
+        }
+        cv.notify_all();
+    }
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        received = true;
+    }
+    cv.notify_all();
+    write_thread.join();
+
+    if (!transport_ok) {
+        return -EIO;
+    }
+    if (result == 0) {
+        result = image.Finish();
+    }
     sync();
     return result;
 }
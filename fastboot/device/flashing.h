@@ -22,4 +22,7 @@
 class FastbootDevice;
 
 int Flash(FastbootDevice* device, const std::string& partition_name);
+// Receives a |size| byte image from the host and writes it to |partition_name|
+// while it is being transferred, instead of downloading it first.
+int FlashStream(FastbootDevice* device, const std::string& partition_name, uint32_t size);
 bool UpdateSuper(FastbootDevice* device, const std::string& super_name, bool wipe);
@@ -531,6 +531,12 @@ bool GetTrebleEnabled(FastbootDevice* /* device */, const std::vector<std::strin
     return true;
 }
 
+bool GetStreamFlash(FastbootDevice* /* device */, const std::vector<std::string>& /* args */,
+                    std::string* message) {
+    *message = "yes";
+    return true;
+}
+
 bool GetMaxFetchSize(FastbootDevice* /* device */, const std::vector<std::string>& /* args */,
                      std::string* message) {
     if (!kEnableFetch) {
@@ -88,6 +88,8 @@ bool GetSecurityPatchLevel(FastbootDevice* device, const std::vector<std::string
                            std::string* message);
 bool GetTrebleEnabled(FastbootDevice* device, const std::vector<std::string>& args,
                       std::string* message);
+bool GetStreamFlash(FastbootDevice* /* device */, const std::vector<std::string>& /* args */,
+                    std::string* message);
 bool GetMaxFetchSize(FastbootDevice* /* device */, const std::vector<std::string>& /* args */,
                      std::string* message);
 
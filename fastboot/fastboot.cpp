@@ -635,6 +635,8 @@ static int show_help() {
             " --disable-fastboot-info    Will collects tasks from image list rather than $OUT/fastboot-info.txt.\n"
             " --fs-options=OPTION[,OPTION]\n"
             "                            Enable filesystem features. OPTION supports casefold, projid, compress\n"
+            " --stream-flash             Write images while they are sent, if the device\n"
+            "                            supports it.\n"
             // TODO: remove --unbuffered?
             " --unbuffered               Don't buffer input or output.\n"
             " --verbose, -v              Verbose output.\n"
@@ -2206,6 +2208,7 @@ int FastBootTool::Main(int argc, char* argv[]) {
 
     int longindex;
     std::string next_active;
+    bool stream_flash = false;
 
     g_boot_img_hdr.kernel_addr = 0x00008000;
     g_boot_img_hdr.ramdisk_addr = 0x01000000;
@@ -2234,6 +2237,7 @@ int FastBootTool::Main(int argc, char* argv[]) {
                                       {"skip-reboot", no_argument, 0, 0},
                                       {"skip-secondary", no_argument, 0, 0},
                                       {"slot", required_argument, 0, 0},
+                                      {"stream-flash", no_argument, 0, 0},
                                       {"tags-offset", required_argument, 0, 0},
                                       {"dtb", required_argument, 0, 0},
                                       {"dtb-offset", required_argument, 0, 0},
@@ -2291,6 +2295,8 @@ int FastBootTool::Main(int argc, char* argv[]) {
                 fp->skip_secondary = true;
             } else if (name == "slot") {
                 fp->slot_override = optarg;
+            } else if (name == "stream-flash") {
+                stream_flash = true;
             } else if (name == "dtb-offset") {
                 g_boot_img_hdr.dtb_addr = strtoul(optarg, 0, 16);
             } else if (name == "tags-offset") {
@@ -2377,6 +2383,7 @@ int FastBootTool::Main(int argc, char* argv[]) {
     };
 
     fastboot::FastBootDriver fastboot_driver(std::move(transport), driver_callbacks, false);
+    fastboot_driver.set_stream_flash(stream_flash);
     fb = &fastboot_driver;
     fp->fb = &fastboot_driver;
 
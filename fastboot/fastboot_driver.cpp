@@ -148,6 +148,9 @@ RetCode FastBootDriver::FlashPartition(const std::string& partition,
 
 RetCode FastBootDriver::FlashPartition(const std::string& partition, android::base::borrowed_fd fd,
                                        uint32_t size) {
+    if (use_stream_flash_ && SupportsStreamFlash()) {
+        return StreamFlash(partition, fd, size);
+    }
     RetCode ret;
     if ((ret = Download(partition, fd, size))) {
         return ret;
@@ -157,6 +160,9 @@ RetCode FastBootDriver::FlashPartition(const std::string& partition, android::ba
 
 RetCode FastBootDriver::FlashPartition(const std::string& partition, sparse_file* s, uint32_t size,
                                        size_t current, size_t total) {
+    if (use_stream_flash_ && SupportsStreamFlash()) {
+        return StreamFlash(partition, s, size, current, total);
+    }
     RetCode ret;
     if ((ret = Download(partition, s, size, current, total, false))) {
         return ret;
@@ -164,6 +170,63 @@ RetCode FastBootDriver::FlashPartition(const std::string& partition, sparse_file
     return Flash(partition);
 }
 
+RetCode FastBootDriver::StreamFlash(const std::string& partition, android::base::borrowed_fd fd,
+                                    uint32_t size) {
+    prolog_(StringPrintf("Sending and writing '%s' (%u KB)", partition.c_str(), size / 1024));
+    auto result = [&]() -> RetCode {
+        if (size == 0 && !disable_checks_) {
+            error_ = "Cannot flash an empty file";
+            return BAD_ARG;
+        }
+        RetCode ret;
+        std::string cmd = StringPrintf("%s:%s:%08" PRIx32, FB_CMD_STREAM_FLASH, partition.c_str(),
+                                       size);
+        if ((ret = RawCommand(cmd))) {
+            return ret;
+        }
+        if ((ret = SendBuffer(fd, size))) {
+            return ret;
+        }
+        return HandleResponse();
+    }();
+    epilog_(result);
+    return result;
+}
+
+RetCode FastBootDriver::StreamFlash(const std::string& partition, sparse_file* s, uint32_t size,
+                                    size_t current, size_t total) {
+    prolog_(StringPrintf("Sending and writing sparse '%s' %zu/%zu (%u KB)", partition.c_str(),
+                         current, total, size / 1024));
+    auto result = [&]() -> RetCode {
+        error_ = "";
+        int64_t len = sparse_file_len(s, true, false);
+        if (len <= 0 || len > MAX_DOWNLOAD_SIZE) {
+            error_ = "Sparse file is too large or invalid";
+            return BAD_ARG;
+        }
+        RetCode ret;
+        std::string cmd = StringPrintf("%s:%s:%08" PRIx32, FB_CMD_STREAM_FLASH, partition.c_str(),
+                                       static_cast<uint32_t>(len));
+        if ((ret = RawCommand(cmd))) {
+            return ret;
+        }
+        if ((ret = SendSparse(s, false))) {
+            return ret;
+        }
+        return HandleResponse();
+    }();
+    epilog_(result);
+    return result;
+}
+
+bool FastBootDriver::SupportsStreamFlash() {
+    if (!stream_flash_) {
+        std::string value;
+        stream_flash_ = GetVar(FB_VAR_STREAM_FLASH, &value) == SUCCESS && value == "yes";
+    }
+    return *stream_flash_;
+}
+
 RetCode FastBootDriver::Partitions(std::vector<std::tuple<std::string, uint64_t>>* partitions) {
     std::vector<std::string> all;
     RetCode ret;
@@ -272,6 +335,14 @@ RetCode FastBootDriver::Download(sparse_file* s, bool use_crc, std::string* resp
         return ret;
     }
 
+    if ((ret = SendSparse(s, use_crc))) {
+        return ret;
+    }
+
+    return HandleResponse(response, info);
+}
+
+RetCode FastBootDriver::SendSparse(sparse_file* s, bool use_crc) {
     struct SparseCBPrivate {
         FastBootDriver* self;
         std::vector<char> tpbuf;
@@ -290,11 +361,12 @@ RetCode FastBootDriver::Download(sparse_file* s, bool use_crc, std::string* resp
     }
 
     // Now flush
+    RetCode ret;
     if (cb_priv.tpbuf.size() && (ret = SendBuffer(cb_priv.tpbuf))) {
         return ret;
     }
 
-    return HandleResponse(response, info);
+    return SUCCESS;
 }
 
 RetCode FastBootDriver::Upload(const std::string& outfile, std::string* response,
@@ -630,6 +702,8 @@ int FastBootDriver::SparseWriteCallback(std::vector<char>& tpbuf, const char* da
 
 void FastBootDriver::set_transport(std::unique_ptr<Transport> transport) {
     transport_ = std::move(transport);
+    // The new transport may be connected to a different fastboot implementation.
+    stream_flash_.reset();
 }
 
 }  // End namespace fastboot
@@ -30,6 +30,7 @@
 #include <functional>
 #include <limits>
 #include <memory>
+#include <optional>
 #include <string>
 #include <vector>
 
@@ -111,6 +112,13 @@ class FastBootDriver : public IFastBootDriver {
                            uint32_t sz) override;
     RetCode FlashPartition(const std::string& partition, sparse_file* s, uint32_t sz,
                            size_t current, size_t total);
+    // Sends the image with stream-flash, which writes it while it is being
+    // transferred. Only supported when the stream-flash variable is "yes".
+    // FlashPartition() only uses it after set_stream_flash(true).
+    RetCode StreamFlash(const std::string& partition, android::base::borrowed_fd fd, uint32_t sz);
+    RetCode StreamFlash(const std::string& partition, sparse_file* s, uint32_t sz,
+                        size_t current, size_t total);
+    bool SupportsStreamFlash();
 
     RetCode Partitions(std::vector<std::tuple<std::string, uint64_t>>* partitions);
     RetCode Require(const std::string& var, const std::vector<std::string>& allowed, bool* reqmet,
@@ -123,6 +131,7 @@ class FastBootDriver : public IFastBootDriver {
     RetCode WaitForDisconnect() override;
 
     void set_transport(std::unique_ptr<Transport> transport);
+    void set_stream_flash(bool enabled) { use_stream_flash_ = enabled; }
 
     RetCode RawCommand(const std::string& cmd, const std::string& message,
                        std::string* response = nullptr, std::vector<std::string>* info = nullptr,
@@ -142,6 +151,7 @@ class FastBootDriver : public IFastBootDriver {
     std::unique_ptr<Transport> transport_;
 
   private:
+    RetCode SendSparse(sparse_file* s, bool use_crc);
     RetCode SendBuffer(android::base::borrowed_fd fd, size_t size);
     RetCode SendBuffer(const std::vector<char>& buf);
     RetCode SendBuffer(const void* buf, size_t size);
@@ -162,6 +172,8 @@ class FastBootDriver : public IFastBootDriver {
     std::function<void(const std::string&)> info_;
     std::function<void(const std::string&)> text_;
     bool disable_checks_;
+    bool use_stream_flash_ = false;
+    std::optional<bool> stream_flash_;
 };
 
 }  // namespace fastboot
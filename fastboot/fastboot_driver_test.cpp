@@ -19,6 +19,7 @@
 #include <memory>
 #include <optional>
 
+#include <android-base/file.h>
 #include <gtest/gtest.h>
 #include "mock_transport.h"
 
@@ -97,3 +98,69 @@ TEST_F(DriverTest, TextMessage) {
               " Indeed we can do that now with a TEXT message whenever we feel like it."
               " Isn't that truly super cool?");
 }
+
+TEST_F(DriverTest, StreamFlash) {
+    std::unique_ptr<MockTransport> transport_pointer = std::make_unique<MockTransport>();
+    MockTransport* transport = transport_pointer.get();
+    FastBootDriver driver(std::move(transport_pointer));
+    driver.set_stream_flash(true);
+
+    TemporaryFile tf;
+    ASSERT_TRUE(android::base::WriteStringToFd("0123456789", tf.fd));
+
+    EXPECT_CALL(*transport, Write(_, _))
+            .With(AllArgs(RawData("getvar:stream-flash")))
+            .WillOnce(ReturnArg<1>());
+    EXPECT_CALL(*transport, Read(_, _)).WillOnce(Invoke(CopyData("OKAYyes")));
+    EXPECT_CALL(*transport, Write(_, _))
+            .With(AllArgs(RawData("stream-flash:system_a:0000000a")))
+            .WillOnce(ReturnArg<1>());
+    EXPECT_CALL(*transport, Read(_, _)).WillOnce(Invoke(CopyData("DATA0000000a")));
+    EXPECT_CALL(*transport, Write(_, _))
+            .With(AllArgs(RawData("0123456789")))
+            .WillOnce(ReturnArg<1>());
+    EXPECT_CALL(*transport, Read(_, _)).WillOnce(Invoke(CopyData("OKAY")));
+
+    ASSERT_EQ(driver.FlashPartition("system_a", tf.fd, 10), SUCCESS) << driver.Error();
+}
+
+TEST_F(DriverTest, StreamFlashNotEnabled) {
+    std::unique_ptr<MockTransport> transport_pointer = std::make_unique<MockTransport>();
+    MockTransport* transport = transport_pointer.get();
+    FastBootDriver driver(std::move(transport_pointer));
+
+    TemporaryFile tf;
+    ASSERT_TRUE(android::base::WriteStringToFd("0123456789", tf.fd));
+
+    // The device is not asked about stream-flash, and the image is
+    // downloaded then flashed.
+    EXPECT_CALL(*transport, Write(_, _))
+            .With(AllArgs(RawData("download:0000000a")))
+            .WillOnce(ReturnArg<1>());
+    EXPECT_CALL(*transport, Read(_, _)).WillOnce(Invoke(CopyData("DATA0000000a")));
+    EXPECT_CALL(*transport, Write(_, _))
+            .With(AllArgs(RawData("0123456789")))
+            .WillOnce(ReturnArg<1>());
+    EXPECT_CALL(*transport, Read(_, _)).WillOnce(Invoke(CopyData("OKAY")));
+    EXPECT_CALL(*transport, Write(_, _))
+            .With(AllArgs(RawData("flash:system_a")))
+            .WillOnce(ReturnArg<1>());
+    EXPECT_CALL(*transport, Read(_, _)).WillOnce(Invoke(CopyData("OKAY")));
+
+    ASSERT_EQ(driver.FlashPartition("system_a", tf.fd, 10), SUCCESS) << driver.Error();
+}
+
+TEST_F(DriverTest, StreamFlashUnsupported) {
+    std::unique_ptr<MockTransport> transport_pointer = std::make_unique<MockTransport>();
+    MockTransport* transport = transport_pointer.get();
+    FastBootDriver driver(std::move(transport_pointer));
+
+    EXPECT_CALL(*transport, Write(_, _))
+            .With(AllArgs(RawData("getvar:stream-flash")))
+            .WillOnce(ReturnArg<1>());
+    EXPECT_CALL(*transport, Read(_, _)).WillOnce(Invoke(CopyData("FAILunknown variable")));
+
+    ASSERT_FALSE(driver.SupportsStreamFlash());
+    // The answer is cached for the rest of the session.
+    ASSERT_FALSE(driver.SupportsStreamFlash());
+}
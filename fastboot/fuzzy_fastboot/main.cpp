@@ -658,6 +658,57 @@ TEST_F(Conformance, SparseVersionCheck) {
     }
 }
 
+TEST_F(Conformance, StreamFlashRaw) {
+    if (!fb->SupportsStreamFlash()) {
+        GTEST_SKIP() << "Device does not support stream-flash";
+    }
+    // Not a multiple of the block size, so the tail takes the unaligned path.
+    std::vector<char> buf = RandomBuf(3 * 4096 + 100);
+    TemporaryFile tf;
+    ASSERT_TRUE(android::base::WriteFully(tf.fd, buf.data(), buf.size()));
+    EXPECT_EQ(fb->StreamFlash("userdata", tf.fd, buf.size()), SUCCESS)
+            << "Stream flashing a raw image failed";
+}
+
+TEST_F(Conformance, StreamFlashSparse) {
+    if (!fb->SupportsStreamFlash()) {
+        GTEST_SKIP() << "Device does not support stream-flash";
+    }
+    SparseWrapper sparse(4096, 10 * 4096);
+    ASSERT_TRUE(*sparse) << "Sparse image creation failed";
+    std::vector<char> buf = RandomBuf(2 * 4096);
+    ASSERT_EQ(sparse_file_add_data(*sparse, buf.data(), buf.size(), 0), 0)
+            << "Adding data failed to sparse file: " << sparse.Rep();
+    ASSERT_EQ(sparse_file_add_fill(*sparse, 0xdeadbeef, 4096, 4), 0)
+            << "Adding fill to sparse file failed: " << sparse.Rep();
+    ASSERT_EQ(sparse_file_add_fill(*sparse, 0, 4096, 5), 0)
+            << "Adding fill to sparse file failed: " << sparse.Rep();
+    ASSERT_EQ(sparse_file_add_data(*sparse, buf.data(), 4096, 9), 0)
+            << "Adding data failed to sparse file: " << sparse.Rep();
+    int64_t len = sparse_file_len(*sparse, true, false);
+    ASSERT_GT(len, 0) << "Sparse image length is invalid: " << sparse.Rep();
+    EXPECT_EQ(fb->StreamFlash("userdata", *sparse, len, 1, 1), SUCCESS)
+            << "Stream flashing sparse failed: " << sparse.Rep();
+}
+
+TEST_F(Conformance, StreamFlashSparseVersionCheck) {
+    if (!fb->SupportsStreamFlash()) {
+        GTEST_SKIP() << "Device does not support stream-flash";
+    }
+    SparseWrapper sparse(4096, 4096);
+    ASSERT_TRUE(*sparse) << "Sparse image creation failed";
+    std::vector<char> buf;
+    ASSERT_TRUE(SparseToBuf(*sparse, &buf)) << "Sparse buffer creation failed";
+    // Invalid, right after magic
+    buf[4] = 0xff;
+    const std::string cmd =
+            android::base::StringPrintf("%s:userdata:%08zx", FB_CMD_STREAM_FLASH, buf.size());
+    ASSERT_EQ(fb->RawCommand(cmd), SUCCESS) << "Device rejected stream-flash command";
+    ASSERT_EQ(SendBuffer(buf), SUCCESS) << "Sending payload failed";
+    EXPECT_EQ(HandleResponse(), DEVICE_FAIL)
+            << "Stream flashing an invalid sparse version should fail " << sparse.Rep();
+}
+
 TEST_F(UnlockPermissions, Download) {
     std::vector<char> buf{'a', 'o', 's', 'p'};
     EXPECT_EQ(fb->Download(buf), SUCCESS) << "Download 4-byte payload failed";
@@ -0,0 +1,313 @@
+/*
+ * Copyright (C) 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <fcntl.h>
+#include <string.h>
+
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <android-base/file.h>
+#include <android-base/unique_fd.h>
+
+#include "fs_avb/fs_avb_util.h"
+#include "sha.h"
+#include "util.h"
+
+using android::base::ReadFullyAtOffset;
+using android::base::unique_fd;
+
+namespace android {
+namespace fs_mgr {
+
+namespace {
+
+// Maximum number of contiguous data blocks read with a single pread().
+constexpr uint64_t kMaxRunBlocks = 256;
+
+struct HashtreeLayout {
+    uint64_t block_size;
+    uint64_t num_data_blocks;
+    uint64_t tree_offset;
+    size_t digest_padding;
+    uint64_t hashes_per_block;
+    // Offset of each level relative to |tree_offset|, starting with the level
+    // that holds the data block digests. Upper levels are stored first.
+    std::vector<uint64_t> level_offsets;
+};
+
+// Same layout as calc_hash_level_offsets() in avbtool.
+bool GetHashtreeLayout(const FsAvbHashtreeDescriptor& desc, size_t digest_size,
+                       HashtreeLayout* layout) {
+    const uint64_t block_size = desc.data_block_size;
+    if (block_size == 0 || (block_size & (block_size - 1)) != 0 ||
+        desc.hash_block_size != block_size) {
+        LERROR << "Unsupported hashtree block sizes: data " << desc.data_block_size << ", hash "
+               << desc.hash_block_size;
+        return false;
+    }
+    if (desc.image_size == 0 || desc.image_size % block_size != 0) {
+        LERROR << "Hashtree image size " << desc.image_size << " is not a multiple of "
+               << block_size;
+        return false;
+    }
+
+    layout->block_size = block_size;
+    layout->num_data_blocks = desc.image_size / block_size;
+    layout->tree_offset = desc.tree_offset;
+    layout->digest_padding = 1;
+    while (layout->digest_padding < digest_size) {
+        layout->digest_padding <<= 1;
+    }
+    layout->hashes_per_block = block_size / layout->digest_padding;
+
+    std::vector<uint64_t> level_sizes;
+    for (uint64_t size = desc.image_size; size > block_size;) {
+        uint64_t num_blocks = (size + block_size - 1) / block_size;
+        uint64_t level_size =
+                (num_blocks * layout->digest_padding + block_size - 1) / block_size * block_size;
+        level_sizes.emplace_back(level_size);
+        size = level_size;
+    }
+
+    uint64_t tree_size = 0;
+    layout->level_offsets.resize(level_sizes.size());
+    for (size_t level = level_sizes.size(); level > 0; level--) {
+        layout->level_offsets[level - 1] = tree_size;
+        tree_size += level_sizes[level - 1];
+    }
+    if (tree_size != desc.tree_size) {
+        LERROR << "Hashtree size mismatch: expected " << tree_size << ", descriptor has "
+               << desc.tree_size;
+        return false;
+    }
+    return true;
+}
+
+template <typename Hasher>
+class HashtreeBlockVerifier {
+  public:
+    HashtreeBlockVerifier(int fd, const HashtreeLayout& layout, std::vector<uint8_t> salt)
+        : fd_(fd), layout_(layout), salt_(std::move(salt)) {}
+
+    // |blocks| must be sorted and unique.
+    bool Verify(const std::vector<uint64_t>& blocks, unsigned int num_threads,
+                const std::string& root_digest, uint64_t* out_hash_blocks);
+
+  private:
+    static constexpr size_t kDigestSize = Hasher::DIGEST_SIZE;
+
+    void HashBlock(const uint8_t* block, uint8_t* digest) const {
+        Hasher hasher;
+        hasher.update(salt_.data(), salt_.size());
+        hasher.update(block, layout_.block_size);
+        memcpy(digest, hasher.finalize(), kDigestSize);
+    }
+
+    bool HashDataBlocks(const std::vector<uint64_t>& blocks, unsigned int num_threads,
+                        std::vector<uint8_t>* digests) const;
+
+    int fd_;
+    const HashtreeLayout& layout_;
+    std::vector<uint8_t> salt_;
+};
+
+template <typename Hasher>
+bool HashtreeBlockVerifier<Hasher>::HashDataBlocks(const std::vector<uint64_t>& blocks,
+                                                   unsigned int num_threads,
+                                                   std::vector<uint8_t>* digests) const {
+    // Group the blocks into runs of contiguous blocks, identified by the
+    // index of their first block in |blocks|.
+    std::vector<std::pair<size_t, size_t>> runs;
+    for (size_t i = 0; i < blocks.size();) {
+        size_t len = 1;
+        while (i + len < blocks.size() && len < kMaxRunBlocks &&
+               blocks[i + len] == blocks[i] + len) {
+            len++;
+        }
+        runs.emplace_back(i, len);
+        i += len;
+    }
+
+    digests->resize(blocks.size() * kDigestSize);
+    num_threads = std::clamp<size_t>(num_threads, 1, runs.size());
+
+    std::atomic<size_t> next_run = 0;
+    std::atomic<bool> failed = false;
+    auto worker = [&]() -> void {
+        std::vector<uint8_t> buffer(kMaxRunBlocks * layout_.block_size);
+        for (size_t r = next_run++; r < runs.size() && !failed; r = next_run++) {
+            auto [first, len] = runs[r];
+            uint64_t offset = blocks[first] * layout_.block_size;
+            if (!ReadFullyAtOffset(fd_, buffer.data(), len * layout_.block_size, offset)) {
+                PERROR << "Failed to read " << len << " data blocks at offset " << offset;
+                failed = true;
+                return;
+            }
+            for (size_t i = 0; i < len; i++) {
+                HashBlock(buffer.data() + i * layout_.block_size,
+                          digests->data() + (first + i) * kDigestSize);
+            }
+        }
+    };
+
+    std::vector<std::thread> threads;
+    for (unsigned int i = 1; i < num_threads; i++) {
+        threads.emplace_back(worker);
+    }
+    worker();
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    return !failed;
+}
+
+template <typename Hasher>
+bool HashtreeBlockVerifier<Hasher>::Verify(const std::vector<uint64_t>& blocks,
+                                           unsigned int num_threads,
+                                           const std::string& root_digest,
+                                           uint64_t* out_hash_blocks) {
+    // |indices| are the blocks of the current level being checked, and
+    // |digests| their computed digests.
+    std::vector<uint64_t> indices = blocks;
+    std::vector<uint8_t> digests;
+    if (!HashDataBlocks(indices, num_threads, &digests)) {
+        return false;
+    }
+
+    uint64_t hash_blocks = 0;
+    std::vector<uint8_t> hash_block(layout_.block_size);
+    for (size_t level = 0; level < layout_.level_offsets.size(); level++) {
+        std::vector<uint64_t> parents;
+        std::vector<uint8_t> parent_digests;
+        for (size_t i = 0; i < indices.size(); i++) {
+            uint64_t parent = indices[i] / layout_.hashes_per_block;
+            if (parents.empty() || parents.back() != parent) {
+                uint64_t offset = layout_.tree_offset + layout_.level_offsets[level] +
+                                  parent * layout_.block_size;
+                if (!ReadFullyAtOffset(fd_, hash_block.data(), hash_block.size(), offset)) {
+                    PERROR << "Failed to read hash block at offset " << offset;
+                    return false;
+                }
+                parents.emplace_back(parent);
+                parent_digests.resize(parents.size() * kDigestSize);
+                HashBlock(hash_block.data(),
+                          parent_digests.data() + (parents.size() - 1) * kDigestSize);
+                hash_blocks++;
+            }
+
+            const uint8_t* expected = hash_block.data() +
+                                      (indices[i] % layout_.hashes_per_block) *
+                                              layout_.digest_padding;
+            if (memcmp(expected, digests.data() + i * kDigestSize, kDigestSize) != 0) {
+                // Level 0 is the data blocks themselves.
+                LERROR << "Hashtree mismatch at level " << level << ", block " << indices[i];
+                return false;
+            }
+        }
+        indices = std::move(parents);
+        digests = std::move(parent_digests);
+    }
+
+    // Whatever is left is the top level, which is a single block.
+    if (indices.size() != 1 || indices[0] != 0) {
+        LERROR << "Malformed hashtree: top level has more than one block";
+        return false;
+    }
+    if (BytesToHex(digests.data(), kDigestSize) != root_digest) {
+        LERROR << "Hashtree root digest mismatch: expected " << root_digest;
+        return false;
+    }
+
+    if (out_hash_blocks) {
+        *out_hash_blocks = hash_blocks;
+    }
+    return true;
+}
+
+template <typename Hasher>
+bool VerifyHashtreeBlocksWith(int fd, const FsAvbHashtreeDescriptor& desc,
+                              const std::vector<uint64_t>& data_blocks, unsigned int num_threads,
+                              uint64_t* out_hash_blocks) {
+    HashtreeLayout layout;
+    if (!GetHashtreeLayout(desc, Hasher::DIGEST_SIZE, &layout)) {
+        return false;
+    }
+    if (data_blocks.back() >= layout.num_data_blocks) {
+        LERROR << "Data block " << data_blocks.back() << " is beyond the end of the image ("
+               << layout.num_data_blocks << " blocks)";
+        return false;
+    }
+
+    std::vector<uint8_t> salt(desc.salt.size() / 2);
+    if (!HexToBytes(salt.data(), salt.size(), desc.salt)) {
+        LERROR << "Invalid hashtree salt: " << desc.salt;
+        return false;
+    }
+
+    HashtreeBlockVerifier<Hasher> verifier(fd, layout, std::move(salt));
+    return verifier.Verify(data_blocks, num_threads, desc.root_digest, out_hash_blocks);
+}
+
+}  // namespace
+
+bool VerifyHashtreeBlocks(const std::string& image_path,
+                          const FsAvbHashtreeDescriptor& hashtree_desc,
+                          std::vector<uint64_t> data_blocks, unsigned int num_threads,
+                          uint64_t* out_hash_blocks) {
+    if (out_hash_blocks) {
+        *out_hash_blocks = 0;
+    }
+    if (data_blocks.empty()) {
+        return true;
+    }
+    std::sort(data_blocks.begin(), data_blocks.end());
+    data_blocks.erase(std::unique(data_blocks.begin(), data_blocks.end()), data_blocks.end());
+
+    if (num_threads == 0) {
+        num_threads = std::max(std::thread::hardware_concurrency(), 1u);
+    }
+
+    unique_fd fd(TEMP_FAILURE_RETRY(open(image_path.c_str(), O_RDONLY | O_CLOEXEC)));
+    if (fd < 0) {
+        PERROR << "Failed to open " << image_path;
+        return false;
+    }
+
+    const uint8_t* algorithm = hashtree_desc.hash_algorithm;
+    std::string hash_algorithm(reinterpret_cast<const char*>(algorithm),
+                               strnlen(reinterpret_cast<const char*>(algorithm),
+                                       sizeof(hashtree_desc.hash_algorithm)));
+    if (hash_algorithm == "sha1") {
+        return VerifyHashtreeBlocksWith<SHA1Hasher>(fd.get(), hashtree_desc, data_blocks,
+                                                    num_threads, out_hash_blocks);
+    } else if (hash_algorithm == "sha256") {
+        return VerifyHashtreeBlocksWith<SHA256Hasher>(fd.get(), hashtree_desc, data_blocks,
+                                                      num_threads, out_hash_blocks);
+    } else if (hash_algorithm == "sha512") {
+        return VerifyHashtreeBlocksWith<SHA512Hasher>(fd.get(), hashtree_desc, data_blocks,
+                                                      num_threads, out_hash_blocks);
+    }
+    LERROR << "Unsupported hashtree algorithm: " << hash_algorithm;
+    return false;
+}
+
+}  // namespace fs_mgr
+}  // namespace android
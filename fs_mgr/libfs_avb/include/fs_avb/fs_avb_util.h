@@ -17,6 +17,7 @@
 #pragma once
 
 #include <string>
+#include <vector>
 
 #include <fs_avb/types.h>
 #include <fstab/fstab.h>
@@ -43,6 +44,17 @@ std::unique_ptr<VBMetaData> LoadAndVerifyVbmetaByPath(
 std::unique_ptr<FsAvbHashtreeDescriptor> GetHashtreeDescriptor(
         const std::string& avb_partition_name, VBMetaData&& vbmeta);
 
+// Verifies |data_blocks| of the image at |image_path| against the hashtree described by
+// |hashtree_desc|, without reading the rest of the image. Only the hash blocks on the path from
+// each data block up to the root digest are read and checked, so the cost is proportional to
+// the number of blocks rather than the image size. Data blocks are hashed by |num_threads|
+// threads, or one per CPU if zero. If |out_hash_blocks| is non-null, it is set to the number of
+// hash blocks that were checked.
+bool VerifyHashtreeBlocks(const std::string& image_path,
+                          const FsAvbHashtreeDescriptor& hashtree_desc,
+                          std::vector<uint64_t> data_blocks, unsigned int num_threads = 0,
+                          uint64_t* out_hash_blocks = nullptr);
+
 std::unique_ptr<FsAvbHashDescriptor> GetHashDescriptor(
         const std::string& partition_name, const std::vector<VBMetaData>& vbmeta_images);
 
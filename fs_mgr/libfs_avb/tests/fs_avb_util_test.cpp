@@ -14,6 +14,10 @@
  * limitations under the License.
  */
 
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <android-base/unique_fd.h>
 #include <fs_avb/fs_avb_util.h>
 
 #include "fs_avb_test_util.h"
@@ -119,4 +123,48 @@ TEST_F(PublicFsAvbUtilTest, GetHashtreeDescriptor_NotFound) {
     EXPECT_EQ(nullptr, hashtree_desc);
 }
 
+
+TEST_F(PublicFsAvbUtilTest, VerifyHashtreeBlocks) {
+    const size_t system_image_size = 10 * 1024 * 1024;
+    const size_t system_partition_size = 15 * 1024 * 1024;
+    base::FilePath system_path = GenerateImage("system.img", system_image_size);
+
+    AddAvbFooter(system_path, "hashtree", "system", system_partition_size, "SHA256_RSA4096", 20,
+                 data_dir_.Append("testkey_rsa4096.pem"), "d00df00d",
+                 "--hash_algorithm sha256 --internal_release_string \"unit test\"");
+
+    auto system_vbmeta = ExtractAndLoadVBMetaData(system_path, "system-vbmeta.img");
+    auto hashtree_desc =
+            GetHashtreeDescriptor("system" /* avb_partition_name */, std::move(system_vbmeta));
+    ASSERT_NE(nullptr, hashtree_desc);
+
+    // 2560 data blocks: 20 leaf hash blocks under a single top-level block.
+    const std::vector<uint64_t> blocks = {0, 1, 2, 3, 127, 128, 1000, 2559};
+    uint64_t hash_blocks = 0;
+    EXPECT_TRUE(VerifyHashtreeBlocks(system_path.value(), *hashtree_desc, blocks,
+                                     4 /* num_threads */, &hash_blocks));
+    EXPECT_EQ(5u, hash_blocks);
+
+    std::vector<uint64_t> all_blocks(system_image_size / 4096);
+    for (size_t i = 0; i < all_blocks.size(); i++) {
+        all_blocks[i] = i;
+    }
+    EXPECT_TRUE(VerifyHashtreeBlocks(system_path.value(), *hashtree_desc, all_blocks,
+                                     0 /* num_threads */, &hash_blocks));
+    EXPECT_EQ(21u, hash_blocks);
+
+    // Out of range.
+    EXPECT_FALSE(VerifyHashtreeBlocks(system_path.value(), *hashtree_desc, {2560}));
+
+    // Corrupts data block 1000; only requests that include it should fail.
+    {
+        android::base::unique_fd fd(open(system_path.value().c_str(), O_WRONLY | O_CLOEXEC));
+        ASSERT_GE(fd, 0);
+        ASSERT_EQ(1, pwrite(fd, "X", 1, 1000 * 4096 + 17));
+    }
+    EXPECT_TRUE(VerifyHashtreeBlocks(system_path.value(), *hashtree_desc, {0, 999, 1001, 2559}));
+    EXPECT_FALSE(VerifyHashtreeBlocks(system_path.value(), *hashtree_desc, {999, 1000}));
+    EXPECT_FALSE(VerifyHashtreeBlocks(system_path.value(), *hashtree_desc, all_blocks));
+}
+
 }  // namespace fs_avb_host_test
@@ -531,6 +531,8 @@ bool MergeWorker::Merge() {
         }
     }
 
+    snapuserd_->LogMergePipelineStats();
+
     // Replace and Zero ops
     if (!MergeReplaceZeroOps()) {
         SNAP_LOG(ERROR) << "Merge failed for replace/zero ops";
@@ -17,6 +17,8 @@
 #include <libsnapshot/cow_format.h>
 #include <pthread.h>
 
+#include <chrono>
+
 #include "read_worker.h"
 #include "snapuserd_core.h"
 #include "utility.h"
@@ -648,12 +650,23 @@ bool ReadWorker::ReadUnalignedSector(sector_t sector, size_t size) {
 }
 
 bool ReadWorker::RequestSectors(uint64_t sector, uint64_t len) {
+    auto begin = std::chrono::steady_clock::now();
+    bool ret;
+
     // Unaligned I/O request
     if (!IsBlockAligned(sector << SECTOR_SHIFT)) {
-        return ReadUnalignedSector(sector, len);
+        ret = ReadUnalignedSector(sector, len);
+    } else {
+        ret = ReadAlignedSector(sector, len);
     }
 
-    return ReadAlignedSector(sector, len);
+    // Let partition verification back off if it is slowing down the
+    // requests we serve.
+    snapuserd_->NotifyForegroundIoLatency(
+            sector, len,
+            std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() -
+                                                                  begin));
+    return ret;
 }
 
 bool ReadWorker::SendBufferedIo() {
@@ -67,7 +67,7 @@ bool SnapshotHandler::InitializeWorkers() {
     read_ahead_thread_ = std::make_unique<ReadAhead>(cow_device_, backing_store_device_, misc_name_,
                                                      GetSharedPtr());
 
-    update_verify_ = std::make_unique<UpdateVerify>(misc_name_);
+    update_verify_ = std::make_unique<UpdateVerify>(misc_name_, IsIouringSupported());
 
     return true;
 }
@@ -440,6 +440,11 @@ bool SnapshotHandler::CheckPartitionVerification() {
     return update_verify_->CheckPartitionVerification();
 }
 
+void SnapshotHandler::NotifyForegroundIoLatency(uint64_t sector, uint64_t size,
+                                                std::chrono::microseconds latency) {
+    update_verify_->NotifyForegroundIoLatency(sector, size, latency);
+}
+
 void SnapshotHandler::FreeResources() {
     worker_threads_.clear();
     read_ahead_thread_ = nullptr;
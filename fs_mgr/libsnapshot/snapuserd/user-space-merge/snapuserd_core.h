@@ -22,6 +22,7 @@
 #include <sys/time.h>
 #include <unistd.h>
 
+#include <chrono>
 #include <condition_variable>
 #include <cstring>
 #include <future>
@@ -100,6 +101,22 @@ struct MergeGroupState {
         : merge_state_(state), num_ios_in_progress(n_ios) {}
 };
 
+// Timing of the ordered-op pipeline. While the merge thread writes out RA
+// window N, the read-ahead thread reads and reconstructs window N+1 into its
+// temporary buffer; it then waits for the merge thread, copies the window into
+// the scratch space and flushes it. Each side is idle while it waits for the
+// other.
+struct MergePipelineStats {
+    uint64_t ra_windows = 0;
+    uint64_t ra_blocks = 0;
+    std::chrono::microseconds ra_read_time{0};
+    std::chrono::microseconds ra_idle_time{0};
+    std::chrono::microseconds ra_flush_time{0};
+    uint64_t merge_windows = 0;
+    std::chrono::microseconds merge_time{0};
+    std::chrono::microseconds merge_idle_time{0};
+};
+
 class SnapshotHandler : public std::enable_shared_from_this<SnapshotHandler> {
   public:
     SnapshotHandler(std::string misc_name, std::string cow_device, std::string backing_device,
@@ -183,8 +200,15 @@ class SnapshotHandler : public std::enable_shared_from_this<SnapshotHandler> {
     bool GetRABuffer(std::unique_lock<std::mutex>* lock, uint64_t block, void* buffer);
     MERGE_GROUP_STATE ProcessMergingBlock(uint64_t new_block, void* buffer);
 
+    // Read-ahead/merge pipeline statistics
+    void RecordReadAheadWindow(uint64_t num_blocks, std::chrono::microseconds read_time,
+                               std::chrono::microseconds flush_time);
+    void LogMergePipelineStats();
+
     bool IsIouringSupported();
     bool CheckPartitionVerification();
+    void NotifyForegroundIoLatency(uint64_t sector, uint64_t size,
+                                   std::chrono::microseconds latency);
 
   private:
     bool ReadMetadata();
@@ -225,6 +249,9 @@ class SnapshotHandler : public std::enable_shared_from_this<SnapshotHandler> {
     bool ra_thread_started_ = false;
     int total_ra_blocks_merged_ = 0;
     MERGE_IO_TRANSITION io_state_ = MERGE_IO_TRANSITION::INVALID;
+    MergePipelineStats pipeline_stats_;
+    std::chrono::steady_clock::time_point merge_window_begin_;
+    std::chrono::steady_clock::time_point merge_window_end_;
     std::unique_ptr<ReadAhead> read_ahead_thread_;
     std::unordered_map<uint64_t, void*> read_ahead_buffer_map_;
 
@@ -18,6 +18,8 @@
 
 #include <pthread.h>
 
+#include <chrono>
+
 #include "snapuserd_core.h"
 #include "utility.h"
 
@@ -659,6 +661,7 @@ bool ReadAhead::ReadAheadIOStart() {
 
     bool retry = false;
     bool ra_status;
+    auto read_begin = std::chrono::steady_clock::now();
 
     // Start Async read-ahead
     if (read_ahead_async_) {
@@ -688,6 +691,7 @@ bool ReadAhead::ReadAheadIOStart() {
     }
 
     SNAP_LOG(DEBUG) << "Read-ahead: total_ra_blocks_merged: " << total_ra_blocks_completed_;
+    auto read_end = std::chrono::steady_clock::now();
 
     // Wait for the merge to finish for the previous RA window. We shouldn't
     // be touching the scratch space until merge is complete of previous RA
@@ -697,6 +701,7 @@ bool ReadAhead::ReadAheadIOStart() {
         SNAP_LOG(ERROR) << "ReadAhead failed to wait for merge ready";
         return false;
     }
+    auto flush_begin = std::chrono::steady_clock::now();
 
     // Copy the data to scratch space
     memcpy(metadata_buffer_, ra_temp_meta_buffer_.get(), snapuserd_->GetBufferMetadataSize());
@@ -729,6 +734,15 @@ bool ReadAhead::ReadAheadIOStart() {
         return false;
     }
 
+    // The merge thread is idle while the window is being flushed.
+    if (total_blocks_merged_) {
+        snapuserd_->RecordReadAheadWindow(
+                total_blocks_merged_,
+                std::chrono::duration_cast<std::chrono::microseconds>(read_end - read_begin),
+                std::chrono::duration_cast<std::chrono::microseconds>(
+                        std::chrono::steady_clock::now() - flush_begin));
+    }
+
     return true;
 }
 
@@ -23,10 +23,12 @@
 #include <sys/types.h>
 #include <unistd.h>
 
+#include <atomic>
 #include <chrono>
 #include <iostream>
 #include <memory>
 #include <string_view>
+#include <thread>
 
 #include <android-base/file.h>
 #include <android-base/properties.h>
@@ -1454,6 +1456,91 @@ TEST_P(HandlerTestV3, Read) {
               0);
 }
 
+#if __ANDROID__
+class UpdateVerifyTest : public ::testing::TestWithParam<bool> {
+  protected:
+    void SetUp() override {
+        harness_ = std::make_unique<DmUserTestHarness>();
+        base_dev_ = harness_->CreateBackingDevice(16_MiB);
+        ASSERT_NE(base_dev_, nullptr);
+    }
+
+    std::unique_ptr<ITestHarness> harness_;
+    std::unique_ptr<IBackingDevice> base_dev_;
+};
+
+TEST_P(UpdateVerifyTest, VerifyPartition) {
+    UpdateVerify verify("system_b-snapshot", GetParam());
+    ASSERT_TRUE(verify.VerifyPartition("system", base_dev_->GetPath()));
+    ASSERT_TRUE(verify.CheckPartitionVerification());
+}
+
+TEST_P(UpdateVerifyTest, VerifyPartitionWithSlowForegroundIo) {
+    UpdateVerify verify("system_b-snapshot", GetParam());
+
+    // Slow requests for the last block of the device keep arriving while the
+    // partition is verified. They are ignored until verification starts, and
+    // are reported back to back from then on, so that one lands before the
+    // last read is issued however fast the device is.
+    const uint64_t last_sector = (16_MiB - 4_KiB) >> SECTOR_SHIFT;
+    std::atomic<bool> done = false;
+    std::thread notifier([&]() {
+        while (!done) {
+            verify.NotifyForegroundIoLatency(last_sector, 4_KiB, 50ms);
+            std::this_thread::yield();
+        }
+    });
+    bool ret = verify.VerifyPartition("system", base_dev_->GetPath());
+    done = true;
+    notifier.join();
+
+    ASSERT_TRUE(ret);
+    ASSERT_TRUE(verify.CheckPartitionVerification());
+
+    if (!GetParam()) {
+        // Only io_uring verification backs off.
+        return;
+    }
+    ASSERT_GE(verify.last_stats_.pauses, 1u);
+    ASSERT_GT(verify.last_stats_.backoff.count(), 0);
+    ASSERT_LE(verify.last_stats_.backoff, UpdateVerify::kMaxBackoff);
+}
+
+TEST_P(UpdateVerifyTest, IgnoresOwnReads) {
+    UpdateVerify verify("system_b-snapshot", GetParam());
+
+    // Notifications are dropped while no verification is in progress.
+    verify.NotifyForegroundIoLatency(0, 4_KiB, 50ms);
+    ASSERT_EQ(verify.backoff_until_, 0);
+
+    verify.verify_in_progress_ = true;
+    verify.verify_size_ = 16_MiB;
+    verify.inflight_reads_.assign(2, {0, 0});
+    verify.SetInflightRead(1, 2_MiB, 2_MiB);
+
+    // A request for the verifier's own read, or one of its blocks.
+    verify.NotifyForegroundIoLatency(2_MiB >> SECTOR_SHIFT, 2_MiB, 50ms);
+    verify.NotifyForegroundIoLatency((3_MiB + 4_KiB) >> SECTOR_SHIFT, 4_KiB, 50ms);
+    ASSERT_EQ(verify.backoff_until_, 0);
+
+    // Verity metadata beyond the verified data.
+    verify.NotifyForegroundIoLatency(16_MiB >> SECTOR_SHIFT, 4_KiB, 50ms);
+    ASSERT_EQ(verify.backoff_until_, 0);
+
+    // A fast request elsewhere.
+    verify.NotifyForegroundIoLatency(0, 4_KiB, 1ms);
+    ASSERT_EQ(verify.backoff_until_, 0);
+
+    // A slow request elsewhere, and one for a completed read.
+    verify.NotifyForegroundIoLatency(4_MiB >> SECTOR_SHIFT, 4_KiB, 50ms);
+    ASSERT_GT(verify.backoff_until_, 0);
+    verify.backoff_until_ = 0;
+    verify.SetInflightRead(1, 0, 0);
+    verify.NotifyForegroundIoLatency(2_MiB >> SECTOR_SHIFT, 4_KiB, 50ms);
+    ASSERT_GT(verify.backoff_until_, 0);
+}
+#endif
+
 std::vector<bool> GetIoUringConfigs() {
 #if __ANDROID__
     if (!android::base::GetBoolProperty("ro.virtual_ab.io_uring.enabled", false)) {
@@ -1519,6 +1606,9 @@ INSTANTIATE_TEST_SUITE_P(Io, SnapuserdVariableBlockSizeTest,
 INSTANTIATE_TEST_SUITE_P(Io, HandlerTestV3, ::testing::ValuesIn(GetVariableBlockTestConfigs()));
 INSTANTIATE_TEST_SUITE_P(Io, SnapuserdTest, ::testing::ValuesIn(GetTestConfigs()));
 INSTANTIATE_TEST_SUITE_P(Io, HandlerTest, ::testing::ValuesIn(GetTestConfigs()));
+#if __ANDROID__
+INSTANTIATE_TEST_SUITE_P(Io, UpdateVerifyTest, ::testing::ValuesIn(GetIoUringConfigs()));
+#endif
 
 }  // namespace snapshot
 }  // namespace android
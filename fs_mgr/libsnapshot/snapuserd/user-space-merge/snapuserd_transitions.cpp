@@ -214,6 +214,15 @@ bool SnapshotHandler::WaitForMergeBegin() {
         SNAP_LOG(ERROR) << "WaitForMergeBegin failed with state: " << io_state_;
         return false;
     }
+
+    // Time since the previous window was merged is spent waiting for the
+    // RA thread.
+    auto now = std::chrono::steady_clock::now();
+    if (pipeline_stats_.merge_windows) {
+        pipeline_stats_.merge_idle_time +=
+                std::chrono::duration_cast<std::chrono::microseconds>(now - merge_window_end_);
+    }
+    merge_window_begin_ = now;
     return true;
 }
 
@@ -264,6 +273,7 @@ bool SnapshotHandler::ReadAheadIOCompleted(bool sync) {
 // flush the data of Block N+1 to scratch space
 bool SnapshotHandler::WaitForMergeReady() {
     {
+        auto begin = std::chrono::steady_clock::now();
         std::unique_lock<std::mutex> lock(lock_);
         while (!(io_state_ == MERGE_IO_TRANSITION::MERGE_READY ||
                  io_state_ == MERGE_IO_TRANSITION::MERGE_FAILED ||
@@ -271,6 +281,8 @@ bool SnapshotHandler::WaitForMergeReady() {
                  io_state_ == MERGE_IO_TRANSITION::IO_TERMINATED)) {
             cv.wait(lock);
         }
+        pipeline_stats_.ra_idle_time += std::chrono::duration_cast<std::chrono::microseconds>(
+                std::chrono::steady_clock::now() - begin);
 
         // Check if merge failed
         if (io_state_ == MERGE_IO_TRANSITION::MERGE_FAILED ||
@@ -288,6 +300,15 @@ bool SnapshotHandler::WaitForMergeReady() {
 void SnapshotHandler::NotifyRAForMergeReady() {
     {
         std::lock_guard<std::mutex> lock(lock_);
+        // This is also invoked once before the first window is read.
+        if (merge_window_begin_ != std::chrono::steady_clock::time_point()) {
+            merge_window_end_ = std::chrono::steady_clock::now();
+            pipeline_stats_.merge_time += std::chrono::duration_cast<std::chrono::microseconds>(
+                    merge_window_end_ - merge_window_begin_);
+            pipeline_stats_.merge_windows += 1;
+            merge_window_begin_ = {};
+        }
+
         if (io_state_ != MERGE_IO_TRANSITION::IO_TERMINATED &&
             io_state_ != MERGE_IO_TRANSITION::READ_AHEAD_FAILURE) {
             io_state_ = MERGE_IO_TRANSITION::MERGE_READY;
@@ -386,6 +407,46 @@ void SnapshotHandler::WaitForRaThreadToStart() {
     }
 }
 
+// Invoked by RA thread after a window has been handed over to the merge
+// thread
+void SnapshotHandler::RecordReadAheadWindow(uint64_t num_blocks,
+                                            std::chrono::microseconds read_time,
+                                            std::chrono::microseconds flush_time) {
+    std::lock_guard<std::mutex> lock(lock_);
+    pipeline_stats_.ra_windows += 1;
+    pipeline_stats_.ra_blocks += num_blocks;
+    pipeline_stats_.ra_read_time += read_time;
+    pipeline_stats_.ra_flush_time += flush_time;
+}
+
+// Invoked by Merge thread once all the ordered ops are merged
+void SnapshotHandler::LogMergePipelineStats() {
+    MergePipelineStats stats;
+    {
+        std::lock_guard<std::mutex> lock(lock_);
+        stats = pipeline_stats_;
+    }
+
+    if (!stats.ra_windows) {
+        return;
+    }
+
+    auto ms = [](std::chrono::microseconds us) { return us.count() / 1000; };
+    uint64_t ra_mib_per_sec = 0;
+    if (stats.ra_read_time.count()) {
+        ra_mib_per_sec =
+                (stats.ra_blocks * BLOCK_SZ * 1000000) / stats.ra_read_time.count() / 1_MiB;
+    }
+
+    SNAP_LOG(INFO) << "Read-ahead windows: " << stats.ra_windows << " blocks: " << stats.ra_blocks
+                   << " read: " << ms(stats.ra_read_time) << " ms (" << ra_mib_per_sec
+                   << " MiB/s) flush: " << ms(stats.ra_flush_time)
+                   << " ms idle: " << ms(stats.ra_idle_time) << " ms";
+    SNAP_LOG(INFO) << "Merge windows: " << stats.merge_windows
+                   << " merge: " << ms(stats.merge_time)
+                   << " ms idle: " << ms(stats.merge_idle_time) << " ms";
+}
+
 void SnapshotHandler::MarkMergeComplete() {
     std::lock_guard<std::mutex> lock(lock_);
     merge_complete_ = true;
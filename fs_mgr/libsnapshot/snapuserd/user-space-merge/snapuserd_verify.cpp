@@ -16,9 +16,17 @@
 
 #include "snapuserd_verify.h"
 
+#include <stdio.h>
+
+#include <algorithm>
+#include <thread>
+
 #include <android-base/chrono_utils.h>
+#include <android-base/file.h>
+#include <android-base/properties.h>
 #include <android-base/scopeguard.h>
 #include <android-base/strings.h>
+#include <liburing.h>
 
 #include "snapuserd_core.h"
 
@@ -29,8 +37,31 @@ using namespace android;
 using namespace android::dm;
 using android::base::unique_fd;
 
-UpdateVerify::UpdateVerify(const std::string& misc_name)
-    : misc_name_(misc_name), state_(UpdateVerifyState::VERIFY_UNKNOWN) {}
+namespace {
+
+// Returns the "some avg10" value of a /proc/pressure file, or a negative
+// value if the kernel does not support PSI.
+double ReadPressureAvg10(const char* path) {
+    std::string contents;
+    if (!android::base::ReadFileToString(path, &contents)) {
+        return -1;
+    }
+    double avg10;
+    if (sscanf(contents.c_str(), "some avg10=%lf", &avg10) != 1) {
+        return -1;
+    }
+    return avg10;
+}
+
+}  // namespace
+
+UpdateVerify::UpdateVerify(const std::string& misc_name, bool use_iouring)
+    : misc_name_(misc_name), state_(UpdateVerifyState::VERIFY_UNKNOWN), use_iouring_(use_iouring) {
+    max_queue_depth_ = std::max(android::base::GetUintProperty<uint32_t>(
+                                        "ro.virtual_ab.verify_queue_depth", kDefaultQueueDepth,
+                                        kMaxQueueDepth),
+                                1u);
+}
 
 bool UpdateVerify::CheckPartitionVerification() {
     auto now = std::chrono::system_clock::now();
@@ -142,6 +173,232 @@ bool UpdateVerify::VerifyBlocks(const std::string& partition_name,
     return true;
 }
 
+bool UpdateVerify::VerifyBlocksThreaded(const std::string& partition_name,
+                                        const std::string& dm_block_device, uint64_t dev_sz) {
+    /*
+     * Not all partitions are of same size. Some partitions are as small as
+     * 100Mb. We can just finish them in a single thread. For bigger partitions
+     * such as product, 4 threads are sufficient enough.
+     */
+    int num_threads = kMinThreadsToVerify;
+    if (dev_sz > kThresholdSize) {
+        num_threads = kMaxThreadsToVerify;
+    }
+
+    std::vector<std::future<bool>> threads;
+    off_t start_offset = 0;
+    const int skip_blocks = num_threads;
+
+    while (num_threads) {
+        threads.emplace_back(std::async(std::launch::async, &UpdateVerify::VerifyBlocks, this,
+                                        partition_name, dm_block_device, start_offset, skip_blocks,
+                                        dev_sz));
+        start_offset += kBlockSizeVerify;
+        num_threads -= 1;
+        if (start_offset >= dev_sz) {
+            break;
+        }
+    }
+
+    bool ret = true;
+    for (auto& t : threads) {
+        ret = t.get() && ret;
+    }
+    return ret;
+}
+
+void UpdateVerify::NotifyForegroundIoLatency(uint64_t sector, uint64_t size,
+                                             std::chrono::microseconds latency) {
+    if (latency < kForegroundLatencyThreshold ||
+        !verify_in_progress_.load(std::memory_order_relaxed)) {
+        return;
+    }
+    uint64_t offset = sector << SECTOR_SHIFT;
+    if (offset >= verify_size_.load(std::memory_order_relaxed) || IsVerifyRead(offset, size)) {
+        return;
+    }
+    auto until = std::chrono::steady_clock::now() + kBackoffInterval;
+    backoff_until_.store(until.time_since_epoch().count(), std::memory_order_relaxed);
+}
+
+bool UpdateVerify::IsVerifyRead(uint64_t offset, uint64_t size) {
+    std::lock_guard<std::mutex> lock(inflight_lock_);
+    for (const auto& [read_offset, read_len] : inflight_reads_) {
+        if (offset < read_offset + read_len && read_offset < offset + size) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void UpdateVerify::SetInflightRead(size_t slot, uint64_t offset, uint64_t size) {
+    std::lock_guard<std::mutex> lock(inflight_lock_);
+    inflight_reads_[slot] = {offset, size};
+}
+
+void UpdateVerify::WaitForForegroundIo(VerifyStats* stats) {
+    using std::chrono::steady_clock;
+
+    auto until = steady_clock::time_point(
+            steady_clock::duration(backoff_until_.load(std::memory_order_relaxed)));
+    auto now = steady_clock::now();
+    if (until <= now || stats->backoff >= kMaxBackoff) {
+        return;
+    }
+
+    auto wait = std::min(std::chrono::ceil<std::chrono::milliseconds>(until - now),
+                         kMaxBackoff - stats->backoff);
+    std::this_thread::sleep_for(wait);
+    stats->backoff += wait;
+    stats->pauses += 1;
+}
+
+void UpdateVerify::AdjustForPressure(VerifyStats* stats) {
+    double pressure = ReadPressureAvg10("/proc/pressure/io");
+    if (pressure < 0) {
+        return;
+    }
+
+    uint32_t queue_depth = stats->queue_depth;
+    uint64_t block_size = stats->block_size;
+    if (pressure > kPressureHigh) {
+        queue_depth = std::max(queue_depth / 2, 1u);
+        block_size = std::max(block_size / 2, kMinBlockSizeVerify);
+    } else if (pressure < kPressureLow) {
+        queue_depth = std::min(queue_depth + 1, max_queue_depth_);
+        block_size = std::min(block_size * 2, kBlockSizeVerify);
+    }
+
+    if (queue_depth != stats->queue_depth || block_size != stats->block_size) {
+        SNAP_LOG(DEBUG) << "I/O pressure: " << pressure << " queue-depth: " << stats->queue_depth
+                        << " -> " << queue_depth << " block-size: " << stats->block_size << " -> "
+                        << block_size;
+        stats->queue_depth = queue_depth;
+        stats->block_size = block_size;
+        stats->pressure_adjustments += 1;
+    }
+}
+
+bool UpdateVerify::VerifyBlocksIouring(const std::string& partition_name,
+                                       const std::string& dm_block_device, int fd, uint64_t dev_sz,
+                                       VerifyStats* stats) {
+    struct ReadSlot {
+        std::unique_ptr<void, decltype(&::free)> buffer{nullptr, ::free};
+        uint64_t offset = 0;
+        size_t len = 0;
+    };
+
+    // Every slot can hold a read of the largest block size, so that the block
+    // size can change without reallocating buffers.
+    std::vector<ReadSlot> slots(max_queue_depth_);
+    std::vector<ReadSlot*> free_slots;
+    for (auto& slot : slots) {
+        void* addr;
+        if (posix_memalign(&addr, getpagesize(), kBlockSizeVerify) != 0) {
+            SNAP_LOG(ERROR) << "posix_memalign failed for read-size: " << kBlockSizeVerify;
+            return false;
+        }
+        slot.buffer.reset(addr);
+        free_slots.push_back(&slot);
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(inflight_lock_);
+        inflight_reads_.assign(slots.size(), {0, 0});
+    }
+    auto inflight_guard = android::base::make_scope_guard([this]() {
+        std::lock_guard<std::mutex> lock(inflight_lock_);
+        inflight_reads_.clear();
+    });
+
+    // Declared after the buffers so that the ring is torn down first.
+    struct io_uring ring;
+    int ret = io_uring_queue_init(max_queue_depth_, &ring, 0);
+    if (ret) {
+        SNAP_LOG(ERROR) << "io_uring_queue_init failed with ret: " << ret
+                        << ", falling back to synchronous verification";
+        return VerifyBlocksThreaded(partition_name, dm_block_device, dev_sz);
+    }
+    auto ring_guard = android::base::make_scope_guard([&ring]() { io_uring_queue_exit(&ring); });
+
+    stats->queue_depth = (dev_sz > kThresholdSize) ? max_queue_depth_ : 1;
+    stats->block_size = kBlockSizeVerify;
+
+    auto next_sample = std::chrono::steady_clock::now() + kPressureSampleInterval;
+    uint64_t offset = 0;
+    uint32_t inflight = 0;
+    bool failed = false;
+
+    while (inflight || (offset < dev_sz && !failed)) {
+        if (!failed) {
+            auto now = std::chrono::steady_clock::now();
+            if (now >= next_sample) {
+                AdjustForPressure(stats);
+                next_sample = now + kPressureSampleInterval;
+            }
+            WaitForForegroundIo(stats);
+        }
+
+        int queued = 0;
+        while (!failed && offset < dev_sz && inflight < stats->queue_depth) {
+            struct io_uring_sqe* sqe = io_uring_get_sqe(&ring);
+            if (!sqe) {
+                break;
+            }
+            ReadSlot* slot = free_slots.back();
+            free_slots.pop_back();
+            slot->offset = offset;
+            slot->len = std::min(dev_sz - offset, stats->block_size);
+            SetInflightRead(slot - slots.data(), slot->offset, slot->len);
+            io_uring_prep_read(sqe, fd, slot->buffer.get(), slot->len, slot->offset);
+            io_uring_sqe_set_data(sqe, slot);
+
+            offset += slot->len;
+            inflight += 1;
+            queued += 1;
+        }
+
+        if (queued) {
+            ret = io_uring_submit(&ring);
+            if (ret != queued) {
+                SNAP_LOG(ERROR) << "io_uring_submit failed for partition: " << partition_name
+                                << " io submit: " << ret << " expected: " << queued;
+                inflight -= static_cast<uint32_t>(queued - std::max(ret, 0));
+                failed = true;
+            }
+        }
+
+        if (!inflight) {
+            continue;
+        }
+
+        struct io_uring_cqe* cqe;
+        ret = io_uring_wait_cqe(&ring, &cqe);
+        if (ret) {
+            SNAP_LOG(ERROR) << "io_uring_wait_cqe failed: " << strerror(-ret);
+            return false;
+        }
+
+        // Reap everything that has completed, not just the first read.
+        do {
+            auto slot = reinterpret_cast<ReadSlot*>(io_uring_cqe_get_data(cqe));
+            if (cqe->res != static_cast<int>(slot->len)) {
+                SNAP_LOG(ERROR) << "Failed to read block from block device: " << dm_block_device
+                                << " partition-name: " << partition_name
+                                << " at offset: " << slot->offset << " read-size: " << slot->len
+                                << " res: " << cqe->res;
+                failed = true;
+            }
+            io_uring_cqe_seen(&ring, cqe);
+            SetInflightRead(slot - slots.data(), 0, 0);
+            free_slots.push_back(slot);
+            inflight -= 1;
+        } while (inflight && io_uring_peek_cqe(&ring, &cqe) == 0);
+    }
+
+    return !failed;
+}
+
 bool UpdateVerify::VerifyPartition(const std::string& partition_name,
                                    const std::string& dm_block_device) {
     android::base::Timer timer;
@@ -172,48 +429,38 @@ bool UpdateVerify::VerifyPartition(const std::string& partition_name,
         return false;
     }
 
-    /*
-     * Not all partitions are of same size. Some partitions are as small as
-     * 100Mb. We can just finish them in a single thread. For bigger partitions
-     * such as product, 4 threads are sufficient enough.
-     *
-     * TODO: With io_uring SQ_POLL support, we can completely cut this
-     * down to just single thread for all partitions and potentially verify all
-     * the partitions with zero syscalls. Additionally, since block layer
-     * supports polling, IO_POLL could be used which will further cut down
-     * latency.
-     */
-    int num_threads = kMinThreadsToVerify;
-    if (dev_sz > kThresholdSize) {
-        num_threads = kMaxThreadsToVerify;
-    }
-
-    std::vector<std::future<bool>> threads;
-    off_t start_offset = 0;
-    const int skip_blocks = num_threads;
-
-    while (num_threads) {
-        threads.emplace_back(std::async(std::launch::async, &UpdateVerify::VerifyBlocks, this,
-                                        partition_name, dm_block_device, start_offset, skip_blocks,
-                                        dev_sz));
-        start_offset += kBlockSizeVerify;
-        num_threads -= 1;
-        if (start_offset >= dev_sz) {
-            break;
-        }
-    }
+    verify_size_ = dev_sz;
+    verify_in_progress_ = true;
+    auto progress_guard = android::base::make_scope_guard([this]() {
+        verify_in_progress_ = false;
+        verify_size_ = 0;
+    });
 
-    bool ret = true;
-    for (auto& t : threads) {
-        ret = t.get() && ret;
+    VerifyStats stats;
+    bool ret;
+    if (use_iouring_) {
+        ret = VerifyBlocksIouring(partition_name, dm_block_device, fd.get(), dev_sz, &stats);
+    } else {
+        ret = VerifyBlocksThreaded(partition_name, dm_block_device, dev_sz);
     }
+    last_stats_ = stats;
 
     if (ret) {
         succeeded = true;
         UpdatePartitionVerificationState(UpdateVerifyState::VERIFY_SUCCESS);
+        auto duration_ms = std::max<int64_t>(timer.duration().count(), 1);
         SNAP_LOG(INFO) << "Partition: " << partition_name << " Block-device: " << dm_block_device
                        << " Size: " << dev_sz
-                       << " verification success. Duration : " << timer.duration().count() << " ms";
+                       << " verification success. Duration : " << duration_ms << " ms"
+                       << " Throughput: " << (dev_sz / 1_MiB) * 1000 / duration_ms << " MiB/s";
+        if (stats.queue_depth) {
+            SNAP_LOG(INFO) << "Partition: " << partition_name
+                           << " io_uring queue-depth: " << stats.queue_depth << "/"
+                           << max_queue_depth_ << " block-size: " << stats.block_size
+                           << " pressure-adjustments: " << stats.pressure_adjustments
+                           << " pauses: " << stats.pauses
+                           << " paused-for: " << stats.backoff.count() << " ms";
+        }
         return true;
     }
 
@@ -18,25 +18,47 @@
 #include <stdint.h>
 #include <sys/types.h>
 
+#include <atomic>
+#include <chrono>
 #include <condition_variable>
 #include <mutex>
 #include <string>
+#include <utility>
+#include <vector>
 
 #include <snapuserd/snapuserd_kernel.h>
 #include <storage_literals/storage_literals.h>
 
+#ifndef FRIEND_TEST
+#define FRIEND_TEST(test_set_name, individual_test) \
+    friend class test_set_name##_##individual_test##_Test
+#define DEFINED_FRIEND_TEST
+#endif
+
 namespace android {
 namespace snapshot {
 
 using namespace android::storage_literals;
+using namespace std::chrono_literals;
 
 class UpdateVerify {
   public:
-    UpdateVerify(const std::string& misc_name);
+    UpdateVerify(const std::string& misc_name, bool use_iouring = false);
     void VerifyUpdatePartition();
     bool CheckPartitionVerification();
 
+    // Called by the read workers with each request they served, in sectors
+    // and bytes, and the time it took. If foreground I/O is slow,
+    // verification stops submitting reads for a while so that it does not
+    // add to the latency. Requests for verification's own reads are ignored.
+    void NotifyForegroundIoLatency(uint64_t sector, uint64_t size,
+                                   std::chrono::microseconds latency);
+
   private:
+    FRIEND_TEST(UpdateVerifyTest, VerifyPartition);
+    FRIEND_TEST(UpdateVerifyTest, VerifyPartitionWithSlowForegroundIo);
+    FRIEND_TEST(UpdateVerifyTest, IgnoresOwnReads);
+
     enum class UpdateVerifyState {
         VERIFY_UNKNOWN,
         VERIFY_FAILED,
@@ -70,12 +92,81 @@ class UpdateVerify {
     uint64_t kThresholdSize = 750_MiB;
     uint64_t kBlockSizeVerify = 2_MiB;
 
+    /*
+     * With io_uring, a single thread keeps up to |queue_depth_| reads in
+     * flight. The queue depth and the read size are adjusted while the
+     * partition is scanned, based on the I/O pressure reported in
+     * /proc/pressure/io: both are halved when other tasks are stalled on
+     * I/O, and grow back towards the maximum when the device is idle.
+     *
+     * The maximum queue depth can be set with ro.virtual_ab.verify_queue_depth.
+     */
+    static constexpr uint32_t kDefaultQueueDepth = 4;
+    static constexpr uint32_t kMaxQueueDepth = 16;
+    static constexpr uint64_t kMinBlockSizeVerify = 256_KiB;
+    static constexpr std::chrono::milliseconds kPressureSampleInterval = 500ms;
+    static constexpr double kPressureLow = 10.0;
+    static constexpr double kPressureHigh = 40.0;
+
+    /*
+     * A read worker request that takes longer than |kForegroundLatencyThreshold|
+     * pauses submission for |kBackoffInterval|. The total pause is capped per
+     * partition so that update_verifier, which waits for the result, is not
+     * starved.
+     */
+    static constexpr std::chrono::microseconds kForegroundLatencyThreshold = 20ms;
+    static constexpr std::chrono::milliseconds kBackoffInterval = 200ms;
+    static constexpr std::chrono::milliseconds kMaxBackoff = 2s;
+
+    struct VerifyStats {
+        uint32_t queue_depth = 0;
+        uint64_t block_size = 0;
+        int pressure_adjustments = 0;
+        int pauses = 0;
+        std::chrono::milliseconds backoff{0};
+    };
+
+    bool use_iouring_;
+    uint32_t max_queue_depth_ = kDefaultQueueDepth;
+    std::atomic<bool> verify_in_progress_ = false;
+    // steady_clock time, in ticks, until which submission is paused.
+    std::atomic<std::chrono::steady_clock::rep> backoff_until_ = 0;
+
+    /*
+     * Verification reads the partition through dm-verity, which maps its data
+     * onto the dm-user device at the same offsets, so the read workers see
+     * verification's own reads as requests too. Those are told apart by the
+     * byte ranges of the reads in flight, indexed by io_uring slot. Requests
+     * beyond the verified size are for verity metadata, which both kinds of
+     * reads cause, and are ignored as well.
+     */
+    std::mutex inflight_lock_;
+    std::vector<std::pair<uint64_t, uint64_t>> inflight_reads_;  // offset, length
+    std::atomic<uint64_t> verify_size_ = 0;
+
+    // Stats of the last io_uring verification.
+    VerifyStats last_stats_;
+
     bool IsBlockAligned(uint64_t read_size) { return ((read_size & (BLOCK_SZ - 1)) == 0); }
-    void UpdatePartitionVerificationState(UpdateVerifyState state);
     bool VerifyPartition(const std::string& partition_name, const std::string& dm_block_device);
+    bool IsVerifyRead(uint64_t offset, uint64_t size);
+    void SetInflightRead(size_t slot, uint64_t offset, uint64_t size);
+    void UpdatePartitionVerificationState(UpdateVerifyState state);
     bool VerifyBlocks(const std::string& partition_name, const std::string& dm_block_device,
                       off_t offset, int skip_blocks, uint64_t dev_sz);
+    bool VerifyBlocksThreaded(const std::string& partition_name,
+                              const std::string& dm_block_device, uint64_t dev_sz);
+    bool VerifyBlocksIouring(const std::string& partition_name,
+                             const std::string& dm_block_device, int fd, uint64_t dev_sz,
+                             VerifyStats* stats);
+    void AdjustForPressure(VerifyStats* stats);
+    void WaitForForegroundIo(VerifyStats* stats);
 };
 
 }  // namespace snapshot
 }  // namespace android
+
+#ifdef DEFINED_FRIEND_TEST
+#undef DEFINED_FRIEND_TEST
+#undef FRIEND_TEST
+#endif
@@ -0,0 +1,194 @@
+//
+// Copyright (C) 2024 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#include <fcntl.h>
+
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <android-base/file.h>
+#include <android-base/logging.h>
+#include <android-base/unique_fd.h>
+#include <fs_avb/fs_avb_util.h>
+#include <gflags/gflags.h>
+#include <libsnapshot/cow_reader.h>
+
+DEFINE_string(image, "", "Partition image or block device, with the update applied");
+DEFINE_string(source_image, "",
+              "Partition image or block device before the update. If set, the blocks that the "
+              "COW copies or xors from are verified against its hashtree");
+DEFINE_string(partition_name, "", "AVB partition name, without the slot suffix");
+DEFINE_string(public_key, "",
+              "AVB public key that signs the partition's vbmeta, as written by avbtool "
+              "extract_public_key");
+DEFINE_uint32(threads, 0, "Number of hashing threads, or 0 for one per CPU");
+DEFINE_bool(silent, false, "Run silently");
+
+using android::base::unique_fd;
+using android::fs_mgr::FsAvbHashtreeDescriptor;
+using namespace android::snapshot;
+
+// Adds the data blocks of |desc| that overlap [offset, offset + length) to
+// |blocks|. Ranges in the hashtree and FEC areas past the data are skipped;
+// the hash blocks are checked on the way up to the root.
+static void AddDataBlocks(const FsAvbHashtreeDescriptor& desc, uint64_t offset, uint64_t length,
+                          std::vector<uint64_t>* blocks) {
+    const uint64_t data_block_size = desc.data_block_size;
+    const uint64_t num_data_blocks = desc.image_size / data_block_size;
+    uint64_t begin = offset / data_block_size;
+    uint64_t end = std::min((offset + length + data_block_size - 1) / data_block_size,
+                            num_data_blocks);
+    for (uint64_t block = begin; block < end; block++) {
+        blocks->emplace_back(block);
+    }
+}
+
+static void SortBlocks(std::vector<uint64_t>* blocks) {
+    std::sort(blocks->begin(), blocks->end());
+    blocks->erase(std::unique(blocks->begin(), blocks->end()), blocks->end());
+}
+
+// Collects the data blocks written by the ops in |cow_path|, in units of the
+// hashtree data block size of the updated image. If |source_desc| is set,
+// also collects the blocks of the source image that copy and xor ops read.
+static bool GetCowBlocks(const std::string& cow_path, const FsAvbHashtreeDescriptor& desc,
+                         const FsAvbHashtreeDescriptor* source_desc,
+                         std::vector<uint64_t>* blocks, std::vector<uint64_t>* source_blocks) {
+    unique_fd fd(open(cow_path.c_str(), O_RDONLY | O_CLOEXEC));
+    if (fd < 0) {
+        PLOG(ERROR) << "open failed: " << cow_path;
+        return false;
+    }
+
+    CowReader reader;
+    if (!reader.Parse(fd)) {
+        LOG(ERROR) << "could not parse " << cow_path;
+        return false;
+    }
+
+    const uint64_t cow_block_size = reader.GetHeader().block_size;
+    for (auto iter = reader.GetOpIter(); !iter->AtEnd(); iter->Next()) {
+        const CowOperation* op = iter->Get();
+        if (IsMetadataOp(*op)) {
+            continue;
+        }
+        uint64_t num_blocks = 1;
+        if (op->type() == kCowReplaceOp) {
+            num_blocks = CowOpCompressionSize(op, cow_block_size) / cow_block_size;
+        }
+        AddDataBlocks(desc, op->new_block * cow_block_size, num_blocks * cow_block_size, blocks);
+
+        uint64_t source_offset;
+        if (source_desc && reader.GetSourceOffset(op, &source_offset)) {
+            AddDataBlocks(*source_desc, source_offset, cow_block_size, source_blocks);
+        }
+    }
+    SortBlocks(blocks);
+    SortBlocks(source_blocks);
+    return true;
+}
+
+// Loads the hashtree descriptor from the vbmeta footer of |image|. The vbmeta
+// must be signed with |public_key|, so that the digests that the blocks are
+// checked against are authentic.
+static std::unique_ptr<FsAvbHashtreeDescriptor> LoadHashtreeDescriptor(
+        const std::string& image, const std::string& partition_name,
+        const std::string& public_key) {
+    android::fs_mgr::VBMetaVerifyResult verify_result;
+    auto vbmeta = android::fs_mgr::LoadAndVerifyVbmetaByPath(
+            image, partition_name, public_key, false /* allow_verification_error */,
+            false /* rollback_protection */, false /* is_chained_vbmeta */,
+            nullptr /* out_public_key_data */, nullptr /* out_verification_disabled */,
+            &verify_result);
+    if (!vbmeta || verify_result != android::fs_mgr::VBMetaVerifyResult::kSuccess) {
+        LOG(ERROR) << "could not load a vbmeta signed with the given key from " << image;
+        return nullptr;
+    }
+    auto desc = android::fs_mgr::GetHashtreeDescriptor(partition_name, std::move(*vbmeta));
+    if (!desc) {
+        LOG(ERROR) << "no hashtree descriptor for " << partition_name << " in " << image;
+    }
+    return desc;
+}
+
+static bool VerifyBlocks(const std::string& image, const FsAvbHashtreeDescriptor& desc,
+                         const std::vector<uint64_t>& blocks, const char* what) {
+    const uint64_t total_blocks = desc.image_size / desc.data_block_size;
+    auto start = std::chrono::steady_clock::now();
+    uint64_t hash_blocks = 0;
+    bool ok = android::fs_mgr::VerifyHashtreeBlocks(image, desc, blocks, FLAGS_threads,
+                                                    &hash_blocks);
+    auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(
+            std::chrono::steady_clock::now() - start);
+
+    if (!FLAGS_silent) {
+        std::cout << (ok ? "Verified " : "Failed to verify ") << blocks.size() << " " << what
+                  << " blocks (" << total_blocks << " in partition), " << hash_blocks
+                  << " hash blocks in " << elapsed.count() << " ms\n";
+    }
+    return ok;
+}
+
+// Verifies the blocks of a partition that an update wrote, instead of the
+// whole partition. They are checked against the hashtree of the updated
+// image, whose vbmeta must be signed with --public_key. With --source_image,
+// the blocks that the update reads from the old partition are also checked
+// against the old partition's hashtree.
+int main(int argc, char** argv) {
+    gflags::SetUsageMessage(
+            "verify_cow_hashtree --image=<img> --partition_name=<name> --public_key=<avbpubkey> "
+            "[--source_image=<img>] <cow>");
+    gflags::ParseCommandLineFlags(&argc, &argv, true);
+    if (argc < 2 || FLAGS_image.empty() || FLAGS_partition_name.empty() ||
+        FLAGS_public_key.empty()) {
+        gflags::ShowUsageWithFlags(argv[0]);
+        return 1;
+    }
+
+    std::string public_key;
+    if (!android::base::ReadFileToString(FLAGS_public_key, &public_key) || public_key.empty()) {
+        PLOG(ERROR) << "could not read public key " << FLAGS_public_key;
+        return 1;
+    }
+
+    auto desc = LoadHashtreeDescriptor(FLAGS_image, FLAGS_partition_name, public_key);
+    if (!desc) {
+        return 1;
+    }
+    std::unique_ptr<FsAvbHashtreeDescriptor> source_desc;
+    if (!FLAGS_source_image.empty()) {
+        source_desc = LoadHashtreeDescriptor(FLAGS_source_image, FLAGS_partition_name, public_key);
+        if (!source_desc) {
+            return 1;
+        }
+    }
+
+    std::vector<uint64_t> blocks;
+    std::vector<uint64_t> source_blocks;
+    if (!GetCowBlocks(argv[1], *desc, source_desc.get(), &blocks, &source_blocks)) {
+        return 1;
+    }
+
+    bool ok = true;
+    if (source_desc) {
+        ok = VerifyBlocks(FLAGS_source_image, *source_desc, source_blocks, "source");
+    }
+    ok = VerifyBlocks(FLAGS_image, *desc, blocks, "changed") && ok;
+    return ok ? 0 : 1;
+}
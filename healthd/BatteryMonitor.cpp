@@ -44,6 +44,8 @@
 #include <utils/String8.h>
 #include <utils/Vector.h>
 
+#include "SysfsReader.h"
+
 #define POWER_SUPPLY_SUBSYSTEM "power_supply"
 #define POWER_SUPPLY_SYSFS_PATH "/sys/class/" POWER_SUPPLY_SUBSYSTEM
 #define FAKE_BATTERY_CAPACITY 42
@@ -134,13 +136,17 @@ static void initHealthInfo(HealthInfo* health_info) {
     };
 }
 
-BatteryMonitor::BatteryMonitor()
+BatteryMonitor::BatteryMonitor() : BatteryMonitor(POWER_SUPPLY_SYSFS_PATH) {}
+
+BatteryMonitor::BatteryMonitor(const char* powerSupplyPath)
     : mHealthdConfig(nullptr),
       mBatteryDevicePresent(false),
       mBatteryFixedCapacity(0),
       mBatteryFixedTemperature(0),
       mBatteryHealthStatus(BatteryMonitor::BH_UNKNOWN),
-      mHealthInfo(std::make_unique<HealthInfo>()) {
+      mHealthInfo(std::make_unique<HealthInfo>()),
+      mPowerSupplyPath(powerSupplyPath),
+      mSysfsReader(std::make_unique<SysfsReader>()) {
     initHealthInfo(mHealthInfo.get());
 }
 
@@ -285,19 +291,16 @@ BatteryChargingState getBatteryChargingState(const char* chargingState) {
     return *ret;
 }
 
-static int readFromFile(const String8& path, std::string* buf) {
-    buf->clear();
-    if (android::base::ReadFileToString(path.c_str(), buf)) {
-        *buf = android::base::Trim(*buf);
-    }
-    return buf->length();
+// Returns the trimmed length of the attribute, or -1 if it can't be read.
+int BatteryMonitor::readFromFile(const String8& path, std::string* buf) {
+    return mSysfsReader->read(path.c_str(), buf);
 }
 
 static bool writeToFile(const String8& path, int32_t in_value) {
     return android::base::WriteStringToFile(std::to_string(in_value), path.c_str());
 }
 
-static BatteryMonitor::PowerSupplyType readPowerSupplyType(const String8& path) {
+BatteryMonitor::PowerSupplyType BatteryMonitor::readPowerSupplyType(const String8& path) {
     static SysfsStringEnumMap<int> supplyTypeMap[] = {
             {"Unknown", BatteryMonitor::ANDROID_POWER_SUPPLY_TYPE_UNKNOWN},
             {"Battery", BatteryMonitor::ANDROID_POWER_SUPPLY_TYPE_BATTERY},
@@ -331,7 +334,7 @@ static BatteryMonitor::PowerSupplyType readPowerSupplyType(const String8& path)
     return static_cast<BatteryMonitor::PowerSupplyType>(*ret);
 }
 
-static bool getBooleanField(const String8& path) {
+bool BatteryMonitor::getBooleanField(const String8& path) {
     std::string buf;
     bool value = false;
 
@@ -342,21 +345,24 @@ static bool getBooleanField(const String8& path) {
     return value;
 }
 
-static int getIntField(const String8& path) {
+int BatteryMonitor::getIntField(const String8& path, int defaultValue) {
     std::string buf;
     int value = 0;
 
-    if (readFromFile(path, &buf) > 0)
+    int len = readFromFile(path, &buf);
+    if (len < 0)
+        return defaultValue;
+    if (len > 0)
         android::base::ParseInt(buf, &value);
 
     return value;
 }
 
-static bool isScopedPowerSupply(const char* name) {
+bool BatteryMonitor::isScopedPowerSupply(const char* name) {
     constexpr char kScopeDevice[] = "Device";
 
     String8 path;
-    path.appendFormat("%s/%s/scope", POWER_SUPPLY_SYSFS_PATH, name);
+    path.appendFormat("%s/%s/scope", mPowerSupplyPath.c_str(), name);
     std::string scope;
     return (readFromFile(path, &scope) > 0 && scope == kScopeDevice);
 }
@@ -446,9 +452,9 @@ void BatteryMonitor::updateValues(void) {
     double MaxPower = 0;
 
     // Rescan for the available charger types
-    std::unique_ptr<DIR, decltype(&closedir)> dir(opendir(POWER_SUPPLY_SYSFS_PATH), closedir);
+    std::unique_ptr<DIR, decltype(&closedir)> dir(opendir(mPowerSupplyPath.c_str()), closedir);
     if (dir == NULL) {
-        KLOG_ERROR(LOG_TAG, "Could not open %s\n", POWER_SUPPLY_SYSFS_PATH);
+        KLOG_ERROR(LOG_TAG, "Could not open %s\n", mPowerSupplyPath.c_str());
     } else {
         struct dirent* entry;
         String8 path;
@@ -463,14 +469,14 @@ void BatteryMonitor::updateValues(void) {
 
             // Look for "type" file in each subdirectory
             path.clear();
-            path.appendFormat("%s/%s/type", POWER_SUPPLY_SYSFS_PATH, name);
+            path.appendFormat("%s/%s/type", mPowerSupplyPath.c_str(), name);
             switch(readPowerSupplyType(path)) {
             case ANDROID_POWER_SUPPLY_TYPE_AC:
             case ANDROID_POWER_SUPPLY_TYPE_USB:
             case ANDROID_POWER_SUPPLY_TYPE_WIRELESS:
             case ANDROID_POWER_SUPPLY_TYPE_DOCK:
                 path.clear();
-                path.appendFormat("%s/%s/online", POWER_SUPPLY_SYSFS_PATH, name);
+                path.appendFormat("%s/%s/online", mPowerSupplyPath.c_str(), name);
                 if (access(path.c_str(), R_OK) == 0)
                     mChargerNames.add(String8(name));
                 break;
@@ -480,10 +486,10 @@ void BatteryMonitor::updateValues(void) {
 
             // Look for "is_dock" file
             path.clear();
-            path.appendFormat("%s/%s/is_dock", POWER_SUPPLY_SYSFS_PATH, name);
+            path.appendFormat("%s/%s/is_dock", mPowerSupplyPath.c_str(), name);
             if (access(path.c_str(), R_OK) == 0) {
                 path.clear();
-                path.appendFormat("%s/%s/online", POWER_SUPPLY_SYSFS_PATH, name);
+                path.appendFormat("%s/%s/online", mPowerSupplyPath.c_str(), name);
                 if (access(path.c_str(), R_OK) == 0)
                     mChargerNames.add(String8(name));
 
@@ -493,10 +499,10 @@ void BatteryMonitor::updateValues(void) {
 
     for (size_t i = 0; i < mChargerNames.size(); i++) {
         String8 path;
-        path.appendFormat("%s/%s/online", POWER_SUPPLY_SYSFS_PATH, mChargerNames[i].c_str());
+        path.appendFormat("%s/%s/online", mPowerSupplyPath.c_str(), mChargerNames[i].c_str());
         if (getIntField(path)) {
             path.clear();
-            path.appendFormat("%s/%s/type", POWER_SUPPLY_SYSFS_PATH, mChargerNames[i].c_str());
+            path.appendFormat("%s/%s/type", mPowerSupplyPath.c_str(), mChargerNames[i].c_str());
             switch(readPowerSupplyType(path)) {
             case ANDROID_POWER_SUPPLY_TYPE_AC:
                 mHealthInfo->chargerAcOnline = true;
@@ -512,7 +518,7 @@ void BatteryMonitor::updateValues(void) {
                 break;
             default:
                 path.clear();
-                path.appendFormat("%s/%s/is_dock", POWER_SUPPLY_SYSFS_PATH,
+                path.appendFormat("%s/%s/is_dock", mPowerSupplyPath.c_str(),
                                   mChargerNames[i].c_str());
                 if (access(path.c_str(), R_OK) == 0)
                     mHealthInfo->chargerDockOnline = true;
@@ -521,16 +527,15 @@ void BatteryMonitor::updateValues(void) {
                                  mChargerNames[i].c_str());
             }
             path.clear();
-            path.appendFormat("%s/%s/current_max", POWER_SUPPLY_SYSFS_PATH,
+            path.appendFormat("%s/%s/current_max", mPowerSupplyPath.c_str(),
                               mChargerNames[i].c_str());
-            int ChargingCurrent = (access(path.c_str(), R_OK) == 0) ? getIntField(path) : 0;
+            int ChargingCurrent = getIntField(path, 0);
 
             path.clear();
-            path.appendFormat("%s/%s/voltage_max", POWER_SUPPLY_SYSFS_PATH,
+            path.appendFormat("%s/%s/voltage_max", mPowerSupplyPath.c_str(),
                               mChargerNames[i].c_str());
 
-            int ChargingVoltage =
-                    (access(path.c_str(), R_OK) == 0) ? getIntField(path) : DEFAULT_VBUS_VOLTAGE;
+            int ChargingVoltage = getIntField(path, DEFAULT_VBUS_VOLTAGE);
 
             double power = ((double)ChargingCurrent / MILLION) *
                            ((double)ChargingVoltage / MILLION);
@@ -805,9 +810,9 @@ void BatteryMonitor::init(struct healthd_config *hc) {
     char pval[PROPERTY_VALUE_MAX];
 
     mHealthdConfig = hc;
-    std::unique_ptr<DIR, decltype(&closedir)> dir(opendir(POWER_SUPPLY_SYSFS_PATH), closedir);
+    std::unique_ptr<DIR, decltype(&closedir)> dir(opendir(mPowerSupplyPath.c_str()), closedir);
     if (dir == NULL) {
-        KLOG_ERROR(LOG_TAG, "Could not open %s\n", POWER_SUPPLY_SYSFS_PATH);
+        KLOG_ERROR(LOG_TAG, "Could not open %s\n", mPowerSupplyPath.c_str());
     } else {
         struct dirent* entry;
 
@@ -825,14 +830,14 @@ void BatteryMonitor::init(struct healthd_config *hc) {
 
             // Look for "type" file in each subdirectory
             path.clear();
-            path.appendFormat("%s/%s/type", POWER_SUPPLY_SYSFS_PATH, name);
+            path.appendFormat("%s/%s/type", mPowerSupplyPath.c_str(), name);
             switch(readPowerSupplyType(path)) {
             case ANDROID_POWER_SUPPLY_TYPE_AC:
             case ANDROID_POWER_SUPPLY_TYPE_USB:
             case ANDROID_POWER_SUPPLY_TYPE_WIRELESS:
             case ANDROID_POWER_SUPPLY_TYPE_DOCK:
                 path.clear();
-                path.appendFormat("%s/%s/online", POWER_SUPPLY_SYSFS_PATH, name);
+                path.appendFormat("%s/%s/online", mPowerSupplyPath.c_str(), name);
                 if (access(path.c_str(), R_OK) == 0) mChargerNames.add(String8(name));
                 break;
 
@@ -846,28 +851,28 @@ void BatteryMonitor::init(struct healthd_config *hc) {
 
                 if (mHealthdConfig->batteryStatusPath.empty()) {
                     path.clear();
-                    path.appendFormat("%s/%s/status", POWER_SUPPLY_SYSFS_PATH,
+                    path.appendFormat("%s/%s/status", mPowerSupplyPath.c_str(),
                                       name);
                     if (access(path.c_str(), R_OK) == 0) mHealthdConfig->batteryStatusPath = path;
                 }
 
                 if (mHealthdConfig->batteryHealthPath.empty()) {
                     path.clear();
-                    path.appendFormat("%s/%s/health", POWER_SUPPLY_SYSFS_PATH,
+                    path.appendFormat("%s/%s/health", mPowerSupplyPath.c_str(),
                                       name);
                     if (access(path.c_str(), R_OK) == 0) mHealthdConfig->batteryHealthPath = path;
                 }
 
                 if (mHealthdConfig->batteryPresentPath.empty()) {
                     path.clear();
-                    path.appendFormat("%s/%s/present", POWER_SUPPLY_SYSFS_PATH,
+                    path.appendFormat("%s/%s/present", mPowerSupplyPath.c_str(),
                                       name);
                     if (access(path.c_str(), R_OK) == 0) mHealthdConfig->batteryPresentPath = path;
                 }
 
                 if (mHealthdConfig->batteryCapacityPath.empty()) {
                     path.clear();
-                    path.appendFormat("%s/%s/capacity", POWER_SUPPLY_SYSFS_PATH,
+                    path.appendFormat("%s/%s/capacity", mPowerSupplyPath.c_str(),
                                       name);
                     if (access(path.c_str(), R_OK) == 0) mHealthdConfig->batteryCapacityPath = path;
                 }
@@ -875,7 +880,7 @@ void BatteryMonitor::init(struct healthd_config *hc) {
                 if (mHealthdConfig->batteryVoltagePath.empty()) {
                     path.clear();
                     path.appendFormat("%s/%s/voltage_now",
-                                      POWER_SUPPLY_SYSFS_PATH, name);
+                                      mPowerSupplyPath.c_str(), name);
                     if (access(path.c_str(), R_OK) == 0) {
                         mHealthdConfig->batteryVoltagePath = path;
                     }
@@ -884,7 +889,7 @@ void BatteryMonitor::init(struct healthd_config *hc) {
                 if (mHealthdConfig->batteryFullChargePath.empty()) {
                     path.clear();
                     path.appendFormat("%s/%s/charge_full",
-                                      POWER_SUPPLY_SYSFS_PATH, name);
+                                      mPowerSupplyPath.c_str(), name);
                     if (access(path.c_str(), R_OK) == 0)
                         mHealthdConfig->batteryFullChargePath = path;
                 }
@@ -892,7 +897,7 @@ void BatteryMonitor::init(struct healthd_config *hc) {
                 if (mHealthdConfig->batteryCurrentNowPath.empty()) {
                     path.clear();
                     path.appendFormat("%s/%s/current_now",
-                                      POWER_SUPPLY_SYSFS_PATH, name);
+                                      mPowerSupplyPath.c_str(), name);
                     if (access(path.c_str(), R_OK) == 0)
                         mHealthdConfig->batteryCurrentNowPath = path;
                 }
@@ -900,14 +905,14 @@ void BatteryMonitor::init(struct healthd_config *hc) {
                 if (mHealthdConfig->batteryCycleCountPath.empty()) {
                     path.clear();
                     path.appendFormat("%s/%s/cycle_count",
-                                      POWER_SUPPLY_SYSFS_PATH, name);
+                                      mPowerSupplyPath.c_str(), name);
                     if (access(path.c_str(), R_OK) == 0)
                         mHealthdConfig->batteryCycleCountPath = path;
                 }
 
                 if (mHealthdConfig->batteryCapacityLevelPath.empty()) {
                     path.clear();
-                    path.appendFormat("%s/%s/capacity_level", POWER_SUPPLY_SYSFS_PATH, name);
+                    path.appendFormat("%s/%s/capacity_level", mPowerSupplyPath.c_str(), name);
                     if (access(path.c_str(), R_OK) == 0) {
                         mHealthdConfig->batteryCapacityLevelPath = path;
                     }
@@ -915,14 +920,14 @@ void BatteryMonitor::init(struct healthd_config *hc) {
 
                 if (mHealthdConfig->batteryChargeTimeToFullNowPath.empty()) {
                     path.clear();
-                    path.appendFormat("%s/%s/time_to_full_now", POWER_SUPPLY_SYSFS_PATH, name);
+                    path.appendFormat("%s/%s/time_to_full_now", mPowerSupplyPath.c_str(), name);
                     if (access(path.c_str(), R_OK) == 0)
                         mHealthdConfig->batteryChargeTimeToFullNowPath = path;
                 }
 
                 if (mHealthdConfig->batteryFullChargeDesignCapacityUahPath.empty()) {
                     path.clear();
-                    path.appendFormat("%s/%s/charge_full_design", POWER_SUPPLY_SYSFS_PATH, name);
+                    path.appendFormat("%s/%s/charge_full_design", mPowerSupplyPath.c_str(), name);
                     if (access(path.c_str(), R_OK) == 0)
                         mHealthdConfig->batteryFullChargeDesignCapacityUahPath = path;
                 }
@@ -930,7 +935,7 @@ void BatteryMonitor::init(struct healthd_config *hc) {
                 if (mHealthdConfig->batteryCurrentAvgPath.empty()) {
                     path.clear();
                     path.appendFormat("%s/%s/current_avg",
-                                      POWER_SUPPLY_SYSFS_PATH, name);
+                                      mPowerSupplyPath.c_str(), name);
                     if (access(path.c_str(), R_OK) == 0)
                         mHealthdConfig->batteryCurrentAvgPath = path;
                 }
@@ -938,14 +943,14 @@ void BatteryMonitor::init(struct healthd_config *hc) {
                 if (mHealthdConfig->batteryChargeCounterPath.empty()) {
                     path.clear();
                     path.appendFormat("%s/%s/charge_counter",
-                                      POWER_SUPPLY_SYSFS_PATH, name);
+                                      mPowerSupplyPath.c_str(), name);
                     if (access(path.c_str(), R_OK) == 0)
                         mHealthdConfig->batteryChargeCounterPath = path;
                 }
 
                 if (mHealthdConfig->batteryTemperaturePath.empty()) {
                     path.clear();
-                    path.appendFormat("%s/%s/temp", POWER_SUPPLY_SYSFS_PATH,
+                    path.appendFormat("%s/%s/temp", mPowerSupplyPath.c_str(),
                                       name);
                     if (access(path.c_str(), R_OK) == 0) {
                         mHealthdConfig->batteryTemperaturePath = path;
@@ -955,19 +960,19 @@ void BatteryMonitor::init(struct healthd_config *hc) {
                 if (mHealthdConfig->batteryTechnologyPath.empty()) {
                     path.clear();
                     path.appendFormat("%s/%s/technology",
-                                      POWER_SUPPLY_SYSFS_PATH, name);
+                                      mPowerSupplyPath.c_str(), name);
                     if (access(path.c_str(), R_OK) == 0)
                         mHealthdConfig->batteryTechnologyPath = path;
                 }
 
                 if (mHealthdConfig->batteryStateOfHealthPath.empty()) {
                     path.clear();
-                    path.appendFormat("%s/%s/state_of_health", POWER_SUPPLY_SYSFS_PATH, name);
+                    path.appendFormat("%s/%s/state_of_health", mPowerSupplyPath.c_str(), name);
                     if (access(path.c_str(), R_OK) == 0) {
                         mHealthdConfig->batteryStateOfHealthPath = path;
                     } else {
                         path.clear();
-                        path.appendFormat("%s/%s/health_index", POWER_SUPPLY_SYSFS_PATH, name);
+                        path.appendFormat("%s/%s/health_index", mPowerSupplyPath.c_str(), name);
                         if (access(path.c_str(), R_OK) == 0)
                             mHealthdConfig->batteryStateOfHealthPath = path;
                     }
@@ -975,7 +980,7 @@ void BatteryMonitor::init(struct healthd_config *hc) {
 
                 if (mHealthdConfig->batteryHealthStatusPath.empty()) {
                     path.clear();
-                    path.appendFormat("%s/%s/health_status", POWER_SUPPLY_SYSFS_PATH, name);
+                    path.appendFormat("%s/%s/health_status", mPowerSupplyPath.c_str(), name);
                     if (access(path.c_str(), R_OK) == 0) {
                         mHealthdConfig->batteryHealthStatusPath = path;
                     }
@@ -983,14 +988,14 @@ void BatteryMonitor::init(struct healthd_config *hc) {
 
                 if (mHealthdConfig->batteryManufacturingDatePath.empty()) {
                     path.clear();
-                    path.appendFormat("%s/%s/manufacturing_date", POWER_SUPPLY_SYSFS_PATH, name);
+                    path.appendFormat("%s/%s/manufacturing_date", mPowerSupplyPath.c_str(), name);
                     if (access(path.c_str(), R_OK) == 0)
                         mHealthdConfig->batteryManufacturingDatePath = path;
                 }
 
                 if (mHealthdConfig->batteryFirstUsageDatePath.empty()) {
                     path.clear();
-                    path.appendFormat("%s/%s/first_usage_date", POWER_SUPPLY_SYSFS_PATH, name);
+                    path.appendFormat("%s/%s/first_usage_date", mPowerSupplyPath.c_str(), name);
                     if (access(path.c_str(), R_OK) == 0) {
                         mHealthdConfig->batteryFirstUsageDatePath = path;
                     }
@@ -998,13 +1003,13 @@ void BatteryMonitor::init(struct healthd_config *hc) {
 
                 if (mHealthdConfig->chargingStatePath.empty()) {
                     path.clear();
-                    path.appendFormat("%s/%s/charging_state", POWER_SUPPLY_SYSFS_PATH, name);
+                    path.appendFormat("%s/%s/charging_state", mPowerSupplyPath.c_str(), name);
                     if (access(path.c_str(), R_OK) == 0) mHealthdConfig->chargingStatePath = path;
                 }
 
                 if (mHealthdConfig->chargingPolicyPath.empty()) {
                     path.clear();
-                    path.appendFormat("%s/%s/charging_policy", POWER_SUPPLY_SYSFS_PATH, name);
+                    path.appendFormat("%s/%s/charging_policy", mPowerSupplyPath.c_str(), name);
                     if (access(path.c_str(), R_OK) == 0) mHealthdConfig->chargingPolicyPath = path;
                 }
 
@@ -1016,10 +1021,10 @@ void BatteryMonitor::init(struct healthd_config *hc) {
 
             // Look for "is_dock" file
             path.clear();
-            path.appendFormat("%s/%s/is_dock", POWER_SUPPLY_SYSFS_PATH, name);
+            path.appendFormat("%s/%s/is_dock", mPowerSupplyPath.c_str(), name);
             if (access(path.c_str(), R_OK) == 0) {
                 path.clear();
-                path.appendFormat("%s/%s/online", POWER_SUPPLY_SYSFS_PATH, name);
+                path.appendFormat("%s/%s/online", mPowerSupplyPath.c_str(), name);
                 if (access(path.c_str(), R_OK) == 0) mChargerNames.add(String8(name));
             }
         }
@@ -0,0 +1,96 @@
+/*
+ * Copyright (C) 2023 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <unistd.h>
+
+#include <filesystem>
+#include <string>
+#include <vector>
+
+#include <android-base/file.h>
+#include <android-base/strings.h>
+#include <benchmark/benchmark.h>
+#include <healthd/BatteryMonitor.h>
+
+#include "SysfsReader.h"
+
+using android::BatteryMonitor;
+using android::SysfsReader;
+using android::base::GetExecutableDirectory;
+
+// Runs against testdata/power_supply, or the device's power supplies when
+// the test data is not installed next to the benchmark.
+static std::string powerSupplyPath() {
+    std::string path = GetExecutableDirectory() + "/power_supply";
+    if (access(path.c_str(), R_OK) == 0) return path;
+    return "/sys/class/power_supply";
+}
+
+static std::vector<std::string> listAttributes(const std::string& root) {
+    std::vector<std::string> attrs;
+    std::error_code ec;
+    for (const auto& entry : std::filesystem::recursive_directory_iterator(root, ec)) {
+        if (entry.is_regular_file(ec) && access(entry.path().c_str(), R_OK) == 0) {
+            attrs.push_back(entry.path());
+        }
+        if (attrs.size() == 64) break;
+    }
+    return attrs;
+}
+
+static void BM_updateValues(benchmark::State& state) {
+    healthd_config config = {};
+    BatteryMonitor monitor(powerSupplyPath().c_str());
+    monitor.init(&config);
+
+    for (auto _ : state) {
+        monitor.updateValues();
+    }
+}
+BENCHMARK(BM_updateValues);
+
+// One pass over the attributes through cached descriptors.
+static void BM_SysfsReader(benchmark::State& state) {
+    std::vector<std::string> attrs = listAttributes(powerSupplyPath());
+    SysfsReader reader;
+    std::string buf;
+
+    for (auto _ : state) {
+        for (const auto& attr : attrs) {
+            reader.read(attr.c_str(), &buf);
+        }
+    }
+    state.SetItemsProcessed(state.iterations() * attrs.size());
+}
+BENCHMARK(BM_SysfsReader);
+
+// The same pass with an open()/read()/close() per attribute, as before.
+static void BM_ReadFileToString(benchmark::State& state) {
+    std::vector<std::string> attrs = listAttributes(powerSupplyPath());
+    std::string buf;
+
+    for (auto _ : state) {
+        for (const auto& attr : attrs) {
+            if (android::base::ReadFileToString(attr, &buf)) {
+                buf = android::base::Trim(buf);
+            }
+        }
+    }
+    state.SetItemsProcessed(state.iterations() * attrs.size());
+}
+BENCHMARK(BM_ReadFileToString);
+
+BENCHMARK_MAIN();
@@ -0,0 +1,146 @@
+/*
+ * Copyright (C) 2023 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <filesystem>
+#include <string>
+
+#include <aidl/android/hardware/health/HealthInfo.h>
+#include <android-base/file.h>
+#include <gtest/gtest.h>
+#include <healthd/BatteryMonitor.h>
+
+#include "SysfsReader.h"
+
+using aidl::android::hardware::health::BatteryCapacityLevel;
+using aidl::android::hardware::health::BatteryHealth;
+using aidl::android::hardware::health::BatteryStatus;
+using android::BatteryMonitor;
+using android::SysfsReader;
+using android::base::GetExecutableDirectory;
+using android::base::WriteStringToFile;
+
+namespace {
+
+// Copies testdata/power_supply into a temporary directory, so tests can
+// change attribute values.
+class FakePowerSupplyTest : public ::testing::Test {
+  protected:
+    void SetUp() override {
+        std::error_code ec;
+        std::filesystem::copy(GetExecutableDirectory() + "/power_supply", dir_.path,
+                              std::filesystem::copy_options::recursive, ec);
+        ASSERT_FALSE(ec) << "Failed to copy test data: " << ec.message();
+    }
+
+    std::string attr(const std::string& supply, const std::string& name) {
+        return std::string(dir_.path) + "/" + supply + "/" + name;
+    }
+
+    void setAttr(const std::string& supply, const std::string& name, const std::string& value) {
+        ASSERT_TRUE(WriteStringToFile(value + "\n", attr(supply, name)));
+    }
+
+    TemporaryDir dir_;
+};
+
+}  // namespace
+
+TEST_F(FakePowerSupplyTest, SysfsReaderReusesFds) {
+    SysfsReader reader;
+    std::string buf;
+
+    EXPECT_EQ(2, reader.read(attr("battery", "capacity").c_str(), &buf));
+    EXPECT_EQ("80", buf);
+    EXPECT_EQ(7, reader.read(attr("usb", "voltage_max").c_str(), &buf));
+    EXPECT_EQ("5000000", buf);
+    EXPECT_EQ(2u, reader.size());
+
+    // Updated values are seen through the cached descriptor.
+    setAttr("battery", "capacity", "  79 ");
+    EXPECT_EQ(2, reader.read(attr("battery", "capacity").c_str(), &buf));
+    EXPECT_EQ("79", buf);
+    EXPECT_EQ(2u, reader.size());
+
+    reader.clear();
+    EXPECT_EQ(0u, reader.size());
+}
+
+TEST_F(FakePowerSupplyTest, SysfsReaderMissingAttribute) {
+    SysfsReader reader;
+    std::string buf = "stale";
+
+    EXPECT_EQ(-1, reader.read(attr("usb", "is_dock").c_str(), &buf));
+    EXPECT_EQ("", buf);
+    EXPECT_EQ(-1, reader.read("", &buf));
+    EXPECT_EQ(0u, reader.size());
+
+    // Attributes that appear later are picked up.
+    setAttr("usb", "is_dock", "1");
+    EXPECT_EQ(1, reader.read(attr("usb", "is_dock").c_str(), &buf));
+    EXPECT_EQ("1", buf);
+}
+
+TEST_F(FakePowerSupplyTest, UpdateValues) {
+    healthd_config config = {};
+    BatteryMonitor monitor(dir_.path);
+    monitor.init(&config);
+    monitor.updateValues();
+
+    const auto& info = monitor.getHealthInfo();
+    EXPECT_TRUE(info.batteryPresent);
+    EXPECT_EQ(80, info.batteryLevel);
+    EXPECT_EQ(4012, info.batteryVoltageMillivolts);
+    EXPECT_EQ(253, info.batteryTemperatureTenthsCelsius);
+    EXPECT_EQ(-512000, info.batteryCurrentMicroamps);
+    EXPECT_EQ(-498000, info.batteryCurrentAverageMicroamps);
+    EXPECT_EQ(2600000, info.batteryChargeCounterUah);
+    EXPECT_EQ(3200000, info.batteryFullChargeUah);
+    EXPECT_EQ(3300000, info.batteryFullChargeDesignCapacityUah);
+    EXPECT_EQ(42, info.batteryCycleCount);
+    EXPECT_EQ(3600, info.batteryChargeTimeToFullNowSeconds);
+    EXPECT_EQ("Li-ion", info.batteryTechnology);
+    EXPECT_EQ(BatteryStatus::CHARGING, info.batteryStatus);
+    EXPECT_EQ(BatteryHealth::GOOD, info.batteryHealth);
+    EXPECT_EQ(BatteryCapacityLevel::NORMAL, info.batteryCapacityLevel);
+
+    EXPECT_TRUE(info.chargerUsbOnline);
+    EXPECT_FALSE(info.chargerAcOnline);
+    EXPECT_FALSE(info.chargerWirelessOnline);
+    EXPECT_EQ(500000, info.maxChargingCurrentMicroamps);
+    EXPECT_EQ(5000000, info.maxChargingVoltageMicrovolts);
+}
+
+TEST_F(FakePowerSupplyTest, UpdateValuesTracksChanges) {
+    healthd_config config = {};
+    BatteryMonitor monitor(dir_.path);
+    monitor.init(&config);
+    monitor.updateValues();
+
+    setAttr("battery", "capacity", "81");
+    setAttr("battery", "status", "Full");
+    setAttr("usb", "online", "0");
+    // Chargers without voltage_max are assumed to supply 5V.
+    setAttr("ac", "online", "1");
+    monitor.updateValues();
+
+    const auto& info = monitor.getHealthInfo();
+    EXPECT_EQ(81, info.batteryLevel);
+    EXPECT_EQ(BatteryStatus::FULL, info.batteryStatus);
+    EXPECT_FALSE(info.chargerUsbOnline);
+    EXPECT_TRUE(info.chargerAcOnline);
+    EXPECT_EQ(3000000, info.maxChargingCurrentMicroamps);
+    EXPECT_EQ(5000000, info.maxChargingVoltageMicrovolts);
+}
@@ -0,0 +1,79 @@
+/*
+ * Copyright (C) 2023 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "SysfsReader.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <string_view>
+
+using android::base::unique_fd;
+
+namespace android {
+
+namespace {
+
+std::string_view trim(const char* s, size_t len) {
+    std::string_view v(s, len);
+    size_t start = v.find_first_not_of(" \t\n\r\f\v");
+    if (start == std::string_view::npos) return {};
+    size_t end = v.find_last_not_of(" \t\n\r\f\v");
+    return v.substr(start, end - start + 1);
+}
+
+}  // namespace
+
+int SysfsReader::read(const char* path, std::string* buf) {
+    buf->clear();
+    if (!path || !*path) return -1;
+
+    std::lock_guard<std::mutex> lock(mLock);
+    auto it = mFds.find(std::string_view(path));
+    // Retry once with a fresh descriptor: an attribute whose device went away
+    // and came back (e.g. a charger re-registering) fails with ENODEV on the
+    // stale one.
+    for (int attempt = 0; attempt < 2; attempt++) {
+        if (it == mFds.end()) {
+            unique_fd fd(TEMP_FAILURE_RETRY(open(path, O_RDONLY | O_CLOEXEC)));
+            if (fd == -1) return -1;
+            if (mFds.size() >= kMaxOpenFds) mFds.clear();
+            it = mFds.emplace(path, std::move(fd)).first;
+        }
+
+        ssize_t n = TEMP_FAILURE_RETRY(pread(it->second.get(), mBuffer, sizeof(mBuffer), 0));
+        if (n >= 0) {
+            *buf = trim(mBuffer, n);
+            return buf->length();
+        }
+        mFds.erase(it);
+        it = mFds.end();
+    }
+    return -1;
+}
+
+void SysfsReader::clear() {
+    std::lock_guard<std::mutex> lock(mLock);
+    mFds.clear();
+}
+
+size_t SysfsReader::size() {
+    std::lock_guard<std::mutex> lock(mLock);
+    return mFds.size();
+}
+
+}  // namespace android
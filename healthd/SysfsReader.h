@@ -0,0 +1,55 @@
+/*
+ * Copyright (C) 2023 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <map>
+#include <mutex>
+#include <string>
+
+#include <android-base/unique_fd.h>
+
+namespace android {
+
+// Reads small sysfs attributes through file descriptors that are kept open
+// between reads. Reading a sysfs attribute at offset 0 regenerates its
+// contents, so polling an attribute costs one pread() instead of an
+// open()/read()/close() sequence. Thread-safe: the health HAL reads
+// individual properties from binder threads while the main loop updates.
+class SysfsReader {
+  public:
+    // Reads the attribute at |path| into |buf|, with surrounding whitespace
+    // removed. Returns the length of |buf|, or -1 if |path| could not be read.
+    int read(const char* path, std::string* buf);
+
+    // Closes all cached file descriptors.
+    void clear();
+
+    // Number of cached file descriptors.
+    size_t size();
+
+  private:
+    // Power supplies come and go (e.g. USB-C partners), so bound the number of
+    // descriptors kept open for attributes that may never be read again.
+    static constexpr size_t kMaxOpenFds = 256;
+
+    std::mutex mLock;
+    // Keyed by path; std::less<> allows lookups without building a std::string.
+    std::map<std::string, android::base::unique_fd, std::less<>> mFds;
+    char mBuffer[4096];
+};
+
+}  // namespace android
@@ -19,6 +19,7 @@
 
 #include <memory>
 #include <optional>
+#include <string>
 
 #include <batteryservice/BatteryService.h>
 #include <utils/String8.h>
@@ -45,6 +46,8 @@ struct HealthInfo;
 }  // namespace health
 }  // namespace hardware
 
+class SysfsReader;
+
 class BatteryMonitor {
   public:
 
@@ -68,6 +71,9 @@ class BatteryMonitor {
     };
 
     BatteryMonitor();
+    // Reads power supplies from |powerSupplyPath| instead of
+    // /sys/class/power_supply, for tests.
+    explicit BatteryMonitor(const char* powerSupplyPath);
     ~BatteryMonitor();
     void init(struct healthd_config *hc);
     int getChargeStatus();
@@ -100,6 +106,16 @@ class BatteryMonitor {
     int mBatteryFixedTemperature;
     int mBatteryHealthStatus;
     std::unique_ptr<aidl::android::hardware::health::HealthInfo> mHealthInfo;
+    std::string mPowerSupplyPath;
+    // Keeps sysfs attributes open across updates.
+    std::unique_ptr<SysfsReader> mSysfsReader;
+
+    int readFromFile(const String8& path, std::string* buf);
+    PowerSupplyType readPowerSupplyType(const String8& path);
+    bool getBooleanField(const String8& path);
+    // Returns |defaultValue| if |path| can't be read, and 0 if it can't be parsed.
+    int getIntField(const String8& path, int defaultValue = 0);
+    bool isScopedPowerSupply(const char* name);
 };
 
 }; // namespace android
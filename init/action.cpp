@@ -143,24 +143,56 @@ size_t Action::CheckAllCommands() const {
     return failures;
 }
 
-void Action::ExecuteOneCommand(std::size_t command) const {
+std::size_t Action::ExecuteOneCommand(std::size_t command) const {
+    if (subcontext_ && commands_[command].execute_in_subcontext()) {
+        return ExecuteSubcontextCommands(command);
+    }
+
     // We need a copy here since some Command execution may result in
     // changing commands_ vector by importing .rc files through parser
     Command cmd = commands_[command];
     ExecuteCommand(cmd);
+    return 1;
 }
 
 void Action::ExecuteAllCommands() const {
-    for (const auto& c : commands_) {
-        ExecuteCommand(c);
+    for (std::size_t i = 0; i < commands_.size();) {
+        i += ExecuteOneCommand(i);
     }
 }
 
 void Action::ExecuteCommand(const Command& command) const {
     android::base::Timer t;
     auto result = command.InvokeFunc(subcontext_);
-    auto duration = t.duration();
+    ReportCommandResult(command, result, t.duration());
+}
+
+// Sends the run of subcontext commands starting at |command| to the subcontext in one message,
+// instead of doing one round trip per command.
+std::size_t Action::ExecuteSubcontextCommands(std::size_t command) const {
+    std::vector<Command> batch;
+    std::vector<std::vector<std::string>> batch_args;
+    for (std::size_t i = command; i < commands_.size() && commands_[i].execute_in_subcontext();
+         ++i) {
+        batch.emplace_back(commands_[i]);
+        batch_args.emplace_back(commands_[i].args());
+    }
+
+    android::base::Timer t;
+    auto results = subcontext_->ExecuteBatch(batch_args);
+    if (!results.ok()) {
+        ReportCommandResult(batch[0], results.error(), t.duration());
+        return 1;
+    }
+
+    for (std::size_t i = 0; i < results->size(); ++i) {
+        ReportCommandResult(batch[i], (*results)[i].result, (*results)[i].duration);
+    }
+    return results->size();
+}
 
+void Action::ReportCommandResult(const Command& command, const Result<void>& result,
+                                 std::chrono::milliseconds duration) const {
     // Any action longer than 50ms will be warned to user as slow operation
     if (!result.has_value() || duration > 50ms ||
         android::base::GetMinimumLogSeverity() <= android::base::DEBUG) {
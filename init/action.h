@@ -45,6 +45,8 @@ class Command {
     Result<void> CheckCommand() const;
 
     int line() const { return line_; }
+    bool execute_in_subcontext() const { return execute_in_subcontext_; }
+    const std::vector<std::string>& args() const { return args_; }
 
   private:
     BuiltinFunction func_;
@@ -66,7 +68,10 @@ class Action {
     Result<void> AddCommand(std::vector<std::string>&& args, int line);
     void AddCommand(BuiltinFunction f, std::vector<std::string>&& args, int line);
     size_t NumCommands() const;
-    void ExecuteOneCommand(std::size_t command) const;
+    // Executes the command at index |command|. Commands that run in the subcontext are sent to
+    // it together with the subcontext commands that follow them. Returns the number of commands
+    // executed.
+    std::size_t ExecuteOneCommand(std::size_t command) const;
     void ExecuteAllCommands() const;
     bool CheckEvent(const EventTrigger& event_trigger) const;
     bool CheckEvent(const PropertyChange& property_change) const;
@@ -76,6 +81,10 @@ class Action {
     size_t CheckAllCommands() const;
 
     bool oneshot() const { return oneshot_; }
+    const std::string& event_trigger() const { return event_trigger_; }
+    const std::map<std::string, std::string>& property_triggers() const {
+        return property_triggers_;
+    }
     const std::string& filename() const { return filename_; }
     int line() const { return line_; }
     static void set_function_map(const BuiltinFunctionMap* function_map) {
@@ -85,6 +94,9 @@ class Action {
 
   private:
     void ExecuteCommand(const Command& command) const;
+    std::size_t ExecuteSubcontextCommands(std::size_t command) const;
+    void ReportCommandResult(const Command& command, const Result<void>& result,
+                             std::chrono::milliseconds duration) const;
     bool CheckPropertyTriggers(const std::string& name = "",
                                const std::string& value = "") const;
 
@@ -38,6 +38,7 @@ ActionManager& ActionManager::GetInstance() {
 
 void ActionManager::AddAction(std::unique_ptr<Action> action) {
     actions_.emplace_back(std::move(action));
+    property_actions_valid_ = false;
 }
 
 void ActionManager::QueueEventTrigger(const std::string& trigger) {
@@ -50,6 +51,14 @@ void ActionManager::QueuePropertyChange(const std::string& name, const std::stri
     event_queue_.emplace(std::make_pair(name, value));
 }
 
+void ActionManager::QueuePropertyChanges(
+        const std::vector<std::pair<std::string, std::string>>& changes) {
+    auto lock = std::lock_guard{event_queue_lock_};
+    for (const auto& change : changes) {
+        event_queue_.emplace(change);
+    }
+}
+
 void ActionManager::QueueAllPropertyActions() {
     QueuePropertyChange("", "");
 }
@@ -64,15 +73,46 @@ void ActionManager::QueueBuiltinAction(BuiltinFunction func, const std::string&
     actions_.emplace_back(std::move(action));
 }
 
+// Returns the actions that a change of the property |name| may trigger, in the order of
+// |actions_|. Actions with an event trigger are never triggered by a property change.
+const std::vector<Action*>& ActionManager::ActionsTriggeredByProperty(const std::string& name) {
+    if (!property_actions_valid_) {
+        property_actions_.clear();
+        for (const auto& action : actions_) {
+            if (!action->event_trigger().empty()) continue;
+            for (const auto& [trigger_name, trigger_value] : action->property_triggers()) {
+                property_actions_[trigger_name].emplace_back(action.get());
+            }
+        }
+        property_actions_valid_ = true;
+    }
+
+    static const std::vector<Action*> kNoActions;
+    auto it = property_actions_.find(name);
+    return it != property_actions_.end() ? it->second : kNoActions;
+}
+
 void ActionManager::ExecuteOneCommand() {
     {
         auto lock = std::lock_guard{event_queue_lock_};
         // Loop through the event queue until we have an action to execute
         while (current_executing_actions_.empty() && !event_queue_.empty()) {
-            for (const auto& action : actions_) {
-                if (std::visit([&action](const auto& event) { return action->CheckEvent(event); },
-                               event_queue_.front())) {
-                    current_executing_actions_.emplace(action.get());
+            // QueueAllPropertyActions() queues a change of the empty property name, which must be
+            // checked against every action.
+            if (auto property_change = std::get_if<PropertyChange>(&event_queue_.front());
+                property_change && !property_change->first.empty()) {
+                for (Action* action : ActionsTriggeredByProperty(property_change->first)) {
+                    if (action->CheckEvent(*property_change)) {
+                        current_executing_actions_.emplace(action);
+                    }
+                }
+            } else {
+                for (const auto& action : actions_) {
+                    if (std::visit(
+                                [&action](const auto& event) { return action->CheckEvent(event); },
+                                event_queue_.front())) {
+                        current_executing_actions_.emplace(action.get());
+                    }
                 }
             }
             event_queue_.pop();
@@ -91,16 +131,19 @@ void ActionManager::ExecuteOneCommand() {
                   << ":" << action->line() << ")";
     }
 
-    action->ExecuteOneCommand(current_command_);
+    // Commands run in the subcontext may be executed several at a time.
+    current_command_ += action->ExecuteOneCommand(current_command_);
 
     // If this was the last command in the current action, then remove
     // the action from the executing list.
     // If this action was oneshot, then also remove it from actions_.
-    ++current_command_;
     if (current_command_ == action->NumCommands()) {
         current_executing_actions_.pop();
         current_command_ = 0;
         if (action->oneshot()) {
+            if (action->event_trigger().empty() && !action->property_triggers().empty()) {
+                property_actions_valid_ = false;
+            }
             auto eraser = [&action](std::unique_ptr<Action>& a) { return a.get() == action; };
             actions_.erase(std::remove_if(actions_.begin(), actions_.end(), eraser),
                            actions_.end());
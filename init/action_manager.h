@@ -18,6 +18,8 @@
 
 #include <mutex>
 #include <string>
+#include <unordered_map>
+#include <utility>
 #include <vector>
 
 #include <android-base/thread_annotations.h>
@@ -40,9 +42,12 @@ class ActionManager {
     template <class UnaryPredicate>
     void RemoveActionIf(UnaryPredicate predicate) {
         actions_.erase(std::remove_if(actions_.begin(), actions_.end(), predicate), actions_.end());
+        property_actions_valid_ = false;
     }
     void QueueEventTrigger(const std::string& trigger);
     void QueuePropertyChange(const std::string& name, const std::string& value);
+    // Queues |changes| in order, taking the event queue lock once for all of them.
+    void QueuePropertyChanges(const std::vector<std::pair<std::string, std::string>>& changes);
     void QueueAllPropertyActions();
     void QueueBuiltinAction(BuiltinFunction func, const std::string& name);
     void ExecuteOneCommand();
@@ -55,12 +60,19 @@ class ActionManager {
     ActionManager(ActionManager const&) = delete;
     void operator=(ActionManager const&) = delete;
 
+    const std::vector<Action*>& ActionsTriggeredByProperty(const std::string& name);
+
     std::vector<std::unique_ptr<Action>> actions_;
     std::queue<std::variant<EventTrigger, PropertyChange, BuiltinAction>> event_queue_
             GUARDED_BY(event_queue_lock_);
     mutable std::mutex event_queue_lock_;
     std::queue<const Action*> current_executing_actions_;
     std::size_t current_command_;
+    // The property triggered actions of |actions_|, indexed by the properties that they are
+    // triggered by, so that a property change is not checked against every action. Rebuilt on
+    // first use after |actions_| changes.
+    std::unordered_map<std::string, std::vector<Action*>> property_actions_;
+    bool property_actions_valid_ = false;
 };
 
 }  // namespace init
@@ -158,5 +158,41 @@ bool BlockDevInitializer::InitDmDevice(const std::string& device) {
     return true;
 }
 
+bool BlockDevInitializer::InitDmDevices(std::set<std::string> devices) {
+    std::set<std::string> device_names;
+    for (const auto& device : devices) {
+        device_names.emplace(basename(device.c_str()));
+    }
+
+    auto uevent_callback = [&device_names, this](const Uevent& uevent) -> ListenerAction {
+        auto iter = device_names.find(uevent.device_name);
+        if (iter == device_names.end()) {
+            return ListenerAction::kContinue;
+        }
+        LOG(VERBOSE) << "Creating device-mapper device : " << uevent.device_name;
+        device_handler_->HandleUevent(uevent);
+        device_names.erase(iter);
+        return device_names.empty() ? ListenerAction::kStop : ListenerAction::kContinue;
+    };
+
+    // Copy the names, since the callback removes the ones it finds.
+    for (const auto& device_name : std::set<std::string>(device_names)) {
+        uevent_listener_.RegenerateUeventsForPath("/sys/block/" + device_name, uevent_callback);
+    }
+    if (!device_names.empty()) {
+        LOG(INFO) << "dm device(s) not found in /sys, waiting for their uevent(s): "
+                  << android::base::Join(device_names, ", ");
+        Timer t;
+        uevent_listener_.Poll(uevent_callback, 10s);
+        LOG(INFO) << "wait for dm devices returned after " << t;
+    }
+    if (!device_names.empty()) {
+        LOG(ERROR) << "dm device(s) not found after polling timeout: "
+                   << android::base::Join(device_names, ", ");
+        return false;
+    }
+    return true;
+}
+
 }  // namespace init
 }  // namespace android
@@ -32,6 +32,8 @@ class BlockDevInitializer final {
     bool InitDmUser(const std::string& name);
     bool InitDevices(std::set<std::string> devices);
     bool InitDmDevice(const std::string& device);
+    // Same as InitDmDevice(), but waits for all of |devices| together.
+    bool InitDmDevices(std::set<std::string> devices);
 
   private:
     ListenerAction HandleUevent(const Uevent& uevent, std::set<std::string>* devices);
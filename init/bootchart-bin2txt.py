@@ -0,0 +1,118 @@
+#!/usr/bin/env python3
+
+# Copyright (C) 2024 The Android Open Source Project
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#      http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+
+"""Converts a binary bootchart to the text logs.
+
+init writes bootchart.bin instead of proc_stat.log, proc_ps.log and
+proc_diskstats.log when /data/bootchart/enabled contains "binary". This script
+writes those three logs from bootchart.bin, in the format of the text
+collector, so that pybootchartgui and compare-bootcharts.py can read them.
+
+The records are described by BinaryCollector in bootchart.cpp.
+"""
+
+import argparse
+import os
+import struct
+import sys
+
+MAGIC = b'BOOTCHRT'
+VERSION = 1
+
+FILE_HEADER = struct.Struct('<8sII')
+RECORD_HEADER = struct.Struct('<II')
+# pid, ppid, utime, stime, starttime, state, padding
+PROCESS_RECORD = struct.Struct('<iiQQQc7x')
+
+SAMPLE = 1
+PROC_STAT = 2
+DISK_STATS = 3
+PROCESS = 4
+PROCESS_NAME = 5
+
+
+def stat_line(record, name):
+    """Returns a /proc/<pid>/stat line with the fields that were recorded."""
+    pid, ppid, utime, stime, starttime, state = record
+    # Fields 3 to 24 of /proc/<pid>/stat, with the ones that are not recorded
+    # left as 0.
+    fields = ['0'] * 22
+    fields[0] = state.decode('ascii', 'replace')
+    fields[1] = str(ppid)
+    fields[11] = str(utime)
+    fields[12] = str(stime)
+    fields[19] = str(starttime)
+    return '%d (%s) %s\n' % (pid, name, ' '.join(fields))
+
+
+def convert(data, out_dir):
+    magic, version, interval_ms = FILE_HEADER.unpack_from(data, 0)
+    if magic != MAGIC:
+        sys.exit('not a binary bootchart')
+    if version != VERSION:
+        sys.exit('unsupported binary bootchart version %d' % version)
+
+    names = {}
+    with open(os.path.join(out_dir, 'proc_stat.log'), 'w') as stat_log, \
+         open(os.path.join(out_dir, 'proc_ps.log'), 'w') as ps_log, \
+         open(os.path.join(out_dir, 'proc_diskstats.log'), 'w') as disk_log:
+        uptime = None
+        offset = FILE_HEADER.size
+        while offset + RECORD_HEADER.size <= len(data):
+            type, size = RECORD_HEADER.unpack_from(data, offset)
+            offset += RECORD_HEADER.size
+            payload = data[offset:offset + size]
+            offset += size
+            if len(payload) != size:
+                # The last sample was cut short, e.g. by a reboot.
+                break
+
+            if type == SAMPLE:
+                if uptime is not None:
+                    ps_log.write('\n')
+                (uptime,) = struct.unpack('<Q', payload)
+                ps_log.write('%d\n' % uptime)
+            elif type == PROC_STAT:
+                stat_log.write('%d\n%s\n\n' % (uptime, payload.decode('utf-8', 'replace')))
+            elif type == DISK_STATS:
+                disk_log.write('%d\n%s\n' % (uptime, payload.decode('utf-8', 'replace')))
+            elif type == PROCESS_NAME:
+                (pid,) = struct.unpack_from('<i', payload)
+                names[pid] = payload[4:].decode('utf-8', 'replace')
+            elif type == PROCESS:
+                record = PROCESS_RECORD.unpack(payload)
+                ps_log.write(stat_line(record, names.get(record[0], '?')))
+        if uptime is not None:
+            ps_log.write('\n')
+
+    return interval_ms
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.split('\n')[0])
+    parser.add_argument('bootchart_bin', help='path to bootchart.bin')
+    parser.add_argument('out_dir', nargs='?', default='.',
+                        help='directory for the text logs (default: .)')
+    args = parser.parse_args()
+
+    with open(args.bootchart_bin, 'rb') as f:
+        data = f.read()
+    interval_ms = convert(data, args.out_dir)
+    print('Sampled every %d ms' % interval_ms)
+
+
+if __name__ == '__main__':
+    main()
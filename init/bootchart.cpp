@@ -28,6 +28,7 @@
 
 #include <chrono>
 #include <condition_variable>
+#include <map>
 #include <memory>
 #include <mutex>
 #include <thread>
@@ -35,11 +36,15 @@
 #include <android-base/chrono_utils.h>
 #include <android-base/file.h>
 #include <android-base/logging.h>
+#include <android-base/parseint.h>
 #include <android-base/properties.h>
 #include <android-base/stringprintf.h>
+#include <android-base/strings.h>
+#include <android-base/unique_fd.h>
 
 using android::base::StringPrintf;
 using android::base::boot_clock;
+using android::base::unique_fd;
 using namespace std::chrono_literals;
 
 namespace android {
@@ -47,6 +52,8 @@ namespace init {
 
 static std::thread* g_bootcharting_thread;
 
+static BootchartOptions g_bootchart_options;
+
 static std::mutex g_bootcharting_finished_mutex;
 static std::condition_variable g_bootcharting_finished_cv;
 static bool g_bootcharting_finished;
@@ -64,7 +71,7 @@ static std::unique_ptr<FILE, decltype(&fclose)> fopen_unique(const char* filenam
   return result;
 }
 
-static void log_header() {
+static void log_header(const BootchartOptions& options) {
   char date[32];
   time_t now_t = time(NULL);
   struct tm now = *localtime(&now_t);
@@ -88,6 +95,8 @@ static void log_header() {
   // TODO: use /proc/cpuinfo "model name" line for x86, "Processor" line for arm.
   fprintf(&*fp, "system.cpu = %s\n", uts.machine);
   fprintf(&*fp, "system.kernel.options = %s\n", kernel_cmdline.c_str());
+  fprintf(&*fp, "bootchart.interval_ms = %lld\n",
+          static_cast<long long>(options.interval.count()));
 }
 
 static void log_uptime(FILE* log) {
@@ -137,6 +146,250 @@ static void log_processes(FILE* log) {
   fputc('\n', log);
 }
 
+// Collector for the binary format. It is meant to be cheap enough to sample much more often than
+// every 200ms: files in /proc are kept open and read with pread() into a reused buffer, each
+// process is read with one pread() of its stat file, and each sample is written with one write().
+//
+// bootchart.bin starts with a FileHeader, followed by records made of a RecordHeader and its
+// payload. Each sample starts with a kSample record.
+class BinaryCollector {
+ public:
+  static constexpr char kMagic[8] = {'B', 'O', 'O', 'T', 'C', 'H', 'R', 'T'};
+  static constexpr uint32_t kVersion = 1;
+
+  struct FileHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t interval_ms;
+  };
+
+  enum RecordType : uint32_t {
+    // Payload: uint64_t uptime in jiffies (10ms).
+    kSample = 1,
+    // Payload: the cpu lines of /proc/stat.
+    kProcStat = 2,
+    // Payload: /proc/diskstats.
+    kDiskStats = 3,
+    // Payload: a ProcessRecord.
+    kProcess = 4,
+    // Payload: int32_t pid, then the name of the process. Written when a process is first
+    // seen and when its name changes, e.g. on exec.
+    kProcessName = 5,
+  };
+
+  struct RecordHeader {
+    uint32_t type;
+    uint32_t size;
+  };
+
+  // The fields of /proc/<pid>/stat that the bootchart tools use.
+  struct ProcessRecord {
+    int32_t pid;
+    int32_t ppid;
+    uint64_t utime;
+    uint64_t stime;
+    uint64_t starttime;
+    char state;
+    char reserved[7];
+  };
+
+  bool Init(const BootchartOptions& options) {
+    out_fd_.reset(open("/data/bootchart/bootchart.bin",
+                       O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0666));
+    if (out_fd_ == -1) {
+      PLOG(ERROR) << "bootchart: failed to open bootchart.bin";
+      return false;
+    }
+    stat_fd_.reset(open("/proc/stat", O_RDONLY | O_CLOEXEC));
+    diskstats_fd_.reset(open("/proc/diskstats", O_RDONLY | O_CLOEXEC));
+    proc_dir_.reset(opendir("/proc"));
+    if (stat_fd_ == -1 || diskstats_fd_ == -1 || !proc_dir_) {
+      PLOG(ERROR) << "bootchart: failed to open /proc";
+      return false;
+    }
+
+    FileHeader header = {};
+    memcpy(header.magic, kMagic, sizeof(kMagic));
+    header.version = kVersion;
+    header.interval_ms = options.interval.count();
+    out_.append(reinterpret_cast<const char*>(&header), sizeof(header));
+    return Flush();
+  }
+
+  bool Sample() {
+    uint64_t uptime = get_uptime_jiffies();
+    AppendRecord(kSample, &uptime, sizeof(uptime));
+
+    if (ReadFd(stat_fd_.get(), &buffer_)) {
+      // Only the cpu lines are used; the rest (interrupt counts...) is large.
+      size_t end = buffer_.find("\nintr");
+      AppendRecord(kProcStat, buffer_.data(), std::min(end, buffer_.size()));
+    }
+    if (ReadFd(diskstats_fd_.get(), &buffer_)) {
+      AppendRecord(kDiskStats, buffer_.data(), buffer_.size());
+    }
+    SampleProcesses();
+    return Flush();
+  }
+
+ private:
+  struct Process {
+    unique_fd stat_fd;
+    std::string comm;
+    // Used to forget the processes that have exited.
+    uint64_t generation = 0;
+  };
+
+  // Processes past this many are read without keeping their stat file open, so that init
+  // does not run out of file descriptors.
+  static constexpr size_t kMaxOpenFds = 256;
+
+  static bool ReadFd(int fd, std::string* buffer) {
+    if (buffer->size() < 4096) buffer->resize(4096);
+    while (true) {
+      ssize_t n = TEMP_FAILURE_RETRY(pread(fd, buffer->data(), buffer->size(), 0));
+      if (n < 0) {
+        buffer->clear();
+        return false;
+      }
+      if (static_cast<size_t>(n) < buffer->size()) {
+        buffer->resize(n);
+        return true;
+      }
+      // The file may be larger than the buffer; grow it and read again.
+      buffer->resize(buffer->size() * 2);
+    }
+  }
+
+  void AppendRecord(RecordType type, const void* data, size_t size) {
+    RecordHeader header = {type, static_cast<uint32_t>(size)};
+    out_.append(reinterpret_cast<const char*>(&header), sizeof(header));
+    out_.append(reinterpret_cast<const char*>(data), size);
+  }
+
+  void AppendProcessName(int pid, const std::string& name) {
+    int32_t pid32 = pid;
+    RecordHeader header = {kProcessName, static_cast<uint32_t>(sizeof(pid32) + name.size())};
+    out_.append(reinterpret_cast<const char*>(&header), sizeof(header));
+    out_.append(reinterpret_cast<const char*>(&pid32), sizeof(pid32));
+    out_.append(name);
+  }
+
+  bool ReadStat(int pid, Process* process) {
+    if (process->stat_fd != -1) {
+      if (ReadFd(process->stat_fd.get(), &buffer_)) return true;
+      // A stat file that was kept open fails to read once its process has exited, even if
+      // the pid has been reused since. Start over with the new process, if there is one.
+      process->stat_fd.reset();
+      process->comm.clear();
+      open_fds_--;
+    }
+    unique_fd fd(open(StringPrintf("/proc/%d/stat", pid).c_str(), O_RDONLY | O_CLOEXEC));
+    if (fd == -1) return false;
+    if (!ReadFd(fd.get(), &buffer_)) return false;
+    if (open_fds_ < kMaxOpenFds) {
+      process->stat_fd = std::move(fd);
+      open_fds_++;
+    }
+    return true;
+  }
+
+  void SampleProcesses() {
+    generation_++;
+    rewinddir(proc_dir_.get());
+    struct dirent* entry;
+    while ((entry = readdir(proc_dir_.get())) != nullptr) {
+      int pid = atoi(entry->d_name);
+      if (pid == 0) continue;
+
+      auto [it, inserted] = processes_.try_emplace(pid);
+      Process* process = &it->second;
+      if (!ReadStat(pid, process)) {
+        processes_.erase(it);
+        continue;
+      }
+      process->generation = generation_;
+      ParseStat(pid, process);
+    }
+
+    for (auto it = processes_.begin(); it != processes_.end();) {
+      if (it->second.generation != generation_) {
+        if (it->second.stat_fd != -1) {
+          open_fds_--;
+        }
+        it = processes_.erase(it);
+      } else {
+        ++it;
+      }
+    }
+  }
+
+  void ParseStat(int pid, Process* process) {
+    // The name is between the first '(' and the last ')', and may contain spaces.
+    size_t open = buffer_.find('(');
+    size_t close = buffer_.rfind(')');
+    if (open == std::string::npos || close == std::string::npos || close < open) return;
+
+    // /proc/<pid>/stat only has truncated task names, so the full name is read from
+    // /proc/<pid>/cmdline, but only when the task name changes.
+    std::string_view comm(buffer_.data() + open + 1, close - open - 1);
+    if (comm != process->comm) {
+      process->comm = comm;
+      std::string cmdline;
+      android::base::ReadFileToString(StringPrintf("/proc/%d/cmdline", pid), &cmdline);
+      std::string name = cmdline.c_str();  // So we stop at the first NUL.
+      AppendProcessName(pid, name.empty() ? process->comm : name);
+    }
+
+    // Fields after the name, starting with the state (field 3).
+    std::vector<std::string> fields = android::base::Split(buffer_.substr(close + 2), " ");
+    if (fields.size() < 20) return;
+
+    ProcessRecord record = {};
+    record.pid = pid;
+    record.state = fields[0].empty() ? '?' : fields[0][0];
+    android::base::ParseInt(fields[1], &record.ppid);
+    android::base::ParseUint(fields[11], &record.utime);
+    android::base::ParseUint(fields[12], &record.stime);
+    android::base::ParseUint(fields[19], &record.starttime);
+    AppendRecord(kProcess, &record, sizeof(record));
+  }
+
+  bool Flush() {
+    bool ok = android::base::WriteFully(out_fd_, out_.data(), out_.size());
+    if (!ok) PLOG(ERROR) << "bootchart: failed to write bootchart.bin";
+    out_.clear();
+    return ok;
+  }
+
+  unique_fd out_fd_;
+  unique_fd stat_fd_;
+  unique_fd diskstats_fd_;
+  std::unique_ptr<DIR, int (*)(DIR*)> proc_dir_{nullptr, closedir};
+  std::map<int, Process> processes_;
+  size_t open_fds_ = 0;
+  uint64_t generation_ = 0;
+  std::string buffer_;
+  std::string out_;
+};
+
+static bool wait_for_next_sample(std::chrono::milliseconds interval) {
+  std::unique_lock<std::mutex> lock(g_bootcharting_finished_mutex);
+  g_bootcharting_finished_cv.wait_for(lock, interval);
+  return !g_bootcharting_finished;
+}
+
+static void bootchart_binary_main(const BootchartOptions& options) {
+  BinaryCollector collector;
+  if (!collector.Init(options)) return;
+
+  log_header(options);
+
+  while (wait_for_next_sample(options.interval)) {
+    if (!collector.Sample()) break;
+  }
+}
+
 static void bootchart_thread_main() {
   LOG(INFO) << "Bootcharting started";
 
@@ -154,6 +407,13 @@ static void bootchart_thread_main() {
       PLOG(ERROR) << "Cannot create mount namespace";
       return;
   }
+  const BootchartOptions& options = g_bootchart_options;
+  if (options.binary) {
+    bootchart_binary_main(options);
+    LOG(INFO) << "Bootcharting finished";
+    return;
+  }
+
   // Open log files.
   auto stat_log = fopen_unique("/data/bootchart/proc_stat.log", "we");
   if (!stat_log) return;
@@ -162,15 +422,9 @@ static void bootchart_thread_main() {
   auto disk_log = fopen_unique("/data/bootchart/proc_diskstats.log", "we");
   if (!disk_log) return;
 
-  log_header();
-
-  while (true) {
-    {
-      std::unique_lock<std::mutex> lock(g_bootcharting_finished_mutex);
-      g_bootcharting_finished_cv.wait_for(lock, 200ms);
-      if (g_bootcharting_finished) break;
-    }
+  log_header(options);
 
+  while (wait_for_next_sample(options.interval)) {
     log_file(&*stat_log, "/proc/stat");
     log_file(&*disk_log, "/proc/diskstats");
     log_processes(&*proc_log);
@@ -179,13 +433,32 @@ static void bootchart_thread_main() {
   LOG(INFO) << "Bootcharting finished";
 }
 
+BootchartOptions parse_bootchart_options(const std::string& content) {
+  BootchartOptions options;
+  constexpr std::string_view kInterval = "interval=";
+  for (const auto& word : android::base::Tokenize(content, " \t\n")) {
+    unsigned int interval_ms;
+    if (word == "binary") {
+      options.binary = true;
+    } else if (android::base::StartsWith(word, kInterval) &&
+               android::base::ParseUint(word.substr(kInterval.size()), &interval_ms, 10000u) &&
+               interval_ms >= 10) {
+      options.interval = std::chrono::milliseconds(interval_ms);
+    } else {
+      LOG(WARNING) << "bootchart: ignoring unknown option '" << word << "'";
+    }
+  }
+  return options;
+}
+
 static Result<void> do_bootchart_start() {
-    // We don't care about the content, but we do care that /data/bootchart/enabled actually exists.
+    // The file /data/bootchart/enabled must exist. It may be empty, or contain options.
     std::string start;
     if (!android::base::ReadFileToString("/data/bootchart/enabled", &start)) {
         LOG(VERBOSE) << "Not bootcharting";
         return {};
     }
+    g_bootchart_options = parse_bootchart_options(start);
 
     g_bootcharting_thread = new std::thread(bootchart_thread_main);
     return {};
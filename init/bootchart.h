@@ -17,6 +17,7 @@
 #ifndef _BOOTCHART_H
 #define _BOOTCHART_H
 
+#include <chrono>
 #include <string>
 #include <vector>
 
@@ -26,6 +27,17 @@
 namespace android {
 namespace init {
 
+// Configuration read from /data/bootchart/enabled, e.g. "binary interval=50".
+struct BootchartOptions {
+    // Write compact binary records to bootchart.bin instead of the text logs. They are converted
+    // to the text logs on the host by bootchart-bin2txt.py.
+    bool binary = false;
+    std::chrono::milliseconds interval = std::chrono::milliseconds(200);
+};
+
+// Parses the content of /data/bootchart/enabled. Unknown options are ignored.
+BootchartOptions parse_bootchart_options(const std::string& content);
+
 Result<void> do_bootchart(const BuiltinArguments& args);
 
 }  // namespace init
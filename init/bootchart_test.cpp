@@ -0,0 +1,66 @@
+/*
+ * Copyright (C) 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "bootchart.h"
+
+#include <gtest/gtest.h>
+
+using namespace std::chrono_literals;
+
+namespace android {
+namespace init {
+
+TEST(bootchart, EmptyOptions) {
+    auto options = parse_bootchart_options("");
+    EXPECT_FALSE(options.binary);
+    EXPECT_EQ(200ms, options.interval);
+
+    // /data/bootchart/enabled is usually created with `touch` or `echo 1`.
+    options = parse_bootchart_options("1\n");
+    EXPECT_FALSE(options.binary);
+    EXPECT_EQ(200ms, options.interval);
+}
+
+TEST(bootchart, BinaryAndInterval) {
+    auto options = parse_bootchart_options("binary");
+    EXPECT_TRUE(options.binary);
+    EXPECT_EQ(200ms, options.interval);
+
+    options = parse_bootchart_options("interval=50\n");
+    EXPECT_FALSE(options.binary);
+    EXPECT_EQ(50ms, options.interval);
+
+    options = parse_bootchart_options("binary\tinterval=10 ");
+    EXPECT_TRUE(options.binary);
+    EXPECT_EQ(10ms, options.interval);
+}
+
+TEST(bootchart, BadIntervalIsIgnored) {
+    for (const char* content : {"interval=", "interval=abc", "interval=-5", "interval=9",
+                                "interval=10001", "interval 50", "binary=1"}) {
+        auto options = parse_bootchart_options(content);
+        EXPECT_FALSE(options.binary) << content;
+        EXPECT_EQ(200ms, options.interval) << content;
+    }
+
+    // The good options around a bad one still apply.
+    auto options = parse_bootchart_options("interval=5 binary interval=abc");
+    EXPECT_TRUE(options.binary);
+    EXPECT_EQ(200ms, options.interval);
+}
+
+}  // namespace init
+}  // namespace android
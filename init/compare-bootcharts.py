@@ -26,7 +26,8 @@ dumps of /proc/<pid>/stat
 timestamp2
 dumps of /proc/<pid>/stat
 
-The timestamps are 200ms apart, and the creation time of selected processes
+The timestamps are 200ms apart unless the header says otherwise (see
+bootchart.interval_ms), and the creation time of selected processes
 are listed. The termination time of the boot animation process is also listed
 as a coarse indication about when the boot process is complete as perceived by
 the user.
@@ -35,8 +36,8 @@ the user.
 import sys
 import tarfile
 
-# The bootchart timestamps are 200ms apart, but the USER_HZ value is not
-# reported in the bootchart, so we use the first two timestamps to calculate
+# The bootchart timestamps are 200ms apart by default, but the USER_HZ value is
+# not reported in the bootchart, so we use the first two timestamps to calculate
 # the wall clock time of a jiffy.
 jiffy_to_wallclock = {
    '1st_timestamp': -1,
@@ -75,9 +76,22 @@ def analyze_process_maps(process_map1, process_map2, jiffy_record):
         (process_map2['/system/bin/bootanimation']['last_tick'] -
             process_map1['/system/bin/bootanimation']['last_tick']) * jw))
 
+def get_interval_ms(tf):
+    """Returns the sampling interval recorded in the header, or 200ms."""
+    try:
+        header = tf.extractfile('header').read().decode('utf-8')
+    except KeyError:
+        return 200
+    for line in header.split('\n'):
+        key, _, value = line.partition(' = ')
+        if key == 'bootchart.interval_ms':
+            return int(value)
+    return 200
+
 def parse_proc_file(pathname, process_map, jiffy_record=None):
     # Uncompress bootchart.tgz
     with tarfile.open(pathname + '/bootchart.tgz', 'r:*') as tf:
+        interval_ms = get_interval_ms(tf)
         try:
             # Read proc_ps.log
             f = tf.extractfile('proc_ps.log')
@@ -89,7 +103,7 @@ def parse_proc_file(pathname, process_map, jiffy_record=None):
                 if not lines[0]:
                     break
 
-                # 200ms apart in jiffies
+                # interval_ms apart in jiffies
                 timestamp = int(lines[0]);
 
                 # Figure out the wall clock time of a jiffy
@@ -99,8 +113,8 @@ def parse_proc_file(pathname, process_map, jiffy_record=None):
                     elif jiffy_record['jiffy_to_wallclock'] == -1:
                         # Not really needed but for debugging purposes
                         jiffy_record['2nd_timestamp'] = timestamp
-                        value = 200 / (timestamp -
-                                       jiffy_record['1st_timestamp'])
+                        value = interval_ms // (timestamp -
+                                                jiffy_record['1st_timestamp'])
                         # Fix the rounding error
                         # e.g., 201 jiffies in 200ms when USER_HZ is 1000
                         if value == 0:
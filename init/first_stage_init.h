@@ -23,6 +23,7 @@ int FirstStageMain(int argc, char** argv);
 
 static constexpr char kEnvFirstStageStartedAt[] = "FIRST_STAGE_STARTED_AT";
 static constexpr char kEnvInitModuleDurationMs[] = "INIT_MODULE_DURATION_MS";
+static constexpr char kEnvInitMountDurationMs[] = "INIT_MOUNT_DURATION_MS";
 
 }  // namespace init
 }  // namespace android
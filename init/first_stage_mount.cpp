@@ -26,6 +26,8 @@
 #include <memory>
 #include <set>
 #include <string>
+#include <thread>
+#include <utility>
 #include <vector>
 
 #include <android-base/chrono_utils.h>
@@ -44,6 +46,7 @@
 
 #include "block_dev_initializer.h"
 #include "devices.h"
+#include "first_stage_init.h"
 #include "result.h"
 #include "snapuserd_transition.h"
 #include "switch_root.h"
@@ -93,8 +96,11 @@ class FirstStageMountVBootV2 : public FirstStageMount {
     bool CreateSnapshotPartitions(SnapshotManager* sm);
     bool MountPartition(const Fstab::iterator& begin, bool erase_same_mounts,
                         Fstab::iterator* end = nullptr);
+    bool MountFirstAvailable(const Fstab::iterator& begin, Fstab::iterator* end);
 
     bool MountPartitions();
+    bool MountPartitionsInParallel(const std::vector<Fstab::iterator>& mounts);
+    void RecordMountDuration(const std::string& phase, const Timer& t);
     bool TrySwitchSystemAsRoot();
     bool IsDmLinearEnabled();
     void GetSuperDeviceName(std::set<std::string>* devices);
@@ -107,13 +113,15 @@ class FirstStageMountVBootV2 : public FirstStageMount {
     void CopyDsuAvbKeys();
 
     bool GetDmVerityDevices(std::set<std::string>* devices);
-    bool SetUpDmVerity(FstabEntry* fstab_entry);
+    bool SetUpDmVerity(FstabEntry* fstab_entry, std::string* out_verity_device = nullptr);
 
     bool InitAvbHandle();
 
     bool need_dm_verity_;
     bool dsu_not_on_userdata_ = false;
     bool use_snapuserd_ = false;
+    // Set by androidboot.first_stage_parallel_mount.
+    bool parallel_mount_ = false;
 
     Fstab fstab_;
     // The super path is only set after InitDevices, and is invalid before.
@@ -126,6 +134,10 @@ class FirstStageMountVBootV2 : public FirstStageMount {
 
     std::vector<std::string> vbmeta_partitions_;
     AvbUniquePtr avb_handle_;
+
+    // "<phase>:<ms>" durations of MountPartitions(), passed to second stage
+    // init through kEnvInitMountDurationMs.
+    std::vector<std::string> mount_durations_;
 };
 
 // Static Functions
@@ -138,6 +150,29 @@ static inline bool IsDtVbmetaCompatible(const Fstab& fstab) {
     return is_android_dt_value_expected("vbmeta/compatible", "android,vbmeta");
 }
 
+// Returns true if a failure to mount |entry| should not fail first stage mount.
+static bool CanIgnoreMountFailure(const FstabEntry& entry) {
+    if (entry.fs_mgr_flags.no_fail) {
+        LOG(INFO) << "Failed to mount " << entry.mount_point
+                  << ", ignoring mount for no_fail partition";
+        return true;
+    }
+    if (entry.fs_mgr_flags.formattable) {
+        LOG(INFO) << "Failed to mount " << entry.mount_point
+                  << ", ignoring mount for formattable partition";
+        return true;
+    }
+    PLOG(ERROR) << "Failed to mount " << entry.mount_point;
+    return false;
+}
+
+// Returns true if |mount_point| is below |parent|, so it can only be mounted
+// after |parent|.
+static bool IsBelowMountPoint(const std::string& mount_point, const std::string& parent) {
+    return mount_point.size() > parent.size() && android::base::StartsWith(mount_point, parent) &&
+           (parent.back() == '/' || mount_point[parent.size()] == '/');
+}
+
 static Result<Fstab> ReadFirstStageFstabAndroid() {
     Fstab fstab;
     if (!ReadFstabFromDt(&fstab)) {
@@ -435,6 +470,21 @@ bool FirstStageMountVBootV2::MountPartition(const Fstab::iterator& begin, bool e
         LOG(INFO) << "AVB is not enabled, skip verity setup for '" << begin->mount_point << "'";
     }
 
+    Fstab::iterator current;
+    bool mounted = MountFirstAvailable(begin, &current);
+    if (erase_same_mounts) {
+        current = fstab_.erase(begin, current);
+    }
+    if (end) {
+        *end = current;
+    }
+    return mounted;
+}
+
+// Mounts |begin|, or failing that, the following entries with the same mount
+// point, in order. Sets |end| to the first entry with another mount point.
+bool FirstStageMountVBootV2::MountFirstAvailable(const Fstab::iterator& begin,
+                                                 Fstab::iterator* end) {
     bool mounted = (fs_mgr_do_mount_one(*begin) == 0);
 
     // Try other mounts with the same mount point.
@@ -447,12 +497,7 @@ bool FirstStageMountVBootV2::MountPartition(const Fstab::iterator& begin, bool e
             mounted = (fs_mgr_do_mount_one(*current) == 0);
         }
     }
-    if (erase_same_mounts) {
-        current = fstab_.erase(begin, current);
-    }
-    if (end) {
-        *end = current;
-    }
+    *end = current;
     return mounted;
 }
 
@@ -537,6 +582,9 @@ bool FirstStageMountVBootV2::MountPartitions() {
 
     if (!SkipMountingPartitions(&fstab_, true /* verbose */)) return false;
 
+    Timer mount_timer;
+    // In parallel mode, the first entry of each mount point to be mounted.
+    std::vector<Fstab::iterator> mounts;
     for (auto current = fstab_.begin(); current != fstab_.end();) {
         // We've already mounted /system above.
         if (current->mount_point == "/system") {
@@ -558,21 +606,27 @@ bool FirstStageMountVBootV2::MountPartitions() {
             continue;
         }
 
+        if (parallel_mount_) {
+            mounts.emplace_back(current);
+            const std::string& mount_point = current->mount_point;
+            current = std::find_if(current, fstab_.end(), [&mount_point](const auto& entry) {
+                return entry.mount_point != mount_point;
+            });
+            continue;
+        }
+
         Fstab::iterator end;
-        if (!MountPartition(current, false /* erase_same_mounts */, &end)) {
-            if (current->fs_mgr_flags.no_fail) {
-                LOG(INFO) << "Failed to mount " << current->mount_point
-                          << ", ignoring mount for no_fail partition";
-            } else if (current->fs_mgr_flags.formattable) {
-                LOG(INFO) << "Failed to mount " << current->mount_point
-                          << ", ignoring mount for formattable partition";
-            } else {
-                PLOG(ERROR) << "Failed to mount " << current->mount_point;
-                return false;
-            }
+        if (!MountPartition(current, false /* erase_same_mounts */, &end) &&
+            !CanIgnoreMountFailure(*current)) {
+            return false;
         }
         current = end;
     }
+    if (parallel_mount_ && !MountPartitionsInParallel(mounts)) {
+        return false;
+    }
+    RecordMountDuration("total", mount_timer);
+    setenv(kEnvInitMountDurationMs, android::base::Join(mount_durations_, ",").c_str(), 1);
 
     for (const auto& entry : fstab_) {
         if (entry.fs_type == "overlay") {
@@ -610,6 +664,115 @@ bool FirstStageMountVBootV2::MountPartitions() {
     return true;
 }
 
+// Same as calling MountPartition() on each of |mounts|, but each step is done
+// for all of them before moving to the next: dm-linear device nodes are
+// created, then dm-verity devices are set up, waiting for all of their nodes
+// at once, and finally mount points that do not depend on each other are
+// mounted concurrently.
+bool FirstStageMountVBootV2::MountPartitionsInParallel(
+        const std::vector<Fstab::iterator>& mounts) {
+    // Whether each mount point is still on track to be mounted.
+    std::vector<char> ready(mounts.size(), true);
+
+    // Creates the nodes of dm devices for the given mounts. If some are
+    // missing, only those mounts are marked as failed.
+    auto init_dm_devices = [&, this](const std::map<size_t, std::string>& devices) -> void {
+        std::set<std::string> paths;
+        for (const auto& [index, path] : devices) {
+            paths.emplace(path);
+        }
+        if (paths.empty() || block_dev_init_.InitDmDevices(std::move(paths))) {
+            return;
+        }
+        for (const auto& [index, path] : devices) {
+            if (access(path.c_str(), F_OK) != 0) {
+                ready[index] = false;
+            }
+        }
+    };
+
+    Timer t;
+    std::map<size_t, std::string> dm_devices;
+    for (size_t i = 0; i < mounts.size(); i++) {
+        FstabEntry* entry = &(*mounts[i]);
+        if (!fs_mgr_create_canonical_mount_point(entry->mount_point)) {
+            ready[i] = false;
+            continue;
+        }
+        if (entry->fs_mgr_flags.logical) {
+            if (!fs_mgr_update_logical_partition(entry)) {
+                ready[i] = false;
+                continue;
+            }
+            dm_devices.emplace(i, entry->blk_device);
+        }
+    }
+    init_dm_devices(dm_devices);
+    RecordMountDuration("dm", t);
+
+    t = Timer();
+    std::map<size_t, std::string> verity_devices;
+    for (size_t i = 0; i < mounts.size(); i++) {
+        FstabEntry* entry = &(*mounts[i]);
+        if (!ready[i]) {
+            continue;
+        }
+        if (!entry->fs_mgr_flags.avb) {
+            LOG(INFO) << "AVB is not enabled, skip verity setup for '" << entry->mount_point
+                      << "'";
+            continue;
+        }
+        std::string verity_device;
+        if (!SetUpDmVerity(entry, &verity_device)) {
+            PLOG(ERROR) << "Failed to setup verity for '" << entry->mount_point << "'";
+            ready[i] = false;
+        } else if (!verity_device.empty()) {
+            verity_devices.emplace(i, std::move(verity_device));
+        }
+    }
+    init_dm_devices(verity_devices);
+    RecordMountDuration("verity", t);
+
+    t = Timer();
+    std::vector<char> mounted(mounts.size(), false);
+    std::vector<int> mount_errno(mounts.size(), 0);
+    std::vector<size_t> pending;
+    std::vector<std::string> pending_mount_points;
+    for (size_t i = 0; i < mounts.size(); i++) {
+        if (!ready[i]) continue;
+        pending.emplace_back(i);
+        pending_mount_points.emplace_back(mounts[i]->mount_point);
+    }
+    for (const auto& wave : GetMountWaves(pending_mount_points)) {
+        std::vector<std::thread> threads;
+        for (size_t k : wave) {
+            threads.emplace_back([&, i = pending[k], this]() -> void {
+                Fstab::iterator end;
+                mounted[i] = MountFirstAvailable(mounts[i], &end);
+                if (!mounted[i]) mount_errno[i] = errno;
+            });
+        }
+        for (auto& thread : threads) {
+            thread.join();
+        }
+    }
+    RecordMountDuration("mount", t);
+
+    for (size_t i = 0; i < mounts.size(); i++) {
+        if (mounted[i]) continue;
+        errno = mount_errno[i];
+        if (!CanIgnoreMountFailure(*mounts[i])) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void FirstStageMountVBootV2::RecordMountDuration(const std::string& phase, const Timer& t) {
+    LOG(INFO) << "First stage mount: " << phase << " took " << t;
+    mount_durations_.emplace_back(phase + ":" + std::to_string(t.duration().count()));
+}
+
 // Preserves /avb/*.avbpubkey to /metadata/gsi/dsu/avb/, so they can be used for
 // key revocation check by DSU installation service.  Note that failing to
 // copy files to /metadata is NOT fatal, because it is auxiliary to perform
@@ -672,6 +835,11 @@ FirstStageMountVBootV2::FirstStageMountVBootV2(Fstab fstab)
     : need_dm_verity_(false), fstab_(std::move(fstab)), avb_handle_(nullptr) {
     super_partition_name_ = fs_mgr_get_super_partition_name();
 
+    std::string parallel_mount;
+    parallel_mount_ = android::fs_mgr::GetBootconfig("androidboot.first_stage_parallel_mount",
+                                                     &parallel_mount) &&
+                      parallel_mount == "true";
+
     std::string device_tree_vbmeta_parts;
     read_android_dt_file("vbmeta/parts", &device_tree_vbmeta_parts);
 
@@ -746,7 +914,11 @@ bool IsHashtreeDisabled(const AvbHandle& vbmeta, const std::string& mount_point)
     return false;
 }
 
-bool FirstStageMountVBootV2::SetUpDmVerity(FstabEntry* fstab_entry) {
+// If |out_verity_device| is set, the node of the dm-verity device is not
+// created; its path is returned there instead, or an empty string if no
+// dm-verity device was set up.
+bool FirstStageMountVBootV2::SetUpDmVerity(FstabEntry* fstab_entry,
+                                           std::string* out_verity_device) {
     AvbHashtreeResult hashtree_result;
 
     // It's possible for a fstab_entry to have both avb_keys and avb flag.
@@ -805,6 +977,10 @@ bool FirstStageMountVBootV2::SetUpDmVerity(FstabEntry* fstab_entry) {
             // The exact block device name (fstab_rec->blk_device) is changed to
             // "/dev/block/dm-XX". Needs to create it because ueventd isn't started in init
             // first stage.
+            if (out_verity_device) {
+                *out_verity_device = fstab_entry->blk_device;
+                return true;
+            }
             return block_dev_init_.InitDmDevice(fstab_entry->blk_device);
         default:
             return false;
@@ -825,6 +1001,26 @@ bool FirstStageMountVBootV2::InitAvbHandle() {
     return true;
 }
 
+std::vector<std::vector<size_t>> GetMountWaves(const std::vector<std::string>& mount_points) {
+    std::vector<std::vector<size_t>> waves;
+    std::vector<size_t> pending(mount_points.size());
+    for (size_t i = 0; i < pending.size(); i++) {
+        pending[i] = i;
+    }
+    while (!pending.empty()) {
+        std::vector<size_t> wave, later;
+        for (size_t i : pending) {
+            bool nested = std::any_of(pending.begin(), pending.end(), [&](size_t j) {
+                return IsBelowMountPoint(mount_points[i], mount_points[j]);
+            });
+            (nested ? later : wave).emplace_back(i);
+        }
+        waves.emplace_back(std::move(wave));
+        pending = std::move(later);
+    }
+    return waves;
+}
+
 void SetInitAvbVersionInRecovery() {
     if (!IsRecoveryMode()) {
         LOG(INFO) << "Skipped setting INIT_AVB_VERSION (not in recovery mode)";
@@ -17,6 +17,8 @@
 #pragma once
 
 #include <memory>
+#include <string>
+#include <vector>
 
 #include "result.h"
 
@@ -40,5 +42,11 @@ class FirstStageMount {
 
 void SetInitAvbVersionInRecovery();
 
+// Groups |mount_points| into waves for androidboot.first_stage_parallel_mount.
+// The mount points of a wave are mounted concurrently, and a mount point is
+// in a later wave than every other one above it, e.g. /vendor/dsp is after
+// /vendor. Returns the indexes in |mount_points| of each wave, in order.
+std::vector<std::vector<size_t>> GetMountWaves(const std::vector<std::string>& mount_points);
+
 }  // namespace init
 }  // namespace android
@@ -0,0 +1,55 @@
+/*
+ * Copyright (C) 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "first_stage_mount.h"
+
+#include <gtest/gtest.h>
+
+using Waves = std::vector<std::vector<size_t>>;
+
+namespace android {
+namespace init {
+
+TEST(first_stage_mount, GetMountWaves_Empty) {
+    EXPECT_EQ(Waves{}, GetMountWaves({}));
+}
+
+TEST(first_stage_mount, GetMountWaves_Independent) {
+    EXPECT_EQ((Waves{{0, 1, 2}}), GetMountWaves({"/vendor", "/odm", "/product"}));
+}
+
+TEST(first_stage_mount, GetMountWaves_Nested) {
+    std::vector<std::string> mount_points = {"/vendor",         "/vendor/dsp",  "/odm",
+                                             "/vendor/dsp/fw", "/vendor_dlkm", "/odm/firmware"};
+    // Mount points stay in fstab order within a wave, and each one is after
+    // those above it. /vendor_dlkm is not below /vendor.
+    EXPECT_EQ((Waves{{0, 2, 4}, {1, 5}, {3}}), GetMountWaves(mount_points));
+}
+
+TEST(first_stage_mount, GetMountWaves_ChildBeforeParentInFstab) {
+    EXPECT_EQ((Waves{{1, 2}, {0}}), GetMountWaves({"/vendor/dsp", "/vendor", "/odm"}));
+}
+
+TEST(first_stage_mount, GetMountWaves_Root) {
+    EXPECT_EQ((Waves{{0}, {1, 2}}), GetMountWaves({"/", "/vendor", "/odm"}));
+}
+
+TEST(first_stage_mount, GetMountWaves_TrailingSlash) {
+    EXPECT_EQ((Waves{{0}, {1}}), GetMountWaves({"/vendor/", "/vendor/dsp"}));
+}
+
+}  // namespace init
+}  // namespace android
@@ -13,9 +13,13 @@ TARBALL=bootchart.tgz
 
 FILES="header proc_stat.log proc_ps.log proc_diskstats.log"
 
-for f in $FILES; do
+for f in $FILES bootchart.bin; do
     adb "${@}" pull $LOGROOT/$f $TMPDIR/$f 2>&1 > /dev/null
 done
+# The binary collector only writes the header and bootchart.bin.
+if [ -f $TMPDIR/bootchart.bin ]; then
+    $(dirname $0)/bootchart-bin2txt.py $TMPDIR/bootchart.bin $TMPDIR
+fi
 (cd $TMPDIR && tar -czf $TARBALL $FILES)
 pybootchartgui ${TMPDIR}/${TARBALL}
 xdg-open ${TARBALL%.tgz}.png
@@ -380,6 +380,25 @@ void PropertyChanged(const std::string& name, const std::string& value) {
     prop_waiter_state.CheckAndResetWait(name, value);
 }
 
+// Like calling PropertyChanged() for each of |changes|, but queues them together and wakes the
+// main thread once, for when many properties are set at once.
+void PropertiesChanged(const std::vector<std::pair<std::string, std::string>>& changes) {
+    for (const auto& [name, value] : changes) {
+        if (name == "sys.powerctl") {
+            trigger_shutdown(value);
+        }
+    }
+
+    if (property_triggers_enabled) {
+        ActionManager::GetInstance().QueuePropertyChanges(changes);
+        WakeMainInitThread();
+    }
+
+    for (const auto& [name, value] : changes) {
+        prop_waiter_state.CheckAndResetWait(name, value);
+    }
+}
+
 static std::optional<boot_clock::time_point> HandleProcessActions() {
     std::optional<boot_clock::time_point> next_process_action_time;
     for (const auto& s : ServiceList::GetInstance()) {
@@ -884,6 +903,15 @@ static void RecordStageBoottimes(const boot_clock::time_point& second_stage_star
         SetProperty("ro.boottime.init.modules", init_module_time_str);
         unsetenv(kEnvInitModuleDurationMs);
     }
+    // "<phase>:<ms>,..." from first stage mount.
+    if (auto mount_time_str = getenv(kEnvInitMountDurationMs); mount_time_str) {
+        for (const auto& duration : android::base::Split(mount_time_str, ",")) {
+            auto parts = android::base::Split(duration, ":");
+            if (parts.size() != 2) continue;
+            SetProperty("ro.boottime.init.mount." + parts[0], parts[1]);
+        }
+        unsetenv(kEnvInitMountDurationMs);
+    }
 }
 
 void SendLoadPersistentPropertiesMessage() {
@@ -19,6 +19,8 @@
 #include <sys/types.h>
 
 #include <string>
+#include <utility>
+#include <vector>
 
 #include "action.h"
 #include "action_manager.h"
@@ -40,6 +42,7 @@ void ResetWaitForProp();
 void SendLoadPersistentPropertiesMessage();
 
 void PropertyChanged(const std::string& name, const std::string& value);
+void PropertiesChanged(const std::vector<std::pair<std::string, std::string>>& changes);
 bool QueueControlMessage(const std::string& message, const std::string& name, pid_t pid, int fd);
 
 int SecondStageMain(int argc, char** argv);
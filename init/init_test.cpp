@@ -176,6 +176,64 @@ execute_third
     EXPECT_EQ(3, num_executed);
 }
 
+TEST(init, PropertyTriggerOrder) {
+    std::string init_script =
+            R"init(
+on property:init_test.order=1
+execute_first
+
+on boot && property:init_test.order=*
+execute_never
+
+on property:init_test.other=1
+execute_never
+
+on property:init_test.order=*
+execute_second
+
+on property:init_test.order=2
+execute_never
+
+on property:init_test.order=1
+execute_third
+)init";
+
+    int num_executed = 0;
+    auto do_execute_first = [&num_executed](const BuiltinArguments&) {
+        EXPECT_EQ(0, num_executed++);
+        return Result<void>{};
+    };
+    auto do_execute_second = [&num_executed](const BuiltinArguments&) {
+        EXPECT_EQ(1, num_executed++);
+        return Result<void>{};
+    };
+    auto do_execute_third = [&num_executed](const BuiltinArguments&) {
+        EXPECT_EQ(2, num_executed++);
+        return Result<void>{};
+    };
+    auto do_execute_never = [](const BuiltinArguments&) {
+        ADD_FAILURE() << "Action executed on the wrong trigger";
+        return Result<void>{};
+    };
+
+    BuiltinFunctionMap test_function_map = {
+            {"execute_first", {0, 0, {false, do_execute_first}}},
+            {"execute_second", {0, 0, {false, do_execute_second}}},
+            {"execute_third", {0, 0, {false, do_execute_third}}},
+            {"execute_never", {0, 0, {false, do_execute_never}}},
+    };
+
+    ActionManagerCommand change_properties = [](ActionManager& am) {
+        am.QueuePropertyChanges({{"init_test.order", "1"}, {"init_test.other", "2"}});
+    };
+    std::vector<ActionManagerCommand> commands{change_properties};
+
+    ActionManager action_manager;
+    ServiceList service_list;
+    TestInitText(init_script, test_function_map, commands, &action_manager, &service_list);
+    EXPECT_EQ(3, num_executed);
+}
+
 TEST(init, OverrideService) {
     std::string init_script = R"init(
 service A something
@@ -612,6 +670,37 @@ TEST(init, LazilyLoadedActionsCanBeTriggeredByTheNextTrigger) {
     EXPECT_EQ(2, num_executed);
 }
 
+TEST(init, LazilyLoadedActionsCanBeTriggeredByTheNextPropertyChange) {
+    // The first property change is processed before "lazy" is loaded, the second one after it, and
+    // only the second one executes the "on property" action that it defines.
+    TemporaryFile lazy;
+    ASSERT_TRUE(lazy.fd != -1);
+    ASSERT_TRUE(android::base::WriteStringToFd("on property:init_test.lazy=1\nexecute 2", lazy.fd));
+
+    TemporaryFile start;
+    // clang-format off
+    std::string start_script = "on boot\n"
+                               "load " + std::string(lazy.path) + "\n"
+                               "execute 1";
+    // clang-format on
+    ASSERT_TRUE(android::base::WriteStringToFd(start_script, start.fd));
+
+    int num_executed = 0;
+    ActionManager action_manager;
+    ServiceList service_list;
+    BuiltinFunctionMap test_function_map =
+            GetTestFunctionMapForLazyLoad(num_executed, action_manager);
+
+    ActionManagerCommand change_property = [](ActionManager& am) {
+        am.QueuePropertyChange("init_test.lazy", "1");
+    };
+    ActionManagerCommand trigger_boot = [](ActionManager& am) { am.QueueEventTrigger("boot"); };
+    std::vector<ActionManagerCommand> commands{change_property, trigger_boot, change_property};
+    TestInit(start.path, test_function_map, commands, &action_manager, &service_list);
+
+    EXPECT_EQ(2, num_executed);
+}
+
 TEST(init, RejectsNoUserStartingInV) {
     std::string init_script =
             R"init(
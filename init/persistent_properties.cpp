@@ -18,22 +18,27 @@
 
 #include <dirent.h>
 #include <fcntl.h>
+#include <sys/mman.h>
 #include <sys/stat.h>
 #include <sys/system_properties.h>
 #include <sys/types.h>
 
 #include <memory>
 
+#include <android-base/chrono_utils.h>
 #include <android-base/file.h>
 #include <android-base/logging.h>
+#include <android-base/mapped_file.h>
 #include <android-base/strings.h>
 #include <android-base/unique_fd.h>
 
 #include "util.h"
 
 using android::base::Dirname;
+using android::base::MappedFile;
 using android::base::ReadFdToString;
 using android::base::StartsWith;
+using android::base::Timer;
 using android::base::unique_fd;
 using android::base::WriteStringToFd;
 
@@ -122,7 +127,7 @@ void RemoveLegacyPersistentPropertyFiles() {
     }
 }
 
-Result<std::string> ReadPersistentPropertyFile() {
+void RemoveTemporaryPersistentPropertyFile() {
     const std::string temp_filename = persistent_property_filename + ".tmp";
     if (access(temp_filename.c_str(), F_OK) == 0) {
         LOG(INFO)
@@ -130,6 +135,10 @@ Result<std::string> ReadPersistentPropertyFile() {
                " a previous persistent property write may have failed";
         unlink(temp_filename.c_str());
     }
+}
+
+Result<std::string> ReadPersistentPropertyFile() {
+    RemoveTemporaryPersistentPropertyFile();
     auto file_contents = ReadFile(persistent_property_filename);
     if (!file_contents.ok()) {
         return Error() << "Unable to read persistent property file: " << file_contents.error();
@@ -151,8 +160,99 @@ Result<PersistentProperties> ParsePersistentPropertyFile(const std::string& file
     return persistent_properties;
 }
 
+// The protobuf wire format, as much of it as is needed to read PersistentProperties.
+constexpr uint32_t kWireTypeVarint = 0;
+constexpr uint32_t kWireTypeFixed64 = 1;
+constexpr uint32_t kWireTypeLengthDelimited = 2;
+constexpr uint32_t kWireTypeFixed32 = 5;
+
+// The field numbers of PersistentProperties.properties and of PersistentPropertyRecord.name and
+// PersistentPropertyRecord.value.
+constexpr uint32_t kPropertiesField = 1;
+constexpr uint32_t kNameField = 1;
+constexpr uint32_t kValueField = 2;
+
+bool ReadVarint(std::string_view* data, uint64_t* value) {
+    *value = 0;
+    for (int shift = 0; shift < 64 && !data->empty(); shift += 7) {
+        uint8_t byte = data->front();
+        data->remove_prefix(1);
+        *value |= uint64_t(byte & 0x7f) << shift;
+        if (!(byte & 0x80)) return true;
+    }
+    return false;
+}
+
+bool ReadBytes(std::string_view* data, size_t size, std::string_view* bytes) {
+    if (size > data->size()) return false;
+    *bytes = data->substr(0, size);
+    data->remove_prefix(size);
+    return true;
+}
+
+// Reads the next field of a message, leaving |data| after it. The contents of length-delimited
+// fields are returned in |bytes|, other fields are skipped.
+bool ReadField(std::string_view* data, uint32_t* field_number, uint32_t* wire_type,
+               std::string_view* bytes) {
+    uint64_t tag, size;
+    if (!ReadVarint(data, &tag)) return false;
+    *field_number = tag >> 3;
+    *wire_type = tag & 0x7;
+    if (*field_number == 0) return false;
+    switch (*wire_type) {
+        case kWireTypeVarint:
+            return ReadVarint(data, &size);
+        case kWireTypeFixed64:
+            return ReadBytes(data, 8, bytes);
+        case kWireTypeLengthDelimited:
+            return ReadVarint(data, &size) && ReadBytes(data, size, bytes);
+        case kWireTypeFixed32:
+            return ReadBytes(data, 4, bytes);
+        default:
+            // Groups are not used by persistent_properties.proto.
+            return false;
+    }
+}
+
 }  // namespace
 
+// Decodes the persistent property file without materializing a PersistentProperties message: the
+// names and values that are returned point into |file_contents|. This accepts what
+// ParsePersistentPropertyFile() accepts, and returns the records in the same order.
+Result<std::vector<std::pair<std::string_view, std::string_view>>> DecodePersistentPropertyFile(
+        std::string_view file_contents) {
+    std::vector<std::pair<std::string_view, std::string_view>> properties;
+    uint32_t field_number, wire_type;
+    std::string_view record;
+    while (!file_contents.empty()) {
+        if (!ReadField(&file_contents, &field_number, &wire_type, &record)) {
+            return Error() << "Unable to parse persistent property file: Could not parse protobuf";
+        }
+        if (field_number != kPropertiesField || wire_type != kWireTypeLengthDelimited) continue;
+
+        std::string_view name, value, bytes;
+        while (!record.empty()) {
+            if (!ReadField(&record, &field_number, &wire_type, &bytes)) {
+                return Error()
+                       << "Unable to parse persistent property file: Could not parse protobuf";
+            }
+            if (wire_type != kWireTypeLengthDelimited) continue;
+            // As for protobuf, the last occurrence of a field wins.
+            if (field_number == kNameField) {
+                name = bytes;
+            } else if (field_number == kValueField) {
+                value = bytes;
+            }
+        }
+        if (!StartsWith(name, "persist.") && !StartsWith(name, "next_boot.")) {
+            return Error() << "Unable to load persistent property file: property '" << name
+                           << "' doesn't start with 'persist.' or 'next_boot.'";
+        }
+        properties.emplace_back(name, value);
+    }
+    return properties;
+}
+
 Result<PersistentProperties> LoadPersistentPropertyFile() {
     auto file_contents = ReadPersistentPropertyFile();
     if (!file_contents.ok()) return file_contents.error();
@@ -316,6 +416,58 @@ PersistentProperties LoadPersistentProperties() {
     return updated_persistent_properties;
 }
 
+size_t ApplyPersistentProperties(
+        const std::function<void(const std::string& name, const std::string& value)>& set) {
+    auto load_persistent_properties = [&set]() {
+        auto persistent_properties = LoadPersistentProperties();
+        for (const auto& property_record : persistent_properties.properties()) {
+            set(property_record.name(), property_record.value());
+        }
+        return persistent_properties.properties().size();
+    };
+
+    Timer t;
+    RemoveTemporaryPersistentPropertyFile();
+    unique_fd fd(TEMP_FAILURE_RETRY(
+            open(persistent_property_filename.c_str(), O_RDONLY | O_NOFOLLOW | O_CLOEXEC)));
+    struct stat sb;
+    // ReadFile() rejects group or world writable files, let LoadPersistentProperties() report it.
+    if (fd == -1 || fstat(fd.get(), &sb) == -1 || (sb.st_mode & (S_IWGRP | S_IWOTH)) != 0) {
+        return load_persistent_properties();
+    }
+
+    std::unique_ptr<MappedFile> mapped_file;
+    std::string_view file_contents;
+    if (sb.st_size > 0) {
+        mapped_file = MappedFile::FromFd(fd.get(), 0, sb.st_size, PROT_READ);
+        if (!mapped_file) {
+            PLOG(ERROR) << "Unable to map persistent property file";
+            return load_persistent_properties();
+        }
+        file_contents = std::string_view(mapped_file->data(), mapped_file->size());
+    }
+
+    auto properties = DecodePersistentPropertyFile(file_contents);
+    if (!properties.ok()) {
+        LOG(ERROR) << properties.error();
+        return load_persistent_properties();
+    }
+    // Staged properties need the file to be rewritten, which LoadPersistentProperties() does.
+    for (const auto& [name, value] : *properties) {
+        if (StartsWith(name, "next_boot.")) return load_persistent_properties();
+    }
+    LOG(INFO) << "Decoded " << properties->size() << " persistent properties ("
+              << file_contents.size() << " bytes) in " << t;
+
+    std::string name, value;
+    for (const auto& property : *properties) {
+        name.assign(property.first);
+        value.assign(property.second);
+        set(name, value);
+    }
+    return properties->size();
+}
+
 
 
 }  // namespace init
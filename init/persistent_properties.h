@@ -17,7 +17,11 @@
 #ifndef _INIT_PERSISTENT_PROPERTIES_H
 #define _INIT_PERSISTENT_PROPERTIES_H
 
+#include <functional>
 #include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
 
 #include "result.h"
 #include "system/core/init/persistent_properties.pb.h"
@@ -29,9 +33,18 @@ PersistentProperties LoadPersistentProperties();
 void WritePersistentProperty(const std::string& name, const std::string& value);
 PersistentProperties LoadPersistentPropertiesFromMemory();
 
+// Loads the persistent properties like LoadPersistentProperties(), calling |set| for each of them
+// in file order. The file is mapped and decoded in place instead of being parsed into a
+// PersistentProperties message; missing or corrupt files and staged 'next_boot.' properties fall
+// back to LoadPersistentProperties(). Returns the number of properties that were loaded.
+size_t ApplyPersistentProperties(
+        const std::function<void(const std::string& name, const std::string& value)>& set);
+
 // Exposed only for testing
 Result<PersistentProperties> LoadPersistentPropertyFile();
 Result<void> WritePersistentPropertyFile(const PersistentProperties& persistent_properties);
+Result<std::vector<std::pair<std::string_view, std::string_view>>> DecodePersistentPropertyFile(
+        std::string_view file_contents);
 extern std::string persistent_property_filename;
 
 }  // namespace init
@@ -210,5 +210,80 @@ TEST(persistent_properties, StagedPersistProperty) {
     CheckPropertiesEqual(expected_persistent_properties, second_read_back_properties);
 }
 
+TEST(persistent_properties, DecodeMatchesParse) {
+    std::vector<std::pair<std::string, std::string>> persistent_properties = {
+        {"persist.sys.locale", "en-US"},
+        {"persist.test.empty.value", ""},
+        {"persist.test.non.ascii", "\x00\x01\x02\xFF\xFE\xFD\x7F\x8F\x9F"s},
+        {"persist.test.long.value", std::string(300, 'x')},
+        {"next_boot.persist.test.numbers", "54321"},
+        {"persist.sys.locale", "pt-BR"},
+    };
+
+    std::string file_contents;
+    ASSERT_TRUE(VectorToPersistentProperties(persistent_properties)
+                        .SerializeToString(&file_contents));
+
+    auto decoded_properties = DecodePersistentPropertyFile(file_contents);
+    ASSERT_RESULT_OK(decoded_properties);
+    ASSERT_EQ(persistent_properties.size(), decoded_properties->size());
+    for (size_t i = 0; i < persistent_properties.size(); ++i) {
+        EXPECT_EQ(persistent_properties[i].first, (*decoded_properties)[i].first);
+        EXPECT_EQ(persistent_properties[i].second, (*decoded_properties)[i].second);
+    }
+}
+
+TEST(persistent_properties, DecodeRejectsBadFile) {
+    std::string file_contents;
+    ASSERT_TRUE(VectorToPersistentProperties({{"persist.sys.locale", "en-US"}})
+                        .SerializeToString(&file_contents));
+    EXPECT_FALSE(DecodePersistentPropertyFile(file_contents.substr(0, file_contents.size() - 1))
+                         .ok());
+    EXPECT_FALSE(DecodePersistentPropertyFile("ab").ok());
+
+    ASSERT_TRUE(VectorToPersistentProperties({{"notpersist.sys.locale", "en-US"}})
+                        .SerializeToString(&file_contents));
+    EXPECT_FALSE(DecodePersistentPropertyFile(file_contents).ok());
+}
+
+TEST(persistent_properties, ApplyPersistentProperties) {
+    TemporaryFile tf;
+    ASSERT_TRUE(tf.fd != -1);
+    persistent_property_filename = tf.path;
+
+    std::vector<std::pair<std::string, std::string>> persistent_properties = {
+        {"persist.sys.locale", "en-US"},
+        {"persist.sys.timezone", "America/Los_Angeles"},
+        {"persist.test.empty.value", ""},
+    };
+    ASSERT_RESULT_OK(
+            WritePersistentPropertyFile(VectorToPersistentProperties(persistent_properties)));
+
+    std::vector<std::pair<std::string, std::string>> applied_properties;
+    auto set = [&applied_properties](const std::string& name, const std::string& value) {
+        applied_properties.emplace_back(name, value);
+    };
+    EXPECT_EQ(persistent_properties.size(), ApplyPersistentProperties(set));
+    EXPECT_EQ(persistent_properties, applied_properties);
+
+    // Staged properties are applied through LoadPersistentProperties(), which rewrites the file.
+    WritePersistentProperty("next_boot.persist.sys.locale", "pt-BR");
+    persistent_properties[0].second = "pt-BR";
+    applied_properties.clear();
+    EXPECT_EQ(persistent_properties.size(), ApplyPersistentProperties(set));
+    EXPECT_EQ(persistent_properties, applied_properties);
+
+    applied_properties.clear();
+    EXPECT_EQ(persistent_properties.size(), ApplyPersistentProperties(set));
+    EXPECT_EQ(persistent_properties, applied_properties);
+
+    // A file that cannot be decoded falls back to the legacy directory, as for
+    // LoadPersistentProperties().
+    ASSERT_RESULT_OK(WriteFile(tf.path, "ab"));
+    applied_properties.clear();
+    ApplyPersistentProperties(set);
+    CheckPropertiesEqual(applied_properties, LoadPersistentProperties());
+}
+
 }  // namespace init
 }  // namespace android
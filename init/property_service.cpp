@@ -193,7 +193,17 @@ static bool CheckMacPerms(const std::string& name, const char* target_context,
                                 &audit_data) == 0;
 }
 
+// While set, the property changes made by this thread are collected here instead of being sent to
+// init one at a time; see NotifyPropertyChanges().
+static thread_local std::vector<std::pair<std::string, std::string>>* property_change_batch =
+        nullptr;
+
 void NotifyPropertyChange(const std::string& name, const std::string& value) {
+    if (property_change_batch) {
+        property_change_batch->emplace_back(name, value);
+        return;
+    }
+
     // If init hasn't started its main loop, then it won't be handling property changed messages
     // anyway, so there's no need to try to send them.
     auto lock = std::lock_guard{accept_messages_lock};
@@ -202,6 +212,13 @@ void NotifyPropertyChange(const std::string& name, const std::string& value) {
     }
 }
 
+static void NotifyPropertyChanges(const std::vector<std::pair<std::string, std::string>>& changes) {
+    auto lock = std::lock_guard{accept_messages_lock};
+    if (accept_messages) {
+        PropertiesChanged(changes);
+    }
+}
+
 class AsyncRestorecon {
   public:
     void TriggerRestorecon(const std::string& path) {
@@ -1561,12 +1578,19 @@ static void HandleInitSocket() {
         case InitMessage::kLoadPersistentProperties: {
             load_override_properties();
 
-            auto persistent_properties = LoadPersistentProperties();
-            for (const auto& property_record : persistent_properties.properties()) {
-                auto const& prop_name = property_record.name();
-                auto const& prop_value = property_record.value();
-                InitPropertySet(prop_name, prop_value);
-            }
+            // The triggers of all persistent properties are queued at once, after they are set.
+            Timer t;
+            std::vector<std::pair<std::string, std::string>> changes;
+            property_change_batch = &changes;
+            auto count = ApplyPersistentProperties(
+                    [](const std::string& name, const std::string& value) {
+                        InitPropertySet(name, value);
+                    });
+            property_change_batch = nullptr;
+            NotifyPropertyChanges(changes);
+            LOG(INFO) << "Loaded " << count << " persistent properties in " << t;
+            InitPropertySet("ro.boottime.init.load_persist_props",
+                            std::to_string(t.duration().count()));
 
             // Apply debug ramdisk special settings after persistent properties are loaded.
             if (android::base::GetBoolProperty("ro.force.debuggable", false)) {
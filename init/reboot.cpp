@@ -22,6 +22,7 @@
 #include <linux/fs.h>
 #include <linux/loop.h>
 #include <mntent.h>
+#include <poll.h>
 #include <semaphore.h>
 #include <stdlib.h>
 #include <sys/cdefs.h>
@@ -33,10 +34,12 @@
 #include <sys/types.h>
 #include <sys/wait.h>
 
+#include <algorithm>
 #include <chrono>
 #include <memory>
 #include <set>
 #include <thread>
+#include <utility>
 #include <vector>
 
 #include <InitProperties.sysprop.h>
@@ -178,6 +181,9 @@ class MountEntry {
         return android::base::StartsWith(mntent.mnt_fsname, "/data/");
     }
 
+    const std::string& mnt_fsname() const { return mnt_fsname_; }
+    const std::string& mnt_dir() const { return mnt_dir_; }
+
   private:
     bool IsF2Fs() const { return mnt_type_ == "f2fs"; }
 
@@ -215,9 +221,34 @@ static Result<void> CallVdc(const std::string& system, const std::string& cmd) {
     return Error() << "'/system/bin/vdc " << system << " " << cmd << "' failed : " << status;
 }
 
-static void LogShutdownTime(UmountStat stat, Timer* t) {
+// Records how long each step of the shutdown sequence took, for LogShutdownTime.
+class ShutdownTimings {
+  public:
+    // Ends the current phase, which took the time since the previous one ended.
+    void EndPhase(const std::string& name) {
+        phases_.emplace_back(name, phase_timer_.duration());
+        phase_timer_ = Timer();
+    }
+
+    // Returns e.g. "stop_services=1210,vold=35,sync=12,umount=230".
+    std::string ToString() const {
+        std::string result;
+        for (const auto& [name, duration] : phases_) {
+            if (!result.empty()) result += ",";
+            result += name + "=" + std::to_string(duration.count());
+        }
+        return result;
+    }
+
+  private:
+    Timer phase_timer_;
+    std::vector<std::pair<std::string, std::chrono::milliseconds>> phases_;
+};
+
+static void LogShutdownTime(UmountStat stat, Timer* t, const ShutdownTimings& timings) {
     LOG(WARNING) << "powerctl_shutdown_time_ms:" << std::to_string(t->duration().count()) << ":"
                  << stat;
+    LOG(WARNING) << "powerctl_shutdown_phases_ms:" << timings.ToString();
 }
 
 static bool IsDataMounted(const std::string& fstype) {
@@ -278,6 +309,56 @@ static void DumpUmountDebuggingInfo() {
     WriteStringToFile("w", PROC_SYSRQ);
 }
 
+// Returns true if |dir| is |parent| or is under it.
+static bool IsSameOrUnder(const std::string& dir, const std::string& parent) {
+    if (parent == "/") return true;
+    return android::base::StartsWith(dir, parent) &&
+           (dir.size() == parent.size() || dir[parent.size()] == '/');
+}
+
+// Unmounts all of |entries|, which are in the reverse order of /proc/mounts. A mount can only be
+// unmounted once the mounts under it, and the mounts stacked on top of it, are gone; those come
+// before it in |entries|. Unmounting can take a while since it writes back the file system, so
+// the mounts that don't depend on each other are unmounted in parallel.
+// Returns true if all of them were unmounted.
+static bool UmountAll(std::vector<MountEntry>* entries, bool force) {
+    std::vector<bool> attempted(entries->size(), false);
+    std::vector<char> unmounted(entries->size(), false);
+    size_t remaining = entries->size();
+    while (remaining > 0) {
+        std::vector<size_t> ready;
+        for (size_t i = 0; i < entries->size(); i++) {
+            if (attempted[i]) continue;
+            bool blocked = false;
+            for (size_t j = 0; j < i && !blocked; j++) {
+                blocked = !attempted[j] &&
+                          IsSameOrUnder((*entries)[j].mnt_dir(), (*entries)[i].mnt_dir());
+            }
+            if (!blocked) ready.emplace_back(i);
+        }
+
+        std::vector<std::thread> threads;
+        for (size_t i : ready) {
+            auto umount = [entries, &unmounted, i, force] {
+                unmounted[i] = (*entries)[i].Umount(force);
+            };
+            if (ready.size() == 1) {
+                umount();
+            } else {
+                threads.emplace_back(umount);
+            }
+        }
+        for (auto& thread : threads) {
+            thread.join();
+        }
+        for (size_t i : ready) {
+            attempted[i] = true;
+        }
+        remaining -= ready.size();
+    }
+    return std::all_of(unmounted.begin(), unmounted.end(), [](char u) { return u; });
+}
+
 static UmountStat UmountPartitions(std::chrono::milliseconds timeout) {
     Timer t;
     /* data partition needs all pending writes to be completed and all emulated partitions
@@ -295,16 +376,12 @@ static UmountStat UmountPartitions(std::chrono::milliseconds timeout) {
         }
         bool unmount_done = true;
         if (emulated_devices.size() > 0) {
-            for (auto& entry : emulated_devices) {
-                if (!entry.Umount(false)) unmount_done = false;
-            }
+            unmount_done = UmountAll(&emulated_devices, false);
             if (unmount_done) {
                 sync();
             }
         }
-        for (auto& entry : block_devices) {
-            if (!entry.Umount(timeout == 0ms)) unmount_done = false;
-        }
+        if (!UmountAll(&block_devices, timeout == 0ms)) unmount_done = false;
         if (unmount_done) {
             return UMOUNT_STAT_SUCCESS;
         }
@@ -415,7 +492,8 @@ void RebootMonitorThread(unsigned int cmd, const std::string& reboot_target,
  * return true when umount was successful. false when timed out.
  */
 static UmountStat TryUmountAndFsck(unsigned int cmd, bool run_fsck,
-                                   std::chrono::milliseconds timeout, sem_t* reboot_semaphore) {
+                                   std::chrono::milliseconds timeout, sem_t* reboot_semaphore,
+                                   ShutdownTimings* timings) {
     Timer t;
     std::vector<MountEntry> block_devices;
     std::vector<MountEntry> emulated_devices;
@@ -453,16 +531,21 @@ static UmountStat TryUmountAndFsck(unsigned int cmd, bool run_fsck,
         UmountStat st = UmountPartitions(0ms);
         if ((st != UMOUNT_STAT_SUCCESS) && DUMP_ON_UMOUNT_FAILURE) DumpUmountDebuggingInfo();
     }
+    timings->EndPhase("umount");
 
     if (stat == UMOUNT_STAT_SUCCESS && run_fsck) {
         LOG(INFO) << "Pause reboot monitor thread before fsck";
         sem_post(reboot_semaphore);
 
         // fsck part is excluded from timeout check. It only runs for user initiated shutdown
-        // and should not affect reboot time.
+        // and should not affect reboot time. Each block device is only checked once. The checks
+        // run one after the other, as logwrap_fork_execvp() serializes its callers anyway.
+        std::set<std::string> checked;
         for (auto& entry : block_devices) {
+            if (!checked.emplace(entry.mnt_fsname()).second) continue;
             entry.DoFsck();
         }
+        timings->EndPhase("fsck");
 
         LOG(INFO) << "Resume reboot monitor thread after fsck";
         sem_post(reboot_semaphore);
@@ -570,6 +653,107 @@ static void StopServices(const std::set<std::string>& services, std::chrono::mil
     }
 }
 
+namespace {
+
+// A service that is being stopped. |pidfd| is a duplicate of the service's own pidfd, so that it
+// stays valid after the service is reaped.
+struct StoppingService {
+    std::string name;
+    pid_t pid;
+    unique_fd pidfd;
+};
+
+}  // namespace
+
+// Returns true once the process |s.pid| of the service has been reaped.
+static bool HasStopped(const StoppingService& s) {
+    Service* service = ServiceList::GetInstance().FindService(s.name);
+    return service == nullptr || !service->IsRunning() || service->pid() != s.pid;
+}
+
+// Waits until all of |stopping| have exited and been reaped, or until |deadline|. The services
+// that have stopped are removed from |stopping|.
+static void WaitForServicesToStop(std::vector<StoppingService>* stopping,
+                                  boot_clock::time_point deadline) {
+    while (true) {
+        ReapAnyOutstandingChildren();
+        stopping->erase(std::remove_if(stopping->begin(), stopping->end(), HasStopped),
+                        stopping->end());
+        auto now = boot_clock::now();
+        if (stopping->empty() || now >= deadline) return;
+
+        // A pidfd becomes readable when its process exits. Services without one (pidfds are
+        // not supported by the kernel) are polled for instead.
+        std::vector<pollfd> pollfds;
+        bool have_all_pidfds = true;
+        for (const auto& s : *stopping) {
+            if (s.pidfd == -1) {
+                have_all_pidfds = false;
+                continue;
+            }
+            pollfds.push_back({.fd = s.pidfd.get(), .events = POLLIN});
+        }
+        auto timeout = std::chrono::ceil<std::chrono::milliseconds>(deadline - now);
+        if (!have_all_pidfds) timeout = std::min(timeout, 50ms);
+        if (TEMP_FAILURE_RETRY(poll(pollfds.data(), pollfds.size(), timeout.count())) == -1) {
+            PLOG(ERROR) << "poll() failed while waiting for services to stop";
+            std::this_thread::sleep_for(50ms);
+        }
+    }
+}
+
+// Stops the given services, sending SIGTERM to all of them at once. Each service is waited for on
+// its own: it is done as soon as it exits, and sent SIGKILL as soon as it is still running
+// |sigterm_timeout| after SIGTERM. The services that were sent SIGKILL are then waited for, for
+// up to |sigkill_timeout|, so that they don't keep file systems busy.
+// Returns the number of services that are still running.
+int StopServicesWithEscalation(const std::set<std::string>& services,
+                               std::chrono::milliseconds sigterm_timeout,
+                               std::chrono::milliseconds sigkill_timeout) {
+    LOG(INFO) << "Stopping " << services.size() << " services, with SIGKILL after "
+              << sigterm_timeout.count() << "ms";
+    Timer t;
+    std::vector<StoppingService> stopping;
+    for (const auto& s : ServiceList::GetInstance().services_in_shutdown_order()) {
+        if (services.count(s->name()) == 0) {
+            continue;
+        }
+        if (s->pid() > 0) {
+            unique_fd pidfd;
+            if (s->pidfd() != -1) {
+                pidfd.reset(fcntl(s->pidfd(), F_DUPFD_CLOEXEC, 0));
+            }
+            stopping.push_back({s->name(), s->pid(), std::move(pidfd)});
+        }
+        if (sigterm_timeout > 0ms) {
+            s->Terminate();
+        }
+    }
+
+    if (sigterm_timeout > 0ms) {
+        WaitForServicesToStop(&stopping, boot_clock::now() + sigterm_timeout);
+    }
+    for (const auto& s : stopping) {
+        LOG(ERROR) << "[service-misbehaving] : service '" << s.name << "' is still running "
+                   << sigterm_timeout.count() << "ms after receiving SIGTERM";
+    }
+
+    // Stop() also disables the services that have already exited, so they are not restarted.
+    for (const auto& s : ServiceList::GetInstance().services_in_shutdown_order()) {
+        if (services.count(s->name()) > 0) {
+            s->Stop();
+        }
+    }
+    WaitForServicesToStop(&stopping, boot_clock::now() + sigkill_timeout);
+    for (const auto& s : stopping) {
+        LOG(ERROR) << "[service-misbehaving] : service '" << s.name << "' is still running "
+                   << sigkill_timeout.count() << "ms after receiving SIGKILL";
+    }
+    LOG(INFO) << "Stopping services took " << t << " with " << stopping.size()
+              << " of them still running";
+    return stopping.size();
+}
+
 // Like StopServices, but also logs all the services that failed to stop after the provided timeout.
 // Returns number of violators.
 int StopServicesAndLogViolations(const std::set<std::string>& services,
@@ -613,6 +797,7 @@ static Result<void> UnmountAllApexes() {
 static void DoReboot(unsigned int cmd, const std::string& reason, const std::string& reboot_target,
                      bool run_fsck) {
     Timer t;
+    ShutdownTimings timings;
     LOG(INFO) << "Reboot start, reason: " << reason << ", reboot_target: " << reboot_target;
 
     bool is_thermal_shutdown = cmd == ANDROID_RB_THERMOFF;
@@ -729,16 +914,21 @@ static void DoReboot(unsigned int cmd, const std::string& reason, const std::str
         }
     }
 
+    timings.EndPhase("prepare");
+
     // optional shutdown step
-    // 1. terminate all services except shutdown critical ones. wait for delay to finish
+    // 1. terminate all services except shutdown critical ones, each of them getting up to half of
+    // the delay to finish. Send SIGKILL to ones that didn't terminate cleanly.
     if (shutdown_timeout > 0ms) {
-        StopServicesAndLogViolations(stop_first, shutdown_timeout / 2, true /* SIGTERM */);
+        StopServicesWithEscalation(stop_first, shutdown_timeout / 2,
+                                   std::min(shutdown_timeout / 4, 1000ms));
+    } else {
+        StopServicesWithEscalation(stop_first, 0ms, 0ms);
     }
-    // Send SIGKILL to ones that didn't terminate cleanly.
-    StopServicesAndLogViolations(stop_first, 0ms, false /* SIGKILL */);
     SubcontextTerminate();
     // Reap subcontext pids.
     ReapAnyOutstandingChildren();
+    timings.EndPhase("stop_services");
 
     // 3. send volume abort_fuse and volume shutdown to vold
     Service* vold_service = ServiceList::GetInstance().FindService("vold");
@@ -753,6 +943,7 @@ static void DoReboot(unsigned int cmd, const std::string& reason, const std::str
     }
     // logcat stopped here
     StopServices(kDebuggingServices, 0ms, false /* SIGKILL */);
+    timings.EndPhase("vold");
     // 4. sync, try umount, and optionally run fsck for user shutdown
     {
         Timer sync_timer;
@@ -760,16 +951,24 @@ static void DoReboot(unsigned int cmd, const std::string& reason, const std::str
         sync();
         LOG(INFO) << "sync() before umount took" << sync_timer;
     }
-    // 5. drop caches and disable zram backing device, if exist
-    KillZramBackingDevice();
+    timings.EndPhase("sync");
+    // 5. drop caches and disable zram backing device, if exist. This doesn't depend on the
+    // apexes, so it is done while they are unmounted.
+    std::thread zram_thread([] {
+        if (auto ret = KillZramBackingDevice(); !ret.ok()) {
+            LOG(WARNING) << ret.error();
+        }
+    });
 
     LOG(INFO) << "Ready to unmount apexes. So far shutdown sequence took " << t;
     // 6. unmount active apexes, otherwise they might prevent clean unmount of /data.
     if (auto ret = UnmountAllApexes(); !ret.ok()) {
         LOG(ERROR) << ret.error();
     }
-    UmountStat stat =
-            TryUmountAndFsck(cmd, run_fsck, shutdown_timeout - t.duration(), &reboot_semaphore);
+    zram_thread.join();
+    timings.EndPhase("zram_and_apexes");
+    UmountStat stat = TryUmountAndFsck(cmd, run_fsck, shutdown_timeout - t.duration(),
+                                       &reboot_semaphore, &timings);
     // Follow what linux shutdown is doing: one more sync with little bit delay
     {
         Timer sync_timer;
@@ -778,7 +977,8 @@ static void DoReboot(unsigned int cmd, const std::string& reason, const std::str
         LOG(INFO) << "sync() after umount took" << sync_timer;
     }
     if (!is_thermal_shutdown) std::this_thread::sleep_for(100ms);
-    LogShutdownTime(stat, &t);
+    timings.EndPhase("final_sync");
+    LogShutdownTime(stat, &t, timings);
 
     // Send signal to terminate reboot monitor thread.
     reboot_monitor_run = false;
@@ -869,9 +1069,7 @@ static Result<void> DoUserspaceReboot() {
               << "Timeout to kill services: " << sigkill_timeout.count() << "ms";
     std::string services_file_name = "/metadata/userspacereboot/services.txt";
     const int flags = O_RDWR | O_CREAT | O_SYNC | O_APPEND | O_CLOEXEC;
-    StopServicesAndLogViolations(stop_first, sigterm_timeout, true /* SIGTERM */);
-    if (int r = StopServicesAndLogViolations(stop_first, sigkill_timeout, false /* SIGKILL */);
-        r > 0) {
+    if (int r = StopServicesWithEscalation(stop_first, sigterm_timeout, sigkill_timeout); r > 0) {
         auto fd = unique_fd(TEMP_FAILURE_RETRY(open(services_file_name.c_str(), flags, 0666)));
         android::base::WriteStringToFd("Post-data services still running: \n", fd);
         for (const auto& s : ServiceList::GetInstance()) {
@@ -891,9 +1089,7 @@ static Result<void> DoUserspaceReboot() {
         return result;
     }
     const auto& debugging_services = GetPostDataDebuggingServices();
-    if (int r = StopServicesAndLogViolations(debugging_services, sigkill_timeout,
-                                             false /* SIGKILL */);
-        r > 0) {
+    if (int r = StopServicesWithEscalation(debugging_services, 0ms, sigkill_timeout); r > 0) {
         auto fd = unique_fd(TEMP_FAILURE_RETRY(open(services_file_name.c_str(), flags, 0666)));
         android::base::WriteStringToFd("Debugging services still running: \n", fd);
         for (const auto& s : ServiceList::GetInstance()) {
@@ -28,6 +28,12 @@ namespace init {
 // Returns number of violators.
 int StopServicesAndLogViolations(const std::set<std::string>& services,
                                  std::chrono::milliseconds timeout, bool terminate);
+// Sends SIGTERM to the given services and waits for each of them to exit, for up to
+// |sigterm_timeout|. The services that are still running then get SIGKILL and are waited for, for
+// up to |sigkill_timeout|. Returns the number of services that are still running.
+int StopServicesWithEscalation(const std::set<std::string>& services,
+                               std::chrono::milliseconds sigterm_timeout,
+                               std::chrono::milliseconds sigkill_timeout);
 // Parses and handles a setprop sys.powerctl message.
 void HandlePowerctlMessage(const std::string& command);
 
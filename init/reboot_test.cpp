@@ -22,6 +22,7 @@
 #include <memory>
 #include <string_view>
 
+#include <android-base/chrono_utils.h>
 #include <android-base/file.h>
 #include <android-base/properties.h>
 #include <android-base/strings.h>
@@ -91,16 +92,17 @@ std::string GetSecurityContext() {
     return result;
 }
 
-void AddTestService(const std::string& name) {
+void AddTestService(const std::string& name, const std::string& command = "/system/bin/yes") {
     static constexpr std::string_view kScriptTemplate = R"init(
-service $name /system/bin/yes
+service $name $command
     user shell
     group shell
     seclabel $selabel
 )init";
 
-    std::string script = StringReplace(StringReplace(kScriptTemplate, "$name", name, false),
-                                       "$selabel", GetSecurityContext(), false);
+    std::string script = StringReplace(kScriptTemplate, "$name", name, false);
+    script = StringReplace(script, "$command", command, false);
+    script = StringReplace(script, "$selabel", GetSecurityContext(), false);
     ServiceList& service_list = ServiceList::GetInstance();
     Parser parser;
     parser.AddSectionParser("service",
@@ -192,5 +194,33 @@ TEST_F(RebootTest, StopServicesSIGKILL) {
     EXPECT_EQ(nullptr, oneshot_service_after_stop);
 }
 
+TEST_F(RebootTest, StopServicesWithEscalation) {
+    if (getuid() != 0) {
+        GTEST_SKIP() << "Skipping test, must be run as root.";
+        return;
+    }
+
+    AddTestService("A");
+    // B ignores SIGTERM, so it has to be killed.
+    AddTestService("B", "/system/bin/sh -c \"trap '' TERM; while true; do sleep 1; done\"");
+
+    auto service_a = ServiceList::GetInstance().FindService("A");
+    ASSERT_NE(nullptr, service_a);
+    auto service_b = ServiceList::GetInstance().FindService("B");
+    ASSERT_NE(nullptr, service_b);
+
+    ASSERT_RESULT_OK(service_a->Start());
+    ASSERT_TRUE(service_a->IsRunning());
+    ASSERT_RESULT_OK(service_b->Start());
+    ASSERT_TRUE(service_b->IsRunning());
+
+    android::base::Timer t;
+    EXPECT_EQ(0, StopServicesWithEscalation({"A", "B"}, 500ms, 10s));
+    EXPECT_FALSE(service_a->IsRunning());
+    EXPECT_FALSE(service_b->IsRunning());
+    // B is killed after 500ms, rather than waited for until a timeout that covers all services.
+    EXPECT_LT(t.duration(), 5s);
+}
+
 }  // namespace init
 }  // namespace android
@@ -299,9 +299,11 @@ void Service::Reap(const siginfo_t& siginfo) {
         removeAllEmptyProcessGroups();
     }
 
+    pidfd_.reset();
+
     if (flags_ & SVC_TEMPORARY) return;
 
-    pid_ = 0;
+    SetPid(0);
     flags_ &= (~SVC_RUNNING);
     start_order_ = 0;
     was_last_exit_ok_ = siginfo.si_code == CLD_EXITED && siginfo.si_status == 0;
@@ -681,7 +683,7 @@ Result<void> Service::Start() {
     }
 
     if (pid < 0) {
-        pid_ = 0;
+        SetPid(0);
         return ErrnoError() << "Failed to fork";
     }
 
@@ -696,7 +698,8 @@ Result<void> Service::Start() {
     }
 
     time_started_ = boot_clock::now();
-    pid_ = pid;
+    SetPid(pid);
+    pidfd_ = OpenPidfd(pid);
     flags_ |= SVC_RUNNING;
     start_order_ = next_start_order_++;
     process_cgroup_empty_ = false;
@@ -829,13 +832,22 @@ void Service::SetStartedInFirstStage(pid_t pid) {
     LOG(INFO) << "adding first-stage service '" << name_ << "'...";
 
     time_started_ = boot_clock::now();  // not accurate, but doesn't matter here
-    pid_ = pid;
+    SetPid(pid);
+    pidfd_ = OpenPidfd(pid);
     flags_ |= SVC_RUNNING;
     start_order_ = next_start_order_++;
 
     NotifyStateChange("running");
 }
 
+void Service::SetPid(pid_t pid) {
+    pid_t old_pid = pid_;
+    pid_ = pid;
+    if (service_list_) {
+        service_list_->UpdatePid(this, old_pid);
+    }
+}
+
 void Service::ResetFlagsForStart() {
     // Starting a service removes it from the disabled or reset state and
     // immediately takes it out of the restarting state if it was in there.
@@ -65,8 +65,11 @@
 namespace android {
 namespace init {
 
+class ServiceList;
+
 class Service {
     friend class ServiceParser;
+    friend class ServiceList;
 
   public:
     Service(const std::string& name, Subcontext* subcontext_for_restart_commands,
@@ -114,6 +117,8 @@ class Service {
     const std::set<std::string>& classnames() const { return classnames_; }
     unsigned flags() const { return flags_; }
     pid_t pid() const { return pid_; }
+    // pidfd of the running process, or -1 if it is not running or pidfds are not supported.
+    int pidfd() const { return pidfd_.get(); }
     android::base::boot_clock::time_point time_started() const { return time_started_; }
     int crash_count() const { return crash_count_; }
     int was_last_exit_ok() const { return was_last_exit_ok_; }
@@ -166,6 +171,7 @@ class Service {
     void StopOrReset(int how);
     void KillProcessGroup(int signal);
     void SetProcessAttributesAndCaps(InterprocessFifo setsid_finished);
+    void SetPid(pid_t pid);
     void ResetFlagsForStart();
     Result<void> CheckConsole();
     void ConfigureMemcg();
@@ -182,6 +188,7 @@ class Service {
 
     unsigned flags_;
     pid_t pid_;
+    android::base::unique_fd pidfd_;
     android::base::boot_clock::time_point time_started_;  // time of last start
     android::base::boot_clock::time_point time_crashed_;  // first crash within inspection window
     int crash_count_;                     // number of times crashed within window
@@ -249,6 +256,9 @@ class Service {
     std::optional<std::string> on_failure_reboot_target_;
 
     std::string filename_;
+
+    // The list this service was added to, whose pid index SetPid() keeps up to date.
+    ServiceList* service_list_ = nullptr;
 };
 
 }  // namespace init
@@ -37,9 +37,72 @@ size_t ServiceList::CheckAllCommands() {
 }
 
 void ServiceList::AddService(std::unique_ptr<Service> service) {
+    AddToIndexes(service.get());
     services_.emplace_back(std::move(service));
 }
 
+void ServiceList::AddToIndexes(Service* service) {
+    service->service_list_ = this;
+    services_by_name_.emplace(service->name(), service);
+    if (service->pid() != 0) {
+        services_by_pid_[service->pid()] = service;
+    }
+    for (const auto& interface : service->interfaces()) {
+        services_by_interface_.emplace(interface, service);
+    }
+}
+
+void ServiceList::RemoveFromIndexes(Service& service) {
+    // If another service has the same name or provides the same interface, it takes over the
+    // index entry.
+    auto replacement = [this, &service](auto predicate) -> Service* {
+        for (const auto& s : services_) {
+            if (s.get() != &service && predicate(*s)) {
+                return s.get();
+            }
+        }
+        return nullptr;
+    };
+
+    if (auto it = services_by_name_.find(service.name());
+        it != services_by_name_.end() && it->second == &service) {
+        auto other = replacement([&service](const Service& s) { return s.name() == service.name(); });
+        if (other) {
+            it->second = other;
+        } else {
+            services_by_name_.erase(it);
+        }
+    }
+    if (auto it = services_by_pid_.find(service.pid());
+        it != services_by_pid_.end() && it->second == &service) {
+        services_by_pid_.erase(it);
+    }
+    service.service_list_ = nullptr;
+    for (const auto& interface : service.interfaces()) {
+        auto it = services_by_interface_.find(interface);
+        if (it == services_by_interface_.end() || it->second != &service) {
+            continue;
+        }
+        auto other = replacement(
+                [&interface](const Service& s) { return s.interfaces().count(interface) > 0; });
+        if (other) {
+            it->second = other;
+        } else {
+            services_by_interface_.erase(it);
+        }
+    }
+}
+
+void ServiceList::UpdatePid(Service* service, pid_t old_pid) {
+    if (auto old = services_by_pid_.find(old_pid);
+        old != services_by_pid_.end() && old->second == service) {
+        services_by_pid_.erase(old);
+    }
+    if (service->pid() != 0) {
+        services_by_pid_[service->pid()] = service;
+    }
+}
+
 // Shutdown services in the opposite order that they were started.
 const std::vector<Service*> ServiceList::services_in_shutdown_order() const {
     std::vector<Service*> shutdown_services;
@@ -59,7 +122,9 @@ void ServiceList::RemoveService(const Service& svc) {
         return;
     }
 
+    std::unique_ptr<Service> removed = std::move(*svc_it);
     services_.erase(svc_it);
+    RemoveFromIndexes(*removed);
 }
 
 void ServiceList::DumpState() const {
@@ -16,8 +16,12 @@
 
 #pragma once
 
+#include <algorithm>
 #include <iterator>
 #include <memory>
+#include <string>
+#include <type_traits>
+#include <unordered_map>
 #include <vector>
 
 #include <android-base/logging.h>
@@ -40,12 +44,33 @@ class ServiceList {
     void RemoveService(const Service& svc);
     template <class UnaryPredicate>
     void RemoveServiceIf(UnaryPredicate predicate) {
-        services_.erase(std::remove_if(services_.begin(), services_.end(), predicate),
-                        services_.end());
+        // Unlike std::remove_if(), this leaves the removed services intact so that they can be
+        // dropped from the indexes.
+        auto removed = std::stable_partition(
+                services_.begin(), services_.end(),
+                [&predicate](const std::unique_ptr<Service>& s) { return !predicate(s); });
+        std::vector<std::unique_ptr<Service>> removed_services(std::make_move_iterator(removed),
+                                                               std::make_move_iterator(services_.end()));
+        services_.erase(removed, services_.end());
+        for (const auto& s : removed_services) {
+            RemoveFromIndexes(*s);
+        }
     }
 
+    // Lookups by name and by pid use the indexes; lookups by any other property scan the list.
     template <typename T, typename F = decltype(&Service::name)>
     Service* FindService(T value, F function = &Service::name) const {
+        if constexpr (std::is_same_v<F, decltype(&Service::name)>) {
+            if (function == &Service::name) {
+                auto it = services_by_name_.find(std::string(value));
+                return it != services_by_name_.end() ? it->second : nullptr;
+            }
+        } else if constexpr (std::is_same_v<F, decltype(&Service::pid)>) {
+            if (function == &Service::pid && value != 0) {
+                auto it = services_by_pid_.find(value);
+                return it != services_by_pid_.end() ? it->second : nullptr;
+            }
+        }
         auto svc = std::find_if(services_.begin(), services_.end(),
                                 [&function, &value](const std::unique_ptr<Service>& s) {
                                     return std::invoke(function, s) == value;
@@ -68,15 +93,13 @@ class ServiceList {
     }
 
     Service* FindInterface(const std::string& interface_name) {
-        for (const auto& svc : services_) {
-            if (svc->interfaces().count(interface_name) > 0) {
-                return svc.get();
-            }
-        }
-
-        return nullptr;
+        auto it = services_by_interface_.find(interface_name);
+        return it != services_by_interface_.end() ? it->second : nullptr;
     }
 
+    // Called by a Service of this list when its pid changes, to keep the pid index up to date.
+    void UpdatePid(Service* service, pid_t old_pid);
+
     void DumpState() const;
 
     auto begin() const { return services_.begin(); }
@@ -93,8 +116,17 @@ class ServiceList {
     auto size() const { return services_.size(); }
 
   private:
+    void AddToIndexes(Service* service);
+    void RemoveFromIndexes(Service& service);
+
     std::vector<std::unique_ptr<Service>> services_;
 
+    // Indexes of services_. When several services share a name or an interface, the first one
+    // in services_ is indexed, which is the one a scan of the list would find.
+    std::unordered_map<std::string, Service*> services_by_name_;
+    std::unordered_map<pid_t, Service*> services_by_pid_;
+    std::unordered_map<std::string, Service*> services_by_interface_;
+
     bool post_data_ = false;
     std::vector<std::string> delayed_service_names_;
 };
@@ -0,0 +1,96 @@
+/*
+ * Copyright (C) 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <memory>
+#include <string>
+
+#include <android-base/file.h>
+#include <android-base/stringprintf.h>
+#include <benchmark/benchmark.h>
+
+#include "parser.h"
+#include "service_list.h"
+#include "service_parser.h"
+
+using android::base::StringAppendF;
+using android::base::StringPrintf;
+
+namespace android {
+namespace init {
+
+// Parses |range(0)| services, each providing one interface, into |service_list|.
+static bool PopulateServiceList(benchmark::State& state, ServiceList* service_list) {
+    std::string script;
+    for (int i = 0; i < state.range(0); i++) {
+        StringAppendF(&script,
+                      "service bench_%d /system/bin/true\n"
+                      "    interface aidl bench_%d\n"
+                      "    disabled\n",
+                      i, i);
+    }
+
+    TemporaryFile tf;
+    if (tf.fd == -1 || !android::base::WriteStringToFd(script, tf.fd)) {
+        state.SkipWithError("could not write init script");
+        return false;
+    }
+    Parser parser;
+    parser.AddSectionParser("service",
+                            std::make_unique<ServiceParser>(service_list, nullptr, std::nullopt));
+    if (!parser.ParseConfig(tf.path) || service_list->size() != size_t(state.range(0))) {
+        state.SkipWithError("could not parse init script");
+        return false;
+    }
+    return true;
+}
+
+// Looks up the last service, as for control messages and 'start' commands.
+static void BM_FindServiceByName(benchmark::State& state) {
+    ServiceList service_list;
+    if (!PopulateServiceList(state, &service_list)) return;
+    std::string name = StringPrintf("bench_%d", int(state.range(0) - 1));
+
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(service_list.FindService(name));
+    }
+}
+BENCHMARK(BM_FindServiceByName)->Arg(100)->Arg(500)->Arg(1000);
+
+// Looks up a pid that no service has, as for the children of services that are reaped by init.
+static void BM_FindServiceByPid(benchmark::State& state) {
+    ServiceList service_list;
+    if (!PopulateServiceList(state, &service_list)) return;
+
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(service_list.FindService(getpid(), &Service::pid));
+    }
+}
+BENCHMARK(BM_FindServiceByPid)->Arg(100)->Arg(500)->Arg(1000);
+
+// Looks up the last interface, as for interface_start and ctl.interface_* messages.
+static void BM_FindInterface(benchmark::State& state) {
+    ServiceList service_list;
+    if (!PopulateServiceList(state, &service_list)) return;
+    std::string interface = StringPrintf("aidl/bench_%d", int(state.range(0) - 1));
+
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(service_list.FindInterface(interface));
+    }
+}
+BENCHMARK(BM_FindInterface)->Arg(100)->Arg(500)->Arg(1000);
+
+}  // namespace init
+}  // namespace android
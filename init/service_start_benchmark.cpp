@@ -0,0 +1,90 @@
+/*
+ * Copyright (C) 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+
+#include <benchmark/benchmark.h>
+#include <selinux/selinux.h>
+
+#include "service.h"
+
+namespace android {
+namespace init {
+
+// Starts a service the way init does during boot, and waits for it to exit. The time per
+// iteration is the start latency of one service: spawning it, creating its process group and
+// handing it over to exec. |range(0)| MiB of memory are mapped and touched first, since the cost
+// of forking grows with the size of init's address space.
+static void BM_ServiceStart(benchmark::State& state) {
+    if (getuid() != 0) {
+        state.SkipWithError("Skipping benchmark, must be run as root.");
+        return;
+    }
+    char* context;
+    if (getcon(&context) != 0) {
+        state.SkipWithError("getcon() failed");
+        return;
+    }
+    std::string seclabel = context;
+    freecon(context);
+
+    size_t ballast_size = state.range(0) << 20;
+    void* ballast = nullptr;
+    if (ballast_size) {
+        ballast = mmap(nullptr, ballast_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS,
+                       -1, 0);
+        if (ballast == MAP_FAILED) {
+            state.SkipWithError("mmap() failed");
+            return;
+        }
+        memset(ballast, 1, ballast_size);
+    }
+
+    for (auto _ : state) {
+        state.PauseTiming();
+        auto service = Service::MakeTemporaryOneshotService(
+                {"exec", seclabel, "root", "--", "/system/bin/true"});
+        if (!service.ok()) {
+            state.SkipWithError(service.error().message().c_str());
+            break;
+        }
+        state.ResumeTiming();
+
+        if (auto result = (*service)->Start(); !result.ok()) {
+            state.SkipWithError(result.error().message().c_str());
+            break;
+        }
+
+        state.PauseTiming();
+        siginfo_t siginfo = {};
+        if (TEMP_FAILURE_RETRY(waitid(P_PID, (*service)->pid(), &siginfo, WEXITED)) != 0) {
+            state.SkipWithError("waitid() failed");
+            break;
+        }
+        (*service)->Reap(siginfo);
+        state.ResumeTiming();
+    }
+
+    if (ballast) {
+        munmap(ballast, ballast_size);
+    }
+}
+BENCHMARK(BM_ServiceStart)->Arg(0)->Arg(256)->ArgName("ballast_mb")->Unit(benchmark::kMicrosecond);
+
+}  // namespace init
+}  // namespace android
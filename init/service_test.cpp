@@ -29,6 +29,7 @@
 #include <android-base/strings.h>
 #include <selinux/selinux.h>
 #include <sys/signalfd.h>
+#include <sys/wait.h>
 #include "lmkd_service.h"
 #include "reboot.h"
 #include "service.h"
@@ -265,6 +266,7 @@ service $name /system/bin/yes
     ASSERT_NE(service, nullptr);
     ASSERT_RESULT_OK(service->Start());
     ASSERT_TRUE(service->IsRunning());
+    EXPECT_GE(service->pidfd(), 0);
     if (GetParam()) {
         const pid_t pid = service->pid();
         const std::string cgroup_path = CgroupPath(pid);
@@ -281,5 +283,62 @@ service $name /system/bin/yes
 
 INSTANTIATE_TEST_SUITE_P(service, ServiceStopTest, testing::Values(false, true));
 
+TEST(service_list, indexes_follow_removal) {
+    static constexpr std::string_view kScriptTemplate = R"init(
+service A /system/bin/true
+    interface aidl A
+service B /system/bin/yes
+    interface aidl B
+    user shell
+    group shell
+    seclabel $selabel
+service C /system/bin/true
+    interface aidl C
+)init";
+
+    std::string script = StringReplace(kScriptTemplate, "$selabel", GetSecurityContext(), false);
+    ServiceList service_list;
+    Parser parser;
+    parser.AddSectionParser("service",
+                            std::make_unique<ServiceParser>(&service_list, nullptr, std::nullopt));
+    TemporaryFile tf;
+    ASSERT_GE(tf.fd, 0);
+    ASSERT_TRUE(WriteStringToFd(script, tf.fd));
+    ASSERT_TRUE(parser.ParseConfig(tf.path));
+
+    Service* b = service_list.FindService("B");
+    ASSERT_NE(b, nullptr);
+    EXPECT_EQ(service_list.FindInterface("aidl/B"), b);
+    EXPECT_EQ(service_list.FindService(std::string_view("C"))->name(), "C");
+
+    // Starting and reaping a service updates the pid index of the list that owns it, not the
+    // global one.
+    if (getuid() == 0) {
+        ASSERT_RESULT_OK(b->Start());
+        const pid_t pid = b->pid();
+        ASSERT_GT(pid, 0);
+        EXPECT_EQ(service_list.FindService(pid, &Service::pid), b);
+        EXPECT_EQ(ServiceList::GetInstance().FindService(pid, &Service::pid), nullptr);
+
+        b->Stop();
+        siginfo_t siginfo = {};
+        ASSERT_EQ(TEMP_FAILURE_RETRY(waitid(P_PID, pid, &siginfo, WEXITED)), 0);
+        b->Reap(siginfo);
+        EXPECT_EQ(service_list.FindService(pid, &Service::pid), nullptr);
+    }
+
+    service_list.RemoveService(*b);
+    EXPECT_EQ(service_list.FindService("B"), nullptr);
+    EXPECT_EQ(service_list.FindInterface("aidl/B"), nullptr);
+
+    service_list.RemoveServiceIf(
+            [](const std::unique_ptr<Service>& s) { return s->name() == "A"; });
+    EXPECT_EQ(service_list.FindService("A"), nullptr);
+    EXPECT_EQ(service_list.FindInterface("aidl/A"), nullptr);
+    ASSERT_NE(service_list.FindService("C"), nullptr);
+    EXPECT_EQ(service_list.FindInterface("aidl/C"), service_list.FindService("C"));
+    EXPECT_EQ(service_list.size(), 1u);
+}
+
 }  // namespace init
 }  // namespace android
@@ -21,6 +21,7 @@
 #include <map>
 #include <sys/mount.h>
 #include <sys/prctl.h>
+#include <sys/syscall.h>
 #include <sys/wait.h>
 #include <unistd.h>
 
@@ -36,6 +37,10 @@
 #include "mount_namespace.h"
 #include "util.h"
 
+#ifndef __NR_pidfd_open
+#define __NR_pidfd_open 434
+#endif
+
 using android::base::GetProperty;
 using android::base::StartsWith;
 using android::base::StringPrintf;
@@ -341,5 +346,22 @@ Result<void> WritePidToFiles(std::vector<std::string>* files) {
     return {};
 }
 
+unique_fd OpenPidfd(pid_t pid) {
+    static bool pidfd_supported = true;
+    if (!pidfd_supported) {
+        return {};
+    }
+    unique_fd pidfd(syscall(__NR_pidfd_open, pid, 0));
+    if (pidfd == -1) {
+        if (errno == ENOSYS) {
+            LOG(INFO) << "pidfds are not supported by this kernel";
+            pidfd_supported = false;
+        } else {
+            PLOG(ERROR) << "pidfd_open(" << pid << ") failed";
+        }
+    }
+    return pidfd;
+}
+
 }  // namespace init
 }  // namespace android
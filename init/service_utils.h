@@ -108,5 +108,9 @@ Result<void> SetProcessAttributes(const ProcessAttributes& attr, InterprocessFif
 
 Result<void> WritePidToFiles(std::vector<std::string>* files);
 
+// Returns a pidfd for |pid|, which must be a child of the caller that has not been reaped yet so
+// that the pid cannot have been reused. The fd is invalid if the kernel does not support pidfds.
+android::base::unique_fd OpenPidfd(pid_t pid);
+
 }  // namespace init
 }  // namespace android
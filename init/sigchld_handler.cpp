@@ -16,6 +16,7 @@
 
 #include "sigchld_handler.h"
 
+#include <fcntl.h>
 #include <signal.h>
 #include <string.h>
 #include <sys/signalfd.h>
@@ -29,7 +30,9 @@
 #include <android-base/logging.h>
 #include <android-base/scopeguard.h>
 #include <android-base/stringprintf.h>
+#include <android-base/unique_fd.h>
 
+#include <map>
 #include <thread>
 
 #include "epoll.h"
@@ -42,6 +45,7 @@ using android::base::make_scope_guard;
 using android::base::ReadFileToString;
 using android::base::StringPrintf;
 using android::base::Timer;
+using android::base::unique_fd;
 
 namespace android {
 namespace init {
@@ -151,8 +155,43 @@ void WaitToBeReaped(int sigchld_fd, const std::vector<pid_t>& pids,
                     std::chrono::milliseconds timeout) {
     Timer t;
     Epoll epoll;
+    auto open_result = epoll.Open();
+
+    // Wait on the pidfds of the services that |pids| belong to, which only become readable when
+    // those exit. SIGCHLD, which is sent for every child, is only needed for the other pids.
+    std::map<pid_t, unique_fd> pidfds;
+    bool need_sigchld = false;
+    for (pid_t pid : pids) {
+        Service* service = ServiceList::GetInstance().FindService(pid, &Service::pid);
+        unique_fd pidfd;
+        if (open_result.ok() && service && service->pidfd() != -1) {
+            pidfd.reset(fcntl(service->pidfd(), F_DUPFD_CLOEXEC, 0));
+        }
+        if (pidfd == -1 || !epoll.RegisterHandler(pidfd.get(), [] {}).ok()) {
+            need_sigchld = true;
+            continue;
+        }
+        pidfds.emplace(pid, std::move(pidfd));
+    }
+    if (!need_sigchld) {
+        sigchld_fd = -1;
+    }
+    // Stops waiting on the pidfds of the pids that have been reaped, as they stay readable.
+    auto forget_reaped = [&](const std::vector<pid_t>& alive_pids) {
+        for (auto it = pidfds.begin(); it != pidfds.end();) {
+            if (std::find(alive_pids.begin(), alive_pids.end(), it->first) == alive_pids.end()) {
+                if (auto result = epoll.UnregisterHandler(it->second.get()); !result.ok()) {
+                    LOG(WARNING) << __func__ << " UnregisterHandler() failed: " << result.error();
+                }
+                it = pidfds.erase(it);
+            } else {
+                ++it;
+            }
+        }
+    };
+
     if (sigchld_fd >= 0) {
-        if (auto result = epoll.Open(); result.ok()) {
+        if (auto result = open_result; result.ok()) {
             result =
                     epoll.RegisterHandler(sigchld_fd, [sigchld_fd]() { HandleSignal(sigchld_fd); });
             if (!result.ok()) {
@@ -169,11 +208,13 @@ void WaitToBeReaped(int sigchld_fd, const std::vector<pid_t>& pids,
     }
     std::vector<pid_t> alive_pids(pids);
     ReapAndRemove(alive_pids);
+    forget_reaped(alive_pids);
     while (!alive_pids.empty() && t.duration() < timeout) {
-        if (sigchld_fd >= 0) {
+        if (sigchld_fd >= 0 || !pidfds.empty()) {
             auto result = epoll.Wait(std::max(timeout - t.duration(), 0ms));
             if (result.ok()) {
                 ReapAndRemove(alive_pids);
+                forget_reaped(alive_pids);
                 continue;
             } else {
                 LOG(WARNING) << "Epoll::Wait() failed " << result.error();
@@ -181,6 +222,7 @@ void WaitToBeReaped(int sigchld_fd, const std::vector<pid_t>& pids,
         }
         std::this_thread::sleep_for(50ms);
         ReapAndRemove(alive_pids);
+        forget_reaped(alive_pids);
     }
     LOG(INFO) << "Waiting for " << pids.size() << " pids to be reaped took " << t << " with "
               << alive_pids.size() << " of them still running";
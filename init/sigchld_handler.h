@@ -26,6 +26,8 @@ namespace init {
 
 std::set<pid_t> ReapAnyOutstandingChildren();
 
+// Waits for |pids| to be reaped, on the pidfds of the services that they belong to, or on
+// |sigchld_fd| for the pids that don't have one.
 void WaitToBeReaped(int sigchld_fd, const std::vector<pid_t>& pids,
                     std::chrono::milliseconds timeout);
 
@@ -0,0 +1,145 @@
+/*
+ * Copyright (C) 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "sigchld_handler.h"
+
+#include <errno.h>
+#include <signal.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <android-base/chrono_utils.h>
+#include <android-base/file.h>
+#include <android-base/strings.h>
+#include <gtest/gtest.h>
+#include <selinux/selinux.h>
+
+#include "parser.h"
+#include "service.h"
+#include "service_list.h"
+#include "service_parser.h"
+
+using namespace std::literals;
+
+using android::base::StringReplace;
+using android::base::Timer;
+using android::base::WriteStringToFd;
+
+namespace android {
+namespace init {
+
+namespace {
+
+std::string GetSecurityContext() {
+    char* ctx;
+    if (getcon(&ctx) == -1) {
+        ADD_FAILURE() << "Failed to call getcon : " << strerror(errno);
+    }
+    std::string result = std::string(ctx);
+    freecon(ctx);
+    return result;
+}
+
+Service* AddTestService(const std::string& name, const std::string& command) {
+    static constexpr std::string_view kScriptTemplate = R"init(
+service $name $command
+    user shell
+    group shell
+    seclabel $selabel
+    oneshot
+)init";
+
+    std::string script = StringReplace(kScriptTemplate, "$name", name, false);
+    script = StringReplace(script, "$command", command, false);
+    script = StringReplace(script, "$selabel", GetSecurityContext(), false);
+    Parser parser;
+    parser.AddSectionParser("service", std::make_unique<ServiceParser>(
+                                               &ServiceList::GetInstance(), nullptr, std::nullopt));
+
+    TemporaryFile tf;
+    EXPECT_NE(tf.fd, -1);
+    EXPECT_TRUE(WriteStringToFd(script, tf.fd));
+    EXPECT_TRUE(parser.ParseConfig(tf.path));
+    return ServiceList::GetInstance().FindService(name);
+}
+
+}  // namespace
+
+class SigchldHandlerTest : public ::testing::Test {
+  protected:
+    void SetUp() override {
+        if (getuid() != 0) {
+            GTEST_SKIP() << "Must be run as root.";
+        }
+    }
+
+    ~SigchldHandlerTest() {
+        for (const auto& name : names_) {
+            Service* service = ServiceList::GetInstance().FindService(name);
+            if (!service) continue;
+            const pid_t pid = service->pid();
+            ServiceList::GetInstance().RemoveService(*service);
+            if (pid > 0) {
+                kill(pid, SIGKILL);
+                waitpid(pid, nullptr, 0);
+            }
+        }
+    }
+
+    Service* AddService(const std::string& name, const std::string& command) {
+        names_.emplace_back(name);
+        return AddTestService(name, command);
+    }
+
+  private:
+    std::vector<std::string> names_;
+};
+
+TEST_F(SigchldHandlerTest, WaitToBeReapedOnPidfds) {
+    Service* exiting = AddService("A", "/system/bin/sh -c \"sleep 0.2\"");
+    ASSERT_NE(exiting, nullptr);
+    Service* running = AddService("B", "/system/bin/yes");
+    ASSERT_NE(running, nullptr);
+    ASSERT_RESULT_OK(exiting->Start());
+    ASSERT_RESULT_OK(running->Start());
+    if (exiting->pidfd() == -1 || running->pidfd() == -1) {
+        GTEST_SKIP() << "pidfds are not supported by this kernel.";
+    }
+
+    // There is no SIGCHLD fd to wake up on, only the pidfds.
+    Timer t;
+    WaitToBeReaped(-1, {exiting->pid()}, 10s);
+    EXPECT_FALSE(exiting->IsRunning());
+    EXPECT_LT(t.duration(), 5s);
+
+    // A service that does not exit is waited for until the timeout.
+    const pid_t pid = running->pid();
+    t = Timer();
+    WaitToBeReaped(-1, {pid}, 200ms);
+    EXPECT_GE(t.duration(), 200ms);
+    EXPECT_TRUE(running->IsRunning());
+
+    running->Stop();
+    WaitToBeReaped(-1, {pid}, 10s);
+    EXPECT_FALSE(running->IsRunning());
+}
+
+}  // namespace init
+}  // namespace android
@@ -22,6 +22,7 @@
 #include <sys/resource.h>
 #include <unistd.h>
 
+#include <android-base/chrono_utils.h>
 #include <android-base/file.h>
 #include <android-base/logging.h>
 #include <android-base/properties.h>
@@ -68,6 +69,8 @@ class SubcontextProcess {
   private:
     void RunCommand(const SubcontextCommand::ExecuteCommand& execute_command,
                     SubcontextReply* reply) const;
+    void RunCommands(const SubcontextCommand::ExecuteBatchCommand& execute_batch_command,
+                     SubcontextReply* reply) const;
     void ExpandArgs(const SubcontextCommand::ExpandArgsCommand& expand_args_command,
                     SubcontextReply* reply) const;
 
@@ -101,6 +104,49 @@ void SubcontextProcess::RunCommand(const SubcontextCommand::ExecuteCommand& exec
     }
 }
 
+void SubcontextProcess::RunCommands(
+        const SubcontextCommand::ExecuteBatchCommand& execute_batch_command,
+        SubcontextReply* reply) const {
+    // The reply must fit in one message. A command is only started while there is room left for
+    // a typical result, and an error message that would not fit is truncated.
+    static constexpr size_t kResultReserve = 512;
+    static constexpr size_t kShutdownReserve = 128;
+
+    auto* batch_reply = reply->mutable_execute_batch_reply();
+    for (const auto& command : execute_batch_command.commands()) {
+        if (batch_reply->results_size() > 0 &&
+            reply->ByteSizeLong() + kResultReserve > kBufferSize) {
+            break;
+        }
+
+        android::base::Timer t;
+        auto command_reply = SubcontextReply();
+        RunCommand(command, &command_reply);
+
+        auto* result = batch_reply->add_results();
+        if (command_reply.reply_case() == SubcontextReply::kFailure) {
+            *result->mutable_failure() = command_reply.failure();
+        } else {
+            result->set_success(true);
+        }
+        result->set_duration_ms(t.duration().count());
+
+        size_t size = reply->ByteSizeLong();
+        if (size + kShutdownReserve > kBufferSize && result->has_failure()) {
+            auto* error_string = result->mutable_failure()->mutable_error_string();
+            error_string->resize(
+                    error_string->size() - std::min(error_string->size(),
+                                                    size + kShutdownReserve - kBufferSize));
+        }
+
+        // The remaining commands must not run once a shutdown has been requested, as init
+        // clears its action queue when it handles the shutdown.
+        if (!shutdown_command.empty()) {
+            break;
+        }
+    }
+}
+
 void SubcontextProcess::ExpandArgs(const SubcontextCommand::ExpandArgsCommand& expand_args_command,
                                    SubcontextReply* reply) const {
     for (const auto& arg : expand_args_command.args()) {
@@ -156,6 +202,10 @@ void SubcontextProcess::MainLoop() {
                 ExpandArgs(subcontext_command.expand_args_command(), &reply);
                 break;
             }
+            case SubcontextCommand::kExecuteBatchCommand: {
+                RunCommands(subcontext_command.execute_batch_command(), &reply);
+                break;
+            }
             default:
                 LOG(FATAL) << "Unknown message type from init: "
                            << subcontext_command.command_case();
@@ -316,6 +366,51 @@ Result<void> Subcontext::Execute(const std::vector<std::string>& args) {
     return {};
 }
 
+Result<std::vector<Subcontext::CommandResult>> Subcontext::ExecuteBatch(
+        const std::vector<std::vector<std::string>>& commands) {
+    auto subcontext_command = SubcontextCommand();
+    auto* batch = subcontext_command.mutable_execute_batch_command();
+    for (const auto& args : commands) {
+        auto* command = batch->add_commands();
+        std::copy(args.begin(), args.end(),
+                  RepeatedPtrFieldBackInserter(command->mutable_args()));
+        // Leave the commands that do not fit for the next batch. A single command that is too
+        // long fails to be sent, as it would with Execute().
+        if (batch->commands_size() > 1 && subcontext_command.ByteSizeLong() > kBufferSize) {
+            batch->mutable_commands()->RemoveLast();
+            break;
+        }
+    }
+
+    auto subcontext_reply = TransmitMessage(subcontext_command);
+    if (!subcontext_reply.ok()) {
+        return subcontext_reply.error();
+    }
+
+    if (subcontext_reply->reply_case() != SubcontextReply::kExecuteBatchReply) {
+        return Error() << "Unexpected message type from subcontext: "
+                       << subcontext_reply->reply_case();
+    }
+
+    auto& reply = subcontext_reply->execute_batch_reply();
+    if (reply.results_size() == 0 || reply.results_size() > batch->commands_size()) {
+        return Error() << "Subcontext returned " << reply.results_size() << " results for "
+                       << batch->commands_size() << " commands";
+    }
+
+    auto results = std::vector<CommandResult>{};
+    for (const auto& command_result : reply.results()) {
+        CommandResult result;
+        if (command_result.has_failure()) {
+            auto& failure = command_result.failure();
+            result.result = ResultError<>(failure.error_string(), failure.error_errno());
+        }
+        result.duration = std::chrono::milliseconds(command_result.duration_ms());
+        results.emplace_back(std::move(result));
+    }
+    return results;
+}
+
 Result<std::vector<std::string>> Subcontext::ExpandArgs(const std::vector<std::string>& args) {
     auto subcontext_command = SubcontextCommand{};
     std::copy(args.begin(), args.end(),
@@ -18,6 +18,7 @@
 
 #include <signal.h>
 
+#include <chrono>
 #include <string>
 #include <vector>
 
@@ -45,7 +46,19 @@ class Subcontext {
         }
     }
 
+    struct CommandResult {
+        Result<void> result;
+        // Time taken by the command in the subcontext.
+        std::chrono::milliseconds duration;
+    };
+
     Result<void> Execute(const std::vector<std::string>& args);
+    // Executes |commands| in order in one round trip, and returns the result of each command
+    // that was executed. That is at least the first one; the subcontext stops early if the
+    // commands or their results do not fit in one message, or after a command that triggers a
+    // shutdown. The caller sends the remaining commands again.
+    Result<std::vector<CommandResult>> ExecuteBatch(
+            const std::vector<std::vector<std::string>>& commands);
     Result<std::vector<std::string>> ExpandArgs(const std::vector<std::string>& args);
     void Restart();
     bool PathMatchesSubcontext(const std::string& path) const;
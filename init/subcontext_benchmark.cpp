@@ -39,6 +39,7 @@ static void BenchmarkSuccess(benchmark::State& state) {
     while (state.KeepRunning()) {
         subcontext.Execute(std::vector<std::string>{"return_success"});
     }
+    state.SetItemsProcessed(state.iterations());
 
     if (subcontext.pid() > 0) {
         kill(subcontext.pid(), SIGTERM);
@@ -48,6 +49,42 @@ static void BenchmarkSuccess(benchmark::State& state) {
 
 BENCHMARK(BenchmarkSuccess);
 
+// Runs |range(0)| commands per round trip. items_per_second is the number of commands per second.
+static void BenchmarkBatchSuccess(benchmark::State& state) {
+    if (getuid() != 0) {
+        state.SkipWithError("Skipping benchmark, must be run as root.");
+        return;
+    }
+    char* context;
+    if (getcon(&context) != 0) {
+        state.SkipWithError("getcon() failed");
+        return;
+    }
+
+    auto subcontext = Subcontext({"path"}, context);
+    free(context);
+
+    auto commands = std::vector<std::vector<std::string>>(
+            state.range(0), std::vector<std::string>{"return_success"});
+    size_t executed = 0;
+    while (state.KeepRunning()) {
+        auto results = subcontext.ExecuteBatch(commands);
+        if (!results.ok()) {
+            state.SkipWithError(results.error().message().c_str());
+            break;
+        }
+        executed += results->size();
+    }
+    state.SetItemsProcessed(executed);
+
+    if (subcontext.pid() > 0) {
+        kill(subcontext.pid(), SIGTERM);
+        kill(subcontext.pid(), SIGKILL);
+    }
+}
+
+BENCHMARK(BenchmarkBatchSuccess)->Arg(1)->Arg(8)->Arg(32);
+
 BuiltinFunctionMap BuildTestFunctionMap() {
     auto function = [](const BuiltinArguments& args) { return Result<void>{}; };
     BuiltinFunctionMap test_function_map = {
@@ -148,6 +148,60 @@ TEST(subcontext, TriggerShutdown) {
     EXPECT_EQ(kTestShutdownCommand, trigger_shutdown_command);
 }
 
+TEST(subcontext, ExecuteBatch) {
+    RunTest([](auto& subcontext) {
+        auto commands = std::vector<std::vector<std::string>>{
+                {"add_word", "this"},
+                {"add_word", "is"},
+                {"generate_sane_error"},
+                {"add_word", "batched"},
+                {"return_words_as_error"},
+        };
+        auto results = subcontext.ExecuteBatch(commands);
+        ASSERT_RESULT_OK(results);
+        ASSERT_EQ(commands.size(), results->size());
+        EXPECT_RESULT_OK((*results)[0].result);
+        EXPECT_RESULT_OK((*results)[1].result);
+        ASSERT_FALSE((*results)[2].result.ok());
+        EXPECT_EQ("Sane error!", (*results)[2].result.error().message());
+        EXPECT_RESULT_OK((*results)[3].result);
+        ASSERT_FALSE((*results)[4].result.ok());
+        EXPECT_EQ("this is batched", (*results)[4].result.error().message());
+    });
+}
+
+TEST(subcontext, ExecuteBatchTooLong) {
+    RunTest([](auto& subcontext) {
+        auto commands = std::vector<std::vector<std::string>>(
+                200, std::vector<std::string>{"add_word", std::string(64, 'w')});
+        size_t executed = 0;
+        while (executed < commands.size()) {
+            auto remaining = std::vector<std::vector<std::string>>(commands.begin() + executed,
+                                                                   commands.end());
+            auto results = subcontext.ExecuteBatch(remaining);
+            ASSERT_RESULT_OK(results);
+            ASSERT_GT(results->size(), 0U);
+            ASSERT_LT(results->size(), commands.size());
+            executed += results->size();
+        }
+        EXPECT_EQ(commands.size(), executed);
+    });
+}
+
+TEST(subcontext, ExecuteBatchStopsAtShutdown) {
+    static std::string trigger_shutdown_command;
+    trigger_shutdown = [](const std::string& command) { trigger_shutdown_command = command; };
+    RunTest([](auto& subcontext) {
+        auto results = subcontext.ExecuteBatch({
+                {"trigger_shutdown", "reboot,test-batch"},
+                {"add_word", "unreachable"},
+        });
+        ASSERT_RESULT_OK(results);
+        EXPECT_EQ(1U, results->size());
+    });
+    EXPECT_EQ("reboot,test-batch", trigger_shutdown_command);
+}
+
 TEST(subcontext, ExpandArgs) {
     RunTest([](auto& subcontext) {
         auto args = std::vector<std::string>{
@@ -16,15 +16,21 @@
 
 #pragma once
 
+#include <deque>
+#include <memory>
 #include <mutex>
 #include <set>
 #include <string>
+#include <string_view>
 #include <unordered_map>
 #include <unordered_set>
 #include <vector>
 
+#include <android-base/mapped_file.h>
 #include <android-base/thread_annotations.h>
 
+#include <modprobe/module_alias_matcher.h>
+
 class Modprobe {
   public:
     Modprobe(const std::vector<std::string>&, const std::string load_file = "modules.load",
@@ -36,6 +42,13 @@ class Modprobe {
                          const std::string& parameters = "");
     bool Remove(const std::string& module_name);
     std::vector<std::string> ListModules(const std::string& pattern);
+    // Writes base_path/modules.index, a binary copy of the alias, dependency
+    // and softdep files in |base_path| that later Modprobe instances load in
+    // place of parsing those files, for as long as they are unchanged. Paths
+    // are stored relative to |base_path|, so the index can be written into a
+    // staging directory at build time and used wherever the directory is
+    // installed.
+    static bool WriteIndex(const std::string& base_path);
     bool GetAllDependencies(const std::string& module, std::vector<std::string>* pre_dependencies,
                             std::vector<std::string>* dependencies,
                             std::vector<std::string>* post_dependencies);
@@ -53,6 +66,7 @@ class Modprobe {
                    const std::string& value);
     std::string GetKernelCmdline();
     bool IsBlocklisted(const std::string& module_name);
+    bool IsLoaded(const std::string& canonical_name);
 
     bool ParseDepCallback(const std::string& base_path, const std::vector<std::string>& args);
     bool ParseAliasCallback(const std::vector<std::string>& args);
@@ -62,8 +76,14 @@ class Modprobe {
     bool ParseBlocklistCallback(const std::vector<std::string>& args);
     void ParseKernelCmdlineOptions();
     void ParseCfg(const std::string& cfg, std::function<bool(const std::vector<std::string>&)> f);
+    bool ReadIndex(const std::string& base_path);
 
-    std::vector<std::pair<std::string, std::string>> module_aliases_;
+    // The strings are either in a mapped modules.index or in alias_strings_,
+    // and are always null-terminated.
+    std::vector<std::pair<std::string_view, std::string_view>> module_aliases_;
+    std::deque<std::string> alias_strings_;
+    std::vector<std::unique_ptr<android::base::MappedFile>> module_indexes_;
+    ModuleAliasMatcher alias_matcher_;
     std::unordered_map<std::string, std::vector<std::string>> module_deps_;
     std::vector<std::pair<std::string, std::string>> module_pre_softdep_;
     std::vector<std::pair<std::string, std::string>> module_post_softdep_;
@@ -0,0 +1,57 @@
+/*
+ * Copyright (C) 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+// Matches names against the fnmatch() patterns of modules.alias.
+//
+// Patterns without wildcards are looked up in a hash table. The others are
+// stored in a trie keyed by their literal prefix, the part before the first
+// wildcard, and a lookup only calls fnmatch() on the patterns whose prefix is
+// a prefix of the name. Modaliases have long literal prefixes, such as
+// "pci:v00008086d", so only a handful of patterns are tried per name.
+//
+// The matcher refers to the patterns given to Build() rather than copying
+// them, so they must outlive it and be null-terminated.
+class ModuleAliasMatcher {
+  public:
+    void Build(const std::vector<std::pair<std::string_view, std::string_view>>& aliases);
+
+    // Returns the indices, in the vector given to Build(), of the aliases
+    // whose pattern matches |name|, in increasing order.
+    std::vector<size_t> Match(const std::string& name) const;
+
+  private:
+    struct Node {
+        // Sorted by character.
+        std::vector<std::pair<char, uint32_t>> children;
+        std::vector<uint32_t> patterns;
+    };
+
+    uint32_t Child(uint32_t node, char c) const;
+
+    std::vector<std::string_view> patterns_;
+    std::unordered_map<std::string_view, std::vector<uint32_t>> literals_;
+    std::vector<Node> nodes_;
+};
@@ -21,8 +21,12 @@
 #include <sys/syscall.h>
 
 #include <algorithm>
+#include <chrono>
+#include <condition_variable>
 #include <map>
+#include <optional>
 #include <set>
+#include <shared_mutex>
 #include <string>
 #include <thread>
 #include <vector>
@@ -104,8 +108,8 @@ bool Modprobe::ParseAliasCallback(const std::vector<std::string>& args) {
         return false;
     }
 
-    const std::string& alias = *it++;
-    const std::string& module_name = *it++;
+    const std::string& alias = alias_strings_.emplace_back(*it++);
+    const std::string& module_name = alias_strings_.emplace_back(*it++);
     this->module_aliases_.emplace_back(alias, module_name);
 
     return true;
@@ -321,14 +325,16 @@ Modprobe::Modprobe(const std::vector<std::string>& base_paths, const std::string
     using namespace std::placeholders;
 
     for (const auto& base_path : base_paths) {
-        auto alias_callback = std::bind(&Modprobe::ParseAliasCallback, this, _1);
-        ParseCfg(base_path + "/modules.alias", alias_callback);
+        if (!ReadIndex(base_path)) {
+            auto alias_callback = std::bind(&Modprobe::ParseAliasCallback, this, _1);
+            ParseCfg(base_path + "/modules.alias", alias_callback);
 
-        auto dep_callback = std::bind(&Modprobe::ParseDepCallback, this, base_path, _1);
-        ParseCfg(base_path + "/modules.dep", dep_callback);
+            auto dep_callback = std::bind(&Modprobe::ParseDepCallback, this, base_path, _1);
+            ParseCfg(base_path + "/modules.dep", dep_callback);
 
-        auto softdep_callback = std::bind(&Modprobe::ParseSoftdepCallback, this, _1);
-        ParseCfg(base_path + "/modules.softdep", softdep_callback);
+            auto softdep_callback = std::bind(&Modprobe::ParseSoftdepCallback, this, _1);
+            ParseCfg(base_path + "/modules.softdep", softdep_callback);
+        }
 
         auto load_callback = std::bind(&Modprobe::ParseLoadCallback, this, _1);
         ParseCfg(base_path + "/" + load_file, load_callback);
@@ -340,6 +346,7 @@ Modprobe::Modprobe(const std::vector<std::string>& base_paths, const std::string
         ParseCfg(base_path + "/modules.blocklist", blocklist_callback);
     }
 
+    alias_matcher_.Build(module_aliases_);
     ParseKernelCmdlineOptions();
 }
 
@@ -398,7 +405,7 @@ bool Modprobe::InsmodWithDeps(const std::string& module_name, const std::string&
 bool Modprobe::LoadWithAliases(const std::string& module_name, bool strict,
                                const std::string& parameters) {
     auto canonical_name = MakeCanonical(module_name);
-    if (module_loaded_.count(canonical_name)) {
+    if (IsLoaded(canonical_name)) {
         return true;
     }
 
@@ -407,10 +414,10 @@ bool Modprobe::LoadWithAliases(const std::string& module_name, bool strict,
 
     // use aliases to expand list of modules to load (multiple modules
     // may alias themselves to the requested name)
-    for (const auto& [alias, aliased_module] : module_aliases_) {
-        if (fnmatch(alias.c_str(), module_name.c_str(), 0) != 0) continue;
+    for (size_t alias : alias_matcher_.Match(module_name)) {
+        std::string aliased_module(module_aliases_[alias].second);
         LOG(VERBOSE) << "Found alias for '" << module_name << "': '" << aliased_module;
-        if (module_loaded_.count(MakeCanonical(aliased_module))) continue;
+        if (IsLoaded(MakeCanonical(aliased_module))) continue;
         modules_to_load.emplace(aliased_module);
     }
 
@@ -428,6 +435,11 @@ bool Modprobe::LoadWithAliases(const std::string& module_name, bool strict,
     return true;
 }
 
+bool Modprobe::IsLoaded(const std::string& canonical_name) {
+    std::lock_guard guard(module_loaded_lock_);
+    return module_loaded_.count(canonical_name) > 0;
+}
+
 bool Modprobe::IsBlocklisted(const std::string& module_name) {
     if (!blocklist_enabled) return false;
 
@@ -440,14 +452,55 @@ bool Modprobe::IsBlocklisted(const std::string& module_name) {
     return module_blocklist_.count(canonical_name) > 0;
 }
 
-// Another option to load kernel modules. load independent modules dependencies
-// in parallel and then update dependency list of other remaining modules,
-// repeat these steps until all modules are loaded.
+namespace {
+
+// A module in the LoadModulesParallel() dependency graph.
+struct LoadNode {
+    std::string name;
+    std::vector<size_t> dependents;
+    size_t pending_deps = 0;
+    // Length of the longest chain of dependents, used to start the modules
+    // that gate the most other work first.
+    int height = 0;
+    bool sequential = false;
+    std::chrono::milliseconds duration{0};
+    std::chrono::milliseconds finished{0};
+    // The dependency that finished last, i.e. the one that made this module
+    // ready. Following these links back from the module that finished last
+    // gives the critical path.
+    std::optional<size_t> gated_by;
+};
+
+}  // namespace
+
+// Another option to load kernel modules. Build a graph of the listed modules
+// and their hard dependencies and load it with a pool of |num_threads|
+// workers. A module is started as soon as its last dependency has finished
+// loading, so a slow module only delays the modules that depend on it.
+// Modules with "load_sequential=1" in their options are loaded while no other
+// module is being loaded.
 // Discard all blocklist.
 // Softdeps are taken care in InsmodWithDeps().
 bool Modprobe::LoadModulesParallel(int num_threads) {
-    bool ret = true;
-    std::unordered_map<std::string, std::vector<std::string>> mod_with_deps;
+    using std::chrono::duration_cast;
+
+    std::vector<LoadNode> nodes;
+    std::unordered_map<std::string, size_t> node_index;
+    std::vector<size_t> to_visit;
+
+    auto get_node = [&](const std::string& name) -> size_t {
+        auto [it, inserted] = node_index.emplace(name, nodes.size());
+        if (inserted) {
+            auto options = module_options_.find(name);
+            nodes.emplace_back();
+            nodes.back().name = name;
+            nodes.back().sequential =
+                    options != module_options_.end() &&
+                    options->second.find("load_sequential=1") != std::string::npos;
+            to_visit.emplace_back(it->second);
+        }
+        return it->second;
+    };
 
     // Get dependencies
     for (const auto& module : module_load_) {
@@ -456,90 +509,152 @@ bool Modprobe::LoadModulesParallel(int num_threads) {
             LOG(VERBOSE) << "LMP: Blocklist: Module " << module << " skipping...";
             continue;
         }
-        auto dependencies = GetDependencies(MakeCanonical(module));
-        if (dependencies.empty()) {
-            LOG(ERROR) << "LMP: Hard-dep: Module " << module
-                       << " not in .dep file";
+        if (GetDependencies(MakeCanonical(module)).empty()) {
+            LOG(ERROR) << "LMP: Hard-dep: Module " << module << " not in .dep file";
             return false;
         }
-        mod_with_deps[MakeCanonical(module)] = dependencies;
+        get_node(MakeCanonical(module));
     }
 
-    while (!mod_with_deps.empty()) {
-        std::vector<std::thread> threads;
-        std::vector<std::string> mods_path_to_load;
-        std::mutex vector_lock;
+    while (!to_visit.empty()) {
+        size_t module = to_visit.back();
+        to_visit.pop_back();
 
-        // Find independent modules
-        for (const auto& [it_mod, it_dep] : mod_with_deps) {
-            auto itd_last = it_dep.rbegin();
-            if (itd_last == it_dep.rend())
-                continue;
-
-            auto cnd_last = MakeCanonical(*itd_last);
+        // A dependency without a line of its own in the .dep file is a leaf;
+        // LoadWithAliases() reports it if it can't be loaded.
+        auto dependencies = GetDependencies(nodes[module].name);
+        if (dependencies.empty()) continue;
+        for (auto dep = dependencies.begin() + 1; dep != dependencies.end(); ++dep) {
+            auto cnd_dep = MakeCanonical(*dep);
             // Hard-dependencies cannot be blocklisted
-            if (IsBlocklisted(cnd_last)) {
-                LOG(ERROR) << "LMP: Blocklist: Module-dep " << cnd_last
-                           << " : failed to load module " << it_mod;
+            if (IsBlocklisted(cnd_dep)) {
+                LOG(ERROR) << "LMP: Blocklist: Module-dep " << cnd_dep
+                           << " : failed to load module " << nodes[module].name;
                 return false;
             }
+            size_t dep_node = get_node(cnd_dep);
+            nodes[dep_node].dependents.emplace_back(module);
+            nodes[module].pending_deps++;
+        }
+    }
 
-            if (module_options_[cnd_last].find("load_sequential=1") != std::string::npos) {
-                if (!LoadWithAliases(cnd_last, true)) {
-                    return false;
-                }
-            } else {
-                if (std::find(mods_path_to_load.begin(), mods_path_to_load.end(),
-                            cnd_last) == mods_path_to_load.end()) {
-                    mods_path_to_load.emplace_back(cnd_last);
-                }
-            }
+    // Sort the graph to reject dependency cycles up front, and compute the
+    // height of each module from the bottom up.
+    std::vector<size_t> order;
+    std::vector<size_t> pending(nodes.size());
+    for (size_t i = 0; i < nodes.size(); i++) {
+        pending[i] = nodes[i].pending_deps;
+        if (pending[i] == 0) order.emplace_back(i);
+    }
+    for (size_t i = 0; i < order.size(); i++) {
+        for (size_t dependent : nodes[order[i]].dependents) {
+            if (--pending[dependent] == 0) order.emplace_back(dependent);
+        }
+    }
+    if (order.size() != nodes.size()) {
+        LOG(ERROR) << "LMP: Hard-dep: dependency cycle in .dep file";
+        return false;
+    }
+    for (auto it = order.rbegin(); it != order.rend(); ++it) {
+        for (size_t dependent : nodes[*it].dependents) {
+            nodes[*it].height = std::max(nodes[*it].height, nodes[dependent].height + 1);
         }
+    }
+
+    // Ready modules are kept in a heap ordered by height, then by load order.
+    auto ready_cmp = [&](size_t a, size_t b) {
+        return nodes[a].height != nodes[b].height ? nodes[a].height < nodes[b].height : a > b;
+    };
+    std::vector<size_t> ready;
+    for (size_t i = 0; i < nodes.size(); i++) {
+        if (nodes[i].pending_deps == 0) {
+            ready.emplace_back(i);
+            std::push_heap(ready.begin(), ready.end(), ready_cmp);
+        }
+    }
 
-        // Load independent modules in parallel
-        auto thread_function = [&] {
-            std::unique_lock lk(vector_lock);
-            while (!mods_path_to_load.empty()) {
-                auto ret_load = true;
-                auto mod_to_load = std::move(mods_path_to_load.back());
-                mods_path_to_load.pop_back();
-
-                lk.unlock();
-                ret_load &= LoadWithAliases(mod_to_load, true);
-                lk.lock();
-                if (!ret_load) {
-                    ret &= ret_load;
+    std::mutex lock;
+    std::condition_variable cv;
+    std::shared_mutex insmod_lock;
+    size_t remaining = nodes.size();
+    bool failed = false;
+    auto start = android::base::boot_clock::now();
+
+    // Load modules as they become ready, until everything is loaded or a
+    // module fails to load.
+    auto thread_function = [&] {
+        std::unique_lock lk(lock);
+        for (;;) {
+            cv.wait(lk, [&] { return !ready.empty() || remaining == 0 || failed; });
+            if (remaining == 0 || failed) return;
+
+            std::pop_heap(ready.begin(), ready.end(), ready_cmp);
+            size_t module = ready.back();
+            ready.pop_back();
+            lk.unlock();
+
+            auto module_start = android::base::boot_clock::now();
+            bool ret_load;
+            if (nodes[module].sequential) {
+                std::unique_lock insmod_guard(insmod_lock);
+                ret_load = LoadWithAliases(nodes[module].name, true);
+            } else {
+                std::shared_lock insmod_guard(insmod_lock);
+                ret_load = LoadWithAliases(nodes[module].name, true);
+            }
+            auto now = android::base::boot_clock::now();
+
+            lk.lock();
+            auto& node = nodes[module];
+            node.duration = duration_cast<std::chrono::milliseconds>(now - module_start);
+            node.finished = duration_cast<std::chrono::milliseconds>(now - start);
+            LOG(VERBOSE) << "LMP: Module " << node.name << " took " << node.duration.count()
+                         << "ms";
+            remaining--;
+            if (!ret_load) {
+                failed = true;
+                cv.notify_all();
+                return;
+            }
+            for (size_t dependent : node.dependents) {
+                if (--nodes[dependent].pending_deps == 0) {
+                    nodes[dependent].gated_by = module;
+                    ready.emplace_back(dependent);
+                    std::push_heap(ready.begin(), ready.end(), ready_cmp);
+                    cv.notify_one();
                 }
             }
-        };
-
-        std::generate_n(std::back_inserter(threads), num_threads,
-                        [&] { return std::thread(thread_function); });
-
-        // Wait for the threads.
-        for (auto& thread : threads) {
-            thread.join();
+            if (remaining == 0) cv.notify_all();
         }
+    };
 
-        if (!ret) return ret;
+    std::vector<std::thread> threads;
+    std::generate_n(std::back_inserter(threads), std::max(num_threads, 1),
+                    [&] { return std::thread(thread_function); });
 
-        std::lock_guard guard(module_loaded_lock_);
-        // Remove loaded module form mod_with_deps and soft dependencies of other modules
-        for (const auto& module_loaded : module_loaded_)
-            mod_with_deps.erase(module_loaded);
+    // Wait for the threads.
+    for (auto& thread : threads) {
+        thread.join();
+    }
 
-        // Remove loaded module form dependencies of other modules which are not loaded yet
-        for (const auto& module_loaded_path : module_loaded_paths_) {
-            for (auto& [mod, deps] : mod_with_deps) {
-                auto it = std::find(deps.begin(), deps.end(), module_loaded_path);
-                if (it != deps.end()) {
-                    deps.erase(it);
-                }
-            }
+    if (failed) return false;
+
+    if (!nodes.empty()) {
+        auto last = std::max_element(nodes.begin(), nodes.end(), [](const auto& a, const auto& b) {
+            return a.finished < b.finished;
+        });
+        std::vector<std::string> critical_path;
+        for (std::optional<size_t> i = last - nodes.begin(); i; i = nodes[*i].gated_by) {
+            critical_path.emplace_back(nodes[*i].name + " (" +
+                                       std::to_string(nodes[*i].duration.count()) + "ms)");
         }
+        std::reverse(critical_path.begin(), critical_path.end());
+        LOG(INFO) << "LMP: Loaded graph of " << nodes.size() << " modules in "
+                  << last->finished.count()
+                  << "ms, critical path: " << android::base::Join(critical_path, " -> ");
     }
 
-    return ret;
+    return true;
 }
 
 bool Modprobe::LoadListedModules(bool strict) {
@@ -17,6 +17,7 @@
 #include <sys/stat.h>
 #include <sys/syscall.h>
 
+#include <mutex>
 #include <string>
 #include <vector>
 
@@ -29,6 +30,9 @@
 
 #include "libmodprobe_test.h"
 
+// Serializes access to modules_loaded from LoadModulesParallel() workers.
+static std::mutex modules_loaded_lock;
+
 std::string Modprobe::GetKernelCmdline(void) {
     return kernel_cmdline;
 }
@@ -41,6 +45,7 @@ bool Modprobe::Insmod(const std::string& path_name, const std::string& parameter
     if (std::find(test_modules.begin(), test_modules.end(), deps.front()) == test_modules.end()) {
         return false;
     }
+    std::lock_guard guard(modules_loaded_lock);
     for (auto it = modules_loaded.begin(); it != modules_loaded.end(); ++it) {
         if (android::base::StartsWith(*it, path_name)) {
             return true;
@@ -61,6 +66,7 @@ bool Modprobe::Insmod(const std::string& path_name, const std::string& parameter
 }
 
 bool Modprobe::Rmmod(const std::string& module_name) {
+    std::lock_guard guard(modules_loaded_lock);
     for (auto it = modules_loaded.begin(); it != modules_loaded.end(); it++) {
         if (*it == module_name || android::base::StartsWith(*it, module_name + " ")) {
             modules_loaded.erase(it);
@@ -0,0 +1,278 @@
+/*
+ * Copyright (C) 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <modprobe/modprobe.h>
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <string>
+#include <string_view>
+#include <tuple>
+#include <utility>
+#include <vector>
+
+#include <android-base/file.h>
+#include <android-base/logging.h>
+#include <android-base/mapped_file.h>
+#include <android-base/strings.h>
+#include <android-base/unique_fd.h>
+
+// modules.index holds the parsed contents of modules.alias, modules.dep and
+// modules.softdep, so that a Modprobe can be constructed without splitting
+// those files into lines and words. It is a sequence of native-endian
+// integers and length-prefixed, null-terminated strings:
+//
+//   magic, version
+//   size of each source file
+//   alias count, then (alias, module) for each alias
+//   dep count, then (module, path count, paths...) for each module
+//   pre-softdep count, then (module, softdep) for each pre-softdep
+//   post-softdep count, then (module, softdep) for each post-softdep
+//
+// Module paths below the directory holding the index are stored relative to
+// it, so an index written into a staging directory at build time still
+// applies once the directory is installed elsewhere. Aliases are used in
+// place from the mapped index.
+//
+// The index is only used if the source files have the sizes it records and
+// none of them is newer than the index itself. Image builds give every file
+// the same timestamp, and on a writable directory editing a source file
+// makes it newer than the index.
+
+namespace {
+
+constexpr char kIndexFile[] = "modules.index";
+constexpr char kIndexMagic[8] = {'M', 'O', 'D', 'I', 'N', 'D', 'E', 'X'};
+constexpr uint32_t kIndexVersion = 2;
+constexpr const char* kIndexSources[] = {"modules.alias", "modules.dep", "modules.softdep"};
+constexpr uint64_t kMissingSource = UINT64_MAX;
+
+class IndexWriter {
+  public:
+    void Bytes(const void* value, size_t size) {
+        data_.append(reinterpret_cast<const char*>(value), size);
+    }
+    void U32(uint32_t value) { data_.append(reinterpret_cast<const char*>(&value), sizeof(value)); }
+    void U64(uint64_t value) { data_.append(reinterpret_cast<const char*>(&value), sizeof(value)); }
+    void String(std::string_view value) {
+        U32(value.size());
+        data_.append(value);
+        data_.push_back('\0');
+    }
+    template <typename T>
+    void Pairs(const std::vector<std::pair<T, T>>& pairs) {
+        U32(pairs.size());
+        for (const auto& [first, second] : pairs) {
+            String(first);
+            String(second);
+        }
+    }
+
+    const std::string& data() const { return data_; }
+
+  private:
+    std::string data_;
+};
+
+class IndexReader {
+  public:
+    explicit IndexReader(std::string_view data) : data_(data) {}
+
+    bool Bytes(void* out, size_t size) {
+        if (data_.size() < size) return false;
+        memcpy(out, data_.data(), size);
+        data_.remove_prefix(size);
+        return true;
+    }
+    bool U32(uint32_t* value) { return Bytes(value, sizeof(*value)); }
+    bool U64(uint64_t* value) { return Bytes(value, sizeof(*value)); }
+    // The returned view points into the index and is null-terminated.
+    bool String(std::string_view* value) {
+        uint32_t size;
+        if (!U32(&size) || data_.size() <= size || data_[size] != '\0') return false;
+        *value = data_.substr(0, size);
+        data_.remove_prefix(size + 1);
+        return true;
+    }
+
+    bool empty() const { return data_.empty(); }
+
+  private:
+    std::string_view data_;
+};
+
+// Walks the entries of an index, after its header. Returns false, possibly
+// after calling some of the callbacks, if the index is malformed.
+template <typename OnAlias, typename OnDep, typename OnPreSoftdep, typename OnPostSoftdep>
+bool ParseIndexEntries(IndexReader reader, OnAlias on_alias, OnDep on_dep,
+                       OnPreSoftdep on_pre_softdep, OnPostSoftdep on_post_softdep) {
+    auto pairs = [&reader](auto on_pair) {
+        uint32_t count;
+        if (!reader.U32(&count)) return false;
+        for (uint32_t i = 0; i < count; i++) {
+            std::string_view first, second;
+            if (!reader.String(&first) || !reader.String(&second)) return false;
+            on_pair(first, second);
+        }
+        return true;
+    };
+
+    if (!pairs(on_alias)) return false;
+
+    uint32_t dep_count;
+    if (!reader.U32(&dep_count)) return false;
+    std::vector<std::string_view> paths;
+    for (uint32_t i = 0; i < dep_count; i++) {
+        std::string_view module;
+        uint32_t path_count;
+        if (!reader.String(&module) || !reader.U32(&path_count)) return false;
+        paths.clear();
+        for (uint32_t j = 0; j < path_count; j++) {
+            if (!reader.String(&paths.emplace_back())) return false;
+        }
+        on_dep(module, paths);
+    }
+
+    return pairs(on_pre_softdep) && pairs(on_post_softdep) && reader.empty();
+}
+
+}  // namespace
+
+bool Modprobe::ReadIndex(const std::string& base_path) {
+    auto index_path = base_path + "/" + kIndexFile;
+    android::base::unique_fd fd(
+            TEMP_FAILURE_RETRY(open(index_path.c_str(), O_RDONLY | O_NOFOLLOW | O_CLOEXEC)));
+    if (fd == -1) {
+        return false;
+    }
+
+    struct stat index_st;
+    if (fstat(fd.get(), &index_st) || index_st.st_size == 0) {
+        return false;
+    }
+    auto map = android::base::MappedFile::FromFd(fd.get(), 0, index_st.st_size, PROT_READ);
+    if (!map) {
+        PLOG(WARNING) << "Could not map " << index_path;
+        return false;
+    }
+
+    IndexReader reader(std::string_view(map->data(), map->size()));
+    char magic[sizeof(kIndexMagic)];
+    uint32_t version;
+    if (!reader.Bytes(magic, sizeof(magic)) || memcmp(magic, kIndexMagic, sizeof(magic)) ||
+        !reader.U32(&version) || version != kIndexVersion) {
+        LOG(WARNING) << "Ignoring " << index_path << ": unknown format";
+        return false;
+    }
+    for (const char* source : kIndexSources) {
+        uint64_t indexed_size;
+        if (!reader.U64(&indexed_size)) {
+            LOG(WARNING) << "Ignoring " << index_path << ": truncated";
+            return false;
+        }
+        struct stat st;
+        bool exists = stat((base_path + "/" + source).c_str(), &st) == 0;
+        uint64_t size = exists ? st.st_size : kMissingSource;
+        if (size != indexed_size ||
+            (exists && std::tie(st.st_mtim.tv_sec, st.st_mtim.tv_nsec) >
+                               std::tie(index_st.st_mtim.tv_sec, index_st.st_mtim.tv_nsec))) {
+            LOG(INFO) << "Ignoring " << index_path << ": " << source << " has changed";
+            return false;
+        }
+    }
+
+    // Check the whole index before adding anything from it.
+    auto ignore = [](auto&&...) {};
+    if (!ParseIndexEntries(reader, ignore, ignore, ignore, ignore)) {
+        LOG(WARNING) << "Ignoring " << index_path << ": truncated";
+        return false;
+    }
+
+    auto add_alias = [this](std::string_view alias, std::string_view module) {
+        module_aliases_.emplace_back(alias, module);
+    };
+    auto add_dep = [this, &base_path](std::string_view module,
+                                      const std::vector<std::string_view>& paths) {
+        auto& deps = module_deps_[std::string(module)];
+        deps.clear();
+        for (auto path : paths) {
+            if (android::base::StartsWith(path, "/")) {
+                deps.emplace_back(path);
+            } else {
+                deps.emplace_back(base_path + "/" + std::string(path));
+            }
+        }
+    };
+    auto add_pre_softdep = [this](std::string_view module, std::string_view softdep) {
+        module_pre_softdep_.emplace_back(module, softdep);
+    };
+    auto add_post_softdep = [this](std::string_view module, std::string_view softdep) {
+        module_post_softdep_.emplace_back(module, softdep);
+    };
+    ParseIndexEntries(reader, add_alias, add_dep, add_pre_softdep, add_post_softdep);
+
+    module_indexes_.emplace_back(std::move(map));
+    LOG(VERBOSE) << "Loaded module index " << index_path;
+    return true;
+}
+
+bool Modprobe::WriteIndex(const std::string& base_path) {
+    Modprobe m({base_path});
+
+    IndexWriter writer;
+    writer.Bytes(kIndexMagic, sizeof(kIndexMagic));
+    writer.U32(kIndexVersion);
+    for (const char* source : kIndexSources) {
+        struct stat st;
+        bool exists = stat((base_path + "/" + source).c_str(), &st) == 0;
+        writer.U64(exists ? st.st_size : kMissingSource);
+    }
+    writer.Pairs(m.module_aliases_);
+    writer.U32(m.module_deps_.size());
+    auto prefix = base_path + "/";
+    for (const auto& [module, paths] : m.module_deps_) {
+        writer.String(module);
+        writer.U32(paths.size());
+        for (std::string_view path : paths) {
+            if (android::base::StartsWith(path, prefix)) {
+                path.remove_prefix(prefix.size());
+            }
+            writer.String(path);
+        }
+    }
+    writer.Pairs(m.module_pre_softdep_);
+    writer.Pairs(m.module_post_softdep_);
+
+    auto index_path = base_path + "/" + kIndexFile;
+    auto tmp_path = index_path + ".tmp";
+    if (!android::base::WriteStringToFile(writer.data(), tmp_path, 0644, getuid(), getgid())) {
+        PLOG(ERROR) << "Could not write " << tmp_path;
+        unlink(tmp_path.c_str());
+        return false;
+    }
+    if (rename(tmp_path.c_str(), index_path.c_str())) {
+        PLOG(ERROR) << "Could not rename " << tmp_path << " to " << index_path;
+        unlink(tmp_path.c_str());
+        return false;
+    }
+    LOG(INFO) << "Wrote module index " << index_path;
+    return true;
+}
@@ -14,14 +14,22 @@
  * limitations under the License.
  */
 
+#include <fcntl.h>
+#include <fnmatch.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
 #include <functional>
 
 #include <android-base/file.h>
 #include <android-base/macros.h>
+#include <android-base/strings.h>
 #include <android-base/unique_fd.h>
 #include <gtest/gtest.h>
 
 #include <modprobe/modprobe.h>
+#include <modprobe/module_alias_matcher.h>
 
 #include "libmodprobe_test.h"
 
@@ -219,3 +227,239 @@ TEST(libmodprobe, ModuleDepLineWithoutColonIsSkipped) {
     Modprobe m({dir.path});
     EXPECT_FALSE(m.LoadWithAliases("no_colon", true));
 }
+
+static void WriteModuleConfig(const TemporaryDir& dir,
+                              const std::vector<std::pair<std::string, std::string>>& files) {
+    for (const auto& [name, contents] : files) {
+        ASSERT_TRUE(android::base::WriteStringToFile(contents, std::string(dir.path) + "/" + name,
+                                                     0600, getuid(), getgid()));
+    }
+}
+
+static ptrdiff_t LoadIndex(const std::string& path) {
+    auto it = std::find_if(modules_loaded.begin(), modules_loaded.end(), [&](const auto& loaded) {
+        return loaded == path || android::base::StartsWith(loaded, path + " ");
+    });
+    return it == modules_loaded.end() ? -1 : it - modules_loaded.begin();
+}
+
+TEST(libmodprobe, LoadModulesParallel) {
+    TemporaryDir dir;
+    auto dir_path = std::string(dir.path);
+    WriteModuleConfig(dir, {
+                                   {"modules.dep",
+                                    "mod_a.ko:\n"
+                                    "mod_b.ko: mod_a.ko\n"
+                                    "mod_c.ko: mod_b.ko mod_a.ko\n"
+                                    "mod_d.ko:\n"
+                                    "mod_e.ko: mod_d.ko\n"
+                                    "mod_f.ko:\n"
+                                    "mod_g.ko: mod_a.ko\n"
+                                    "mod_h.ko:\n"},
+                                   {"modules.softdep", "softdep mod_g pre: mod_h\n"},
+                                   {"modules.options", "options mod_f.ko load_sequential=1\n"},
+                                   {"modules.load", "mod_c.ko\nmod_e.ko\nmod_f.ko\nmod_g.ko\n"},
+                           });
+
+    kernel_cmdline = "";
+    modules_loaded.clear();
+    test_modules.clear();
+    for (char name = 'a'; name <= 'h'; name++) {
+        test_modules.emplace_back(dir_path + "/mod_" + name + ".ko");
+    }
+
+    Modprobe m({dir.path});
+    EXPECT_TRUE(m.LoadModulesParallel(4));
+    EXPECT_EQ(8, m.GetModuleCount());
+    EXPECT_EQ(8u, modules_loaded.size());
+
+    for (const auto& module : test_modules) {
+        EXPECT_NE(-1, LoadIndex(module)) << module << " was not loaded";
+    }
+    // Hard dependencies and soft pre-dependencies load before their users.
+    EXPECT_LT(LoadIndex(dir_path + "/mod_a.ko"), LoadIndex(dir_path + "/mod_b.ko"));
+    EXPECT_LT(LoadIndex(dir_path + "/mod_b.ko"), LoadIndex(dir_path + "/mod_c.ko"));
+    EXPECT_LT(LoadIndex(dir_path + "/mod_d.ko"), LoadIndex(dir_path + "/mod_e.ko"));
+    EXPECT_LT(LoadIndex(dir_path + "/mod_a.ko"), LoadIndex(dir_path + "/mod_g.ko"));
+    EXPECT_LT(LoadIndex(dir_path + "/mod_h.ko"), LoadIndex(dir_path + "/mod_g.ko"));
+}
+
+TEST(libmodprobe, LoadModulesParallelFailsOnMissingModule) {
+    TemporaryDir dir;
+    auto dir_path = std::string(dir.path);
+    WriteModuleConfig(dir, {
+                                   {"modules.dep",
+                                    "mod_a.ko:\n"
+                                    "mod_b.ko: mod_a.ko\n"
+                                    "mod_c.ko:\n"},
+                                   {"modules.load", "mod_b.ko\nmod_c.ko\n"},
+                           });
+
+    kernel_cmdline = "";
+    modules_loaded.clear();
+    test_modules = {dir_path + "/mod_b.ko", dir_path + "/mod_c.ko"};
+
+    Modprobe m({dir.path});
+    EXPECT_FALSE(m.LoadModulesParallel(4));
+    EXPECT_EQ(-1, LoadIndex(dir_path + "/mod_b.ko"));
+}
+
+TEST(libmodprobe, LoadModulesParallelRejectsDependencyCycle) {
+    TemporaryDir dir;
+    auto dir_path = std::string(dir.path);
+    WriteModuleConfig(dir, {
+                                   {"modules.dep",
+                                    "mod_a.ko: mod_b.ko\n"
+                                    "mod_b.ko: mod_a.ko\n"},
+                                   {"modules.load", "mod_a.ko\n"},
+                           });
+
+    kernel_cmdline = "";
+    modules_loaded.clear();
+    test_modules = {dir_path + "/mod_a.ko", dir_path + "/mod_b.ko"};
+
+    Modprobe m({dir.path});
+    EXPECT_FALSE(m.LoadModulesParallel(4));
+    EXPECT_TRUE(modules_loaded.empty());
+}
+
+TEST(libmodprobe, ModuleAliasMatcherMatchesLikeFnmatch) {
+    std::vector<std::pair<std::string_view, std::string_view>> aliases = {
+            {"pci:v00008086d00001234sv*sd*bc*sc*i*", "intel_a"},
+            {"pci:v00008086d*sv*sd*bc02sc00i*", "intel_net"},
+            {"pci:v000010ECd00008168sv*sd*bc*sc*i*", "r8169"},
+            {"of:N*T*Cqcom,gcc-sm8150", "gcc_sm8150"},
+            {"of:N*T*Cqcom,gcc-sm8150C*", "gcc_sm8150"},
+            {"usb:v1D6Bp0002d*dc*dsc*dp*ic*isc*ip*in*", "hub"},
+            {"platform:exynos-ufs", "ufs_exynos"},
+            {"platform:exynos-ufs", "ufs_exynos_compat"},
+            {"platform:exynos-?fs", "ufs_wild"},
+            {"platform:[ab]x", "ab"},
+            {"platform:\\*", "escaped"},
+            {"*", "everything"},
+            {"", "empty"},
+    };
+    ModuleAliasMatcher matcher;
+    matcher.Build(aliases);
+
+    for (const char* name : {
+                 "pci:v00008086d00001234sv00001028sd00000001bc02sc00i00",
+                 "pci:v00008086d00005678sv00001028sd00000001bc02sc00i00",
+                 "pci:v000010ECd00008168sv00001028sd00000001bc02sc00i00",
+                 "of:NclockT(null)Cqcom,gcc-sm8150",
+                 "of:NclockT(null)Cqcom,gcc-sm8150Cqcom,gcc",
+                 "usb:v1D6Bp0002d0504dc09dsc00dp01ic09isc00ip00in00",
+                 "platform:exynos-ufs",
+                 "platform:exynos-xfs",
+                 "platform:ax",
+                 "platform:*",
+                 "platform:x",
+                 "pci:",
+                 "",
+         }) {
+        std::vector<size_t> expected;
+        for (size_t i = 0; i < aliases.size(); i++) {
+            if (fnmatch(aliases[i].first.data(), name, 0) == 0) expected.emplace_back(i);
+        }
+        EXPECT_EQ(expected, matcher.Match(name)) << name;
+    }
+}
+
+TEST(libmodprobe, ModuleIndex) {
+    TemporaryDir dir;
+    auto dir_path = std::string(dir.path);
+    WriteModuleConfig(dir, {
+                                   {"modules.dep",
+                                    "mod_a.ko:\n"
+                                    "mod_b.ko: mod_a.ko\n"
+                                    "mod_c.ko:\n"},
+                                   {"modules.alias", "alias of:N*T*Cvendor,b* mod_b\n"},
+                                   {"modules.softdep", "softdep mod_b pre: mod_c\n"},
+                           });
+
+    kernel_cmdline = "";
+    modules_loaded.clear();
+    test_modules = {dir_path + "/mod_a.ko", dir_path + "/mod_b.ko", dir_path + "/mod_c.ko"};
+
+    ASSERT_TRUE(Modprobe::WriteIndex(dir_path));
+    ASSERT_EQ(0, access((dir_path + "/modules.index").c_str(), F_OK));
+
+    Modprobe m({dir.path});
+    std::vector<std::string> pre_deps;
+    std::vector<std::string> deps;
+    std::vector<std::string> post_deps;
+    ASSERT_TRUE(m.GetAllDependencies("mod_b", &pre_deps, &deps, &post_deps));
+    EXPECT_EQ(std::vector<std::string>{"mod_c"}, pre_deps);
+    EXPECT_EQ((std::vector<std::string>{dir_path + "/mod_a.ko", dir_path + "/mod_b.ko"}), deps);
+    EXPECT_TRUE(post_deps.empty());
+    EXPECT_TRUE(m.LoadWithAliases("of:NfooT(null)Cvendor,bar", true));
+    EXPECT_EQ((std::vector<std::string>{dir_path + "/mod_a.ko", dir_path + "/mod_c.ko",
+                                        dir_path + "/mod_b.ko"}),
+              modules_loaded);
+
+    // The index is ignored once the files it was written from change, even
+    // if their size stays the same.
+    WriteModuleConfig(dir, {
+                                   {"modules.dep",
+                                    "mod_a.ko:\n"
+                                    "mod_b.ko: mod_c.ko\n"
+                                    "mod_c.ko:\n"},
+                           });
+    struct timespec times[2] = {{.tv_nsec = UTIME_OMIT}, {.tv_sec = time(nullptr) + 10}};
+    ASSERT_EQ(0, utimensat(AT_FDCWD, (dir_path + "/modules.dep").c_str(), times, 0));
+    Modprobe m2({dir.path});
+    ASSERT_TRUE(m2.GetAllDependencies("mod_b", nullptr, &deps, nullptr));
+    EXPECT_EQ((std::vector<std::string>{dir_path + "/mod_c.ko", dir_path + "/mod_b.ko"}), deps);
+
+    // A truncated index is ignored too.
+    ASSERT_TRUE(Modprobe::WriteIndex(dir_path));
+    ASSERT_EQ(0, truncate((dir_path + "/modules.index").c_str(), 40));
+    Modprobe m3({dir.path});
+    ASSERT_TRUE(m3.GetAllDependencies("mod_b", nullptr, &deps, nullptr));
+    EXPECT_EQ((std::vector<std::string>{dir_path + "/mod_c.ko", dir_path + "/mod_b.ko"}), deps);
+}
+
+TEST(libmodprobe, ModuleIndexIsRelocatable) {
+    TemporaryDir staging_dir;
+    WriteModuleConfig(staging_dir, {
+                                           {"modules.dep",
+                                            "mod_a.ko:\n"
+                                            "mod_b.ko: mod_a.ko /lib/modules/mod_z.ko\n"
+                                            "/lib/modules/mod_z.ko:\n"},
+                                           {"modules.alias", "alias of:N*T*Cvendor,b* mod_b\n"},
+                                   });
+    ASSERT_TRUE(Modprobe::WriteIndex(staging_dir.path));
+
+    // Install the directory somewhere else, with the index newer than the rest.
+    TemporaryDir dir;
+    auto dir_path = std::string(dir.path);
+    for (const char* file : {"modules.dep", "modules.alias", "modules.index"}) {
+        std::string contents;
+        ASSERT_TRUE(android::base::ReadFileToString(
+                std::string(staging_dir.path) + "/" + file, &contents));
+        ASSERT_TRUE(android::base::WriteStringToFile(contents, dir_path + "/" + file));
+    }
+    // Garble modules.dep without changing its size, and make it older than the
+    // index, so that only the index can provide the dependencies below.
+    std::string dep_contents;
+    ASSERT_TRUE(android::base::ReadFileToString(dir_path + "/modules.dep", &dep_contents));
+    ASSERT_TRUE(android::base::WriteStringToFile(std::string(dep_contents.size(), '#'),
+                                                 dir_path + "/modules.dep"));
+    struct timespec times[2] = {{.tv_nsec = UTIME_OMIT}, {.tv_sec = 0}};
+    ASSERT_EQ(0, utimensat(AT_FDCWD, (dir_path + "/modules.dep").c_str(), times, 0));
+
+    kernel_cmdline = "";
+    modules_loaded.clear();
+    test_modules = {dir_path + "/mod_a.ko", dir_path + "/mod_b.ko", "/lib/modules/mod_z.ko"};
+
+    Modprobe m({dir.path});
+    std::vector<std::string> deps;
+    ASSERT_TRUE(m.GetAllDependencies("mod_b", nullptr, &deps, nullptr));
+    EXPECT_EQ((std::vector<std::string>{"/lib/modules/mod_z.ko", dir_path + "/mod_a.ko",
+                                        dir_path + "/mod_b.ko"}),
+              deps);
+    EXPECT_TRUE(m.LoadWithAliases("of:NfooT(null)Cvendor,bar", true));
+    EXPECT_EQ((std::vector<std::string>{"/lib/modules/mod_z.ko", dir_path + "/mod_a.ko",
+                                        dir_path + "/mod_b.ko"}),
+              modules_loaded);
+}
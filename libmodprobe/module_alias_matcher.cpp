@@ -0,0 +1,94 @@
+/*
+ * Copyright (C) 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <modprobe/module_alias_matcher.h>
+
+#include <fnmatch.h>
+
+#include <algorithm>
+
+namespace {
+
+constexpr uint32_t kNoChild = UINT32_MAX;
+
+}  // namespace
+
+void ModuleAliasMatcher::Build(
+        const std::vector<std::pair<std::string_view, std::string_view>>& aliases) {
+    patterns_.clear();
+    literals_.clear();
+    nodes_.assign(1, Node());
+
+    for (const auto& [alias, module] : aliases) {
+        uint32_t index = patterns_.size();
+        patterns_.emplace_back(alias);
+
+        auto wildcard = alias.find_first_of("*?[\\");
+        if (wildcard == std::string_view::npos) {
+            literals_[alias].emplace_back(index);
+            continue;
+        }
+
+        uint32_t node = 0;
+        for (size_t i = 0; i < wildcard; i++) {
+            uint32_t child = Child(node, alias[i]);
+            if (child == kNoChild) {
+                child = nodes_.size();
+                auto& children = nodes_[node].children;
+                auto it = std::lower_bound(children.begin(), children.end(),
+                                           std::make_pair(alias[i], uint32_t(0)));
+                children.emplace(it, alias[i], child);
+                // |children| may be invalidated from here on.
+                nodes_.emplace_back();
+            }
+            node = child;
+        }
+        nodes_[node].patterns.emplace_back(index);
+    }
+}
+
+uint32_t ModuleAliasMatcher::Child(uint32_t node, char c) const {
+    const auto& children = nodes_[node].children;
+    auto it = std::lower_bound(children.begin(), children.end(), std::make_pair(c, uint32_t(0)));
+    if (it == children.end() || it->first != c) return kNoChild;
+    return it->second;
+}
+
+std::vector<size_t> ModuleAliasMatcher::Match(const std::string& name) const {
+    std::vector<size_t> matches;
+
+    auto literal = literals_.find(name);
+    if (literal != literals_.end()) {
+        matches.insert(matches.end(), literal->second.begin(), literal->second.end());
+    }
+
+    if (!nodes_.empty()) {
+        uint32_t node = 0;
+        for (size_t i = 0;; i++) {
+            for (uint32_t pattern : nodes_[node].patterns) {
+                if (fnmatch(patterns_[pattern].data(), name.c_str(), 0) == 0) {
+                    matches.emplace_back(pattern);
+                }
+            }
+            if (i == name.size()) break;
+            node = Child(node, name[i]);
+            if (node == kNoChild) break;
+        }
+    }
+
+    std::sort(matches.begin(), matches.end());
+    return matches;
+}
@@ -0,0 +1,42 @@
+/*
+ * Copyright (C) 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Writes modules.index into kernel module directories at build time, after
+// depmod has produced their modules.alias, modules.dep and modules.softdep.
+// The index must be written last, so that it is not older than those files.
+
+#include <stdlib.h>
+
+#include <android-base/logging.h>
+#include <modprobe/modprobe.h>
+
+int main(int argc, char** argv) {
+    android::base::InitLogging(argv, android::base::StderrLogger);
+    android::base::SetMinimumLogSeverity(android::base::WARNING);
+
+    if (argc < 2) {
+        LOG(ERROR) << "usage: " << argv[0] << " MODULE_DIR...";
+        return EXIT_FAILURE;
+    }
+
+    int rv = EXIT_SUCCESS;
+    for (int i = 1; i < argc; i++) {
+        if (!Modprobe::WriteIndex(argv[i])) {
+            rv = EXIT_FAILURE;
+        }
+    }
+    return rv;
+}
@@ -28,6 +28,7 @@
 #include <time.h>
 #include <unistd.h>
 
+#include <algorithm>
 #include <regex>
 
 #include <android-base/file.h>
@@ -42,8 +43,11 @@
 #include <processgroup/processgroup.h>
 
 using android::base::GetBoolProperty;
+using android::base::ReadFileToString;
+using android::base::Split;
 using android::base::StartsWith;
 using android::base::StringPrintf;
+using android::base::Trim;
 using android::base::unique_fd;
 using android::base::WriteStringToFile;
 
@@ -247,3 +251,27 @@ int CgroupMap::ActivateControllers(const std::string& path) const {
     }
     return -ENOSYS;
 }
+
+bool CgroupMap::ControllersActivated(const std::string& path) const {
+    if (__builtin_available(android 30, *)) {
+        std::string content;
+        if (!ReadFileToString(path + "/cgroup.subtree_control", &content)) {
+            return false;
+        }
+        auto active = Split(Trim(content), " ");
+        auto controller_count = ACgroupFile_getControllerCount();
+        for (uint32_t i = 0; i < controller_count; ++i) {
+            const ACgroupController* controller = ACgroupFile_getController(i);
+            const uint32_t flags = ACgroupController_getFlags(controller);
+            // Optional controllers that failed to activate are not retried.
+            if ((flags & CGROUPRC_CONTROLLER_FLAG_NEEDS_ACTIVATION) &&
+                !(flags & CGROUPRC_CONTROLLER_FLAG_OPTIONAL) &&
+                std::find(active.begin(), active.end(), ACgroupController_getName(controller)) ==
+                        active.end()) {
+                return false;
+            }
+        }
+        return true;
+    }
+    return false;
+}
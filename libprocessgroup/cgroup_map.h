@@ -65,6 +65,8 @@ class CgroupMap {
     CgroupController FindController(const std::string& name) const;
     CgroupController FindControllerByPath(const std::string& path) const;
     int ActivateControllers(const std::string& path) const;
+    // Whether all required controllers are enabled in the cgroup.subtree_control of |path|.
+    bool ControllersActivated(const std::string& path) const;
 
   private:
     bool loaded_ = false;
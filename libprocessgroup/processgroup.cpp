@@ -326,8 +326,13 @@ void removeAllEmptyProcessGroups() {
  * Process groups are primarily created by the Zygote, meaning that uid/pid groups are created by
  * the user root. Ownership for the newly created cgroup and all of its files must thus be
  * transferred for the user/group passed as uid/gid before system_server can properly access them.
+ * If |created| is not null, it is set to whether the directory did not exist yet.
  */
-static bool MkdirAndChown(const std::string& path, mode_t mode, uid_t uid, gid_t gid) {
+static bool MkdirAndChown(const std::string& path, mode_t mode, uid_t uid, gid_t gid,
+                          bool* created = nullptr) {
+    if (created) {
+        *created = false;
+    }
     if (mkdir(path.c_str(), mode) == -1) {
         if (errno == EEXIST) {
             // Directory already exists and permissions have been set at the time it was created
@@ -335,6 +340,9 @@ static bool MkdirAndChown(const std::string& path, mode_t mode, uid_t uid, gid_t
         }
         return false;
     }
+    if (created) {
+        *created = true;
+    }
 
     auto dir = std::unique_ptr<DIR, decltype(&closedir)>(opendir(path.c_str()), closedir);
 
@@ -659,11 +667,17 @@ static int createProcessGroupInternal(uid_t uid, pid_t initialPid, std::string c
         cgroup_gid = cgroup_stat.st_gid;
     }
 
-    if (!MkdirAndChown(uid_path, cgroup_mode, cgroup_uid, cgroup_gid)) {
+    bool uid_path_created;
+    if (!MkdirAndChown(uid_path, cgroup_mode, cgroup_uid, cgroup_gid, &uid_path_created)) {
         PLOG(ERROR) << "Failed to make and chown " << uid_path;
         return -errno;
     }
-    if (activate_controllers) {
+    // The controllers only need to be activated once per uid. Starting a process for a uid that
+    // already has a cgroup then costs a read of cgroup.subtree_control instead of a write for
+    // every controller. The read is still needed because the process that created the uid cgroup
+    // may not have activated the controllers yet, or may have failed to.
+    if (activate_controllers &&
+        (uid_path_created || !CgroupMap::GetInstance().ControllersActivated(uid_path))) {
         ret = CgroupMap::GetInstance().ActivateControllers(uid_path);
         if (ret) {
             LOG(ERROR) << "Failed to activate controllers in " << uid_path;
@@ -165,6 +165,31 @@ int sparse_file_add_fd(struct sparse_file* s, int fd, int64_t file_offset, uint6
 int sparse_file_write(struct sparse_file *s, int fd, bool gz, bool sparse,
 		bool crc);
 
+/**
+ * struct sparse_write_stats - I/O done by the last sparse_file_write()
+ *
+ * @write_calls - number of write() or writev() calls
+ * @seek_calls - number of lseek() calls to skip over unused chunks
+ * @punch_calls - number of fallocate() calls punching holes for zero fills
+ * @bytes_written - number of bytes passed to write() or writev()
+ *
+ * Only writes to an uncompressed file descriptor are counted.
+ */
+struct sparse_write_stats {
+	uint64_t write_calls;
+	uint64_t seek_calls;
+	uint64_t punch_calls;
+	uint64_t bytes_written;
+};
+
+/**
+ * sparse_file_get_write_stats - get the I/O done by the last sparse_file_write()
+ *
+ * @s - sparse file cookie
+ * @stats - filled in with the counts
+ */
+void sparse_file_get_write_stats(struct sparse_file *s, struct sparse_write_stats *stats);
+
 /**
  * sparse_file_len - return the length of a sparse file if written to disk
  *
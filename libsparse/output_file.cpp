@@ -30,6 +30,10 @@
 #include <unistd.h>
 #include <zlib.h>
 
+#ifndef _WIN32
+#include <sys/uio.h>
+#endif
+
 #include "defs.h"
 #include "output_file.h"
 #include "sparse_crc32.h"
@@ -41,6 +45,10 @@
 #define O_BINARY 0
 #else
 #define ftruncate64 ftruncate
+struct iovec {
+  void* iov_base;
+  size_t iov_len;
+};
 #endif
 
 #if defined(__APPLE__) && defined(__MACH__)
@@ -56,6 +64,14 @@
 
 #define FILL_ZERO_BUFSIZE (2 * 1024 * 1024)
 
+/* Writes to a file descriptor are batched into a single writev() of up to
+ * OUTPUT_IOV_MAX buffers. Writes of up to OUTPUT_COPY_MAX bytes, like chunk
+ * headers, are copied since they usually live on the stack; larger ones are
+ * referenced until the next flush. */
+#define OUTPUT_IOV_MAX 64
+#define OUTPUT_COPY_MAX 4096
+#define OUTPUT_COPY_BUFSIZE (64 * 1024)
+
 #define container_of(inner, outer_t, elem) ((outer_t*)((char*)(inner)-offsetof(outer_t, elem)))
 
 static constexpr size_t kMaxMmapSize = 256 * 1024 * 1024;
@@ -66,6 +82,11 @@ struct output_file_ops {
   int (*pad)(struct output_file*, int64_t);
   int (*write)(struct output_file*, void*, size_t);
   void (*close)(struct output_file*);
+  /* Optional: writes out anything buffered by write. */
+  int (*flush)(struct output_file*);
+  /* Optional: zeroes len bytes and skips over them without writing them.
+   * Returns -EOPNOTSUPP if the zeroes have to be written instead. */
+  int (*zero)(struct output_file*, int64_t len);
 };
 
 struct sparse_file_ops {
@@ -87,7 +108,9 @@ struct output_file {
   int64_t len;
   char* zero_buf;
   uint32_t* fill_buf;
+  uint32_t fill_buf_val;
   char* buf;
+  struct sparse_write_stats* stats;
 };
 
 struct output_file_gz {
@@ -100,6 +123,13 @@ struct output_file_gz {
 struct output_file_normal {
   struct output_file out;
   int fd;
+  /* Offset of fd, or -1 if it is not a regular file holes can be punched in. */
+  int64_t pos;
+  int error;
+  struct iovec iov[OUTPUT_IOV_MAX];
+  int iov_cnt;
+  char copy_buf[OUTPUT_COPY_BUFSIZE];
+  size_t copy_len;
 };
 
 #define to_output_file_normal(_o) container_of((_o), struct output_file_normal, out)
@@ -114,27 +144,118 @@ struct output_file_callback {
 
 static int file_open(struct output_file* out, int fd) {
   struct output_file_normal* outn = to_output_file_normal(out);
+  struct stat st;
 
   outn->fd = fd;
+  outn->pos = -1;
+  if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode)) {
+    outn->pos = lseek64(fd, 0, SEEK_CUR);
+  }
   return 0;
 }
 
+static int file_flush(struct output_file* out) {
+  struct output_file_normal* outn = to_output_file_normal(out);
+  struct iovec* iov = outn->iov;
+  int cnt = outn->iov_cnt;
+
+  while (cnt > 0 && !outn->error) {
+#ifdef _WIN32
+    ssize_t ret = write(outn->fd, iov->iov_base, iov->iov_len);
+#else
+    ssize_t ret = writev(outn->fd, iov, cnt);
+#endif
+    if (ret < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      error_errno("writev");
+      outn->error = -1;
+      break;
+    }
+    if (out->stats) {
+      out->stats->write_calls++;
+      out->stats->bytes_written += ret;
+    }
+    if (outn->pos >= 0) {
+      outn->pos += ret;
+    }
+
+    while (cnt > 0 && (size_t)ret >= iov->iov_len) {
+      ret -= iov->iov_len;
+      iov++;
+      cnt--;
+    }
+    if (cnt > 0) {
+      iov->iov_base = (char*)iov->iov_base + ret;
+      iov->iov_len -= ret;
+    }
+  }
+
+  outn->iov_cnt = 0;
+  outn->copy_len = 0;
+  return outn->error;
+}
+
 static int file_skip(struct output_file* out, int64_t cnt) {
   off64_t ret;
   struct output_file_normal* outn = to_output_file_normal(out);
 
+  if (file_flush(out) < 0) {
+    return -1;
+  }
   ret = lseek64(outn->fd, cnt, SEEK_CUR);
   if (ret < 0) {
     error_errno("lseek64");
     return -1;
   }
+  if (out->stats) {
+    out->stats->seek_calls++;
+  }
+  if (outn->pos >= 0) {
+    outn->pos = ret;
+  }
   return 0;
 }
 
+static int file_zero(struct output_file* out, int64_t len) {
+#if defined(__linux__)
+  struct output_file_normal* outn = to_output_file_normal(out);
+
+  if (outn->pos < 0) {
+    return -EOPNOTSUPP;
+  }
+  if (file_flush(out) < 0) {
+    return -1;
+  }
+  // Unlike skipping, this also clears any data already in the file.
+  if (fallocate(outn->fd, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE, outn->pos, len) < 0) {
+    if (errno != EOPNOTSUPP && errno != ENOSYS) {
+      error_errno("fallocate");
+      return -1;
+    }
+    // The filesystem cannot punch holes; write zeroes from now on.
+    outn->pos = -1;
+    return -EOPNOTSUPP;
+  }
+  if (out->stats) {
+    out->stats->punch_calls++;
+  }
+  return file_skip(out, len);
+#else
+  (void)out;
+  (void)len;
+  return -EOPNOTSUPP;
+#endif
+}
+
 static int file_pad(struct output_file* out, int64_t len) {
   int ret;
   struct output_file_normal* outn = to_output_file_normal(out);
 
+  if (file_flush(out) < 0) {
+    return -1;
+  }
   ret = ftruncate64(outn->fd, len);
   if (ret < 0) {
     return -errno;
@@ -144,22 +265,34 @@ static int file_pad(struct output_file* out, int64_t len) {
 }
 
 static int file_write(struct output_file* out, void* data, size_t len) {
-  ssize_t ret;
   struct output_file_normal* outn = to_output_file_normal(out);
 
-  while (len > 0) {
-    ret = write(outn->fd, data, len);
-    if (ret < 0) {
-      if (errno == EINTR) {
-        continue;
-      }
-      error_errno("write");
+  if (len == 0) {
+    return 0;
+  }
+  bool small = len <= OUTPUT_COPY_MAX;
+  if (outn->iov_cnt == OUTPUT_IOV_MAX || (small && outn->copy_len + len > OUTPUT_COPY_BUFSIZE)) {
+    if (file_flush(out) < 0) {
       return -1;
     }
-
-    data = (char*)data + ret;
-    len -= ret;
   }
+  if (small) {
+    char* copy = outn->copy_buf + outn->copy_len;
+    memcpy(copy, data, len);
+    outn->copy_len += len;
+    // Merge with the previous copy, e.g. a fill chunk header and its value.
+    if (outn->iov_cnt > 0) {
+      struct iovec* last = &outn->iov[outn->iov_cnt - 1];
+      if ((char*)last->iov_base + last->iov_len == copy) {
+        last->iov_len += len;
+        return 0;
+      }
+    }
+    data = copy;
+  }
+  outn->iov[outn->iov_cnt].iov_base = data;
+  outn->iov[outn->iov_cnt].iov_len = len;
+  outn->iov_cnt++;
 
   return 0;
 }
@@ -176,6 +309,8 @@ static struct output_file_ops file_ops = {
     .pad = file_pad,
     .write = file_write,
     .close = file_close,
+    .flush = file_flush,
+    .zero = file_zero,
 };
 
 static int gz_file_open(struct output_file* out, int fd) {
@@ -255,6 +390,8 @@ static struct output_file_ops gz_file_ops = {
     .pad = gz_file_pad,
     .write = gz_file_write,
     .close = gz_file_close,
+    .flush = nullptr,
+    .zero = nullptr,
 };
 
 static int callback_file_open(struct output_file* out __unused, int fd __unused) {
@@ -300,6 +437,8 @@ static struct output_file_ops callback_file_ops = {
     .pad = callback_file_pad,
     .write = callback_file_write,
     .close = callback_file_close,
+    .flush = nullptr,
+    .zero = nullptr,
 };
 
 int read_all(int fd, void* buf, size_t len) {
@@ -341,6 +480,16 @@ static bool write_fd_chunk_range(int fd, int64_t offset, uint64_t len, T callbac
   return true;
 }
 
+/* Writes data that is unmapped as soon as this returns, so it cannot stay
+ * buffered. */
+static int write_mapped(struct output_file* out, char* data, size_t len) {
+  int ret = out->ops->write(out, data, len);
+  if (ret >= 0 && out->ops->flush) {
+    ret = out->ops->flush(out);
+  }
+  return ret;
+}
+
 static int write_sparse_skip_chunk(struct output_file* out, uint64_t skip_len) {
   chunk_header_t chunk_header;
   int ret;
@@ -465,7 +614,7 @@ static int write_sparse_fd_chunk(struct output_file* out, uint64_t len, int fd,
 
   if (ret < 0) return -1;
   bool ok = write_fd_chunk_range(fd, offset, len, [&ret, out](char* data, size_t size) -> bool {
-    ret = out->ops->write(out, data, size);
+    ret = write_mapped(out, data, size);
     if (ret < 0) return false;
     if (out->use_crc) {
       out->crc32 = sparse_crc32(out->crc32, data, size);
@@ -553,17 +702,40 @@ static int write_normal_data_chunk(struct output_file* out, uint64_t len, void*
 
 static int write_normal_fill_chunk(struct output_file* out, uint64_t len, uint32_t fill_val) {
   int ret;
-  unsigned int i;
   uint64_t write_len;
+  void* buf;
 
-  /* Initialize fill_buf with the fill_val */
-  for (i = 0; i < FILL_ZERO_BUFSIZE / sizeof(uint32_t); i++) {
-    out->fill_buf[i] = fill_val;
+  if (fill_val == 0) {
+    if (out->ops->zero) {
+      ret = out->ops->zero(out, len);
+      if (ret != -EOPNOTSUPP) {
+        return ret;
+      }
+    }
+    buf = out->zero_buf;
+  } else {
+    if (fill_val != out->fill_buf_val) {
+      /* fill_buf may still be referenced by buffered writes */
+      if (out->ops->flush) {
+        ret = out->ops->flush(out);
+        if (ret < 0) {
+          return ret;
+        }
+      }
+      /* Initialize fill_buf with the fill_val, doubling the initialized part
+       * with each memcpy */
+      out->fill_buf[0] = fill_val;
+      for (size_t n = sizeof(fill_val); n < FILL_ZERO_BUFSIZE; n *= 2) {
+        memcpy((char*)out->fill_buf + n, out->fill_buf, std::min(n, FILL_ZERO_BUFSIZE - n));
+      }
+      out->fill_buf_val = fill_val;
+    }
+    buf = out->fill_buf;
   }
 
   while (len) {
     write_len = std::min(len, (uint64_t)FILL_ZERO_BUFSIZE);
-    ret = out->ops->write(out, out->fill_buf, write_len);
+    ret = out->ops->write(out, buf, write_len);
     if (ret < 0) {
       return ret;
     }
@@ -579,7 +751,7 @@ static int write_normal_fd_chunk(struct output_file* out, uint64_t len, int fd,
   uint64_t rnd_up_len = ALIGN(len, out->block_size);
 
   bool ok = write_fd_chunk_range(fd, offset, len, [&ret, out](char* data, size_t size) -> bool {
-    ret = out->ops->write(out, data, size);
+    ret = write_mapped(out, data, size);
     return ret >= 0;
   });
   if (!ok) return ret;
@@ -607,13 +779,23 @@ static struct sparse_file_ops normal_file_ops = {
     .write_fd_chunk = write_normal_fd_chunk,
 };
 
-void output_file_close(struct output_file* out) {
+int output_file_close(struct output_file* out) {
+  int ret = 0;
+
   out->sparse_ops->write_end_chunk(out);
+  if (out->ops->flush) {
+    ret = out->ops->flush(out);
+  }
   free(out->zero_buf);
   free(out->fill_buf);
   out->zero_buf = nullptr;
   out->fill_buf = nullptr;
   out->ops->close(out);
+  return ret;
+}
+
+void output_file_set_stats(struct output_file* out, struct sparse_write_stats* stats) {
+  out->stats = stats;
 }
 
 static int output_file_init(struct output_file* out, int block_size, int64_t len, bool sparse,
@@ -626,6 +808,8 @@ static int output_file_init(struct output_file* out, int block_size, int64_t len
   out->chunk_cnt = 0;
   out->crc32 = 0;
   out->use_crc = crc;
+  out->fill_buf_val = 0;
+  out->stats = nullptr;
 
   // don't use sparse format block size as it can takes up to 32GB
   out->zero_buf = reinterpret_cast<char*>(calloc(FILL_ZERO_BUFSIZE, 1));
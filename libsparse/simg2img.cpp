@@ -17,6 +17,7 @@
 #include <sparse/sparse.h>
 
 #include <fcntl.h>
+#include <inttypes.h>
 #include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -30,7 +31,8 @@
 #endif
 
 void usage() {
-  fprintf(stderr, "Usage: simg2img <sparse_image_files> <raw_image_file>\n");
+  fprintf(stderr, "Usage: simg2img [-v] <sparse_image_files> <raw_image_file>\n");
+  fprintf(stderr, "  -v  print the number of system calls used to write the output\n");
 }
 
 int main(int argc, char* argv[]) {
@@ -38,6 +40,14 @@ int main(int argc, char* argv[]) {
   int out;
   int i;
   struct sparse_file* s;
+  bool verbose = false;
+  struct sparse_write_stats total = {};
+
+  if (argc > 1 && strcmp(argv[1], "-v") == 0) {
+    verbose = true;
+    argc--;
+    argv++;
+  }
 
   if (argc < 3) {
     usage();
@@ -76,11 +86,26 @@ int main(int argc, char* argv[]) {
       fprintf(stderr, "Cannot write output file\n");
       exit(EXIT_FAILURE);
     }
+    if (verbose) {
+      struct sparse_write_stats stats;
+      sparse_file_get_write_stats(s, &stats);
+      total.write_calls += stats.write_calls;
+      total.seek_calls += stats.seek_calls;
+      total.punch_calls += stats.punch_calls;
+      total.bytes_written += stats.bytes_written;
+    }
     sparse_file_destroy(s);
     close(in);
   }
 
   close(out);
 
+  if (verbose) {
+    fprintf(stderr,
+            "%" PRIu64 " bytes in %" PRIu64 " writes, %" PRIu64 " seeks, %" PRIu64
+            " holes punched\n",
+            total.bytes_written, total.write_calls, total.seek_calls, total.punch_calls);
+  }
+
   exit(EXIT_SUCCESS);
 }
@@ -158,11 +158,18 @@ int sparse_file_write(struct sparse_file* s, int fd, bool gz, bool sparse, bool
 
   if (!out) return -ENOMEM;
 
+  s->write_stats = {};
+  output_file_set_stats(out, &s->write_stats);
+
   ret = write_all_blocks(s, out);
 
-  output_file_close(out);
+  int close_ret = output_file_close(out);
 
-  return ret;
+  return ret ? ret : close_ret;
+}
+
+void sparse_file_get_write_stats(struct sparse_file* s, struct sparse_write_stats* stats) {
+  *stats = s->write_stats;
 }
 
 int sparse_file_callback(struct sparse_file* s, bool sparse, bool crc,
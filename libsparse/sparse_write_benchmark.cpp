@@ -0,0 +1,124 @@
+/*
+ * Copyright (C) 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Measures writing a multi-gigabyte image with sparse_file_write(), as
+// simg2img and fastboot do. The write_calls, seek_calls and punch_calls
+// counters are the number of system calls used for each image.
+
+#include <string.h>
+#include <unistd.h>
+
+#include <memory>
+#include <vector>
+
+#include <android-base/file.h>
+#include <android-base/logging.h>
+#include <benchmark/benchmark.h>
+#include <sparse/sparse.h>
+
+namespace {
+
+constexpr unsigned int kBlockSize = 4096;
+constexpr int64_t kImageSize = 4LL * 1024 * 1024 * 1024;
+// Data extents are all backed by the same buffer, so the image does not need
+// gigabytes of memory.
+constexpr unsigned int kExtent = 16 * 1024 * 1024;
+
+const std::vector<char>& GetData() {
+    static std::vector<char>* data = [] {
+        auto data = new std::vector<char>(kExtent);
+        uint32_t x = 1;
+        for (size_t i = 0; i < data->size(); i += sizeof(x)) {
+            x = x * 1103515245 + 12345;
+            memcpy(&(*data)[i], &x, sizeof(x));
+        }
+        return data;
+    }();
+    return *data;
+}
+
+using SparseFilePtr = std::unique_ptr<sparse_file, decltype(&sparse_file_destroy)>;
+
+// A system-like image: data extents, zero fills, pattern fills and holes.
+// Small data extents are sprinkled through the zero fills, as a filesystem's
+// metadata would be.
+SparseFilePtr CreateImage() {
+    SparseFilePtr file(sparse_file_new(kBlockSize, kImageSize), sparse_file_destroy);
+    auto& data = GetData();
+    unsigned int block = 0;
+    for (int64_t offset = 0; offset < kImageSize; offset += kExtent) {
+        switch ((offset / kExtent) % 8) {
+            case 0:
+            case 1:
+            case 5:
+                sparse_file_add_data(file.get(), const_cast<char*>(data.data()), kExtent, block);
+                break;
+            case 2:
+            case 6:
+                for (unsigned int i = 0; i < kExtent / kBlockSize; i += 64) {
+                    sparse_file_add_data(file.get(), const_cast<char*>(data.data()), kBlockSize,
+                                         block + i);
+                    sparse_file_add_fill(file.get(), 0, 63 * kBlockSize, block + i + 1);
+                }
+                break;
+            case 3:
+                sparse_file_add_fill(file.get(), 0, kExtent, block);
+                break;
+            case 4:
+                sparse_file_add_fill(file.get(), 0xdeadbeef, kExtent, block);
+                break;
+            default:
+                // Left as a hole (DONT_CARE).
+                break;
+        }
+        block += kExtent / kBlockSize;
+    }
+    return file;
+}
+
+}  // namespace
+
+// Writes the image to a file, expanded (|range(0)| == 0) as simg2img does, or
+// as a sparse image (|range(0)| == 1).
+static void BM_SparseFile_write(benchmark::State& state) {
+    SparseFilePtr file = CreateImage();
+    bool sparse = state.range(0);
+    struct sparse_write_stats stats = {};
+
+    for (auto _ : state) {
+        state.PauseTiming();
+        TemporaryFile temp;
+        state.ResumeTiming();
+        if (sparse_file_write(file.get(), temp.fd, false, sparse, false) < 0) {
+            state.SkipWithError("write failed");
+            return;
+        }
+        sparse_file_get_write_stats(file.get(), &stats);
+    }
+    state.SetBytesProcessed(state.iterations() * kImageSize);
+    state.counters["write_calls"] = stats.write_calls;
+    state.counters["seek_calls"] = stats.seek_calls;
+    state.counters["punch_calls"] = stats.punch_calls;
+    state.counters["bytes_written"] = stats.bytes_written;
+}
+BENCHMARK(BM_SparseFile_write)
+        ->Arg(0)
+        ->Arg(1)
+        ->ArgName("sparse")
+        ->Unit(benchmark::kMillisecond)
+        ->UseRealTime();
+
+BENCHMARK_MAIN();
@@ -0,0 +1,171 @@
+//
+// Copyright (C) 2024 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+#include "include/Aggregation.h"
+
+#define LOG_TAG "tex"
+
+#include <log/log.h>
+#include <statslog_express.h>
+#include <stdlib.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <limits>
+#include <mutex>
+#include <thread>
+
+#include "Aggregator.h"
+
+namespace android {
+namespace expresslog {
+
+namespace {
+
+void writeAggregated(const Aggregator::Key& key, int64_t count) {
+    // Histogram atoms carry a 32-bit count.
+    constexpr int64_t kMaxHistogramCount = std::numeric_limits<int32_t>::max();
+
+    switch (key.atomId) {
+        case EXPRESS_EVENT_REPORTED:
+            stats_write(EXPRESS_EVENT_REPORTED, key.metricIdHash, count);
+            break;
+        case EXPRESS_UID_EVENT_REPORTED:
+            stats_write(EXPRESS_UID_EVENT_REPORTED, key.metricIdHash, count, key.uid);
+            break;
+        case EXPRESS_HISTOGRAM_SAMPLE_REPORTED:
+            for (; count > 0; count -= kMaxHistogramCount) {
+                stats_write(EXPRESS_HISTOGRAM_SAMPLE_REPORTED, key.metricIdHash,
+                            (int32_t)std::min(count, kMaxHistogramCount), key.binIndex);
+            }
+            break;
+        case EXPRESS_UID_HISTOGRAM_SAMPLE_REPORTED:
+            for (; count > 0; count -= kMaxHistogramCount) {
+                stats_write(EXPRESS_UID_HISTOGRAM_SAMPLE_REPORTED, key.metricIdHash,
+                            (int32_t)std::min(count, kMaxHistogramCount), key.binIndex, key.uid);
+            }
+            break;
+        default:
+            ALOGE("Dropping aggregated samples for unknown atom %d", key.atomId);
+            break;
+    }
+}
+
+/** Owns the process-wide Aggregator and the thread that flushes it */
+class AggregationState {
+public:
+    AggregationState() : mAggregator(writeAggregated) {
+    }
+
+    Aggregator& aggregator() {
+        return mAggregator;
+    }
+
+    bool isEnabled() const {
+        // Sequentially consistent, so that a sample added after disable() flipped this flag
+        // is seen either by the final flush in disable() or by the thread that added it.
+        return mEnabled.load();
+    }
+
+    void enable(int64_t flushIntervalMs) {
+        std::unique_lock<std::mutex> lock(mMutex);
+        mFlushInterval = std::chrono::milliseconds(std::max<int64_t>(flushIntervalMs, 1));
+        if (mEnabled.load(std::memory_order_relaxed)) {
+            mCondition.notify_all();
+            return;
+        }
+
+        static std::once_flag atExitRegistered;
+        std::call_once(atExitRegistered, [] { atexit([] { get().disable(); }); });
+
+        mStopping = false;
+        mFlushThread = std::thread(&AggregationState::flushLoop, this);
+        mEnabled.store(true, std::memory_order_relaxed);
+    }
+
+    void disable() {
+        std::thread flushThread;
+        {
+            std::lock_guard<std::mutex> lock(mMutex);
+            if (!mEnabled.load(std::memory_order_relaxed)) return;
+            mEnabled.store(false);
+            mStopping = true;
+            flushThread = std::move(mFlushThread);
+        }
+        mCondition.notify_all();
+        flushThread.join();
+        // Catch samples added by threads that saw aggregation still enabled. A thread that
+        // adds one after this flush flushes it itself, see aggregateSample().
+        mAggregator.flush();
+    }
+
+    static AggregationState& get() {
+        // Never destroyed, so that threads logging during exit don't use a dead instance.
+        static AggregationState* state = new AggregationState();
+        return *state;
+    }
+
+private:
+    void flushLoop() {
+        std::unique_lock<std::mutex> lock(mMutex);
+        while (!mStopping) {
+            mCondition.wait_for(lock, mFlushInterval);
+            if (mStopping) break;
+            lock.unlock();
+            mAggregator.flush();
+            lock.lock();
+        }
+    }
+
+    Aggregator mAggregator;
+    std::atomic<bool> mEnabled = false;
+    std::mutex mMutex;
+    std::condition_variable mCondition;
+    std::chrono::milliseconds mFlushInterval{Aggregation::kDefaultFlushIntervalMs};
+    bool mStopping = false;
+    std::thread mFlushThread;
+};
+
+}  // namespace
+
+bool aggregateSample(const Aggregator::Key& key, int64_t amount) {
+    AggregationState& state = AggregationState::get();
+    if (!state.isEnabled()) return false;
+    state.aggregator().add(key, amount);
+    // If disable() ran since the check above, its final flush may have missed this sample.
+    if (!state.isEnabled()) state.aggregator().flush();
+    return true;
+}
+
+void Aggregation::enable(int64_t flushIntervalMs) {
+    AggregationState::get().enable(flushIntervalMs);
+}
+
+void Aggregation::disable() {
+    AggregationState::get().disable();
+}
+
+void Aggregation::flush() {
+    AggregationState::get().aggregator().flush();
+}
+
+bool Aggregation::isEnabled() {
+    return AggregationState::get().isEnabled();
+}
+
+}  // namespace expresslog
+}  // namespace android
@@ -0,0 +1,60 @@
+//
+// Copyright (C) 2024 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#include "Aggregator.h"
+
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace android {
+namespace expresslog {
+
+size_t Aggregator::KeyHash::operator()(const Key& key) const {
+    size_t hash = std::hash<int64_t>()(key.metricIdHash);
+    hash = hash * 31 + key.atomId;
+    hash = hash * 31 + key.binIndex;
+    hash = hash * 31 + key.uid;
+    return hash;
+}
+
+Aggregator::Aggregator(Writer writer) : mWriter(std::move(writer)) {
+}
+
+void Aggregator::add(const Key& key, int64_t amount) {
+    static thread_local const size_t shardIndex =
+            std::hash<std::thread::id>()(std::this_thread::get_id()) % kShardCount;
+    Shard& shard = mShards[shardIndex];
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    shard.counts[key] += amount;
+}
+
+void Aggregator::flush() {
+    // Serializes flushes so that counts for a key are written in the order they were taken.
+    std::lock_guard<std::mutex> flushLock(mFlushMutex);
+    std::vector<std::pair<Key, int64_t>> pending;
+    for (Shard& shard : mShards) {
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        pending.insert(pending.end(), shard.counts.begin(), shard.counts.end());
+        shard.counts.clear();
+    }
+    for (const auto& [key, count] : pending) {
+        mWriter(key, count);
+    }
+}
+
+}  // namespace expresslog
+}  // namespace android
@@ -0,0 +1,79 @@
+//
+// Copyright (C) 2024 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#pragma once
+#include <stdint.h>
+
+#include <functional>
+#include <mutex>
+#include <unordered_map>
+
+namespace android {
+namespace expresslog {
+
+/**
+ * Sums expresslog samples by atom, metric, bin and uid until they are flushed. Samples are
+ * spread over shards picked per thread, so threads logging concurrently rarely share a lock.
+ */
+class Aggregator final {
+public:
+    struct Key {
+        int32_t atomId;
+        int64_t metricIdHash;
+        int32_t binIndex;
+        int32_t uid;
+
+        bool operator==(const Key& other) const {
+            return atomId == other.atomId && metricIdHash == other.metricIdHash &&
+                   binIndex == other.binIndex && uid == other.uid;
+        }
+    };
+
+    using Writer = std::function<void(const Key& key, int64_t count)>;
+
+    explicit Aggregator(Writer writer);
+
+    void add(const Key& key, int64_t amount);
+
+    /** Passes each pending count to the writer and resets it */
+    void flush();
+
+private:
+    struct KeyHash {
+        size_t operator()(const Key& key) const;
+    };
+
+    struct Shard {
+        std::mutex mutex;
+        std::unordered_map<Key, int64_t, KeyHash> counts;
+    };
+
+    static constexpr size_t kShardCount = 16;
+
+    const Writer mWriter;
+    std::mutex mFlushMutex;
+    Shard mShards[kShardCount];
+};
+
+/**
+ * Adds the sample to the process-wide Aggregator if Aggregation is enabled.
+ *
+ * @return false if aggregation is disabled and the sample should be written directly
+ */
+bool aggregateSample(const Aggregator::Key& key, int64_t amount);
+
+}  // namespace expresslog
+}  // namespace android
@@ -20,16 +20,20 @@
 #include <string.h>
 #include <utils/hash/farmhash.h>
 
+#include "Aggregator.h"
+
 namespace android {
 namespace expresslog {
 
 void Counter::logIncrement(const char* metricName, int64_t amount) {
     const int64_t metricIdHash = farmhash::Fingerprint64(metricName, strlen(metricName));
+    if (aggregateSample({EXPRESS_EVENT_REPORTED, metricIdHash, 0, 0}, amount)) return;
     stats_write(EXPRESS_EVENT_REPORTED, metricIdHash, amount);
 }
 
 void Counter::logIncrementWithUid(const char* metricName, int32_t uid, int64_t amount) {
     const int64_t metricIdHash = farmhash::Fingerprint64(metricName, strlen(metricName));
+    if (aggregateSample({EXPRESS_UID_EVENT_REPORTED, metricIdHash, 0, uid}, amount)) return;
     stats_write(EXPRESS_UID_EVENT_REPORTED, metricIdHash, amount, uid);
 }
 
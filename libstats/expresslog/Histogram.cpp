@@ -23,6 +23,8 @@
 #include <string.h>
 #include <utils/hash/farmhash.h>
 
+#include "Aggregator.h"
+
 namespace android {
 namespace expresslog {
 
@@ -68,11 +70,18 @@ Histogram::Histogram(const char* metricName, std::shared_ptr<BinOptions> binOpti
 
 void Histogram::logSample(float sample) const {
     const int binIndex = mBinOptions->getBinForSample(sample);
+    if (aggregateSample({EXPRESS_HISTOGRAM_SAMPLE_REPORTED, mMetricIdHash, binIndex, 0}, 1)) {
+        return;
+    }
     stats_write(EXPRESS_HISTOGRAM_SAMPLE_REPORTED, mMetricIdHash, /*count*/ 1, binIndex);
 }
 
 void Histogram::logSampleWithUid(int32_t uid, float sample) const {
     const int binIndex = mBinOptions->getBinForSample(sample);
+    if (aggregateSample({EXPRESS_UID_HISTOGRAM_SAMPLE_REPORTED, mMetricIdHash, binIndex, uid},
+                        1)) {
+        return;
+    }
     stats_write(EXPRESS_UID_HISTOGRAM_SAMPLE_REPORTED, mMetricIdHash, /*count*/ 1, binIndex, uid);
 }
 
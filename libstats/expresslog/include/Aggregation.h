@@ -0,0 +1,53 @@
+//
+// Copyright (C) 2024 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#pragma once
+#include <stdint.h>
+
+namespace android {
+namespace expresslog {
+
+/**
+ * Aggregation controls whether Counter and Histogram write one StatsD atom per logged sample
+ * (the default), or sum samples in process and periodically write one atom per metric, bin and
+ * uid, with the summed count.
+ */
+class Aggregation final {
+public:
+    static constexpr int64_t kDefaultFlushIntervalMs = 60 * 1000;
+
+    /**
+     * Starts aggregating samples logged by this process. Pending samples are written every
+     * flushIntervalMs, on flush() and disable(), and when the process exits normally.
+     * Calling enable() again changes the flush interval.
+     */
+    static void enable(int64_t flushIntervalMs = kDefaultFlushIntervalMs);
+
+    /**
+     * Writes pending samples and goes back to writing one atom per sample.
+     */
+    static void disable();
+
+    /**
+     * Writes pending samples now.
+     */
+    static void flush();
+
+    static bool isEnabled();
+};
+
+}  // namespace expresslog
+}  // namespace android
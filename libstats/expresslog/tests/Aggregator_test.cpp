@@ -0,0 +1,124 @@
+//
+// Copyright (C) 2024 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+#include "Aggregator.h"
+
+#include <gtest/gtest.h>
+#include <statslog_express.h>
+
+#include "Aggregation.h"
+
+#include <map>
+#include <thread>
+#include <tuple>
+#include <vector>
+
+namespace android {
+namespace expresslog {
+
+namespace {
+
+using Counts = std::map<std::tuple<int32_t, int64_t, int32_t, int32_t>, int64_t>;
+
+Aggregator::Writer recordInto(Counts* counts) {
+    return [counts](const Aggregator::Key& key, int64_t count) {
+        (*counts)[{key.atomId, key.metricIdHash, key.binIndex, key.uid}] += count;
+    };
+}
+
+}  // namespace
+
+TEST(Aggregator, sumsSamplesPerKey) {
+    Counts counts;
+    Aggregator aggregator(recordInto(&counts));
+
+    aggregator.add({1, 100, 0, 0}, 1);
+    aggregator.add({1, 100, 0, 0}, 5);
+    aggregator.add({1, 200, 0, 0}, 2);
+    aggregator.add({2, 100, 3, 0}, 1);
+    aggregator.add({2, 100, 4, 0}, 1);
+    aggregator.add({2, 100, 4, 10001}, 1);
+    ASSERT_TRUE(counts.empty());
+
+    aggregator.flush();
+    const Counts expected = {
+            {{1, 100, 0, 0}, 6}, {{1, 200, 0, 0}, 2},     {{2, 100, 3, 0}, 1},
+            {{2, 100, 4, 0}, 1}, {{2, 100, 4, 10001}, 1},
+    };
+    ASSERT_EQ(expected, counts);
+}
+
+TEST(Aggregator, flushResetsCounts) {
+    Counts counts;
+    Aggregator aggregator(recordInto(&counts));
+
+    aggregator.add({1, 100, 0, 0}, 3);
+    aggregator.flush();
+    counts.clear();
+
+    aggregator.flush();
+    ASSERT_TRUE(counts.empty());
+
+    aggregator.add({1, 100, 0, 0}, 4);
+    aggregator.flush();
+    ASSERT_EQ((Counts{{{1, 100, 0, 0}, 4}}), counts);
+}
+
+TEST(Aggregator, concurrentAddsAreNotLost) {
+    constexpr int kThreads = 8;
+    constexpr int kSamplesPerThread = 10000;
+    Counts counts;
+    Aggregator aggregator(recordInto(&counts));
+
+    std::vector<std::thread> threads;
+    for (int t = 0; t < kThreads; t++) {
+        threads.emplace_back([&aggregator, t] {
+            for (int i = 0; i < kSamplesPerThread; i++) {
+                aggregator.add({1, 100, i % 4, 0}, 1);
+                aggregator.add({1, 200 + t, 0, 0}, 1);
+                // Flushing while other threads add must not drop samples.
+                if (t == 0 && i % 1000 == 0) aggregator.flush();
+            }
+        });
+    }
+    for (auto& thread : threads) thread.join();
+    aggregator.flush();
+
+    for (int bin = 0; bin < 4; bin++) {
+        EXPECT_EQ(kThreads * kSamplesPerThread / 4, (counts[{1, 100, bin, 0}]));
+    }
+    for (int t = 0; t < kThreads; t++) {
+        EXPECT_EQ(kSamplesPerThread, (counts[{1, 200 + t, 0, 0}]));
+    }
+}
+
+TEST(Aggregation, enableAndDisable) {
+    const int64_t kTestMetricIdHash = 0x7e57;
+    ASSERT_FALSE(Aggregation::isEnabled());
+    ASSERT_FALSE(aggregateSample({EXPRESS_EVENT_REPORTED, kTestMetricIdHash, 0, 0}, 1));
+
+    Aggregation::enable(/*flushIntervalMs*/ 10);
+    ASSERT_TRUE(Aggregation::isEnabled());
+    ASSERT_TRUE(aggregateSample({EXPRESS_EVENT_REPORTED, kTestMetricIdHash, 0, 0}, 1));
+    Aggregation::enable(/*flushIntervalMs*/ 20);
+    ASSERT_TRUE(Aggregation::isEnabled());
+
+    Aggregation::disable();
+    ASSERT_FALSE(Aggregation::isEnabled());
+    ASSERT_FALSE(aggregateSample({EXPRESS_EVENT_REPORTED, kTestMetricIdHash, 0, 0}, 1));
+}
+
+}  // namespace expresslog
+}  // namespace android
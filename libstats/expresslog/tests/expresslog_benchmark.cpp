@@ -0,0 +1,59 @@
+//
+// Copyright (C) 2024 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+#include <Aggregation.h>
+#include <Counter.h>
+#include <Histogram.h>
+#include <benchmark/benchmark.h>
+
+using android::expresslog::Aggregation;
+using android::expresslog::Counter;
+using android::expresslog::Histogram;
+
+// The per-sample cost of logging, writing one atom per sample (aggregate:0) or adding to the
+// in-process aggregation (aggregate:1). The aggregated cost excludes the periodic flush.
+// Atoms are written to the statsd socket of the device the benchmark runs on.
+
+static void setAggregation(const benchmark::State& state) {
+    if (state.range(0)) {
+        Aggregation::enable();
+    } else {
+        Aggregation::disable();
+    }
+}
+
+static void BM_Counter_logIncrement(benchmark::State& state) {
+    if (state.thread_index() == 0) setAggregation(state);
+    for (auto _ : state) {
+        Counter::logIncrement("expresslog.benchmark.counter");
+    }
+    if (state.thread_index() == 0) Aggregation::disable();
+}
+BENCHMARK(BM_Counter_logIncrement)->ArgName("aggregate")->Arg(0)->Arg(1)->ThreadRange(1, 8);
+
+static void BM_Histogram_logSample(benchmark::State& state) {
+    static const Histogram histogram("expresslog.benchmark.histogram",
+                                     Histogram::UniformOptions::create(50, 0, 1000));
+    if (state.thread_index() == 0) setAggregation(state);
+    float sample = 0;
+    for (auto _ : state) {
+        histogram.logSample(sample);
+        sample = sample < 1000 ? sample + 7 : 0;
+    }
+    if (state.thread_index() == 0) Aggregation::disable();
+}
+BENCHMARK(BM_Histogram_logSample)->ArgName("aggregate")->Arg(0)->Arg(1)->ThreadRange(1, 8);
+
+BENCHMARK_MAIN();
@@ -18,6 +18,7 @@
 
 #include "SocketListener.h"
 
+#include <atomic>
 #include <vector>
 
 class FrameworkCommand;
@@ -31,9 +32,11 @@ public:
     int errorRate;
 
 private:
-    int mCommandCount;
+    std::atomic<int> mCommandCount;
     bool mWithSeq;
     std::vector<FrameworkCommand*> mCommands;
+    // Unused: whether to skip the rest of an oversized command is tracked per client,
+    // since several clients may be served at once. Kept for ABI compatibility.
     bool mSkipToNextNullByte;
 
 public:
@@ -68,6 +68,13 @@ public:
     void incRef();
     bool decRef(); // returns true at 0 (but note: SocketClient already deleted)
 
+    // Used by FrameworkListener to skip the rest of a command that was too
+    // large for its buffer, up to the next null byte.  The state lives outside
+    // of the object, whose layout is part of the ABI, and goes away with it.
+    void setSkipToNextNullByte();
+    // Returns whether the rest of a command was being skipped, and stops skipping it.
+    bool takeSkipToNextNullByte();
+
     // return a new string in quotes with '\\' and '\"' escaped for "my arg"
     // transmissions
     static char *quoteArg(const char *arg);
@@ -18,7 +18,9 @@
 
 #include <pthread.h>
 
+#include <mutex>
 #include <unordered_map>
+#include <vector>
 
 #include <sysutils/SocketClient.h>
 #include "SocketClientCommand.h"
@@ -49,6 +51,12 @@ public:
 
     bool release(SocketClient *c) { return release(c, true); }
 
+    // Handle commands on a pool of |count| threads instead of the listener
+    // thread. Commands from one client are still handled one at a time and in
+    // order, but onDataAvailable() may run concurrently for different clients.
+    // Must be called before startListener().
+    void setWorkerThreads(size_t count);
+
 protected:
     virtual bool onDataAvailable(SocketClient *c) = 0;
 
@@ -59,8 +67,20 @@ private:
     // while processing it.
     std::vector<SocketClient*> snapshotClients();
 
+    // State added after the layout of this class became part of the VNDK ABI.
+    // It is kept in a table keyed by listener rather than in members, so that
+    // the size and layout of SocketListener and its subclasses don't change.
+    struct ListenerState;
+    static std::mutex& statesLock();
+    static std::unordered_map<const SocketListener*, ListenerState*>& states();
+    ListenerState* state() const;
+
     bool release(SocketClient *c, bool wakeup);
     void runListener();
+    void runWorker(ListenerState* state);
+    void handleClient(ListenerState* state, SocketClient *c);
+    bool watch(ListenerState* state, int fd, bool oneShot, int op);
+    void stopWorkers(ListenerState* state);
     void init(const char *socketName, int socketFd, bool listen, bool useCmdNum);
 };
 #endif
@@ -55,6 +55,7 @@ bool FrameworkListener::onDataAvailable(SocketClient *c) {
     int len;
 
     len = TEMP_FAILURE_RETRY(read(c->getSocket(), buffer, sizeof(buffer)));
+    bool skip = c->takeSkipToNextNullByte();
     if (len < 0) {
         SLOGE("read() failed (%s)", strerror(errno));
         return false;
@@ -64,7 +65,7 @@ bool FrameworkListener::onDataAvailable(SocketClient *c) {
         SLOGW("String is not zero-terminated");
         android_errorWriteLog(0x534e4554, "29831647");
         c->sendMsg(500, "Command too large for buffer", false);
-        mSkipToNextNullByte = true;
+        c->setSkipToNextNullByte();
         return true;
     }
 
@@ -74,8 +75,8 @@ bool FrameworkListener::onDataAvailable(SocketClient *c) {
     for (i = 0; i < len; i++) {
         if (buffer[i] == '\0') {
             /* IMPORTANT: dispatchCommand() expects a zero-terminated string */
-            if (mSkipToNextNullByte) {
-                mSkipToNextNullByte = false;
+            if (skip) {
+                skip = false;
             } else {
                 dispatchCommand(c, buffer + offset);
             }
@@ -83,7 +84,6 @@ bool FrameworkListener::onDataAvailable(SocketClient *c) {
         }
     }
 
-    mSkipToNextNullByte = false;
     return true;
 }
 
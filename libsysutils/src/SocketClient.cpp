@@ -27,11 +27,25 @@
 #include <sys/types.h>
 #include <unistd.h>
 
+#include <mutex>
+#include <unordered_set>
+
 #include <android-base/file.h>
 #include <android-base/macros.h>
 #include <log/log.h>
 #include <sysutils/SocketClient.h>
 
+// Clients whose last read ended in the middle of an oversized command.
+static std::mutex& skippingClientsLock() {
+    static std::mutex lock;
+    return lock;
+}
+
+static std::unordered_set<const SocketClient*>& skippingClients() {
+    static auto* clients = new std::unordered_set<const SocketClient*>();
+    return *clients;
+}
+
 SocketClient::SocketClient(int socket, bool owned) {
     init(socket, owned, false);
 }
@@ -65,11 +79,25 @@ void SocketClient::init(int socket, bool owned, bool useCmdNum) {
 }
 
 SocketClient::~SocketClient() {
+    {
+        std::lock_guard<std::mutex> lock(skippingClientsLock());
+        skippingClients().erase(this);
+    }
     if (mSocketOwned) {
         close(mSocket);
     }
 }
 
+void SocketClient::setSkipToNextNullByte() {
+    std::lock_guard<std::mutex> lock(skippingClientsLock());
+    skippingClients().insert(this);
+}
+
+bool SocketClient::takeSkipToNextNullByte() {
+    std::lock_guard<std::mutex> lock(skippingClientsLock());
+    return skippingClients().erase(this) != 0;
+}
+
 int SocketClient::sendMsg(int code, const char *msg, bool addErrno) {
     return sendMsg(code, msg, addErrno, mUseCmdNum);
 }
@@ -19,13 +19,17 @@
 #include <errno.h>
 #include <stdio.h>
 #include <stdlib.h>
-#include <sys/poll.h>
+#include <sys/epoll.h>
 #include <sys/socket.h>
 #include <sys/time.h>
 #include <sys/types.h>
 #include <sys/un.h>
 #include <unistd.h>
 
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
 #include <vector>
 
 #include <cutils/sockets.h>
@@ -36,6 +40,36 @@
 #define CtrlPipe_Shutdown 0
 #define CtrlPipe_Wakeup   1
 
+static constexpr int kMaxEpollEvents = 64;
+
+struct SocketListener::ListenerState {
+    int epollFd = -1;
+
+    // Optional pool that runs onDataAvailable() off the listener thread.
+    size_t workerCount = 0;
+    std::vector<std::thread> workers;
+    std::mutex workLock;
+    std::condition_variable workCond;
+    std::deque<SocketClient*> work;
+    bool stopWorkers = false;
+};
+
+std::mutex& SocketListener::statesLock() {
+    static std::mutex lock;
+    return lock;
+}
+
+std::unordered_map<const SocketListener*, SocketListener::ListenerState*>&
+SocketListener::states() {
+    static auto* states = new std::unordered_map<const SocketListener*, ListenerState*>();
+    return *states;
+}
+
+SocketListener::ListenerState* SocketListener::state() const {
+    std::lock_guard<std::mutex> lock(statesLock());
+    return states().at(this);
+}
+
 SocketListener::SocketListener(const char *socketName, bool listen) {
     init(socketName, -1, listen, false);
 }
@@ -53,7 +87,12 @@ void SocketListener::init(const char *socketName, int socketFd, bool listen, boo
     mSocketName = socketName;
     mSock = socketFd;
     mUseCmdNum = useCmdNum;
+    mCtrlPipe[0] = -1;
+    mCtrlPipe[1] = -1;
     pthread_mutex_init(&mClientsLock, nullptr);
+
+    std::lock_guard<std::mutex> lock(statesLock());
+    states()[this] = new ListenerState();
 }
 
 SocketListener::~SocketListener() {
@@ -67,6 +106,22 @@ SocketListener::~SocketListener() {
     for (auto pair : mClients) {
         pair.second->decRef();
     }
+
+    ListenerState* state;
+    {
+        std::lock_guard<std::mutex> lock(statesLock());
+        auto it = states().find(this);
+        state = it->second;
+        states().erase(it);
+    }
+    if (state->epollFd != -1) {
+        close(state->epollFd);
+    }
+    delete state;
+}
+
+void SocketListener::setWorkerThreads(size_t count) {
+    state()->workerCount = count;
 }
 
 int SocketListener::startListener() {
@@ -100,14 +155,52 @@ int SocketListener::startListener(int backlog) {
         return -1;
     }
 
+    // Every socket stays registered with epoll for as long as we watch it, so
+    // the listener loop doesn't have to rebuild its fd set on each iteration.
+    ListenerState* state = this->state();
+    state->epollFd = epoll_create1(EPOLL_CLOEXEC);
+    if (state->epollFd == -1) {
+        SLOGE("epoll_create1 failed (%s)", strerror(errno));
+        return -1;
+    }
+    if (!watch(state, mCtrlPipe[0], false, EPOLL_CTL_ADD) ||
+        (mListen && !watch(state, mSock, false, EPOLL_CTL_ADD))) {
+        return -1;
+    }
+    for (auto pair : mClients) {
+        if (!watch(state, pair.first, state->workerCount > 0, EPOLL_CTL_ADD)) {
+            return -1;
+        }
+    }
+
+    state->stopWorkers = false;
+    for (size_t i = 0; i < state->workerCount; ++i) {
+        state->workers.emplace_back(&SocketListener::runWorker, this, state);
+    }
+
     if (pthread_create(&mThread, nullptr, SocketListener::threadStart, this)) {
         SLOGE("pthread_create (%s)", strerror(errno));
+        stopWorkers(state);
         return -1;
     }
 
     return 0;
 }
 
+bool SocketListener::watch(ListenerState* state, int fd, bool oneShot, int op) {
+    // With a worker pool, client sockets are one-shot: a client is not reported
+    // again until its current command has been handled and it is re-armed,
+    // which keeps the commands of one client in order.
+    struct epoll_event ev = {};
+    ev.events = EPOLLIN | (oneShot ? EPOLLONESHOT : 0u);
+    ev.data.fd = fd;
+    if (epoll_ctl(state->epollFd, op, fd, &ev) == -1) {
+        SLOGE("epoll_ctl(%d) failed for fd %d (%s)", op, fd, strerror(errno));
+        return false;
+    }
+    return true;
+}
+
 int SocketListener::stopListener() {
     char c = CtrlPipe_Shutdown;
     int  rc;
@@ -123,10 +216,16 @@ int SocketListener::stopListener() {
         SLOGE("Error joining to listener thread (%s)", strerror(errno));
         return -1;
     }
+
+    ListenerState* state = this->state();
+    stopWorkers(state);
+
     close(mCtrlPipe[0]);
     close(mCtrlPipe[1]);
     mCtrlPipe[0] = -1;
     mCtrlPipe[1] = -1;
+    close(state->epollFd);
+    state->epollFd = -1;
 
     if (mSocketName && mSock > -1) {
         close(mSock);
@@ -140,6 +239,23 @@ int SocketListener::stopListener() {
     return 0;
 }
 
+// Joins the worker threads, dropping any work that they didn't get to.
+void SocketListener::stopWorkers(ListenerState* state) {
+    {
+        std::lock_guard<std::mutex> lock(state->workLock);
+        state->stopWorkers = true;
+    }
+    state->workCond.notify_all();
+    for (std::thread& worker : state->workers) {
+        worker.join();
+    }
+    state->workers.clear();
+    for (SocketClient* c : state->work) {
+        c->decRef();
+    }
+    state->work.clear();
+}
+
 void *SocketListener::threadStart(void *obj) {
     SocketListener *me = reinterpret_cast<SocketListener *>(obj);
 
@@ -149,81 +265,124 @@ void *SocketListener::threadStart(void *obj) {
 }
 
 void SocketListener::runListener() {
-    while (true) {
-        std::vector<pollfd> fds;
-
-        pthread_mutex_lock(&mClientsLock);
-        fds.reserve(2 + mClients.size());
-        fds.push_back({.fd = mCtrlPipe[0], .events = POLLIN});
-        if (mListen) fds.push_back({.fd = mSock, .events = POLLIN});
-        for (auto pair : mClients) {
-            // NB: calling out to an other object with mClientsLock held (safe)
-            const int fd = pair.second->getSocket();
-            if (fd != pair.first) SLOGE("fd mismatch: %d != %d", fd, pair.first);
-            fds.push_back({.fd = fd, .events = POLLIN});
-        }
-        pthread_mutex_unlock(&mClientsLock);
+    ListenerState* state = this->state();
+    struct epoll_event events[kMaxEpollEvents];
+    std::vector<SocketClient*> pending;
 
+    while (true) {
         SLOGV("mListen=%d, mSocketName=%s", mListen, mSocketName);
-        int rc = TEMP_FAILURE_RETRY(poll(fds.data(), fds.size(), -1));
+        int rc = TEMP_FAILURE_RETRY(epoll_wait(state->epollFd, events, kMaxEpollEvents, -1));
         if (rc < 0) {
-            SLOGE("poll failed (%s) mListen=%d", strerror(errno), mListen);
+            SLOGE("epoll_wait failed (%s) mListen=%d", strerror(errno), mListen);
             sleep(1);
             continue;
         }
 
-        if (fds[0].revents & (POLLIN | POLLERR)) {
+        bool ctrl = false;
+        bool incoming = false;
+
+        // Add all active clients to the pending list first, so we can release
+        // the lock before invoking the callbacks.
+        pending.clear();
+        pthread_mutex_lock(&mClientsLock);
+        for (int i = 0; i < rc; ++i) {
+            const int fd = events[i].data.fd;
+            if (fd == mCtrlPipe[0]) {
+                ctrl = true;
+                continue;
+            }
+            if (mListen && fd == mSock) {
+                incoming = true;
+                continue;
+            }
+            auto it = mClients.find(fd);
+            if (it == mClients.end()) {
+                SLOGE("fd vanished: %d", fd);
+                continue;
+            }
+            SocketClient* c = it->second;
+            pending.push_back(c);
+            c->incRef();
+        }
+        pthread_mutex_unlock(&mClientsLock);
+
+        if (ctrl) {
             char c = CtrlPipe_Shutdown;
             TEMP_FAILURE_RETRY(read(mCtrlPipe[0], &c, 1));
             if (c == CtrlPipe_Shutdown) {
+                for (SocketClient* client : pending) {
+                    client->decRef();
+                }
                 break;
             }
-            continue;
         }
-        if (mListen && (fds[1].revents & (POLLIN | POLLERR))) {
+
+        if (incoming) {
             int c = TEMP_FAILURE_RETRY(accept4(mSock, nullptr, nullptr, SOCK_CLOEXEC));
             if (c < 0) {
                 SLOGE("accept failed (%s)", strerror(errno));
                 sleep(1);
-                continue;
+            } else {
+                pthread_mutex_lock(&mClientsLock);
+                mClients[c] = new SocketClient(c, true, mUseCmdNum);
+                pthread_mutex_unlock(&mClientsLock);
+                watch(state, c, state->workerCount > 0, EPOLL_CTL_ADD);
             }
-            pthread_mutex_lock(&mClientsLock);
-            mClients[c] = new SocketClient(c, true, mUseCmdNum);
-            pthread_mutex_unlock(&mClientsLock);
         }
 
-        // Add all active clients to the pending list first, so we can release
-        // the lock before invoking the callbacks.
-        std::vector<SocketClient*> pending;
-        pthread_mutex_lock(&mClientsLock);
-        const int size = fds.size();
-        for (int i = mListen ? 2 : 1; i < size; ++i) {
-            const struct pollfd& p = fds[i];
-            if (p.revents & (POLLIN | POLLERR)) {
-                auto it = mClients.find(p.fd);
-                if (it == mClients.end()) {
-                    SLOGE("fd vanished: %d", p.fd);
-                    continue;
-                }
-                SocketClient* c = it->second;
-                pending.push_back(c);
-                c->incRef();
+        if (state->workers.empty()) {
+            for (SocketClient* c : pending) {
+                handleClient(state, c);
+            }
+        } else if (!pending.empty()) {
+            {
+                std::lock_guard<std::mutex> lock(state->workLock);
+                state->work.insert(state->work.end(), pending.begin(), pending.end());
+            }
+            if (pending.size() == 1) {
+                state->workCond.notify_one();
+            } else {
+                state->workCond.notify_all();
             }
         }
-        pthread_mutex_unlock(&mClientsLock);
+    }
+}
 
-        for (SocketClient* c : pending) {
-            // Process it, if false is returned, remove from the map
-            SLOGV("processing fd %d", c->getSocket());
-            if (!onDataAvailable(c)) {
-                release(c, false);
+void SocketListener::runWorker(ListenerState* state) {
+    while (true) {
+        SocketClient* c;
+        {
+            std::unique_lock<std::mutex> lock(state->workLock);
+            state->workCond.wait(lock,
+                                 [state] { return state->stopWorkers || !state->work.empty(); });
+            if (state->stopWorkers) {
+                return;
             }
-            c->decRef();
+            c = state->work.front();
+            state->work.pop_front();
         }
+        handleClient(state, c);
     }
 }
 
-bool SocketListener::release(SocketClient* c, bool wakeup) {
+// Called with a reference held on |c|, which is dropped here.
+void SocketListener::handleClient(ListenerState* state, SocketClient* c) {
+    // Process it, if false is returned, remove from the map
+    SLOGV("processing fd %d", c->getSocket());
+    if (!onDataAvailable(c)) {
+        release(c, false);
+    } else if (!state->workers.empty()) {
+        // Re-arm the one-shot registration. This fails harmlessly if the client
+        // was released while its command was running.
+        struct epoll_event ev = {};
+        ev.events = EPOLLIN | EPOLLONESHOT;
+        ev.data.fd = c->getSocket();
+        epoll_ctl(state->epollFd, EPOLL_CTL_MOD, c->getSocket(), &ev);
+    }
+    c->decRef();
+}
+
+bool SocketListener::release(SocketClient* c, bool /* wakeup */) {
     bool ret = false;
     /* if our sockets are connection-based, remove and destroy it */
     if (mListen && c) {
@@ -233,11 +392,11 @@ bool SocketListener::release(SocketClient* c, bool wakeup) {
         ret = (mClients.erase(c->getSocket()) != 0);
         pthread_mutex_unlock(&mClientsLock);
         if (ret) {
+            // Stop watching the socket before it can be closed and its fd reused.
+            // Registrations are persistent, so the listener thread doesn't need
+            // a wakeup to notice.
+            epoll_ctl(state()->epollFd, EPOLL_CTL_DEL, c->getSocket(), nullptr);
             ret = c->decRef();
-            if (wakeup) {
-                char b = CtrlPipe_Wakeup;
-                TEMP_FAILURE_RETRY(write(mCtrlPipe[1], &b, 1));
-            }
         }
     }
     return ret;
@@ -0,0 +1,128 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <sysutils/FrameworkCommand.h>
+#include <sysutils/FrameworkListener.h>
+
+#include <inttypes.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <thread>
+#include <vector>
+
+#include <android-base/file.h>
+#include <android-base/logging.h>
+#include <android-base/stringprintf.h>
+#include <android-base/unique_fd.h>
+#include <benchmark/benchmark.h>
+#include <cutils/sockets.h>
+
+using android::base::StringPrintf;
+using android::base::unique_fd;
+
+namespace {
+
+constexpr int kCommandsPerClient = 64;
+
+// Replies "0 ok" after spinning for the requested number of microseconds,
+// standing in for the work a real command handler does.
+class BusyCommand : public FrameworkCommand {
+  public:
+    BusyCommand() : FrameworkCommand("busy") {}
+
+    int runCommand(SocketClient* cli, int argc, char** argv) override {
+        if (argc > 1) {
+            usleep(atoi(argv[1]));
+        }
+        cli->sendMsg(0, "ok", /*addErrno=*/false, /*useCmdNum=*/false);
+        return 0;
+    }
+};
+
+class BenchmarkListener : public FrameworkListener {
+  public:
+    BenchmarkListener(int fd, size_t workers) : FrameworkListener(fd) {
+        registerCmd(new BusyCommand);  // Leaked :-(
+        setWorkerThreads(workers);
+    }
+};
+
+unique_fd socketAt(const std::string& path, bool server) {
+    unique_fd fd(socket(PF_UNIX, SOCK_STREAM | SOCK_CLOEXEC | (server ? SOCK_NONBLOCK : 0), 0));
+    CHECK(fd.get() >= 0);
+
+    struct sockaddr_un addr = {.sun_family = AF_UNIX};
+    strlcpy(addr.sun_path, path.c_str(), sizeof(addr.sun_path));
+    if (server) {
+        unlink(path.c_str());
+        CHECK(bind(fd.get(), reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) == 0);
+    } else {
+        CHECK(connect(fd.get(), reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) == 0);
+    }
+    return fd;
+}
+
+// Sends |count| commands over |fd|, waiting for each reply before sending
+// the next, like a typical client does.
+void roundTrips(int fd, const char* cmd, int count) {
+    char buf[64];
+    for (int i = 0; i < count; i++) {
+        CHECK(android::base::WriteFully(fd, cmd, strlen(cmd) + 1));
+        CHECK(read(fd, buf, sizeof(buf)) > 0);
+    }
+}
+
+}  // unnamed namespace
+
+// Args: concurrent clients, listener worker threads, command cost in us.
+static void BM_framework_listener(benchmark::State& state) {
+    const int clients = state.range(0);
+    const std::string path = StringPrintf("%s/BM_framework_listener.%d", ANDROID_SOCKET_DIR,
+                                          getpid());
+    const std::string cmd = StringPrintf("busy %" PRId64, state.range(2));
+
+    unique_fd server = socketAt(path, true);
+    BenchmarkListener listener(server.get(), state.range(1));
+    CHECK(listener.startListener() == 0);
+
+    std::vector<unique_fd> fds;
+    for (int i = 0; i < clients; i++) {
+        fds.push_back(socketAt(path, false));
+    }
+
+    for (auto _ : state) {
+        std::vector<std::thread> threads;
+        for (auto& fd : fds) {
+            threads.emplace_back(roundTrips, fd.get(), cmd.c_str(), kCommandsPerClient);
+        }
+        for (auto& t : threads) {
+            t.join();
+        }
+    }
+    state.SetItemsProcessed(state.iterations() * clients * kCommandsPerClient);
+
+    fds.clear();
+    CHECK(listener.stopListener() == 0);
+    unlink(path.c_str());
+}
+BENCHMARK(BM_framework_listener)
+        ->ArgsProduct({{1, 8, 32}, {0, 4}, {0, 100}})
+        ->UseRealTime();
+
+BENCHMARK_MAIN();
@@ -39,8 +39,11 @@ namespace {
 std::string testSocketPath() {
     const testing::TestInfo* const test_info =
             testing::UnitTest::GetInstance()->current_test_info();
-    return std::string(ANDROID_SOCKET_DIR "/") + std::string(test_info->test_case_name()) +
-           std::string(".") + std::string(test_info->name());
+    std::string name = std::string(test_info->test_case_name()) + std::string(".") +
+                       std::string(test_info->name());
+    // Parameterized test names contain slashes.
+    std::replace(name.begin(), name.end(), '/', '_');
+    return std::string(ANDROID_SOCKET_DIR "/") + name;
 }
 
 unique_fd serverSocket(const std::string& path) {
@@ -110,22 +113,38 @@ class TestCommand : public FrameworkCommand {
     }
 };
 
-// A test listener with a single command.
+// Test command which replies "0 slow" after a delay.
+class SlowCommand : public FrameworkCommand {
+  public:
+    SlowCommand() : FrameworkCommand("slow") {}
+    ~SlowCommand() override {}
+
+    int runCommand(SocketClient* cli, int /*argc*/, char** /*argv*/) {
+        usleep(200 * 1000);
+        cli->sendMsg(0, "slow", /*addErrno=*/false, /*useCmdNum=*/false);
+        return 0;
+    }
+};
+
+// A test listener with a test command and a slow command.
 class TestListener : public FrameworkListener {
   public:
-    TestListener(int fd) : FrameworkListener(fd) {
+    TestListener(int fd, size_t workers) : FrameworkListener(fd) {
         registerCmd(new TestCommand);  // Leaked :-(
+        registerCmd(new SlowCommand);  // Leaked :-(
+        setWorkerThreads(workers);
     }
 };
 
 }  // unnamed namespace
 
-class FrameworkListenerTest : public testing::Test {
+// Parameterized on the number of worker threads.
+class FrameworkListenerTest : public testing::TestWithParam<size_t> {
   public:
     FrameworkListenerTest() {
         mSocketPath = testSocketPath();
         mSserverFd = serverSocket(mSocketPath);
-        mListener = std::make_unique<TestListener>(mSserverFd.get());
+        mListener = std::make_unique<TestListener>(mSserverFd.get(), GetParam());
         EXPECT_EQ(0, mListener->startListener());
     }
 
@@ -150,12 +169,12 @@ class FrameworkListenerTest : public testing::Test {
     std::unique_ptr<TestListener> mListener;
 };
 
-TEST_F(FrameworkListenerTest, DoesNothing) {
+TEST_P(FrameworkListenerTest, DoesNothing) {
     // Let the test harness start and stop a FrameworkListener
     // without sending any commands through it.
 }
 
-TEST_F(FrameworkListenerTest, DispatchesValidCommands) {
+TEST_P(FrameworkListenerTest, DispatchesValidCommands) {
     testCommand("test", "42 test");
     testCommand("test arg1 arg2", "42 test,arg1,arg2");
     testCommand("test \"arg1 still_arg1\" arg2", "42 test,arg1 still_arg1,arg2");
@@ -166,13 +185,13 @@ TEST_F(FrameworkListenerTest, DispatchesValidCommands) {
     testCommand("test   ", "42 test,,,");
 }
 
-TEST_F(FrameworkListenerTest, RejectsInvalidCommands) {
+TEST_P(FrameworkListenerTest, RejectsInvalidCommands) {
     testCommand("unknown arg1 arg2", "500 Command not recognized");
     testCommand("test \"arg1 arg2", "500 Unclosed quotes error");
     testCommand("test \\a", "500 Unsupported escape sequence");
 }
 
-TEST_F(FrameworkListenerTest, MultipleClients) {
+TEST_P(FrameworkListenerTest, MultipleClients) {
     unique_fd client1 = clientSocket(mSocketPath);
     unique_fd client2 = clientSocket(mSocketPath);
     sendCmd(client1.get(), "test 1");
@@ -181,3 +200,78 @@ TEST_F(FrameworkListenerTest, MultipleClients) {
     EXPECT_EQ(std::string("42 test,2") + '\0', recvReply(client2.get()));
     EXPECT_EQ(std::string("42 test,1") + '\0', recvReply(client1.get()));
 }
+
+TEST_P(FrameworkListenerTest, PreservesPerClientOrder) {
+    unique_fd client = clientSocket(mSocketPath);
+    std::string expected;
+    for (int i = 0; i < 20; i++) {
+        std::string cmd = "test " + std::to_string(i);
+        sendCmd(client.get(), cmd.c_str());
+        expected += "42 test," + std::to_string(i) + '\0';
+    }
+
+    std::string replies;
+    while (replies.size() < expected.size()) {
+        std::string reply = recvReply(client.get());
+        if (reply.empty()) break;
+        replies += reply;
+    }
+    EXPECT_EQ(expected, replies);
+}
+
+TEST_P(FrameworkListenerTest, SkipsOversizedCommandPerClient) {
+    unique_fd client1 = clientSocket(mSocketPath);
+    unique_fd client2 = clientSocket(mSocketPath);
+
+    // Fill a whole read buffer without a terminating null byte.
+    std::string oversized(4096, 'a');
+    ASSERT_TRUE(android::base::WriteFully(client1.get(), oversized.data(), oversized.size()));
+    EXPECT_EQ(std::string("500 Command too large for buffer") + '\0', recvReply(client1.get()));
+
+    // Another client's commands are not skipped...
+    sendCmd(client2.get(), "test 2");
+    EXPECT_EQ(std::string("42 test,2") + '\0', recvReply(client2.get()));
+
+    // ...but the rest of the oversized command is.
+    std::string rest = std::string("aaaa") + '\0' + "test 1";
+    ASSERT_TRUE(android::base::WriteFully(client1.get(), rest.c_str(), rest.size() + 1));
+    EXPECT_EQ(std::string("42 test,1") + '\0', recvReply(client1.get()));
+}
+
+TEST_P(FrameworkListenerTest, SlowClientDoesNotBlockOthers) {
+    if (GetParam() == 0) {
+        GTEST_SKIP() << "commands are serialized without worker threads";
+    }
+
+    unique_fd slow_client = clientSocket(mSocketPath);
+    unique_fd fast_client = clientSocket(mSocketPath);
+    sendCmd(slow_client.get(), "slow");
+    // Give the listener a chance to hand the slow command to a worker.
+    usleep(20 * 1000);
+    sendCmd(fast_client.get(), "test fast");
+
+    pollfd fds = {.fd = slow_client.get(), .events = POLLIN};
+    EXPECT_EQ(std::string("42 test,fast") + '\0', recvReply(fast_client.get()));
+    EXPECT_EQ(0, poll(&fds, 1, 0)) << "slow command finished before the fast one";
+    EXPECT_EQ(std::string("0 slow") + '\0', recvReply(slow_client.get()));
+}
+
+INSTANTIATE_TEST_SUITE_P(Workers, FrameworkListenerTest, testing::Values(0, 4),
+                         [](const testing::TestParamInfo<size_t>& info) {
+                             return "Workers" + std::to_string(info.param);
+                         });
+
+TEST(SocketClientTest, SkipStateGoesAwayWithClient) {
+    // A client released in the middle of an oversized command...
+    SocketClient* client = new SocketClient(-1, false);
+    client->setSkipToNextNullByte();
+    client->decRef();
+
+    // ...does not make a new client that gets its memory skip its first command.
+    SocketClient* reused = new SocketClient(-1, false);
+    EXPECT_FALSE(reused->takeSkipToNextNullByte());
+    reused->setSkipToNextNullByte();
+    EXPECT_TRUE(reused->takeSkipToNextNullByte());
+    EXPECT_FALSE(reused->takeSkipToNextNullByte());
+    reused->decRef();
+}
@@ -20,7 +20,10 @@
 #include <utils/Looper.h>
 
 #include <sys/eventfd.h>
+#include <atomic>
 #include <cinttypes>
+#include <memory>
+#include <vector>
 
 namespace android {
 
@@ -32,6 +35,100 @@ epoll_event createEpollEvent(uint32_t events, uint64_t seq) {
     return {.events = events, .data = {.u64 = seq}};
 }
 
+// Pending messages, ordered by uptime and then by send order.
+//
+// A binary min-heap of indices into a slab of envelopes, with each
+// envelope recording its heap position so that it can be removed in
+// O(log n). A secondary index from handler to its pending envelopes lets
+// removeMessages() visit only that handler's messages.
+//
+// Messages can also be posted without the looper lock through a bounded
+// multi-producer inbox, which the looper drains into the heap with the lock
+// held.  Every message is numbered when it is sent, whichever way it goes, so
+// draining the inbox late never reorders messages with equal uptimes.
+//
+// Looper's members are part of the ABI, so the queue is held as the handler
+// of the only envelope in Looper::mMessageEnvelopes.  It is never sent a message.
+class MessageQueue final : public MessageHandler {
+  public:
+    struct Envelope {
+        nsecs_t uptime = 0;
+        uint64_t seq = 0;  // send order, breaks ties between equal uptimes
+        sp<MessageHandler> handler;
+        Message message;
+        size_t heapIndex = 0;     // position in mHeap
+        size_t handlerIndex = 0;  // position in the handler's mByHandler list
+    };
+
+    void handleMessage(const Message&) override {
+        LOG_ALWAYS_FATAL("Looper message queue cannot handle messages");
+    }
+
+    size_t size() const { return mHeap.size(); }
+    bool empty() const { return mHeap.empty(); }
+
+    uint64_t nextSeq() { return mNextSeq.fetch_add(1, std::memory_order_relaxed); }
+
+    // Returns true if the message became the head of the queue.
+    bool push(nsecs_t uptime, uint64_t seq, const sp<MessageHandler>& handler,
+              const Message& message);
+    const Envelope& top() const { return mSlots[mHeap[0]]; }
+    void pop(sp<MessageHandler>* handler, Message* message);
+
+    void remove(const sp<MessageHandler>& handler);
+    void remove(const sp<MessageHandler>& handler, int what);
+
+    bool inboxEnabled() const { return mInboxEnabled.load(std::memory_order_acquire); }
+    void setInboxEnabled(bool enabled);  // requires the looper lock
+
+    // Posts a message without the looper lock.  Returns false if the inbox is
+    // disabled or full.  Sets |wake| if the looper needs to be woken to drain it.
+    bool post(nsecs_t uptime, const sp<MessageHandler>& handler, const Message& message,
+              bool* wake);
+    // Moves every message posted so far into the heap, except those that are still being
+    // posted.  Requires the looper lock.
+    void drainInbox();
+
+  private:
+    // A cell of the inbox ring.  |sequence| tells producers and the consumer
+    // whose turn it is to use the cell, as in Dmitry Vyukov's bounded queue.
+    struct InboxCell {
+        std::atomic<size_t> sequence;
+        nsecs_t uptime;
+        uint64_t seq;
+        sp<MessageHandler> handler;
+        Message message;
+        bool drained = false;  // moved to the heap, guarded by the looper lock
+    };
+    static constexpr size_t kInboxCapacity = 256;
+
+    bool before(size_t a, size_t b) const;
+    void siftUp(size_t pos);
+    void siftDown(size_t pos);
+    void place(size_t pos, size_t slot);
+    void removeSlot(size_t slot);
+
+    std::vector<Envelope> mSlots;
+    std::vector<size_t> mFreeSlots;
+    std::vector<size_t> mHeap;  // slot indices
+    std::unordered_map<MessageHandler*, std::vector<size_t>> mByHandler;
+    std::atomic<uint64_t> mNextSeq = 0;
+
+    // Allocated the first time the inbox is enabled and kept until the looper goes away.
+    std::unique_ptr<InboxCell[]> mInbox;
+    std::atomic<bool> mInboxEnabled = false;
+    std::atomic<size_t> mInboxTail = 0;  // next cell to claim for posting
+    size_t mInboxHead = 0;               // next cell to drain, guarded by the looper lock
+    // Set by the first post after a drain, which is the only one that needs to wake the looper.
+    std::atomic<bool> mInboxWakePending = false;
+};
+
+// Deduces the envelope type, which is private to Looper.
+template <typename Envelopes>
+MessageQueue& messageQueueOf(const Envelopes& envelopes) {
+    return *static_cast<MessageQueue*>(envelopes.itemAt(0).handler.get());
+}
+
 }  // namespace
 
 // --- WeakMessageHandler ---
@@ -84,6 +181,8 @@ Looper::Looper(bool allowNonCallbacks)
     mWakeEventFd.reset(eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC));
     LOG_ALWAYS_FATAL_IF(mWakeEventFd.get() < 0, "Could not make wake event fd: %s", strerror(errno));
 
+    mMessageEnvelopes.push(MessageEnvelope(0, sp<MessageQueue>::make(), Message()));
+
     AutoMutex _l(mLock);
     rebuildEpollLocked();
 }
@@ -315,18 +414,20 @@ Done: ;
 
     // Invoke pending message callbacks.
     mNextMessageUptime = LLONG_MAX;
-    while (mMessageEnvelopes.size() != 0) {
+    MessageQueue& messageQueue = messageQueueOf(mMessageEnvelopes);
+    messageQueue.drainInbox();
+    while (!messageQueue.empty()) {
         nsecs_t now = systemTime(SYSTEM_TIME_MONOTONIC);
-        const MessageEnvelope& messageEnvelope = mMessageEnvelopes.itemAt(0);
+        const MessageQueue::Envelope& messageEnvelope = messageQueue.top();
         if (messageEnvelope.uptime <= now) {
-            // Remove the envelope from the list.
+            // Remove the envelope from the queue.
             // We keep a strong reference to the handler until the call to handleMessage
             // finishes.  Then we drop it so that the handler can be deleted *before*
             // we reacquire our lock.
             { // obtain handler
-                sp<MessageHandler> handler = messageEnvelope.handler;
-                Message message = messageEnvelope.message;
-                mMessageEnvelopes.removeAt(0);
+                sp<MessageHandler> handler;
+                Message message;
+                messageQueue.pop(&handler, &message);
                 mSendingMessage = true;
                 mLock.unlock();
 
@@ -340,6 +441,8 @@ Done: ;
             mLock.lock();
             mSendingMessage = false;
             result = POLL_CALLBACK;
+            // Pick up anything the handler, or another thread, posted meanwhile.
+            messageQueue.drainInbox();
         } else {
             // The last message left at the head of the queue determines the next wakeup time.
             mNextMessageUptime = messageEnvelope.uptime;
@@ -622,17 +725,25 @@ void Looper::sendMessageAtTime(nsecs_t uptime, const sp<MessageHandler>& handler
             this, uptime, handler.get(), message.what);
 #endif
 
-    size_t i = 0;
+    MessageQueue& messageQueue = messageQueueOf(mMessageEnvelopes);
+    if (messageQueue.inboxEnabled()) {
+        bool needWake = false;
+        if (messageQueue.post(uptime, handler, message, &needWake)) {
+            if (needWake) {
+                wake();
+            }
+            return;
+        }
+        // The inbox is full, so queue the message under the lock instead.
+    }
+
+    bool atHead;
     { // acquire lock
         AutoMutex _l(mLock);
 
-        size_t messageCount = mMessageEnvelopes.size();
-        while (i < messageCount && uptime >= mMessageEnvelopes.itemAt(i).uptime) {
-            i += 1;
-        }
-
-        MessageEnvelope messageEnvelope(uptime, handler, message);
-        mMessageEnvelopes.insertAt(messageEnvelope, i, 1);
+        // Anything this thread posted to the inbox earlier must be queued first.
+        messageQueue.drainInbox();
+        atHead = messageQueue.push(uptime, messageQueue.nextSeq(), handler, message);
 
         // Optimization: If the Looper is currently sending a message, then we can skip
         // the call to wake() because the next thing the Looper will do after processing
@@ -644,7 +755,7 @@ void Looper::sendMessageAtTime(nsecs_t uptime, const sp<MessageHandler>& handler
     } // release lock
 
     // Wake the poll loop only when we enqueue a new message at the head.
-    if (i == 0) {
+    if (atHead) {
         wake();
     }
 }
@@ -656,13 +767,9 @@ void Looper::removeMessages(const sp<MessageHandler>& handler) {
 
     { // acquire lock
         AutoMutex _l(mLock);
-
-        for (size_t i = mMessageEnvelopes.size(); i != 0; ) {
-            const MessageEnvelope& messageEnvelope = mMessageEnvelopes.itemAt(--i);
-            if (messageEnvelope.handler == handler) {
-                mMessageEnvelopes.removeAt(i);
-            }
-        }
+        MessageQueue& messageQueue = messageQueueOf(mMessageEnvelopes);
+        messageQueue.drainInbox();
+        messageQueue.remove(handler);
     } // release lock
 }
 
@@ -673,21 +780,244 @@ void Looper::removeMessages(const sp<MessageHandler>& handler, int what) {
 
     { // acquire lock
         AutoMutex _l(mLock);
-
-        for (size_t i = mMessageEnvelopes.size(); i != 0; ) {
-            const MessageEnvelope& messageEnvelope = mMessageEnvelopes.itemAt(--i);
-            if (messageEnvelope.handler == handler
-                    && messageEnvelope.message.what == what) {
-                mMessageEnvelopes.removeAt(i);
-            }
-        }
+        MessageQueue& messageQueue = messageQueueOf(mMessageEnvelopes);
+        messageQueue.drainInbox();
+        messageQueue.remove(handler, what);
     } // release lock
 }
 
+void Looper::setLockFreeMessageInbox(bool enabled) {
+    AutoMutex _l(mLock);
+    messageQueueOf(mMessageEnvelopes).setInboxEnabled(enabled);
+}
+
 bool Looper::isPolling() const {
     return mPolling;
 }
 
+// --- MessageQueue ---
+
+bool MessageQueue::push(nsecs_t uptime, uint64_t seq, const sp<MessageHandler>& handler,
+                        const Message& message) {
+    size_t slot;
+    if (mFreeSlots.empty()) {
+        slot = mSlots.size();
+        mSlots.emplace_back();
+    } else {
+        slot = mFreeSlots.back();
+        mFreeSlots.pop_back();
+    }
+
+    Envelope& envelope = mSlots[slot];
+    envelope.uptime = uptime;
+    envelope.seq = seq;
+    envelope.handler = handler;
+    envelope.message = message;
+
+    std::vector<size_t>& handlerSlots = mByHandler[handler.get()];
+    envelope.handlerIndex = handlerSlots.size();
+    handlerSlots.push_back(slot);
+
+    mHeap.push_back(slot);
+    siftUp(mHeap.size() - 1);
+    return envelope.heapIndex == 0;
+}
+
+void MessageQueue::pop(sp<MessageHandler>* handler, Message* message) {
+    size_t slot = mHeap[0];
+    *message = mSlots[slot].message;
+    *handler = mSlots[slot].handler;
+    removeSlot(slot);
+}
+
+void MessageQueue::remove(const sp<MessageHandler>& handler) {
+    auto it = mByHandler.find(handler.get());
+    if (it == mByHandler.end()) {
+        return;
+    }
+    // Removing the last message of a handler erases its list, so work on a copy.
+    std::vector<size_t> slots = it->second;
+    for (size_t slot : slots) {
+        removeSlot(slot);
+    }
+}
+
+void MessageQueue::remove(const sp<MessageHandler>& handler, int what) {
+    auto it = mByHandler.find(handler.get());
+    if (it == mByHandler.end()) {
+        return;
+    }
+    std::vector<size_t> slots;
+    for (size_t slot : it->second) {
+        if (mSlots[slot].message.what == what) {
+            slots.push_back(slot);
+        }
+    }
+    for (size_t slot : slots) {
+        removeSlot(slot);
+    }
+}
+
+void MessageQueue::setInboxEnabled(bool enabled) {
+    if (enabled && mInbox == nullptr) {
+        mInbox = std::make_unique<InboxCell[]>(kInboxCapacity);
+        for (size_t i = 0; i < kInboxCapacity; i++) {
+            mInbox[i].sequence.store(i, std::memory_order_relaxed);
+        }
+    }
+    // Publishes mInbox to the threads that see the inbox enabled.
+    mInboxEnabled.store(enabled, std::memory_order_release);
+}
+
+bool MessageQueue::post(nsecs_t uptime, const sp<MessageHandler>& handler,
+                        const Message& message, bool* wake) {
+    if (!inboxEnabled()) {
+        return false;
+    }
+
+    // Claim the cell at the tail, unless the looper has not drained it yet.
+    size_t pos = mInboxTail.load(std::memory_order_relaxed);
+    InboxCell* cell;
+    for (;;) {
+        cell = &mInbox[pos % kInboxCapacity];
+        size_t sequence = cell->sequence.load(std::memory_order_acquire);
+        intptr_t diff = static_cast<intptr_t>(sequence) - static_cast<intptr_t>(pos);
+        if (diff == 0) {
+            if (mInboxTail.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                break;
+            }
+        } else if (diff < 0) {
+            return false;
+        } else {
+            pos = mInboxTail.load(std::memory_order_relaxed);
+        }
+    }
+
+    cell->uptime = uptime;
+    cell->seq = nextSeq();
+    cell->handler = handler;
+    cell->message = message;
+    cell->sequence.store(pos + 1, std::memory_order_release);
+
+    // Only the first post since the looper last drained the inbox needs to wake it;
+    // the looper picks up everything posted behind that one in the same pass.
+    *wake = !mInboxWakePending.exchange(true, std::memory_order_acq_rel);
+    return true;
+}
+
+void MessageQueue::drainInbox() {
+    if (mInbox == nullptr) {
+        return;
+    }
+
+    // Clear the flag before draining: a post that lands after this point either
+    // makes it into this drain or wakes the looper again.
+    mInboxWakePending.exchange(false, std::memory_order_acq_rel);
+
+    // Drain every cell filled so far, without waiting for a producer that has claimed a
+    // cell but not filled it yet: the looper may outrank it, and it holds the looper lock.
+    // Cells are only handed back to producers in order, so the head stays at the first
+    // such cell, and the filled cells behind it are marked as drained until it is filled.
+    // Their messages still reach the heap now, where |seq| keeps them in send order.
+    size_t tail = mInboxTail.load(std::memory_order_acquire);
+    bool stalled = false;
+    for (size_t pos = mInboxHead; pos != tail; pos++) {
+        InboxCell& cell = mInbox[pos % kInboxCapacity];
+        if (cell.sequence.load(std::memory_order_acquire) != pos + 1) {
+            stalled = true;
+            continue;
+        }
+        if (!cell.drained) {
+            push(cell.uptime, cell.seq, cell.handler, cell.message);
+            cell.handler.clear();
+            cell.drained = true;
+        }
+        if (!stalled) {
+            cell.drained = false;
+            cell.sequence.store(pos + kInboxCapacity, std::memory_order_release);
+            mInboxHead = pos + 1;
+        }
+    }
+
+    // Re-arm the wake, so that the producer that fills the first pending cell wakes the
+    // looper to drain it.
+    if (stalled) {
+        mInboxWakePending.store(false, std::memory_order_release);
+    }
+}
+
+bool MessageQueue::before(size_t a, size_t b) const {
+    const Envelope& x = mSlots[a];
+    const Envelope& y = mSlots[b];
+    return x.uptime < y.uptime || (x.uptime == y.uptime && x.seq < y.seq);
+}
+
+void MessageQueue::place(size_t pos, size_t slot) {
+    mHeap[pos] = slot;
+    mSlots[slot].heapIndex = pos;
+}
+
+void MessageQueue::siftUp(size_t pos) {
+    size_t slot = mHeap[pos];
+    while (pos > 0) {
+        size_t parent = (pos - 1) / 2;
+        if (!before(slot, mHeap[parent])) {
+            break;
+        }
+        place(pos, mHeap[parent]);
+        pos = parent;
+    }
+    place(pos, slot);
+}
+
+void MessageQueue::siftDown(size_t pos) {
+    size_t slot = mHeap[pos];
+    size_t count = mHeap.size();
+    for (;;) {
+        size_t child = 2 * pos + 1;
+        if (child >= count) {
+            break;
+        }
+        if (child + 1 < count && before(mHeap[child + 1], mHeap[child])) {
+            child += 1;
+        }
+        if (!before(mHeap[child], slot)) {
+            break;
+        }
+        place(pos, mHeap[child]);
+        pos = child;
+    }
+    place(pos, slot);
+}
+
+void MessageQueue::removeSlot(size_t slot) {
+    Envelope& envelope = mSlots[slot];
+
+    // Swap the last message of the same handler into this one's place.
+    auto it = mByHandler.find(envelope.handler.get());
+    std::vector<size_t>& handlerSlots = it->second;
+    size_t movedSlot = handlerSlots.back();
+    handlerSlots[envelope.handlerIndex] = movedSlot;
+    mSlots[movedSlot].handlerIndex = envelope.handlerIndex;
+    handlerSlots.pop_back();
+    if (handlerSlots.empty()) {
+        mByHandler.erase(it);
+    }
+
+    // Likewise move the last heap entry here and restore the heap order.
+    size_t pos = envelope.heapIndex;
+    size_t lastSlot = mHeap.back();
+    mHeap.pop_back();
+    if (pos < mHeap.size()) {
+        place(pos, lastSlot);
+        siftUp(pos);
+        siftDown(mSlots[lastSlot].heapIndex);
+    }
+
+    envelope.handler.clear();
+    mFreeSlots.push_back(slot);
+}
+
 uint32_t Looper::Request::getEpollEvents() const {
     uint32_t epollEvents = 0;
     if (events & EVENT_INPUT) epollEvents |= EPOLLIN;
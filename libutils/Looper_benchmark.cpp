@@ -0,0 +1,158 @@
+/*
+ * Copyright (C) 2023 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <benchmark/benchmark.h>
+#include <utils/Looper.h>
+
+#include <atomic>
+#include <thread>
+#include <vector>
+
+using namespace android;
+
+namespace {
+
+class NopMessageHandler : public MessageHandler {
+  public:
+    void handleMessage(const Message&) override {}
+};
+
+// Queues |count| messages at pseudo-random uptimes within the next hour, so
+// they are pending for the whole benchmark.
+void fillQueue(const sp<Looper>& looper, const sp<MessageHandler>& handler, int count) {
+    nsecs_t now = systemTime(SYSTEM_TIME_MONOTONIC);
+    uint32_t x = 1;
+    for (int i = 0; i < count; i++) {
+        x = x * 1103515245 + 12345;
+        looper->sendMessageAtTime(now + s2ns(60) + ms2ns(x % 3600000), handler, Message(i));
+    }
+}
+
+class CountingMessageHandler : public MessageHandler {
+  public:
+    void handleMessage(const Message&) override { count.fetch_add(1, std::memory_order_relaxed); }
+    std::atomic<int> count = 0;
+};
+
+}  // namespace
+
+// Cost of posting a delayed message and cancelling it, with |range(0)|
+// other messages pending.
+static void BM_Looper_sendAndRemoveDelayed(benchmark::State& state) {
+    sp<Looper> looper = new Looper(false);
+    sp<MessageHandler> background = new NopMessageHandler();
+    sp<MessageHandler> handler = new NopMessageHandler();
+    fillQueue(looper, background, state.range(0));
+
+    int what = 0;
+    for (auto _ : state) {
+        looper->sendMessageDelayed(s2ns(120), handler, Message(what));
+        looper->removeMessages(handler, what);
+        what++;
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_Looper_sendAndRemoveDelayed)->RangeMultiplier(8)->Range(8, 32768);
+
+// Cost of posting many delayed messages to a queue with |range(0)| pending.
+static void BM_Looper_sendDelayedBurst(benchmark::State& state) {
+    constexpr int kBurst = 1024;
+    sp<Looper> looper = new Looper(false);
+    sp<MessageHandler> background = new NopMessageHandler();
+    sp<MessageHandler> handler = new NopMessageHandler();
+    fillQueue(looper, background, state.range(0));
+
+    for (auto _ : state) {
+        fillQueue(looper, handler, kBurst);
+        state.PauseTiming();
+        looper->removeMessages(handler);
+        state.ResumeTiming();
+    }
+    state.SetItemsProcessed(state.iterations() * kBurst);
+}
+BENCHMARK(BM_Looper_sendDelayedBurst)->RangeMultiplier(8)->Range(8, 32768);
+
+// Throughput of posting due messages and dispatching them from pollOnce().
+static void BM_Looper_dispatch(benchmark::State& state) {
+    sp<Looper> looper = new Looper(false);
+    sp<MessageHandler> background = new NopMessageHandler();
+    sp<MessageHandler> handler = new NopMessageHandler();
+    fillQueue(looper, background, state.range(0));
+
+    for (auto _ : state) {
+        for (int i = 0; i < 64; i++) {
+            looper->sendMessage(handler, Message(i));
+        }
+        looper->pollOnce(0);
+    }
+    state.SetItemsProcessed(state.iterations() * 64);
+}
+BENCHMARK(BM_Looper_dispatch)->RangeMultiplier(8)->Range(8, 32768);
+
+// Cost of removeMessages() for one of |range(0)| handlers with 16 messages each.
+static void BM_Looper_removeMessages(benchmark::State& state) {
+    sp<Looper> looper = new Looper(false);
+    std::vector<sp<MessageHandler>> handlers;
+    for (int i = 0; i < state.range(0); i++) {
+        handlers.push_back(new NopMessageHandler());
+        fillQueue(looper, handlers.back(), 16);
+    }
+
+    size_t i = 0;
+    for (auto _ : state) {
+        const sp<MessageHandler>& handler = handlers[i++ % handlers.size()];
+        looper->removeMessages(handler);
+        state.PauseTiming();
+        fillQueue(looper, handler, 16);
+        state.ResumeTiming();
+    }
+}
+BENCHMARK(BM_Looper_removeMessages)->RangeMultiplier(8)->Range(8, 4096);
+
+// Throughput of |range(0)| threads posting to one looper that is dispatching
+// them, with the lock-free inbox disabled (0) or enabled (1) per |range(1)|.
+static void BM_Looper_contendedSend(benchmark::State& state) {
+    constexpr int kMessagesPerThread = 4096;
+    const int threads = state.range(0);
+    sp<Looper> looper = new Looper(false);
+    looper->setLockFreeMessageInbox(state.range(1));
+    sp<CountingMessageHandler> handler = new CountingMessageHandler();
+
+    for (auto _ : state) {
+        handler->count = 0;
+        std::vector<std::thread> producers;
+        for (int t = 0; t < threads; t++) {
+            producers.emplace_back([&]() {
+                for (int i = 0; i < kMessagesPerThread; i++) {
+                    looper->sendMessage(handler, Message(i));
+                }
+            });
+        }
+        while (handler->count.load(std::memory_order_relaxed) < threads * kMessagesPerThread) {
+            looper->pollOnce(100);
+        }
+        for (std::thread& producer : producers) {
+            producer.join();
+        }
+    }
+    state.SetItemsProcessed(state.iterations() * threads * kMessagesPerThread);
+}
+BENCHMARK(BM_Looper_contendedSend)
+        ->ArgsProduct({{1, 2, 4, 8}, {0, 1}})
+        ->ArgNames({"threads", "inbox"})
+        ->UseRealTime();
+
+BENCHMARK_MAIN();
@@ -11,6 +11,7 @@
 #include <thread>
 #include <unordered_map>
 #include <utility>
+#include <vector>
 #include "Looper_test_pipe.h"
 
 #include <utils/threads.h>
@@ -713,6 +714,282 @@ TEST_F(LooperTest, RemoveMessage_WhenRemovingSomeMessagesForHandler_ShouldRemove
             << "no more messages to handle";
 }
 
+TEST_F(LooperTest, SendMessageAtTime_WhenMessagesShareAnUptime_ShouldInvokeThemInSendOrder) {
+    nsecs_t now = systemTime(SYSTEM_TIME_MONOTONIC);
+    sp<StubMessageHandler> handler = new StubMessageHandler();
+    // Interleave two uptimes so that equal keys end up spread across the queue.
+    for (int i = 0; i < 200; i++) {
+        mLooper->sendMessageAtTime(now - ms2ns(i % 2 ? 10 : 20), handler, Message(i));
+    }
+
+    int result = mLooper->pollOnce(0);
+
+    EXPECT_EQ(Looper::POLL_CALLBACK, result)
+            << "pollOnce result should be Looper::POLL_CALLBACK because messages were sent";
+    ASSERT_EQ(size_t(200), handler->messages.size())
+            << "all messages should have been handled";
+    for (int i = 0; i < 100; i++) {
+        EXPECT_EQ(2 * i, handler->messages[i].what)
+                << "messages at the earlier uptime should be handled first, in send order";
+        EXPECT_EQ(2 * i + 1, handler->messages[100 + i].what)
+                << "messages at the later uptime should be handled next, in send order";
+    }
+}
+
+TEST_F(LooperTest, SendMessageAtTime_WhenSentOutOfOrder_ShouldInvokeHandlersInUptimeOrder) {
+    nsecs_t now = systemTime(SYSTEM_TIME_MONOTONIC);
+    sp<StubMessageHandler> handler = new StubMessageHandler();
+    // 0, 37, 74, ... mod 1000 visits every value once.
+    for (int i = 0; i < 1000; i++) {
+        int what = (i * 37) % 1000;
+        mLooper->sendMessageAtTime(now - ms2ns(1000) + us2ns(what), handler, Message(what));
+    }
+
+    int result = mLooper->pollOnce(0);
+
+    EXPECT_EQ(Looper::POLL_CALLBACK, result)
+            << "pollOnce result should be Looper::POLL_CALLBACK because messages were sent";
+    ASSERT_EQ(size_t(1000), handler->messages.size())
+            << "all messages should have been handled";
+    for (int i = 0; i < 1000; i++) {
+        EXPECT_EQ(i, handler->messages[i].what)
+                << "messages should be handled in uptime order";
+    }
+}
+
+TEST_F(LooperTest, RemoveMessage_WhenManyHandlersHaveMessages_ShouldOnlyRemoveMatchingMessages) {
+    nsecs_t now = systemTime(SYSTEM_TIME_MONOTONIC);
+    sp<StubMessageHandler> handler1 = new StubMessageHandler();
+    sp<StubMessageHandler> handler2 = new StubMessageHandler();
+    sp<StubMessageHandler> handler3 = new StubMessageHandler();
+    for (int i = 0; i < 300; i++) {
+        sp<StubMessageHandler> handler = i % 3 == 0 ? handler1 : i % 3 == 1 ? handler2 : handler3;
+        mLooper->sendMessageAtTime(now - ms2ns(300 - i), handler, Message(i % 4));
+    }
+    mLooper->removeMessages(handler2);
+    mLooper->removeMessages(handler3, MSG_TEST1);
+    mLooper->removeMessages(handler3, MSG_TEST2);
+    // Removing messages that are not queued is a no-op.
+    mLooper->removeMessages(handler2);
+    mLooper->removeMessages(handler1, 42);
+
+    int result = mLooper->pollOnce(0);
+
+    EXPECT_EQ(Looper::POLL_CALLBACK, result)
+            << "pollOnce result should be Looper::POLL_CALLBACK because messages were sent";
+    EXPECT_EQ(size_t(100), handler1->messages.size())
+            << "handler1 messages should not have been removed";
+    EXPECT_EQ(size_t(0), handler2->messages.size())
+            << "handler2 messages should all have been removed";
+    ASSERT_EQ(size_t(50), handler3->messages.size())
+            << "only MSG_TEST1 and MSG_TEST2 messages of handler3 should have been removed";
+    for (size_t i = 0; i < handler1->messages.size(); i++) {
+        EXPECT_EQ(int(i * 3 % 4), handler1->messages[i].what)
+                << "handler1 messages should be handled in order";
+    }
+    for (size_t i = 0; i < handler3->messages.size(); i++) {
+        EXPECT_TRUE(handler3->messages[i].what == 0 || handler3->messages[i].what == MSG_TEST3)
+                << "handler3 message " << handler3->messages[i].what << " should have been removed";
+    }
+}
+
+TEST_F(LooperTest, SendMessageDelayed_WhenManyMessagesArePending_ShouldInvokeOnlyDueMessages) {
+    sp<StubMessageHandler> handler = new StubMessageHandler();
+    for (int i = 0; i < 1000; i++) {
+        mLooper->sendMessageDelayed(ms2ns(1000 + i), handler, Message(MSG_TEST2));
+    }
+    mLooper->sendMessageDelayed(ms2ns(100), handler, Message(MSG_TEST1));
+
+    StopWatch stopWatch("pollOnce");
+    int result = mLooper->pollOnce(1000);
+
+    EXPECT_EQ(Looper::POLL_WAKE, result)
+            << "pollOnce result should be Looper::POLL_WAKE due to wakeup";
+
+    result = mLooper->pollOnce(1000);
+    int32_t elapsedMillis = ns2ms(stopWatch.elapsedTime());
+
+    EXPECT_NEAR(100, elapsedMillis, TIMING_TOLERANCE_MS)
+            << "second poll should end when the earliest message becomes due";
+    EXPECT_EQ(Looper::POLL_CALLBACK, result)
+            << "pollOnce result should be Looper::POLL_CALLBACK because a message was sent";
+    ASSERT_EQ(size_t(1), handler->messages.size())
+            << "only the earliest message should have been handled";
+    EXPECT_EQ(MSG_TEST1, handler->messages[0].what)
+            << "handled message";
+
+    mLooper->removeMessages(handler);
+    result = mLooper->pollOnce(0);
+
+    EXPECT_EQ(Looper::POLL_TIMEOUT, result)
+            << "pollOnce result should be Looper::POLL_TIMEOUT because there was nothing to do";
+}
+
+TEST_F(LooperTest, SendMessage_WhenInboxEnabled_ShouldInvokeHandlersInOrderDuringNextPoll) {
+    mLooper->setLockFreeMessageInbox(true);
+    sp<StubMessageHandler> handler1 = new StubMessageHandler();
+    sp<StubMessageHandler> handler2 = new StubMessageHandler();
+    mLooper->sendMessage(handler1, Message(MSG_TEST1));
+    mLooper->sendMessage(handler2, Message(MSG_TEST2));
+    mLooper->sendMessage(handler1, Message(MSG_TEST3));
+    mLooper->sendMessage(handler1, Message(MSG_TEST4));
+
+    int result = mLooper->pollOnce(1000);
+
+    EXPECT_EQ(Looper::POLL_CALLBACK, result)
+            << "pollOnce result should be Looper::POLL_CALLBACK because message was sent";
+    ASSERT_EQ(size_t(3), handler1->messages.size())
+            << "handled message";
+    EXPECT_EQ(MSG_TEST1, handler1->messages[0].what)
+            << "handled message";
+    EXPECT_EQ(MSG_TEST3, handler1->messages[1].what)
+            << "handled message";
+    EXPECT_EQ(MSG_TEST4, handler1->messages[2].what)
+            << "handled message";
+    ASSERT_EQ(size_t(1), handler2->messages.size())
+            << "handled message";
+    EXPECT_EQ(MSG_TEST2, handler2->messages[0].what)
+            << "handled message";
+}
+
+TEST_F(LooperTest, SendMessageDelayed_WhenInboxEnabled_ShouldInvokeHandlerAfterDelayTime) {
+    mLooper->setLockFreeMessageInbox(true);
+    sp<StubMessageHandler> handler = new StubMessageHandler();
+    mLooper->sendMessageDelayed(ms2ns(100), handler, Message(MSG_TEST1));
+
+    StopWatch stopWatch("pollOnce");
+    int result = mLooper->pollOnce(1000);
+    int32_t elapsedMillis = ns2ms(stopWatch.elapsedTime());
+
+    EXPECT_NEAR(0, elapsedMillis, TIMING_TOLERANCE_MS)
+            << "first poll should end quickly because the inbox woke the looper";
+    EXPECT_EQ(Looper::POLL_WAKE, result)
+            << "pollOnce result should be Looper::POLL_WAKE due to wakeup";
+    EXPECT_EQ(size_t(0), handler->messages.size())
+            << "no message handled yet";
+
+    result = mLooper->pollOnce(1000);
+    elapsedMillis = ns2ms(stopWatch.elapsedTime());
+
+    EXPECT_NEAR(100, elapsedMillis, TIMING_TOLERANCE_MS)
+            << "second poll should end around the time of the delayed message dispatch";
+    EXPECT_EQ(Looper::POLL_CALLBACK, result)
+            << "pollOnce result should be Looper::POLL_CALLBACK because message was sent";
+    ASSERT_EQ(size_t(1), handler->messages.size())
+            << "handled message";
+}
+
+TEST_F(LooperTest, RemoveMessage_WhenInboxEnabled_ShouldRemoveMessagesNotYetPolled) {
+    mLooper->setLockFreeMessageInbox(true);
+    sp<StubMessageHandler> handler = new StubMessageHandler();
+    mLooper->sendMessage(handler, Message(MSG_TEST1));
+    mLooper->sendMessage(handler, Message(MSG_TEST2));
+    mLooper->sendMessage(handler, Message(MSG_TEST3));
+    mLooper->removeMessages(handler, MSG_TEST2);
+
+    int result = mLooper->pollOnce(0);
+
+    EXPECT_EQ(Looper::POLL_CALLBACK, result)
+            << "pollOnce result should be Looper::POLL_CALLBACK because two messages were sent";
+    ASSERT_EQ(size_t(2), handler->messages.size())
+            << "handled message";
+    EXPECT_EQ(MSG_TEST1, handler->messages[0].what)
+            << "handled message";
+    EXPECT_EQ(MSG_TEST3, handler->messages[1].what)
+            << "handled message";
+
+    mLooper->sendMessage(handler, Message(MSG_TEST4));
+    mLooper->removeMessages(handler);
+    result = mLooper->pollOnce(0);
+
+    EXPECT_EQ(Looper::POLL_WAKE, result)
+            << "pollOnce result should be Looper::POLL_WAKE because the message was removed";
+    EXPECT_EQ(size_t(2), handler->messages.size())
+            << "no more messages to handle";
+}
+
+TEST_F(LooperTest, SendMessageAtTime_WhenInboxDisabledBeforeDrain_ShouldKeepSendOrder) {
+    sp<StubMessageHandler> handler = new StubMessageHandler();
+    nsecs_t now = systemTime(SYSTEM_TIME_MONOTONIC);
+    mLooper->setLockFreeMessageInbox(true);
+    mLooper->sendMessageAtTime(now, handler, Message(MSG_TEST1));
+    mLooper->sendMessageAtTime(now, handler, Message(MSG_TEST2));
+    mLooper->setLockFreeMessageInbox(false);
+    mLooper->sendMessageAtTime(now, handler, Message(MSG_TEST3));
+    mLooper->setLockFreeMessageInbox(true);
+    mLooper->sendMessageAtTime(now, handler, Message(MSG_TEST4));
+
+    int result = mLooper->pollOnce(0);
+
+    EXPECT_EQ(Looper::POLL_CALLBACK, result)
+            << "pollOnce result should be Looper::POLL_CALLBACK because messages were sent";
+    ASSERT_EQ(size_t(4), handler->messages.size())
+            << "handled message";
+    EXPECT_EQ(MSG_TEST1, handler->messages[0].what)
+            << "handled message";
+    EXPECT_EQ(MSG_TEST2, handler->messages[1].what)
+            << "handled message";
+    EXPECT_EQ(MSG_TEST3, handler->messages[2].what)
+            << "handled message";
+    EXPECT_EQ(MSG_TEST4, handler->messages[3].what)
+            << "handled message";
+}
+
+TEST_F(LooperTest, SendMessage_WhenInboxIsFull_ShouldKeepSendOrder) {
+    constexpr int kMessages = 1000;  // several times the inbox capacity
+    mLooper->setLockFreeMessageInbox(true);
+    sp<StubMessageHandler> handler = new StubMessageHandler();
+    for (int i = 0; i < kMessages; i++) {
+        mLooper->sendMessage(handler, Message(i));
+    }
+
+    int result = mLooper->pollOnce(0);
+
+    EXPECT_EQ(Looper::POLL_CALLBACK, result)
+            << "pollOnce result should be Looper::POLL_CALLBACK because messages were sent";
+    ASSERT_EQ(size_t(kMessages), handler->messages.size())
+            << "all messages should have been handled";
+    for (int i = 0; i < kMessages; i++) {
+        EXPECT_EQ(i, handler->messages[i].what)
+                << "messages should be handled in the order sent";
+    }
+}
+
+TEST_F(LooperTest, SendMessage_WhenInboxEnabledAndManyThreadsPost_ShouldKeepEachThreadsOrder) {
+    constexpr int kThreads = 4;
+    constexpr int kMessagesPerThread = 2000;
+    mLooper->setLockFreeMessageInbox(true);
+    sp<StubMessageHandler> handler = new StubMessageHandler();
+
+    std::vector<std::thread> threads;
+    for (int t = 0; t < kThreads; t++) {
+        threads.emplace_back([this, handler, t]() {
+            for (int i = 0; i < kMessagesPerThread; i++) {
+                mLooper->sendMessage(handler, Message(t * kMessagesPerThread + i));
+            }
+        });
+    }
+
+    nsecs_t deadline = systemTime(SYSTEM_TIME_MONOTONIC) + s2ns(10);
+    while (handler->messages.size() < size_t(kThreads * kMessagesPerThread) &&
+           systemTime(SYSTEM_TIME_MONOTONIC) < deadline) {
+        mLooper->pollOnce(100);
+    }
+    for (std::thread& thread : threads) {
+        thread.join();
+    }
+
+    ASSERT_EQ(size_t(kThreads * kMessagesPerThread), handler->messages.size())
+            << "all messages should have been handled";
+    int next[kThreads] = {};
+    for (size_t i = 0; i < handler->messages.size(); i++) {
+        int what = handler->messages[i].what;
+        int t = what / kMessagesPerThread;
+        EXPECT_EQ(next[t]++, what % kMessagesPerThread)
+                << "messages from thread " << t << " should be handled in the order sent";
+    }
+}
+
 class LooperEventCallback : public LooperCallback {
   public:
     using Callback = std::function<int(int fd, int events)>;
@@ -386,6 +386,23 @@ public:
     void sendMessageAtTime(nsecs_t uptime, const sp<MessageHandler>& handler,
             const Message& message);
 
+    /**
+     * Enables or disables the lock-free message inbox.
+     *
+     * When enabled, sendMessage(), sendMessageDelayed() and sendMessageAtTime() post
+     * messages to a fixed-size lock-free inbox instead of taking the looper lock, and the
+     * looper thread moves them into its queue the next time it polls. A burst of posts made
+     * while the looper has not yet drained the inbox costs a single wake.  When the inbox
+     * is full, messages are sent the usual way.  This helps loopers that many threads post
+     * to concurrently.
+     *
+     * Messages are numbered when they are sent, so messages with equal uptimes are
+     * delivered in the order they were sent whether they went through the inbox or not,
+     * including across calls to this method.
+     * This method can be called on any thread.
+     */
+    void setLockFreeMessageInbox(bool enabled);
+
     /**
      * Removes all messages for the specified handler from the queue.
      *
@@ -468,7 +485,9 @@ private:
     android::base::unique_fd mWakeEventFd;  // immutable
     Mutex mLock;
 
-    Vector<MessageEnvelope> mMessageEnvelopes; // guarded by mLock
+    // Holds a single envelope whose handler is the message queue (see Looper.cpp).
+    // It keeps its original type because the layout of Looper is part of the ABI.
+    Vector<MessageEnvelope> mMessageEnvelopes; // immutable, the queue is guarded by mLock
     bool mSendingMessage; // guarded by mLock
 
     // Whether we are currently waiting for work.  Not protected by a lock,
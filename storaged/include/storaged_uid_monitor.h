@@ -28,6 +28,7 @@
 
 #include "storaged.pb.h"
 #include "uid_info.h"
+#include "uid_io_stats_parser.h"
 
 #define FRIEND_TEST(test_case_name, test_name) \
 friend class test_case_name##_##test_name##_Test
@@ -37,10 +38,7 @@ using namespace storaged_proto;
 using namespace android;
 using namespace android::os::storaged;
 
-class uid_info : public UidInfo {
-public:
-    bool parse_uid_io_stats(string&& s);
-};
+class uid_info : public UidInfo {};
 
 class io_usage {
 public:
@@ -80,9 +78,33 @@ class uid_monitor {
 private:
     FRIEND_TEST(storaged_test, uid_monitor);
     FRIEND_TEST(storaged_test, load_uid_io_proto);
-
-    // last dump from /proc/uid_io/stats, uid -> uid_info
-    unordered_map<uint32_t, uid_info> last_uid_io_stats_;
+    FRIEND_TEST(storaged_test, uid_io_delta);
+    friend class uid_monitor_benchmark;
+
+    // per-task state carried between samples of /proc/uid_io/stats
+    struct task_slot {
+        string comm;
+        io_stats io[UID_STATS];
+        // bytes[READ|WRITE][FOREGROUND|BACKGROUND] since the previous sample
+        uint64_t delta[IO_TYPES][UID_STATS];
+        uint64_t generation;
+    };
+
+    // per-uid state carried between samples of /proc/uid_io/stats
+    struct uid_slot {
+        string name;
+        io_stats io[UID_STATS];
+        uint64_t delta[IO_TYPES][UID_STATS];
+        uint64_t generation;
+        unordered_map<pid_t, task_slot> tasks;
+    };
+
+    // last sample from /proc/uid_io/stats, uid -> uid_slot
+    unordered_map<uint32_t, uid_slot> uid_slots_;
+    // bumped on every sample; slots not touched by the latest one are stale
+    uint64_t generation_;
+    // buffer for /proc/uid_io/stats, reused across samples
+    uid_io_stats_parser parser_;
     // current io usage for next report, app name -> uid_io_usage
     unordered_map<string, uid_io_usage> curr_io_stats_;
     // io usage records, end timestamp -> {start timestamp, vector of records}
@@ -98,6 +120,14 @@ private:
 
     // reads from /proc/uid_io/stats
     unordered_map<uint32_t, uid_info> get_uid_io_stats_locked();
+    // updates uid_slots_ and their deltas from the contents of parser_,
+    // returns false if no uid was found
+    bool update_uid_slots_locked();
+    // asks package manager for the names of all known uids if any is new
+    void update_uid_names_locked();
+    // adds the deltas of the latest sample to curr_io_stats and drops
+    // stale slots
+    void flush_uid_deltas_locked(bool accumulate);
     // flushes curr_io_stats to records
     void add_records_locked(uint64_t curr_ts);
     // updates curr_io_stats and set last_uid_io_stats
@@ -56,7 +56,6 @@ public:
     std::string comm;
     pid_t pid;
     io_stats io[UID_STATS];
-    bool parse_task_io_stats(std::string&& s);
 };
 
 class UidInfo : public Parcelable {
@@ -0,0 +1,105 @@
+/*
+ * Copyright (C) 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _UID_IO_STATS_PARSER_H_
+#define _UID_IO_STATS_PARSER_H_
+
+#include <stdint.h>
+#include <sys/types.h>
+
+#include <string_view>
+#include <vector>
+
+#include "uid_info.h"
+
+namespace android {
+namespace os {
+namespace storaged {
+
+// One "<uid> <fg/bg counters...>" line of /proc/uid_io/stats.
+struct uid_io_line {
+    uint32_t uid;
+    io_stats io[UID_STATS];
+};
+
+// One "task,<comm>,<pid>,<fg/bg counters...>" line of /proc/uid_io/stats.
+// |comm| points into the parser buffer and is only valid until the next read.
+struct task_io_line {
+    std::string_view comm;
+    pid_t pid;
+    io_stats io[UID_STATS];
+};
+
+/* return true on parse success and false on failure */
+bool parse_uid_io_line(std::string_view line, uid_io_line* out);
+bool parse_task_io_line(std::string_view line, task_io_line* out);
+
+// Streaming parser for /proc/uid_io/stats. The file contents are read into a
+// buffer that is kept across samples, and lines are handed to the caller as
+// views into it, so a sampling pass does not allocate once the buffer has
+// grown to the size of the file.
+class uid_io_stats_parser {
+  public:
+    // Reads |path| into the internal buffer.
+    bool read(const char* path);
+    // Replaces the buffer contents, for tests and benchmarks.
+    void set_contents(std::string_view contents);
+    std::string_view contents() const { return std::string_view(buffer_.data(), size_); }
+
+    // Calls |on_uid| for each uid line and |on_task| for each task line, in
+    // file order; task lines belong to the uid line preceding them. Returns
+    // the number of uid lines parsed.
+    template <typename UidFn, typename TaskFn>
+    size_t parse(UidFn&& on_uid, TaskFn&& on_task) const;
+
+  private:
+    std::vector<char> buffer_;
+    size_t size_ = 0;
+};
+
+template <typename UidFn, typename TaskFn>
+size_t uid_io_stats_parser::parse(UidFn&& on_uid, TaskFn&& on_task) const {
+    std::string_view rest = contents();
+    size_t uids = 0;
+    bool have_uid = false;
+    uid_io_line u;
+    task_io_line t;
+
+    while (!rest.empty()) {
+        size_t eol = rest.find('\n');
+        std::string_view line = rest.substr(0, eol);
+        rest = (eol == std::string_view::npos) ? std::string_view() : rest.substr(eol + 1);
+        if (line.empty()) {
+            continue;
+        }
+
+        if (line.compare(0, 4, "task")) {
+            have_uid = parse_uid_io_line(line, &u);
+            if (!have_uid) continue;
+            on_uid(u);
+            uids++;
+        } else if (have_uid && parse_task_io_line(line, &t)) {
+            on_task(t);
+        }
+    }
+    return uids;
+}
+
+} // namespace storaged
+} // namespace os
+} // namespace android
+
+#endif /* _UID_IO_STATS_PARSER_H_ */
@@ -17,6 +17,7 @@
 #define LOG_TAG "storaged"
 
 #include <stdint.h>
+#include <string.h>
 #include <time.h>
 
 #include <string>
@@ -24,11 +25,8 @@
 #include <unordered_set>
 
 #include <android/content/pm/IPackageManagerNative.h>
-#include <android-base/file.h>
 #include <android-base/logging.h>
 #include <android-base/macros.h>
-#include <android-base/parseint.h>
-#include <android-base/strings.h>
 #include <android-base/stringprintf.h>
 #include <binder/IServiceManager.h>
 #include <log/log_event_list.h>
@@ -55,53 +53,6 @@ std::unordered_map<uint32_t, uid_info> uid_monitor::get_uid_io_stats()
     return get_uid_io_stats_locked();
 };
 
-/* return true on parse success and false on failure */
-bool uid_info::parse_uid_io_stats(std::string&& s)
-{
-    std::vector<std::string> fields = Split(s, " ");
-    if (fields.size() < 11 ||
-        !ParseUint(fields[0],  &uid) ||
-        !ParseUint(fields[1],  &io[FOREGROUND].rchar) ||
-        !ParseUint(fields[2],  &io[FOREGROUND].wchar) ||
-        !ParseUint(fields[3],  &io[FOREGROUND].read_bytes) ||
-        !ParseUint(fields[4],  &io[FOREGROUND].write_bytes) ||
-        !ParseUint(fields[5],  &io[BACKGROUND].rchar) ||
-        !ParseUint(fields[6],  &io[BACKGROUND].wchar) ||
-        !ParseUint(fields[7],  &io[BACKGROUND].read_bytes) ||
-        !ParseUint(fields[8],  &io[BACKGROUND].write_bytes) ||
-        !ParseUint(fields[9],  &io[FOREGROUND].fsync) ||
-        !ParseUint(fields[10], &io[BACKGROUND].fsync)) {
-        LOG(WARNING) << "Invalid uid I/O stats: \"" << s << "\"";
-        return false;
-    }
-    return true;
-}
-
-/* return true on parse success and false on failure */
-bool task_info::parse_task_io_stats(std::string&& s)
-{
-    std::vector<std::string> fields = Split(s, ",");
-    size_t size = fields.size();
-    if (size < 13 ||
-        !ParseInt(fields[size - 11],  &pid) ||
-        !ParseUint(fields[size - 10],  &io[FOREGROUND].rchar) ||
-        !ParseUint(fields[size - 9],  &io[FOREGROUND].wchar) ||
-        !ParseUint(fields[size - 8],  &io[FOREGROUND].read_bytes) ||
-        !ParseUint(fields[size - 7],  &io[FOREGROUND].write_bytes) ||
-        !ParseUint(fields[size - 6],  &io[BACKGROUND].rchar) ||
-        !ParseUint(fields[size - 5],  &io[BACKGROUND].wchar) ||
-        !ParseUint(fields[size - 4],  &io[BACKGROUND].read_bytes) ||
-        !ParseUint(fields[size - 3], &io[BACKGROUND].write_bytes) ||
-        !ParseUint(fields[size - 2], &io[FOREGROUND].fsync) ||
-        !ParseUint(fields[size - 1], &io[BACKGROUND].fsync)) {
-        LOG(WARNING) << "Invalid task I/O stats: \"" << s << "\"";
-        return false;
-    }
-    comm = Join(std::vector<std::string>(
-                fields.begin() + 1, fields.end() - 11), ',');
-    return true;
-}
-
 bool io_usage::is_zero() const
 {
     for (int i = 0; i < IO_TYPES; i++) {
@@ -153,47 +104,154 @@ void get_uid_names(const vector<int>& uids, const vector<std::string*>& uid_name
 std::unordered_map<uint32_t, uid_info> uid_monitor::get_uid_io_stats_locked()
 {
     std::unordered_map<uint32_t, uid_info> uid_io_stats;
-    std::string buffer;
-    if (!ReadFileToString(UID_IO_STATS_PATH, &buffer)) {
-        PLOG(ERROR) << UID_IO_STATS_PATH << ": ReadFileToString failed";
+    if (!parser_.read(UID_IO_STATS_PATH)) {
+        PLOG(ERROR) << UID_IO_STATS_PATH << ": read failed";
         return uid_io_stats;
     }
 
-    std::vector<std::string> io_stats = Split(std::move(buffer), "\n");
-    uid_info u;
     vector<int> uids;
     vector<std::string*> uid_names;
+    uid_info* u = nullptr;
+
+    parser_.parse(
+        [&](const uid_io_line& line) {
+            u = &uid_io_stats[line.uid];
+            u->uid = line.uid;
+            memcpy(u->io, line.io, sizeof(u->io));
+            auto slot = uid_slots_.find(line.uid);
+            if (slot == uid_slots_.end()) {
+                u->name = std::to_string(line.uid);
+                refresh_uid_names = true;
+            } else {
+                u->name = slot->second.name;
+            }
+            uids.push_back(line.uid);
+            uid_names.push_back(&u->name);
+        },
+        [&](const task_io_line& line) {
+            task_info& t = u->tasks[line.pid];
+            t.comm = line.comm;
+            t.pid = line.pid;
+            memcpy(t.io, line.io, sizeof(t.io));
+        });
 
-    for (uint32_t i = 0; i < io_stats.size(); i++) {
-        if (io_stats[i].empty()) {
-            continue;
-        }
+    if (!uids.empty() && refresh_uid_names) {
+        get_uid_names(uids, uid_names);
+    }
 
-        if (io_stats[i].compare(0, 4, "task")) {
-            if (!u.parse_uid_io_stats(std::move(io_stats[i])))
-                continue;
-            uid_io_stats[u.uid] = u;
-            uid_io_stats[u.uid].name = std::to_string(u.uid);
-            uids.push_back(u.uid);
-            uid_names.push_back(&uid_io_stats[u.uid].name);
-            if (last_uid_io_stats_.find(u.uid) == last_uid_io_stats_.end()) {
+    return uid_io_stats;
+}
+
+namespace {
+
+inline uint64_t delta_or_zero(uint64_t curr, uint64_t last)
+{
+    return curr > last ? curr - last : 0;
+}
+
+inline void set_delta(uint64_t delta[IO_TYPES][UID_STATS], io_stats* last,
+                      const io_stats* curr)
+{
+    for (int i = 0; i < UID_STATS; i++) {
+        delta[READ][i] = delta_or_zero(curr[i].read_bytes, last[i].read_bytes);
+        delta[WRITE][i] = delta_or_zero(curr[i].write_bytes, last[i].write_bytes);
+        last[i] = curr[i];
+    }
+}
+
+} // namespace
+
+bool uid_monitor::update_uid_slots_locked()
+{
+    uint64_t generation = ++generation_;
+    uid_slot* slot = nullptr;
+
+    size_t uids = parser_.parse(
+        [&](const uid_io_line& line) {
+            auto [it, inserted] = uid_slots_.try_emplace(line.uid);
+            slot = &it->second;
+            if (inserted) {
+                slot->name = std::to_string(line.uid);
+                memset(slot->io, 0, sizeof(slot->io));
                 refresh_uid_names = true;
-            } else {
-                uid_io_stats[u.uid].name = last_uid_io_stats_[u.uid].name;
             }
-        } else {
-            task_info t;
-            if (!t.parse_task_io_stats(std::move(io_stats[i])))
-                continue;
-            uid_io_stats[u.uid].tasks[t.pid] = t;
+            set_delta(slot->delta, slot->io, line.io);
+            slot->generation = generation;
+        },
+        [&](const task_io_line& line) {
+            auto [it, inserted] = slot->tasks.try_emplace(line.pid);
+            task_slot& task = it->second;
+            if (inserted) {
+                memset(task.io, 0, sizeof(task.io));
+            }
+            if (task.comm != line.comm) {
+                task.comm.assign(line.comm);
+            }
+            set_delta(task.delta, task.io, line.io);
+            task.generation = generation;
+        });
+
+    return uids > 0;
+}
+
+void uid_monitor::update_uid_names_locked()
+{
+    if (!refresh_uid_names) {
+        return;
+    }
+
+    vector<int> uids;
+    vector<std::string*> uid_names;
+    for (auto& [uid, slot] : uid_slots_) {
+        if (slot.generation == generation_) {
+            uids.push_back(uid);
+            uid_names.push_back(&slot.name);
         }
     }
 
-    if (!uids.empty() && refresh_uid_names) {
+    if (!uids.empty()) {
         get_uid_names(uids, uid_names);
     }
+}
 
-    return uid_io_stats;
+void uid_monitor::flush_uid_deltas_locked(bool accumulate)
+{
+    for (auto it = uid_slots_.begin(); it != uid_slots_.end();) {
+        uid_slot& slot = it->second;
+        if (slot.generation != generation_) {
+            it = uid_slots_.erase(it);
+            continue;
+        }
+
+        struct uid_io_usage* usage = nullptr;
+        if (accumulate) {
+            usage = &curr_io_stats_[slot.name];
+            usage->user_id = multiuser_get_user_id(it->first);
+            for (int i = 0; i < IO_TYPES; i++) {
+                for (int j = 0; j < UID_STATS; j++) {
+                    usage->uid_ios.bytes[i][j][charger_stat_] += slot.delta[i][j];
+                }
+            }
+        }
+
+        for (auto task_it = slot.tasks.begin(); task_it != slot.tasks.end();) {
+            task_slot& task = task_it->second;
+            if (task.generation != generation_) {
+                task_it = slot.tasks.erase(task_it);
+                continue;
+            }
+            if (usage) {
+                io_usage& task_usage = usage->task_ios[task.comm];
+                for (int i = 0; i < IO_TYPES; i++) {
+                    for (int j = 0; j < UID_STATS; j++) {
+                        task_usage.bytes[i][j][charger_stat_] += task.delta[i][j];
+                    }
+                }
+            }
+            ++task_it;
+        }
+        ++it;
+    }
 }
 
 namespace {
@@ -302,65 +360,15 @@ std::map<uint64_t, struct uid_records> uid_monitor::dump(
 
 void uid_monitor::update_curr_io_stats_locked()
 {
-    std::unordered_map<uint32_t, uid_info> uid_io_stats =
-        get_uid_io_stats_locked();
-    if (uid_io_stats.empty()) {
+    if (!parser_.read(UID_IO_STATS_PATH)) {
+        PLOG(ERROR) << UID_IO_STATS_PATH << ": read failed";
         return;
     }
-
-    for (const auto& it : uid_io_stats) {
-        const uid_info& uid = it.second;
-        if (curr_io_stats_.find(uid.name) == curr_io_stats_.end()) {
-            curr_io_stats_[uid.name] = {};
-        }
-
-        struct uid_io_usage& usage = curr_io_stats_[uid.name];
-        usage.user_id = multiuser_get_user_id(uid.uid);
-
-        int64_t fg_rd_delta = uid.io[FOREGROUND].read_bytes -
-            last_uid_io_stats_[uid.uid].io[FOREGROUND].read_bytes;
-        int64_t bg_rd_delta = uid.io[BACKGROUND].read_bytes -
-            last_uid_io_stats_[uid.uid].io[BACKGROUND].read_bytes;
-        int64_t fg_wr_delta = uid.io[FOREGROUND].write_bytes -
-            last_uid_io_stats_[uid.uid].io[FOREGROUND].write_bytes;
-        int64_t bg_wr_delta = uid.io[BACKGROUND].write_bytes -
-            last_uid_io_stats_[uid.uid].io[BACKGROUND].write_bytes;
-
-        usage.uid_ios.bytes[READ][FOREGROUND][charger_stat_] +=
-            (fg_rd_delta < 0) ? 0 : fg_rd_delta;
-        usage.uid_ios.bytes[READ][BACKGROUND][charger_stat_] +=
-            (bg_rd_delta < 0) ? 0 : bg_rd_delta;
-        usage.uid_ios.bytes[WRITE][FOREGROUND][charger_stat_] +=
-            (fg_wr_delta < 0) ? 0 : fg_wr_delta;
-        usage.uid_ios.bytes[WRITE][BACKGROUND][charger_stat_] +=
-            (bg_wr_delta < 0) ? 0 : bg_wr_delta;
-
-        for (const auto& task_it : uid.tasks) {
-            const task_info& task = task_it.second;
-            const pid_t pid = task_it.first;
-            const std::string& comm = task_it.second.comm;
-            int64_t task_fg_rd_delta = task.io[FOREGROUND].read_bytes -
-                last_uid_io_stats_[uid.uid].tasks[pid].io[FOREGROUND].read_bytes;
-            int64_t task_bg_rd_delta = task.io[BACKGROUND].read_bytes -
-                last_uid_io_stats_[uid.uid].tasks[pid].io[BACKGROUND].read_bytes;
-            int64_t task_fg_wr_delta = task.io[FOREGROUND].write_bytes -
-                last_uid_io_stats_[uid.uid].tasks[pid].io[FOREGROUND].write_bytes;
-            int64_t task_bg_wr_delta = task.io[BACKGROUND].write_bytes -
-                last_uid_io_stats_[uid.uid].tasks[pid].io[BACKGROUND].write_bytes;
-
-            io_usage& task_usage = usage.task_ios[comm];
-            task_usage.bytes[READ][FOREGROUND][charger_stat_] +=
-                (task_fg_rd_delta < 0) ? 0 : task_fg_rd_delta;
-            task_usage.bytes[READ][BACKGROUND][charger_stat_] +=
-                (task_bg_rd_delta < 0) ? 0 : task_bg_rd_delta;
-            task_usage.bytes[WRITE][FOREGROUND][charger_stat_] +=
-                (task_fg_wr_delta < 0) ? 0 : task_fg_wr_delta;
-            task_usage.bytes[WRITE][BACKGROUND][charger_stat_] +=
-                (task_bg_wr_delta < 0) ? 0 : task_bg_wr_delta;
-        }
+    if (!update_uid_slots_locked()) {
+        return;
     }
-
-    last_uid_io_stats_ = uid_io_stats;
+    update_uid_names_locked();
+    flush_uid_deltas_locked(true);
 }
 
 void uid_monitor::report(unordered_map<int, StoragedProto>* protos)
@@ -529,12 +537,17 @@ void uid_monitor::set_charger_state(charger_stat_t stat)
 
 void uid_monitor::init(charger_stat_t stat)
 {
+    Mutex::Autolock _l(uidm_mutex_);
+
     charger_stat_ = stat;
 
     start_ts_ = time(NULL);
-    last_uid_io_stats_ = get_uid_io_stats();
+    if (parser_.read(UID_IO_STATS_PATH) && update_uid_slots_locked()) {
+        update_uid_names_locked();
+        flush_uid_deltas_locked(false);
+    }
 }
 
 uid_monitor::uid_monitor()
-    : enabled_(!access(UID_IO_STATS_PATH, R_OK)) {
+    : generation_(0), enabled_(!access(UID_IO_STATS_PATH, R_OK)) {
 }
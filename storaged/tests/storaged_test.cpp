@@ -697,3 +697,51 @@ TEST(storaged_test, load_uid_io_proto) {
     uidm.load_uid_io_proto(0, user_0);
     ASSERT_LE(io_history.size(), size_t(uid_monitor::MAX_UID_RECORDS_SIZE));
 }
+
+TEST(storaged_test, uid_io_delta) {
+    uid_monitor uidm;
+    uidm.charger_stat_ = CHARGER_OFF;
+
+    uidm.parser_.set_contents(
+        "10001 0 0 100 200 0 0 300 400 0 0\n"
+        "task,main,1234,0,0,100,200,0,0,0,0,0,0\n"
+        "10002 0 0 1000 1000 0 0 0 0 0 0\n");
+    ASSERT_TRUE(uidm.update_uid_slots_locked());
+    uidm.flush_uid_deltas_locked(false);
+    EXPECT_TRUE(uidm.curr_io_stats_.empty());
+    EXPECT_EQ(uidm.uid_slots_.size(), 2UL);
+
+    uidm.parser_.set_contents(
+        "10001 0 0 150 200 0 0 300 500 0 0\n"
+        "task,main,1234,0,0,150,200,0,0,0,0,0,0\n"
+        "task,binder:1234,,5678,0,0,0,0,0,0,0,100,0,0\n");
+    ASSERT_TRUE(uidm.update_uid_slots_locked());
+    uidm.flush_uid_deltas_locked(true);
+
+    // uid 10002 disappeared and its slot is dropped.
+    EXPECT_EQ(uidm.uid_slots_.size(), 1UL);
+    EXPECT_EQ(uidm.uid_slots_[10001].tasks.size(), 2UL);
+
+    ASSERT_EQ(uidm.curr_io_stats_.count("10001"), 1UL);
+    const uid_io_usage& usage = uidm.curr_io_stats_["10001"];
+    EXPECT_EQ(usage.uid_ios.bytes[READ][FOREGROUND][CHARGER_OFF], 50UL);
+    EXPECT_EQ(usage.uid_ios.bytes[WRITE][FOREGROUND][CHARGER_OFF], 0UL);
+    EXPECT_EQ(usage.uid_ios.bytes[READ][BACKGROUND][CHARGER_OFF], 0UL);
+    EXPECT_EQ(usage.uid_ios.bytes[WRITE][BACKGROUND][CHARGER_OFF], 100UL);
+
+    ASSERT_EQ(usage.task_ios.count("main"), 1UL);
+    EXPECT_EQ(usage.task_ios.at("main").bytes[READ][FOREGROUND][CHARGER_OFF], 50UL);
+    // A task seen for the first time is charged with its full counters.
+    ASSERT_EQ(usage.task_ios.count("binder:1234,"), 1UL);
+    EXPECT_EQ(usage.task_ios.at("binder:1234,").bytes[WRITE][BACKGROUND][CHARGER_OFF], 100UL);
+
+    // Counters going backwards never produce negative usage.
+    uidm.parser_.set_contents("10001 0 0 0 0 0 0 0 0 0 0\n");
+    ASSERT_TRUE(uidm.update_uid_slots_locked());
+    uidm.flush_uid_deltas_locked(true);
+    EXPECT_EQ(uidm.curr_io_stats_["10001"].uid_ios.bytes[READ][FOREGROUND][CHARGER_OFF], 50UL);
+    EXPECT_TRUE(uidm.uid_slots_[10001].tasks.empty());
+
+    uidm.parser_.set_contents("not uid io stats\n");
+    EXPECT_FALSE(uidm.update_uid_slots_locked());
+}
@@ -0,0 +1,121 @@
+/*
+ * Copyright (C) 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <inttypes.h>
+
+#include <string>
+#include <vector>
+
+#include <android-base/file.h>
+#include <android-base/stringprintf.h>
+#include <android-base/strings.h>
+#include <benchmark/benchmark.h>
+
+#include <storaged.h>
+
+using android::base::ReadFileToString;
+using android::base::Split;
+using android::base::StringAppendF;
+using android::base::WriteStringToFd;
+
+// Builds a /proc/uid_io/stats lookalike with |uids| uids of |tasks| tasks
+// each. Counters grow with |sample| so consecutive samples have deltas.
+static std::string make_uid_io_stats(int uids, int tasks, int sample) {
+    std::string s;
+    for (int u = 0; u < uids; u++) {
+        uint64_t v = (u + 1) * 4096ULL * (sample + 1);
+        StringAppendF(&s, "%d %" PRIu64 " %" PRIu64 " %" PRIu64 " %" PRIu64 " %" PRIu64
+                      " %" PRIu64 " %" PRIu64 " %" PRIu64 " %d %d\n",
+                      10000 + u, v, v, v, v, v / 2, v / 2, v / 2, v / 2, sample, sample);
+        for (int t = 0; t < tasks; t++) {
+            StringAppendF(&s, "task,worker:%d,%d,%" PRIu64 ",%" PRIu64 ",%" PRIu64 ",%" PRIu64
+                          ",0,0,0,0,%d,0\n",
+                          t, 1000 + u * tasks + t, v, v, v, v, sample);
+        }
+    }
+    return s;
+}
+
+class uid_monitor_benchmark {
+  public:
+    // One sampling period of uid_monitor::update_curr_io_stats_locked(),
+    // minus the read of the stats file and package manager lookups.
+    static void run(benchmark::State& state) {
+        std::string samples[2] = {
+                make_uid_io_stats(state.range(0), state.range(1), 0),
+                make_uid_io_stats(state.range(0), state.range(1), 1),
+        };
+
+        uid_monitor uidm;
+        uidm.charger_stat_ = CHARGER_OFF;
+        uidm.parser_.set_contents(samples[0]);
+        uidm.update_uid_slots_locked();
+        uidm.flush_uid_deltas_locked(false);
+
+        size_t i = 1;
+        for (auto _ : state) {
+            state.PauseTiming();
+            uidm.parser_.set_contents(samples[i++ % 2]);
+            uidm.curr_io_stats_.clear();
+            state.ResumeTiming();
+
+            uidm.update_uid_slots_locked();
+            uidm.flush_uid_deltas_locked(true);
+        }
+    }
+};
+
+static void BM_uid_io_update(benchmark::State& state) {
+    uid_monitor_benchmark::run(state);
+}
+BENCHMARK(BM_uid_io_update)->Args({100, 10})->Args({1000, 20})->Args({4000, 50});
+
+static void BM_uid_io_parse(benchmark::State& state) {
+    TemporaryFile tf;
+    std::string contents = make_uid_io_stats(state.range(0), state.range(1), 0);
+    WriteStringToFd(contents, tf.fd);
+
+    android::os::storaged::uid_io_stats_parser parser;
+    for (auto _ : state) {
+        size_t tasks = 0;
+        parser.read(tf.path);
+        size_t uids = parser.parse([](const auto&) {}, [&](const auto&) { tasks++; });
+        benchmark::DoNotOptimize(uids + tasks);
+    }
+    state.SetBytesProcessed(state.iterations() * contents.size());
+}
+BENCHMARK(BM_uid_io_parse)->Args({100, 10})->Args({1000, 20})->Args({4000, 50});
+
+// The previous ReadFileToString() + Split() parsing, kept as a reference.
+static void BM_uid_io_parse_split(benchmark::State& state) {
+    TemporaryFile tf;
+    std::string contents = make_uid_io_stats(state.range(0), state.range(1), 0);
+    WriteStringToFd(contents, tf.fd);
+
+    for (auto _ : state) {
+        std::string buffer;
+        ReadFileToString(tf.path, &buffer);
+        size_t fields = 0;
+        for (auto& line : Split(std::move(buffer), "\n")) {
+            fields += Split(line, line.compare(0, 4, "task") ? " " : ",").size();
+        }
+        benchmark::DoNotOptimize(fields);
+    }
+    state.SetBytesProcessed(state.iterations() * contents.size());
+}
+BENCHMARK(BM_uid_io_parse_split)->Args({100, 10})->Args({1000, 20})->Args({4000, 50});
+
+BENCHMARK_MAIN();
@@ -0,0 +1,151 @@
+/*
+ * Copyright (C) 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "storaged"
+
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <charconv>
+
+#include <android-base/logging.h>
+#include <android-base/unique_fd.h>
+
+#include "uid_io_stats_parser.h"
+
+using android::base::unique_fd;
+
+namespace android {
+namespace os {
+namespace storaged {
+
+namespace {
+
+constexpr size_t kMinBufferSize = 64 * 1024;
+
+constexpr size_t kUidFields = 11;
+constexpr size_t kTaskTailFields = 11;
+
+template <typename T>
+bool parse_number(std::string_view s, T* out) {
+    if (s.empty()) return false;
+    auto [end, ec] = std::from_chars(s.data(), s.data() + s.size(), *out);
+    return ec == std::errc() && end == s.data() + s.size();
+}
+
+// Parses the ten counters that follow the uid/pid in both line formats.
+bool parse_counters(const std::string_view* fields, io_stats* io) {
+    return parse_number(fields[0], &io[FOREGROUND].rchar) &&
+           parse_number(fields[1], &io[FOREGROUND].wchar) &&
+           parse_number(fields[2], &io[FOREGROUND].read_bytes) &&
+           parse_number(fields[3], &io[FOREGROUND].write_bytes) &&
+           parse_number(fields[4], &io[BACKGROUND].rchar) &&
+           parse_number(fields[5], &io[BACKGROUND].wchar) &&
+           parse_number(fields[6], &io[BACKGROUND].read_bytes) &&
+           parse_number(fields[7], &io[BACKGROUND].write_bytes) &&
+           parse_number(fields[8], &io[FOREGROUND].fsync) &&
+           parse_number(fields[9], &io[BACKGROUND].fsync);
+}
+
+} // namespace
+
+bool parse_uid_io_line(std::string_view line, uid_io_line* out) {
+    std::string_view fields[kUidFields];
+    size_t n = 0;
+    size_t start = 0;
+    while (n < kUidFields) {
+        size_t end = line.find(' ', start);
+        if (end == std::string_view::npos) {
+            fields[n++] = line.substr(start);
+            break;
+        }
+        fields[n++] = line.substr(start, end - start);
+        start = end + 1;
+    }
+
+    if (n < kUidFields || !parse_number(fields[0], &out->uid) ||
+        !parse_counters(&fields[1], out->io)) {
+        LOG(WARNING) << "Invalid uid I/O stats: \"" << line << "\"";
+        return false;
+    }
+    return true;
+}
+
+bool parse_task_io_line(std::string_view line, task_io_line* out) {
+    // The comm may itself contain commas, so the numeric fields are split off
+    // from the end of the line.
+    std::string_view fields[kTaskTailFields];
+    std::string_view head = line;
+    for (size_t i = kTaskTailFields; i > 0; i--) {
+        size_t pos = head.rfind(',');
+        if (pos == std::string_view::npos) {
+            LOG(WARNING) << "Invalid task I/O stats: \"" << line << "\"";
+            return false;
+        }
+        fields[i - 1] = head.substr(pos + 1);
+        head = head.substr(0, pos);
+    }
+
+    size_t comm_start = head.find(',');
+    if (comm_start == std::string_view::npos || !parse_number(fields[0], &out->pid) ||
+        !parse_counters(&fields[1], out->io)) {
+        LOG(WARNING) << "Invalid task I/O stats: \"" << line << "\"";
+        return false;
+    }
+    out->comm = head.substr(comm_start + 1);
+    return true;
+}
+
+bool uid_io_stats_parser::read(const char* path) {
+    size_ = 0;
+
+    unique_fd fd(TEMP_FAILURE_RETRY(open(path, O_RDONLY | O_CLOEXEC)));
+    if (fd == -1) {
+        return false;
+    }
+
+    if (buffer_.size() < kMinBufferSize) {
+        buffer_.resize(kMinBufferSize);
+    }
+    for (;;) {
+        if (size_ == buffer_.size()) {
+            buffer_.resize(buffer_.size() * 2);
+        }
+        ssize_t n = TEMP_FAILURE_RETRY(::read(fd, buffer_.data() + size_, buffer_.size() - size_));
+        if (n < 0) {
+            size_ = 0;
+            return false;
+        }
+        if (n == 0) {
+            break;
+        }
+        size_ += n;
+    }
+    return true;
+}
+
+void uid_io_stats_parser::set_contents(std::string_view contents) {
+    if (buffer_.size() < contents.size()) {
+        buffer_.resize(contents.size());
+    }
+    memcpy(buffer_.data(), contents.data(), contents.size());
+    size_ = contents.size();
+}
+
+} // namespace storaged
+} // namespace os
+} // namespace android
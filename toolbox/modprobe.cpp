@@ -35,6 +35,7 @@ enum modprobe_mode {
     RemoveModulesMode,
     ListModulesMode,
     ShowDependenciesMode,
+    WriteIndexMode,
 };
 
 void print_usage(void) {
@@ -49,6 +50,7 @@ void print_usage(void) {
     LOG(INFO) << "  -d, --dirname=DIR: Load modules from DIR, option may be used multiple times";
     LOG(INFO) << "  -D, --show-depends: Print dependencies for modules only, do not load";
     LOG(INFO) << "  -h, --help: Print this help";
+    LOG(INFO) << "  -i, --write-index: Write DIR/modules.index for faster loading, for each DIR";
     LOG(INFO) << "  -l, --list: List modules matching pattern";
     LOG(INFO) << "  -r, --remove: Remove MODULE (multiple modules may be specified)";
     LOG(INFO) << "  -s, --syslog: print to syslog also";
@@ -130,6 +132,7 @@ extern "C" int modprobe_main(int argc, char** argv) {
         { "dirname",             required_argument, 0, 'd' },
         { "show-depends",        no_argument,       0, 'D' },
         { "help",                no_argument,       0, 'h' },
+        { "write-index",         no_argument,       0, 'i' },
         { "list",                no_argument,       0, 'l' },
         { "quiet",               no_argument,       0, 'q' },
         { "remove",              no_argument,       0, 'r' },
@@ -137,7 +140,7 @@ extern "C" int modprobe_main(int argc, char** argv) {
         { "verbose",             no_argument,       0, 'v' },
     };
     // clang-format on
-    while ((opt = getopt_long(argc, argv, "a::bd:Dhlqrsv", long_options, &option_index)) != -1) {
+    while ((opt = getopt_long(argc, argv, "a::bd:Dhilqrsv", long_options, &option_index)) != -1) {
         switch (opt) {
             case 'a':
                 // toybox modprobe supported -a to load multiple modules, this
@@ -169,6 +172,10 @@ extern "C" int modprobe_main(int argc, char** argv) {
                 android::base::SetMinimumLogSeverity(android::base::INFO);
                 print_usage();
                 return rv;
+            case 'i':
+                check_mode();
+                mode = WriteIndexMode;
+                break;
             case 'l':
                 check_mode();
                 mode = ListModulesMode;
@@ -235,6 +242,15 @@ extern "C" int modprobe_main(int argc, char** argv) {
     LOG(DEBUG) << "modules is: " << android::base::Join(modules, " ");
     LOG(DEBUG) << "module parameters is: " << android::base::Join(module_parameters, " ");
 
+    if (mode == WriteIndexMode) {
+        for (const auto& mod_dir : mod_dirs) {
+            if (!Modprobe::WriteIndex(mod_dir)) {
+                rv = EXIT_FAILURE;
+            }
+        }
+        return rv;
+    }
+
     if (modules.empty()) {
         if (mode == ListModulesMode) {
             // emulate toybox modprobe list with no pattern (list all)
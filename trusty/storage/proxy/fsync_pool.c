@@ -0,0 +1,125 @@
+/*
+ * Copyright (C) 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include <errno.h>
+#include <pthread.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "fsync_pool.h"
+#include "log.h"
+
+/*
+ * The batch being synced. Workers claim fds by advancing next, and the
+ * batch is finished once done reaches count.
+ */
+static pthread_mutex_t pool_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t work_cond = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t done_cond = PTHREAD_COND_INITIALIZER;
+static const int* batch_fds;
+static size_t batch_count;
+static size_t batch_next;
+static size_t batch_done;
+static int batch_failed_fd;
+static int batch_errno;
+static unsigned int pool_threads;
+
+/* Called with pool_lock held, which is dropped while syncing. */
+static void sync_next_locked(void) {
+    int fd = batch_fds[batch_next++];
+
+    pthread_mutex_unlock(&pool_lock);
+    int rc = fsync(fd);
+    int error = errno;
+    pthread_mutex_lock(&pool_lock);
+
+    if (rc < 0 && batch_failed_fd < 0) {
+        batch_failed_fd = fd;
+        batch_errno = error;
+    }
+    if (++batch_done == batch_count) {
+        pthread_cond_signal(&done_cond);
+    }
+}
+
+static void* fsync_worker(void* arg) {
+    (void)arg;
+
+    pthread_mutex_lock(&pool_lock);
+    for (;;) {
+        while (batch_next >= batch_count) {
+            pthread_cond_wait(&work_cond, &pool_lock);
+        }
+        sync_next_locked();
+    }
+    return NULL;
+}
+
+int fsync_pool_init(unsigned int num_threads) {
+    for (; pool_threads < num_threads; pool_threads++) {
+        pthread_t thread;
+        int rc = pthread_create(&thread, NULL, fsync_worker, NULL);
+        if (rc) {
+            ALOGE("%s: failed to start fsync thread: %s\n", __func__, strerror(rc));
+            return -1;
+        }
+        pthread_detach(thread);
+    }
+    return 0;
+}
+
+int fsync_all(const int* fds, size_t count, int* failed_fd) {
+    if (count == 0) {
+        return 0;
+    }
+
+    if (count == 1 || pool_threads == 0) {
+        for (size_t i = 0; i < count; i++) {
+            if (fsync(fds[i]) < 0) {
+                *failed_fd = fds[i];
+                return -1;
+            }
+        }
+        return 0;
+    }
+
+    pthread_mutex_lock(&pool_lock);
+    batch_fds = fds;
+    batch_count = count;
+    batch_next = 0;
+    batch_done = 0;
+    batch_failed_fd = -1;
+    pthread_cond_broadcast(&work_cond);
+
+    /* the calling thread syncs too, rather than just waiting */
+    while (batch_next < batch_count) {
+        sync_next_locked();
+    }
+    while (batch_done < batch_count) {
+        pthread_cond_wait(&done_cond, &pool_lock);
+    }
+
+    int rc = 0;
+    if (batch_failed_fd >= 0) {
+        *failed_fd = batch_failed_fd;
+        errno = batch_errno;
+        rc = -1;
+    }
+    batch_fds = NULL;
+    batch_count = 0;
+    batch_next = 0;
+    pthread_mutex_unlock(&pool_lock);
+    return rc;
+}
@@ -0,0 +1,39 @@
+/*
+ * Copyright (C) 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#pragma once
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Starts @num_threads threads that fsync_all() hands fds to, in addition to
+ * the calling thread. With no threads, fsync_all() syncs fds one by one.
+ */
+int fsync_pool_init(unsigned int num_threads);
+
+/*
+ * fsync()s all of @fds concurrently and waits for them to complete. Returns 0
+ * on success. On failure returns -1 with errno set, and stores the first fd
+ * that failed in @failed_fd. Must not be called concurrently.
+ */
+int fsync_all(const int* fds, size_t count, int* failed_fd);
+
+#ifdef __cplusplus
+}
+#endif
@@ -28,6 +28,7 @@
 #include <unistd.h>
 
 #include "checkpoint_handling.h"
+#include "fsync_pool.h"
 #include "ipc.h"
 #include "log.h"
 #include "storage.h"
@@ -36,6 +37,9 @@
 #define FD_TBL_SIZE 64
 #define MAX_READ_SIZE 4096
 
+/* Threads that fsync dirty files alongside the main thread on checkpoint */
+#define SYNC_THREADS 3
+
 #define ALTERNATE_DATA_DIR "alternate/"
 
 /* Maximum file size for filesystem backed storage (i.e. not block dev backed storage) */
@@ -68,6 +72,15 @@ static bool fs_ready_initialized = false;
 static enum sync_state fs_state;
 static enum sync_state fd_state[FD_TBL_SIZE];
 
+/* is the file behind each tracked fd covered by a syncfs() of ssdir_name? */
+static bool fd_on_data_fs[FD_TBL_SIZE];
+
+/* has an untracked fd outside of the ssdir_name filesystem been dirtied? */
+static bool foreign_fs_dirty;
+
+static dev_t data_fs_dev;
+static bool data_fs_dev_valid;
+
 static bool alternate_mode;
 
 static struct {
@@ -75,6 +88,35 @@ static struct {
    uint8_t data[MAX_READ_SIZE];
 }  read_rsp;
 
+/*
+ * Returns true if @fd is a file or directory on the same filesystem as
+ * ssdir_name, so that syncfs() on ssdir_name flushes it. Block devices are
+ * never covered, even if their device node is under ssdir_name.
+ */
+static bool is_on_data_fs(int fd) {
+    struct stat st;
+
+    if (!data_fs_dev_valid) {
+        if (stat(ssdir_name, &st) < 0) {
+            return false;
+        }
+        data_fs_dev = st.st_dev;
+        data_fs_dev_valid = true;
+    }
+
+    if (fstat(fd, &st) < 0) {
+        return false;
+    }
+    return (S_ISREG(st.st_mode) || S_ISDIR(st.st_mode)) && st.st_dev == data_fs_dev;
+}
+
+static void mark_fs_dirty(int fd) {
+    fs_state = SS_DIRTY;
+    if (!foreign_fs_dirty && !is_on_data_fs(fd)) {
+        foreign_fs_dirty = true;
+    }
+}
+
 static uint32_t insert_fd(int open_flags, int fd)
 {
     uint32_t handle = fd;
@@ -84,10 +126,11 @@ static uint32_t insert_fd(int open_flags, int fd)
             if (open_flags & O_TRUNC) {
                 fd_state[fd] = SS_DIRTY;  /* set fd dirty */
             }
+            fd_on_data_fs[fd] = is_on_data_fs(fd);
     } else {
             ALOGW("%s: untracked fd %u\n", __func__, fd);
             if (open_flags & (O_TRUNC | O_CREAT)) {
-                fs_state = SS_DIRTY;
+                mark_fs_dirty(fd);
             }
     }
     return handle;
@@ -99,7 +142,7 @@ static int lookup_fd(uint32_t handle, bool dirty)
         if (handle < FD_TBL_SIZE) {
             fd_state[handle] = SS_DIRTY;
         } else {
-            fs_state = SS_DIRTY;
+            mark_fs_dirty(handle);
         }
     }
     return handle;
@@ -609,45 +652,89 @@ int storage_init(const char *dirname)
     alternate_mode = is_gsi_running();
 
     fs_state = SS_CLEAN;
+    foreign_fs_dirty = false;
     for (uint i = 0; i < FD_TBL_SIZE; i++) {
         fd_state[i] = SS_UNUSED;  /* uninstalled */
     }
 
     ssdir_name = dirname;
+    data_fs_dev_valid = false;
+
+    /* without the pool, dirty files are synced one at a time */
+    fsync_pool_init(SYNC_THREADS);
     return 0;
 }
 
+/* Flushes the filesystem holding ssdir_name, or all filesystems as a fallback. */
+static int sync_data_fs(struct watcher* watcher) {
+    int fd = TEMP_FAILURE_RETRY(open(ssdir_name, O_RDONLY | O_DIRECTORY | O_CLOEXEC));
+    if (fd < 0) {
+        ALOGE("%s: failed to open \"%s\": %s\n", __func__, ssdir_name, strerror(errno));
+        watch_progress(watcher, "all fs sync");
+        sync();
+        return 0;
+    }
+
+    watch_progress(watcher, "data fs sync");
+    int rc = syncfs(fd);
+    if (rc < 0) {
+        ALOGE("syncfs for \"%s\" failed: %s\n", ssdir_name, strerror(errno));
+    }
+    close(fd);
+    return rc;
+}
+
 int storage_sync_checkpoint(struct watcher* watcher) {
     int rc;
+    int dirty_fds[FD_TBL_SIZE];
+    size_t dirty_count = 0;
+    int failed_fd;
 
     watch_progress(watcher, "sync fd table");
-    /* sync fd table and reset it to clean state first */
+    /*
+     * Sync the fd table and reset it to clean state first. Files on the data
+     * filesystem are skipped if that whole filesystem is synced below.
+     */
+    for (uint fd = 0; fd < FD_TBL_SIZE; fd++) {
+        if (fd_state[fd] == SS_DIRTY &&
+            (fs_state == SS_CLEAN || (!foreign_fs_dirty && !fd_on_data_fs[fd]))) {
+            dirty_fds[dirty_count++] = fd;
+        }
+    }
+
+    rc = fsync_all(dirty_fds, dirty_count, &failed_fd);
+    if (rc < 0) {
+        /* leave everything dirty so that the next checkpoint retries */
+        ALOGE("fsync for fd=%d failed: %s\n", failed_fd, strerror(errno));
+        return rc;
+    }
+
     for (uint fd = 0; fd < FD_TBL_SIZE; fd++) {
-         if (fd_state[fd] == SS_DIRTY) {
-             if (fs_state == SS_CLEAN) {
-                 /* need to sync individual fd */
-                 rc = fsync(fd);
-                 if (rc < 0) {
-                     ALOGE("fsync for fd=%d failed: %s\n", fd, strerror(errno));
-                     return rc;
-                 }
-             }
-             fd_state[fd] = SS_CLEAN; /* set to clean */
-         }
-    }
-
-    /* check if we need to sync all filesystems */
+        if (fd_state[fd] == SS_DIRTY) {
+            fd_state[fd] = SS_CLEAN; /* set to clean */
+        }
+    }
+
+    /* check if we need to sync filesystems */
     if (fs_state == SS_DIRTY) {
-        /*
-         * We sync all filesystems here because we don't know what filesystem
-         * needs syncing if there happen to be other filesystems symlinked under
-         * the root data directory. This should not happen in the normal case
-         * because our fd table is large enough to handle the few open files we
-         * use.
-         */
-         watch_progress(watcher, "all fs sync");
-         sync();
-         fs_state = SS_CLEAN;
+        if (foreign_fs_dirty) {
+            /*
+             * An untracked fd outside of the data filesystem has been written,
+             * e.g. through another filesystem symlinked under the root data
+             * directory. We don't know which filesystem needs syncing, so sync
+             * all of them. This should not happen in the normal case because
+             * our fd table is large enough to handle the few open files we use.
+             */
+            watch_progress(watcher, "all fs sync");
+            sync();
+        } else {
+            rc = sync_data_fs(watcher);
+            if (rc < 0) {
+                return rc;
+            }
+        }
+        fs_state = SS_CLEAN;
+        foreign_fs_dirty = false;
     }
 
     watch_progress(watcher, "done syncing");
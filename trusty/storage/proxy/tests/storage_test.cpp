@@ -0,0 +1,176 @@
+/*
+ * Copyright (C) 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <fcntl.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <utility>
+#include <string>
+#include <vector>
+
+#include <android-base/file.h>
+#include <android-base/unique_fd.h>
+#include <gtest/gtest.h>
+
+// storage.h and ipc.h are C headers without extern "C" guards, and watchdog.h
+// includes storage.h.
+extern "C" {
+#include "ipc.h"
+#include "storage.h"
+}
+
+#include "checkpoint_handling.h"
+#include "watchdog.h"
+
+/*
+ * Stand-ins for the Trusty IPC channel and the rest of storageproxyd, so
+ * that storage.c can be driven directly with requests.
+ */
+static int32_t last_result;
+static std::vector<uint8_t> last_response;
+
+extern "C" int ipc_respond(struct storage_msg* msg, void* out, size_t out_size) {
+    last_result = msg->result;
+    last_response.assign(static_cast<uint8_t*>(out), static_cast<uint8_t*>(out) + out_size);
+    return 0;
+}
+
+void watch_progress(struct watcher*, const char*) {}
+
+bool is_gsi_running() {
+    return false;
+}
+
+namespace {
+
+class FakeTrustyStorage {
+  public:
+    uint32_t Open(const std::string& name) {
+        std::vector<uint8_t> req(sizeof(storage_file_open_req) + name.size() + 1);
+        auto open_req = reinterpret_cast<storage_file_open_req*>(req.data());
+        open_req->flags = STORAGE_FILE_OPEN_CREATE | STORAGE_FILE_OPEN_TRUNCATE;
+        memcpy(open_req->name, name.c_str(), name.size() + 1);
+
+        storage_msg msg = {.cmd = STORAGE_FILE_OPEN};
+        storage_file_open(&msg, req.data(), req.size() - 1, nullptr);
+        EXPECT_EQ(STORAGE_NO_ERROR, last_result) << "opening " << name;
+        if (last_response.size() != sizeof(storage_file_open_resp)) return UINT32_MAX;
+        return reinterpret_cast<storage_file_open_resp*>(last_response.data())->handle;
+    }
+
+    int32_t Write(uint32_t handle, uint64_t offset, size_t size, uint32_t msg_flags) {
+        std::vector<uint8_t> req(sizeof(storage_file_write_req) + size, 0xa5);
+        auto write_req = reinterpret_cast<storage_file_write_req*>(req.data());
+        write_req->offset = offset;
+        write_req->handle = handle;
+        write_req->__reserved = 0;
+
+        storage_msg msg = {.cmd = STORAGE_FILE_WRITE, .flags = msg_flags};
+        storage_file_write(&msg, req.data(), req.size(), nullptr);
+        return last_result;
+    }
+
+    void Close(uint32_t handle) {
+        storage_file_close_req req = {.handle = handle};
+        storage_msg msg = {.cmd = STORAGE_FILE_CLOSE};
+        storage_file_close(&msg, &req, sizeof(req), nullptr);
+        EXPECT_EQ(STORAGE_NO_ERROR, last_result);
+    }
+};
+
+class StorageProxyTest : public ::testing::Test {
+  protected:
+    void SetUp() override { ASSERT_EQ(0, storage_init(dir_.path)); }
+
+    // Writes to each of |handles|, then commits with a final write as the
+    // Trusty storage service does at the end of a transaction. Returns the
+    // latency of the commit.
+    std::chrono::microseconds Commit(const std::vector<uint32_t>& handles, size_t write_size) {
+        for (uint32_t handle : handles) {
+            EXPECT_EQ(STORAGE_NO_ERROR, storage_.Write(handle, 0, write_size, 0));
+        }
+        auto start = std::chrono::steady_clock::now();
+        EXPECT_EQ(STORAGE_NO_ERROR, storage_.Write(handles[0], 0, write_size,
+                                                   STORAGE_MSG_FLAG_POST_COMMIT));
+        return std::chrono::duration_cast<std::chrono::microseconds>(
+                std::chrono::steady_clock::now() - start);
+    }
+
+    TemporaryDir dir_;
+    FakeTrustyStorage storage_;
+};
+
+}  // namespace
+
+TEST_F(StorageProxyTest, CommitSyncsDirtyFiles) {
+    std::vector<uint32_t> handles;
+    for (int i = 0; i < 4; i++) {
+        handles.push_back(storage_.Open("file" + std::to_string(i)));
+    }
+    Commit(handles, 4096);
+
+    for (int i = 0; i < 4; i++) {
+        struct stat st;
+        ASSERT_EQ(0, stat((std::string(dir_.path) + "/file" + std::to_string(i)).c_str(), &st));
+        EXPECT_EQ(4096, st.st_size);
+    }
+    for (uint32_t handle : handles) {
+        storage_.Close(handle);
+    }
+}
+
+TEST_F(StorageProxyTest, CommitWithUntrackedFd) {
+    // Fill the fd table so that the next file opened is untracked, which
+    // makes the commit sync the whole data filesystem.
+    std::vector<android::base::unique_fd> fillers;
+    for (;;) {
+        android::base::unique_fd fd(open("/dev/null", O_RDONLY | O_CLOEXEC));
+        ASSERT_GE(fd.get(), 0);
+        if (fd.get() >= 64) break;
+        fillers.push_back(std::move(fd));
+    }
+
+    uint32_t handle = storage_.Open("untracked");
+    ASSERT_GE(handle, 64u);
+    EXPECT_EQ(STORAGE_NO_ERROR, storage_.Write(handle, 0, 4096, STORAGE_MSG_FLAG_POST_COMMIT));
+    storage_.Close(handle);
+}
+
+TEST_F(StorageProxyTest, CommitLatency) {
+    constexpr int kCommits = 20;
+    for (size_t files : {1, 4, 16}) {
+        std::vector<uint32_t> handles;
+        for (size_t i = 0; i < files; i++) {
+            handles.push_back(storage_.Open("latency" + std::to_string(i)));
+        }
+
+        std::chrono::microseconds total(0);
+        for (int i = 0; i < kCommits; i++) {
+            total += Commit(handles, 16384);
+        }
+        GTEST_LOG_(INFO) << files << " dirty files: " << (total / kCommits).count()
+                         << " us per commit";
+        RecordProperty("commit_us_" + std::to_string(files), (total / kCommits).count());
+
+        for (uint32_t handle : handles) {
+            storage_.Close(handle);
+        }
+    }
+}